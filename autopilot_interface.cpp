@@ -57,18 +57,6 @@
 #define Vega_Body 1
 
 
-// ----------------------------------------------------------------------------------
-//   Time
-// ------------------- ---------------------------------------------------------------
-uint64_t
-get_time_usec()
-{
-	static struct timeval _time_stamp;
-	gettimeofday(&_time_stamp, NULL);
-	return _time_stamp.tv_sec*1000000 + _time_stamp.tv_usec;
-}
-
-
 // ----------------------------------------------------------------------------------
 //   Setpoint Helper Functions
 // ----------------------------------------------------------------------------------
@@ -198,7 +186,7 @@ set_yaw_rate(float yaw_rate, mavlink_set_position_target_local_ned_t &sp)
 //   Con/De structors
 // ------------------------------------------------------------------------------
 Autopilot_Interface::
-Autopilot_Interface(Serial_Port *serial_port_)
+Autopilot_Interface(Generic_Port *port_)
 {
 	// initialize attributes
 	write_count = 0;
@@ -211,6 +199,40 @@ Autopilot_Interface(Serial_Port *serial_port_)
 	read_tid  = 0; // read thread id
 	write_tid = 0; // write thread id
 
+	setpoint_rate     = 0; // setpoint streaming off
+	setpoint_priority = 0; // normal scheduling
+	setpoint_overruns = 0;
+
+	bus = NULL; // nothing shared with other processes
+
+	timesync_interval  = AUTOPILOT_INTERFACE_TIMESYNC_INTERVAL;
+	timesync_read_only = false; // read only mode stays silent
+	timesync_active    = false;
+	next_timesync      = 0;
+
+	heartbeat_interval = AUTOPILOT_INTERFACE_HEARTBEAT_INTERVAL;
+	next_heartbeat     = 0;
+	reply_pending      = false;
+	reply_ts1          = 0;
+
+	pthread_mutex_init(&setpoint_lock, NULL);
+
+	// the write thread sleeps until absolute deadlines on the monotonic clock
+	pthread_condattr_t cond_attr;
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_mutex_init(&tx_lock, NULL);
+	pthread_cond_init(&tx_cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	// lets stop() wake the read thread out of its wait
+	wake_fd = eventfd(0, EFD_NONBLOCK);
+	if ( wake_fd < 0 )
+	{
+		fprintf(stderr,"ERROR: could not create wake up event\n");
+		throw 1;
+	}
+
 	system_id    = 0; // system id
 	autopilot_id = 0; // autopilot component id
 	companion_id = 0; // companion computer component id
@@ -218,13 +240,46 @@ Autopilot_Interface(Serial_Port *serial_port_)
 	current_messages.sysid  = system_id;
 	current_messages.compid = autopilot_id;
 
-	serial_port = serial_port_; // serial port management object
+	port = port_; // port management object, serial or otherwise
+
+	// what the write thread sends in one wake up goes out in one write
+	tx_batch.port      = port;
+	tx_batch.max_delay = AUTOPILOT_INTERFACE_WRITE_DELAY;
+
+	// messages kept per sender, in current_messages for the autopilot
+	// flown, unsubscribe the ones not needed
+	Mavlink_Messages &m = current_messages;
+	dispatch.subscribe(m, m.heartbeat);
+	dispatch.subscribe(m, m.sys_status);
+	dispatch.subscribe(m, m.battery_status);
+	dispatch.subscribe(m, m.radio_status);
+	dispatch.subscribe(m, m.local_position_ned);
+	dispatch.subscribe(m, m.global_position_int);
+	dispatch.subscribe(m, m.position_target_local_ned);
+	dispatch.subscribe(m, m.position_target_global_int);
+	dispatch.subscribe(m, m.highres_imu);
+	dispatch.subscribe(m, m.attitude);
+	dispatch.subscribe(m, m.attitude_target);
+	dispatch.subscribe(m, m.vfr_hud);
+	dispatch.subscribe(m, m.home_position);
+
+	// clock sync with the autopilot
+	dispatch.subscribe<mavlink_timesync_t, Autopilot_Interface, &Autopilot_Interface::handle_timesync>(this);
+
+	// what filters are fed at full rate
+	history.subscribe(local_position_history);
+	history.subscribe(highres_imu_history);
 
 }
 
 Autopilot_Interface::
 ~Autopilot_Interface()
-{}
+{
+	close(wake_fd);
+	pthread_mutex_destroy(&setpoint_lock);
+	pthread_cond_destroy(&tx_cond);
+	pthread_mutex_destroy(&tx_lock);
+}
 
 
 // ------------------------------------------------------------------------------
@@ -234,192 +289,243 @@ void
 Autopilot_Interface::
 update_setpoint(mavlink_set_position_target_local_ned_t setpoint)
 {
-	current_setpoint = setpoint;
+	// the seqlock allows one writer at a time
+	pthread_mutex_lock(&setpoint_lock);
+	current_setpoint.store(setpoint, get_time_usec());
+	pthread_mutex_unlock(&setpoint_lock);
 }
 
 
 // ------------------------------------------------------------------------------
 //   Read Messages
 // ------------------------------------------------------------------------------
+// Handles everything the port has buffered, without waiting for more.  Called
+// by the read thread as soon as the port becomes readable, at arrival.
 void
 Autopilot_Interface::
-read_messages()
+read_messages(uint64_t arrival)
 {
-	bool success;               // receive success flag
-	bool received_all = false;  // receive only one message
-	Time_Stamps this_timestamps;
+	Frame_View frames[GENERIC_PORT_MAX_BATCH];
+	int count;
 
-	// Blocking wait for new data
-	while ( !received_all and !time_to_exit )
+	// whatever is left over keeps the port readable for the next call
+	for ( int batch = 0; batch < AUTOPILOT_INTERFACE_MAX_BATCHES && not time_to_exit &&
+	      (count = port->read_frames(frames, GENERIC_PORT_MAX_BATCH)) > 0; batch++ )
 	{
-		// ----------------------------------------------------------------------
-		//   READ MESSAGE
-		// ----------------------------------------------------------------------
-		mavlink_message_t message;
-		success = serial_port->read_message(message);
+		// the first batch was there when the port turned readable; later
+		// ones may have come in since, they count from being read
+		if ( batch > 0 )
+			arrival = get_time_usec();
 
 		// ----------------------------------------------------------------------
-		//   HANDLE MESSAGE
+		//   HANDLE MESSAGES
 		// ----------------------------------------------------------------------
-		if( success )
+		for ( int i = 0; i < count; i++ )
 		{
+			// handled where they lie in the port's buffer, nothing is copied
+			// until a subscriber decodes it
+			handle_message(frames[i]);
+
+			dispatch_latency.add(get_time_usec() - arrival);
+		}
+	}
+
+	return;
+}
 
-			// Store message sysid and compid.
-			// Note this doesn't handle multiple message sources.
-			current_messages.sysid  = message.sysid;
-			current_messages.compid = message.compid;
-
-			// Handle Message ID
-			switch (message.msgid)
-			{
-
-				case MAVLINK_MSG_ID_HEARTBEAT:
-				{
-					//printf("MAVLINK_MSG_ID_HEARTBEAT\n");
-					mavlink_msg_heartbeat_decode(&message, &(current_messages.heartbeat));
-					current_messages.time_stamps.heartbeat = get_time_usec();
-					this_timestamps.heartbeat = current_messages.time_stamps.heartbeat;
-					break;
-				}
-
-				case MAVLINK_MSG_ID_SYS_STATUS:
-				{
-					//printf("MAVLINK_MSG_ID_SYS_STATUS\n");
-					mavlink_msg_sys_status_decode(&message, &(current_messages.sys_status));
-					current_messages.time_stamps.sys_status = get_time_usec();
-					this_timestamps.sys_status = current_messages.time_stamps.sys_status;
-					break;
-				}
-
-				case MAVLINK_MSG_ID_BATTERY_STATUS:
-				{
-					//printf("MAVLINK_MSG_ID_BATTERY_STATUS\n");
-					mavlink_msg_battery_status_decode(&message, &(current_messages.battery_status));
-					current_messages.time_stamps.battery_status = get_time_usec();
-					this_timestamps.battery_status = current_messages.time_stamps.battery_status;
-					break;
-				}
-
-				case MAVLINK_MSG_ID_RADIO_STATUS:
-				{
-					//printf("MAVLINK_MSG_ID_RADIO_STATUS\n");
-					mavlink_msg_radio_status_decode(&message, &(current_messages.radio_status));
-					current_messages.time_stamps.radio_status = get_time_usec();
-					this_timestamps.radio_status = current_messages.time_stamps.radio_status;
-					break;
-				}
-
-				case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
-				{
-					//printf("MAVLINK_MSG_ID_LOCAL_POSITION_NED\n");
-					mavlink_msg_local_position_ned_decode(&message, &(current_messages.local_position_ned));
-					current_messages.time_stamps.local_position_ned = get_time_usec();
-					this_timestamps.local_position_ned = current_messages.time_stamps.local_position_ned;
-					break;
-				}
-
-				case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
-				{
-					//printf("MAVLINK_MSG_ID_GLOBAL_POSITION_INT\n");
-					mavlink_msg_global_position_int_decode(&message, &(current_messages.global_position_int));
-					current_messages.time_stamps.global_position_int = get_time_usec();
-					this_timestamps.global_position_int = current_messages.time_stamps.global_position_int;
-					break;
-				}
-
-				case MAVLINK_MSG_ID_POSITION_TARGET_LOCAL_NED:
-				{
-					//printf("MAVLINK_MSG_ID_POSITION_TARGET_LOCAL_NED\n");
-					mavlink_msg_position_target_local_ned_decode(&message, &(current_messages.position_target_local_ned));
-					current_messages.time_stamps.position_target_local_ned = get_time_usec();
-					this_timestamps.position_target_local_ned = current_messages.time_stamps.position_target_local_ned;
-					break;
-				}
-
-				case MAVLINK_MSG_ID_POSITION_TARGET_GLOBAL_INT:
-				{
-					//printf("MAVLINK_MSG_ID_POSITION_TARGET_GLOBAL_INT\n");
-					mavlink_msg_position_target_global_int_decode(&message, &(current_messages.position_target_global_int));
-					current_messages.time_stamps.position_target_global_int = get_time_usec();
-					this_timestamps.position_target_global_int = current_messages.time_stamps.position_target_global_int;
-					break;
-				}
-
-				case MAVLINK_MSG_ID_HIGHRES_IMU:
-				{
-					//printf("MAVLINK_MSG_ID_HIGHRES_IMU\n");
-					mavlink_msg_highres_imu_decode(&message, &(current_messages.highres_imu));
-					current_messages.time_stamps.highres_imu = get_time_usec();
-					this_timestamps.highres_imu = current_messages.time_stamps.highres_imu;
-					break;
-				}
-
-				case MAVLINK_MSG_ID_ATTITUDE:
-				{
-					//printf("MAVLINK_MSG_ID_ATTITUDE\n");
-					mavlink_msg_attitude_decode(&message, &(current_messages.attitude));
-					current_messages.time_stamps.attitude = get_time_usec();
-					this_timestamps.attitude = current_messages.time_stamps.attitude;
-					break;
-				}
-                case MAVLINK_MSG_ID_ATTITUDE_TARGET:
-                {
-                        mavlink_msg_attitude_target_decode(&message, &(current_messages.attitude_target));
-                        break;
-                
-                }
-                case 242://MAVLINK_MSG_ID_HOME_POSITION
-                {
-                //       mavlink_home_position_t  home;
-               //       mavlink_msg_home_position_decode(&message, &home);
-               //       printf("Get HOME POSITION !! ----------------------\n\n");
-               //       printf("HOME:        X:%f\n  Y: %f\n Z:%f\n\n\n------------ ",home.x,home.y,home.z);
-                      break;
-                }
-				case MAVLINK_MSG_ID_VFR_HUD:
-				{
-					mavlink_msg_vfr_hud_decode(&message, &(current_messages.vfr_hud));
-					current_messages.time_stamps.vfr_hud = get_time_usec();
-					this_timestamps.vfr_hud = current_messages.time_stamps.vfr_hud;
-					break;
-				}
-
-
-				default:
-				{
-					// printf("Warning, did not handle message id %i\n",message.msgid);
-					break;
-				}
-
-
-			} // end: switch msgid
-
-		} // end: if read message
-
-		// Check for receipt of all items
-		received_all =
-				this_timestamps.heartbeat                  &&
-//				this_timestamps.battery_status             &&
-//				this_timestamps.radio_status               &&
-//				this_timestamps.local_position_ned         &&
-//				this_timestamps.global_position_int        &&
-//				this_timestamps.position_target_local_ned  &&
-//				this_timestamps.position_target_global_int &&
-//				this_timestamps.highres_imu                &&
-//				this_timestamps.attitude                   &&
-				this_timestamps.sys_status
-				;
-
-		// give the write thread time to use the port
-		if ( writing_status > false ) {
-			usleep(100); // look for components of batches at 10kHz
+
+// ------------------------------------------------------------------------------
+//   Handle Message
+// ------------------------------------------------------------------------------
+void
+Autopilot_Interface::
+handle_message(const Frame_View &frame)
+{
+	// one arrival stamp for everything this message updates
+	uint64_t now = get_time_usec();
+
+	// state is kept per sender, so a gimbal or a second vehicle on the link
+	// never overwrites the autopilot's
+	Mavlink_Messages *vehicle = vehicles.insert(frame.sysid, frame.compid);
+
+	if ( vehicle && not vehicle->sysid )
+	{
+		vehicle->sysid  = frame.sysid;
+		vehicle->compid = frame.compid;
+	}
+
+	// fly the first autopilot that sends a heartbeat, unless told which
+	if ( not current_messages.sysid && frame.msgid == MAVLINK_MSG_ID_HEARTBEAT &&
+	     Message_View<mavlink_heartbeat_t>(frame).get(&mavlink_heartbeat_t::autopilot) != MAV_AUTOPILOT_INVALID &&
+	     ( not system_id    || system_id    == frame.sysid  ) &&
+	     ( not autopilot_id || autopilot_id == frame.compid ) )
+	{
+		vehicle = vehicles.bind(frame.sysid, frame.compid, &current_messages);
+		if ( vehicle )
+		{
+			current_messages.compid = frame.compid;
+			__atomic_store_n(&current_messages.sysid, (int)frame.sysid, __ATOMIC_RELEASE);
 		}
+	}
+
+	if ( vehicle )
+	{
+		vehicle->messages++;
+		vehicle->sequence.count(frame.seq);
+	}
+
+	bool autopilot = ( vehicle == &current_messages );
+
+	// how the link to the autopilot is doing
+	if ( autopilot )
+		link.received(frame, now);
+
+	// other processes read the autopilot's state without a link of their own
+	if ( bus && autopilot )
+		bus->publish(frame, now);
+
+	// TIMESYNC answers only count from the autopilot flown
+	if ( frame.msgid == MAVLINK_MSG_ID_TIMESYNC && not autopilot )
+		return;
+
+	// decode and store, or drop if nobody subscribed to it
+	dispatch.dispatch(frame, now, vehicle);
+
+	// other senders' clocks are not the autopilot's
+	if ( not autopilot )
+		return;
+
+	// and its recent past, for readers that must not miss a sample
+	history.dispatch(frame, now);
 
-	} // end: while not received all
+	// and how well it follows its setpoints, from every position
+	tracking.received(frame, now);
+
+	// every message stamped with the autopilot's boot time refines the
+	// clock mapping, the field is read straight from the payload
+	switch (frame.msgid)
+	{
+		case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
+			sync_boot_time(Message_View<mavlink_local_position_ned_t>(frame).get(&mavlink_local_position_ned_t::time_boot_ms)*1000ULL, now);
+			break;
+
+		case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+			sync_boot_time(Message_View<mavlink_global_position_int_t>(frame).get(&mavlink_global_position_int_t::time_boot_ms)*1000ULL, now);
+			break;
+
+		case MAVLINK_MSG_ID_POSITION_TARGET_LOCAL_NED:
+			sync_boot_time(Message_View<mavlink_position_target_local_ned_t>(frame).get(&mavlink_position_target_local_ned_t::time_boot_ms)*1000ULL, now);
+			break;
+
+		case MAVLINK_MSG_ID_POSITION_TARGET_GLOBAL_INT:
+			sync_boot_time(Message_View<mavlink_position_target_global_int_t>(frame).get(&mavlink_position_target_global_int_t::time_boot_ms)*1000ULL, now);
+			break;
+
+		case MAVLINK_MSG_ID_HIGHRES_IMU:
+			sync_boot_time(Message_View<mavlink_highres_imu_t>(frame).get(&mavlink_highres_imu_t::time_usec), now);
+			break;
+
+		case MAVLINK_MSG_ID_ATTITUDE:
+			sync_boot_time(Message_View<mavlink_attitude_t>(frame).get(&mavlink_attitude_t::time_boot_ms)*1000ULL, now);
+			break;
+
+		case MAVLINK_MSG_ID_ATTITUDE_TARGET:
+			sync_boot_time(Message_View<mavlink_attitude_target_t>(frame).get(&mavlink_attitude_target_t::time_boot_ms)*1000ULL, now);
+			break;
+	}
 
 	return;
 }
 
+// ------------------------------------------------------------------------------
+//   Boot Time
+// ------------------------------------------------------------------------------
+// Feed a message's autopilot time since boot to the clock map, and record how
+// long the message took to get here
+void
+Autopilot_Interface::
+sync_boot_time(uint64_t boot_usec, uint64_t now)
+{
+	boot_time.update(boot_usec, now);
+	link_latency.add(now - boot_time.to_local(boot_usec));
+}
+
+
+// ------------------------------------------------------------------------------
+//   Time Sync
+// ------------------------------------------------------------------------------
+// The autopilot asks with tc1 = 0 and the write thread answers with our
+// time, otherwise it is an answer to one of our requests
+void
+Autopilot_Interface::
+handle_timesync(const Message_View<mavlink_timesync_t> &timesync, uint64_t /* now */)
+{
+	// not even read unless we take part
+	if ( not timesync_active )
+		return;
+
+	int64_t tc1 = timesync.get(&mavlink_timesync_t::tc1);
+	int64_t ts1 = timesync.get(&mavlink_timesync_t::ts1);
+
+	if ( tc1 == 0 )
+	{
+		// a newer request replaces one not answered yet
+		pthread_mutex_lock(&tx_lock);
+		reply_pending = true;
+		reply_ts1     = ts1;
+		pthread_cond_signal(&tx_cond);
+		pthread_mutex_unlock(&tx_lock);
+	}
+	else
+		time_sync.handle_response(tc1, ts1, get_time_nsec());
+}
+
+void
+Autopilot_Interface::
+write_timesync(int64_t tc1, int64_t ts1)
+{
+	mavlink_timesync_t timesync;
+	timesync.tc1 = tc1;
+	timesync.ts1 = ts1;
+
+	queue_message(timesync_encoder, timesync);
+}
+
+// ------------------------------------------------------------------------------
+//   Companion Heartbeat
+// ------------------------------------------------------------------------------
+// Tells the autopilot and anyone else on the link the companion is alive
+void
+Autopilot_Interface::
+write_heartbeat()
+{
+	mavlink_heartbeat_t heartbeat;
+	heartbeat.custom_mode     = 0;
+	heartbeat.type            = MAV_TYPE_ONBOARD_CONTROLLER;
+	heartbeat.autopilot       = MAV_AUTOPILOT_INVALID;
+	heartbeat.base_mode       = 0;
+	heartbeat.system_status   = MAV_STATE_ACTIVE;
+	heartbeat.mavlink_version = MAVLINK_VERSION;
+
+	queue_message(heartbeat_encoder, heartbeat);
+}
+
+// Autopilot time since boot at the given companion time.  Uses TIMESYNC
+// once it has converged, the offset seen on received messages before that,
+// and our own clock if neither is known yet.
+uint64_t
+Autopilot_Interface::
+autopilot_time_usec(uint64_t local_usec) const
+{
+	if ( time_sync.valid() )
+		return time_sync.to_remote(local_usec*1000) / 1000;
+
+	if ( boot_time.valid() )
+		return local_usec - boot_time.offset();
+
+	return local_usec;
+}
+
 // ------------------------------------------------------------------------------
 //   Write Message
 // ------------------------------------------------------------------------------
@@ -428,15 +534,27 @@ Autopilot_Interface::
 write_message(mavlink_message_t message)
 {
 	// do the write
-	int len = serial_port->write_message(message);
+	int len = port->write_message(message);
 
-	// book keep
-	write_count++;
+	// book keep, the read and write threads and callers may all write
+	__atomic_add_fetch(&write_count, 1, __ATOMIC_RELAXED);
 
 	// Done!
 	return len;
 }
 
+// Sends what the write thread collected with as few system calls as the
+// port can manage
+void
+Autopilot_Interface::
+flush_messages()
+{
+	int count = tx_batch.size();
+
+	if ( tx_batch.flush() < 0 )
+		fprintf(stderr,"WARNING: could not send %i messages \n", count);
+}
+
 // ------------------------------------------------------------------------------
 //   Write Setpoint Message
 // ------------------------------------------------------------------------------
@@ -449,33 +567,23 @@ write_setpoint()
 	// --------------------------------------------------------------------------
 
 	// pull from position target
-	mavlink_set_position_target_local_ned_t sp = current_setpoint;
+	mavlink_set_position_target_local_ned_t sp = current_setpoint.load();
+
+	// stamp with the autopilot's clock at the moment of sending
+	sp.time_boot_ms = (uint32_t) (autopilot_time_usec(get_time_usec())/1000);
 
 	// double check some system parameters
-	if ( not sp.time_boot_ms )
-		sp.time_boot_ms = (uint32_t) (get_time_usec()/1000);
 	sp.target_system    = system_id;
 	sp.target_component = autopilot_id;
 
 
 	// --------------------------------------------------------------------------
-	//   ENCODE
+	//   ENCODE AND WRITE
 	// --------------------------------------------------------------------------
 
-	mavlink_message_t message;
-	mavlink_msg_set_position_target_local_ned_encode(system_id, companion_id, &message, &sp);
-
+	// encoded into the batch, goes out with the rest of this wake up's messages
+	queue_message(setpoint_encoder, sp);
 
-	// --------------------------------------------------------------------------
-	//   WRITE
-	// --------------------------------------------------------------------------
-
-	// do the write
-	int len = write_message(message);
-
-	// check the write
-	if ( len <= 0 )
-		fprintf(stderr,"WARNING: could not send POSITION_TARGET_LOCAL_NED \n");
 	//	else
 	//		printf("%lu POSITION_TARGET  = [ %f , %f , %f ] \n", write_count, position_target.x, position_target.y, position_target.z);
 
@@ -570,11 +678,11 @@ toggle_offboard_control( bool flag )
 	com.param1           = (float) flag; // flag >0.5 => start, <0.5 => stop
 
 	// Encode
-	mavlink_message_t message;
-	mavlink_msg_command_long_encode(system_id, companion_id, &message, &com);
+	uint8_t frame[Wire_Encoder<mavlink_command_long_t>::FRAME_LENGTH];
+	unsigned length = command_encoder.encode(com, wire_next_seq(), frame);
 
 	// Send the message
-	int len = serial_port->write_message(message);
+	int len = port->write_frames(frame, length, 1);
 
 	// Done!
 	return len;
@@ -594,13 +702,21 @@ start()
 	//   CHECK SERIAL PORT
 	// --------------------------------------------------------------------------
 
-	if ( serial_port->status != 1 ) // SERIAL_PORT_OPEN
+	if ( not port->is_running() )
 	{
-		fprintf(stderr,"ERROR: serial port not open\n");
+		fprintf(stderr,"ERROR: port not open\n");
 		throw 1;
 	}
 
 
+	// messages subscribed from outside the dialect, before anything is read
+	dispatch.add_messages_to(*port);
+	history.add_messages_to(*port);
+
+	// read only mode sends nothing, TIMESYNC answers included, unless asked
+	timesync_active = timesync_interval && ( setpoint_rate > 0 || timesync_read_only );
+
+
 	// --------------------------------------------------------------------------
 	//   READ THREAD
 	// --------------------------------------------------------------------------
@@ -637,10 +753,9 @@ start()
 	//   GET SYSTEM and COMPONENT IDs
 	// --------------------------------------------------------------------------
 
-	// This comes from the heartbeat, which in theory should only come from
-	// the autopilot we're directly connected to it.  If there is more than one
-	// vehicle then we can't expect to discover id's like this.
-	// In which case set the id's manually.
+	// This comes from the first heartbeat of an autopilot, other components
+	// and vehicles on the link are kept in vehicles.  If there is more than
+	// one vehicle set the id's manually to pick the one to fly.
 
 	// System ID
 	if ( not system_id )
@@ -657,14 +772,20 @@ start()
 		printf("\n");
 	}
 
+	// what we send all the time goes straight to the wire with these ids
+	setpoint_encoder.set_ids(system_id, companion_id);
+	heartbeat_encoder.set_ids(system_id, companion_id);
+	timesync_encoder.set_ids(system_id, companion_id);
+	command_encoder.set_ids(system_id, companion_id);
+
 
 	// --------------------------------------------------------------------------
 	//   GET INITIAL POSITION
 	// --------------------------------------------------------------------------
 
 	// Wait for initial position ned
-	while ( not ( current_messages.time_stamps.local_position_ned &&
-				  current_messages.time_stamps.attitude            )  )
+	while ( not ( current_messages.local_position_ned.time_stamp() &&
+				  current_messages.attitude.time_stamp()            )  )
 	{
 		if ( time_to_exit )
 			return;
@@ -672,15 +793,16 @@ start()
 	}
 
 	// copy initial position ned
-	Mavlink_Messages local_data = current_messages;
-	initial_position.x        = local_data.local_position_ned.x;
-	initial_position.y        = local_data.local_position_ned.y;
-	initial_position.z        = local_data.local_position_ned.z;
-	initial_position.vx       = local_data.local_position_ned.vx;
-	initial_position.vy       = local_data.local_position_ned.vy;
-	initial_position.vz       = local_data.local_position_ned.vz;
-	initial_position.yaw      = local_data.attitude.yaw;
-	initial_position.yaw_rate = local_data.attitude.yawspeed;
+	mavlink_local_position_ned_t local_position_ned = current_messages.local_position_ned.load();
+	mavlink_attitude_t           attitude           = current_messages.attitude.load();
+	initial_position.x        = local_position_ned.x;
+	initial_position.y        = local_position_ned.y;
+	initial_position.z        = local_position_ned.z;
+	initial_position.vx       = local_position_ned.vx;
+	initial_position.vy       = local_position_ned.vy;
+	initial_position.vz       = local_position_ned.vz;
+	initial_position.yaw      = attitude.yaw;
+	initial_position.yaw_rate = attitude.yawspeed;
 
 	printf("INITIAL POSITION XYZ = [ %.4f , %.4f , %.4f ] \n", initial_position.x, initial_position.y, initial_position.z);
 	printf("INITIAL POSITION YAW = %.4f \n", initial_position.yaw);
@@ -692,17 +814,53 @@ start()
 	// --------------------------------------------------------------------------
 	//   WRITE THREAD
 	// --------------------------------------------------------------------------
-/*   This part is for Reading the value only from pixhawk only no command output
-	printf("START WRITE THREAD \n");
 
-    result = pthread_create( &write_tid, NULL, &start_autopilot_interface_write_thread, this );
-	if ( result ) throw result;
+	// Without a setpoint rate we only read from the pixhawk, no command output
+	// other than TIMESYNC if that was asked for
+	if ( setpoint_rate > 0 || timesync_active )
+	{
+		printf("START WRITE THREAD \n");
+
+		if ( setpoint_rate > AUTOPILOT_INTERFACE_MAX_SETPOINT_RATE )
+		{
+			fprintf(stderr,"WARNING: setpoint rate limited to %i Hz\n", AUTOPILOT_INTERFACE_MAX_SETPOINT_RATE);
+			setpoint_rate = AUTOPILOT_INTERFACE_MAX_SETPOINT_RATE;
+		}
+
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+
+		if ( setpoint_priority > 0 )
+		{
+			struct sched_param param;
+			param.sched_priority = setpoint_priority;
+			pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+			pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+			pthread_attr_setschedparam(&attr, &param);
+		}
+
+		result = pthread_create( &write_tid, &attr, &start_autopilot_interface_write_thread, this );
+		pthread_attr_destroy(&attr);
+
+		// real time priority needs root or CAP_SYS_NICE, carry on without it
+		if ( result == EPERM || result == EINVAL )
+		{
+			fprintf(stderr,"WARNING: could not set SCHED_FIFO priority %i, writing at normal priority\n", setpoint_priority);
+			result = pthread_create( &write_tid, NULL, &start_autopilot_interface_write_thread, this );
+		}
+		if ( result ) throw result;
+
+		// wait for it to be started
+		while ( not writing_status )
+			usleep(100000); // 10Hz
+
+		// now we're streaming setpoint commands
+		if ( setpoint_rate > 0 )
+			printf("STREAMING SETPOINTS AT %i Hz\n", setpoint_rate);
+		else
+			printf("SENDING TIMESYNC ONLY\n");
+	}
 
-	// wait for it to be started
-	while ( not writing_status )
-		usleep(100000); // 10Hz
-*/
-	// now we're streaming setpoint commands
 	printf("\n");
 
 
@@ -727,9 +885,20 @@ stop()
 	// signal exit
 	time_to_exit = true;
 
+	// wake up the read thread
+	uint64_t one = 1;
+	if ( write(wake_fd, &one, sizeof(one)) < 0 )
+		fprintf(stderr,"WARNING: could not wake read thread\n");
+
+	// and the write thread
+	pthread_mutex_lock(&tx_lock);
+	pthread_cond_signal(&tx_cond);
+	pthread_mutex_unlock(&tx_lock);
+
 	// wait for exit
 	pthread_join(read_tid ,NULL);
-	pthread_join(write_tid,NULL);
+	if ( write_tid )
+		pthread_join(write_tid,NULL);
 
 	// now the read and write threads are closed
 	printf("\n");
@@ -803,6 +972,65 @@ handle_quit( int sig )
 
 
 
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+Autopilot_Interface::
+print_stats()
+{
+	// how long messages waited between arriving and being handled
+	dispatch_latency.print("ARRIVAL TO DISPATCH");
+
+	// everybody on the link
+	uint64_t now = get_time_usec();
+	printf("%-20s %i", "VEHICLES", vehicles.size());
+	if ( vehicles.overflow )
+		printf(", %llu messages from senders that did not fit", (unsigned long long) vehicles.overflow);
+	printf("\n");
+	for ( int i = 0; i < vehicles.size(); i++ )
+	{
+		Mavlink_Messages *vehicle = vehicles.at(i);
+		uint64_t heartbeat = vehicle->heartbeat.time_stamp();
+
+		printf("  %3u/%-3u %s %10llu messages", vehicles.sysid_at(i), vehicles.compid_at(i),
+				vehicle == &current_messages ? "*" : " ", (unsigned long long) vehicle->messages);
+		printf(", %u lost (%.2f%%)", vehicle->sequence.lost_frames(), vehicle->sequence.loss() * 100.0);
+		if ( vehicle->sequence.late_frames() )
+			printf(", %u out of order", vehicle->sequence.late_frames());
+		if ( heartbeat )
+			printf(", heartbeat %.1f s ago", (now - heartbeat) * 1e-6);
+		printf("\n");
+	}
+
+	// what arrives from the autopilot, and how regularly
+	link.print(now);
+
+	// round trips to the autopilot and the clock estimate from them
+	time_sync.print();
+
+	// how old messages are by the time they are handled
+	if ( boot_time.valid() )
+		link_latency.print("LINK LATENCY");
+
+	// how well the setpoint stream keeps its deadlines
+	if ( write_tid )
+	{
+		setpoint_period.print("SETPOINT PERIOD");
+		setpoint_jitter.print("SETPOINT JITTER");
+		printf("%-20s %llu\n", "SETPOINT OVERRUNS", (unsigned long long) setpoint_overruns);
+		printf("%-20s %llu messages in %llu writes, %llu failed\n", "WRITE BATCHES",
+				(unsigned long long) tx_batch.messages, (unsigned long long) tx_batch.flushes,
+				(unsigned long long) tx_batch.failed);
+	}
+
+	if ( bus )
+		bus->print_stats();
+
+	port->print_stats();
+}
+
+
 // ------------------------------------------------------------------------------
 //   Read Thread
 // ------------------------------------------------------------------------------
@@ -812,10 +1040,26 @@ read_thread()
 {
 	reading_status = true;
 
+	// Handle messages as soon as they arrive, sleeping in between
 	while ( ! time_to_exit )
 	{
-		read_messages();
-		usleep(100000); // Read batches at 10Hz
+		int ready = port->wait_readable(wake_fd, AUTOPILOT_INTERFACE_LINK_CHECK);
+
+		// the data that woke us arrived about now
+		uint64_t arrival = get_time_usec();
+
+		if ( ready > 0 )
+			read_messages(arrival);
+
+		else if ( ready < 0 )
+		{
+			fprintf(stderr,"ERROR: could not wait for port data\n");
+			usleep(100000);
+		}
+
+		// wakes up at least every AUTOPILOT_INTERFACE_LINK_CHECK to notice
+		// an autopilot that went silent
+		link.check(get_time_usec());
 	}
 
 	reading_status = false;
@@ -841,59 +1085,130 @@ write_thread(void)
         home_req.target_component = companion_id;
         home_req.confirmation = 0;
         mavlink_msg_command_long_encode(system_id,companion_id,&home_req_msg ,&home_req);
-        printf("%s Write Home_Req\n", serial_port->write_message(home_req_msg)?"Success":"Fail");*/
+        printf("%s Write Home_Req\n", port->write_message(home_req_msg)?"Success":"Fail");*/
         usleep(100);// For send request
 
 	// signal startup
 	writing_status = 2;
-        
-	// prepare an initial setpoint, just stay put
-	mavlink_set_position_target_local_ned_t sp;
-	sp.type_mask = MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_VELOCITY &
-		       MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_POSITION ; 
-                      // MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_YAW_ANGLE & 
-                      // MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_YAW_RATE;
-	
+
+	bool streaming = ( setpoint_rate > 0 );
+
+	if ( streaming )
+	{
+		// prepare an initial setpoint, just stay put
+		mavlink_set_position_target_local_ned_t sp;
+		sp.type_mask = MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_VELOCITY &
+			       MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_POSITION ; 
+	                      // MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_YAW_ANGLE & 
+	                      // MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_YAW_RATE;
+		
 #ifdef Vega_Body
-        sp.coordinate_frame = MAV_FRAME_BODY_OFFSET_NED;
-        printf("----------------------In Body Frame------------------------------\n");
+	        sp.coordinate_frame = MAV_FRAME_BODY_OFFSET_NED;
+	        printf("----------------------In Body Frame------------------------------\n");
 #else
-        sp.coordinate_frame = MAV_FRAME_LOCAL_NED;
-        printf("----------------------In Local Frame------------------------------\n");
+	        sp.coordinate_frame = MAV_FRAME_LOCAL_NED;
+	        printf("----------------------In Local Frame------------------------------\n");
 #endif
-	// initialization
-        mavlink_local_position_ned_t initial_pos = current_messages.local_position_ned;
-	sp.vx       = 0; //initial_pos.vx;
-	sp.vy       = 0;//initial_pos.vy;
-	sp.vz       = 0;//initial_pos.vz;
-	//sp.yaw_rate = 0.0;
-
-        sp.x = initial_position.x; //initial_pos.x;
-        sp.y = initial_position.y;//initial_pos.y;
-        sp.z = initial_position.z;//initial_pos.z;
-        //sp.yaw = current_messages.attitude.yaw;
-        
-// set position target
-	current_setpoint = sp;
-
-
-
-	// write a message and signal writing
-	write_setpoint();
+		// initialization
+	        mavlink_local_position_ned_t initial_pos = current_messages.local_position_ned.load();
+		sp.vx       = 0; //initial_pos.vx;
+		sp.vy       = 0;//initial_pos.vy;
+		sp.vz       = 0;//initial_pos.vz;
+		//sp.yaw_rate = 0.0;
+
+	        sp.x = initial_position.x; //initial_pos.x;
+	        sp.y = initial_position.y;//initial_pos.y;
+	        sp.z = initial_position.z;//initial_pos.z;
+	        //sp.yaw = current_messages.attitude.yaw;
+	        
+		// set position target
+		update_setpoint(sp);
+
+		// write a message and signal writing
+		write_setpoint();
+	}
 	writing_status = true;
 
 	// Pixhawk needs to see off-board commands at minimum 2Hz,
-	// otherwise it will go into fail safe
+	// otherwise it will go into fail safe.  Sleep until absolute deadlines,
+	// so the time spent writing never stretches the period.  TIMESYNC
+	// requests go out on their own deadlines, answers as soon as the read
+	// thread posts them.
+	uint64_t period   = streaming ? 1000000000ULL / setpoint_rate : 0; // [ns]
+	uint64_t deadline = get_time_nsec() + period;
+	uint64_t last     = deadline - period;
+
+	next_timesync  = get_time_usec();
+	next_heartbeat = next_timesync;
+
 	while ( !time_to_exit )
 	{
-               
-                write_setpoint();
-                
-                usleep(250000);
-                //printf("local_pos: %f   initial_ps: %f, zacc: %f ,throttle: %f \n",current_messages.local_position_ned.z, initial_position.z, current_messages.highres_imu.zacc,throttle);
+		// everything the last wake up queued, in one write
+		flush_messages();
 
+		uint64_t wake_at = streaming ? deadline : 0;
+		if ( timesync_active && ( wake_at == 0 || next_timesync*1000 < wake_at ) )
+			wake_at = next_timesync*1000;
+		if ( heartbeat_interval && ( wake_at == 0 || next_heartbeat*1000 < wake_at ) )
+			wake_at = next_heartbeat*1000;
 
-        }
+		wait_for_tx(wake_at);
+
+		// ----------------------------------------------------------------------
+		//   TIMESYNC
+		// ----------------------------------------------------------------------
+		pthread_mutex_lock(&tx_lock);
+		bool    reply = reply_pending;
+		int64_t ts1   = reply_ts1;
+		reply_pending = false;
+		pthread_mutex_unlock(&tx_lock);
+
+		// our time as close to sending as it gets
+		if ( reply )
+			write_timesync(get_time_nsec(), ts1);
+
+		uint64_t now = get_time_nsec();
+
+		if ( timesync_active && now >= next_timesync*1000 )
+		{
+			write_timesync(0, time_sync.request(get_time_nsec()));
+			next_timesync = now/1000 + timesync_interval;
+		}
+
+		// ----------------------------------------------------------------------
+		//   HEARTBEAT
+		// ----------------------------------------------------------------------
+		if ( heartbeat_interval && now >= next_heartbeat*1000 )
+		{
+			write_heartbeat();
+			next_heartbeat = now/1000 + heartbeat_interval;
+		}
+
+		// ----------------------------------------------------------------------
+		//   SETPOINT
+		// ----------------------------------------------------------------------
+		if ( not streaming || now < deadline )
+			continue;
+
+		setpoint_period.add( (now - last) / 1000 );
+		setpoint_jitter.add( (now - deadline) / 1000 );
+		last = now;
+
+		write_setpoint();
+
+		// fell a whole period or more behind, drop the missed cycles
+		// rather than sending a burst to catch up
+		deadline += period;
+		now = get_time_nsec();
+		if ( now >= deadline + period )
+		{
+			uint64_t missed = (now - deadline) / period;
+			deadline          += missed * period;
+			setpoint_overruns += missed;
+		}
+	}
+
+	flush_messages();
 
 	// signal end
 	writing_status = false;
@@ -902,6 +1217,27 @@ write_thread(void)
 
 }
 
+// Sleeps until deadline on the monotonic clock [ns], a posted TIMESYNC answer
+// or stop(), whichever comes first.  A deadline of 0 never comes.
+void
+Autopilot_Interface::
+wait_for_tx(uint64_t deadline)
+{
+	struct timespec wake_at;
+	wake_at.tv_sec  = deadline / 1000000000ULL;
+	wake_at.tv_nsec = deadline % 1000000000ULL;
+
+	pthread_mutex_lock(&tx_lock);
+	while ( not time_to_exit && not reply_pending && ( deadline == 0 || get_time_nsec() < deadline ) )
+	{
+		if ( deadline == 0 )
+			pthread_cond_wait(&tx_cond, &tx_lock);
+		else if ( pthread_cond_timedwait(&tx_cond, &tx_lock, &wake_at) == ETIMEDOUT )
+			break;
+	}
+	pthread_mutex_unlock(&tx_lock);
+}
+
 // End Autopilot_Interface
 
 
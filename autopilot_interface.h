@@ -55,11 +55,24 @@
 //   Includes
 // ------------------------------------------------------------------------------
 
+#include "generic_port.h"
 #include "serial_port.h"
+#include "latency_histogram.h"
+#include "seqlock.h"
+#include "time_base.h"
+#include "time_sync.h"
+#include "message_dispatch.h"
+#include "vehicle_table.h"
+#include "telemetry_bus.h"
+#include "write_batch.h"
+#include "link_supervisor.h"
+#include "tracking_analyzer.h"
 
 #include <signal.h>
+#include <sched.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/eventfd.h>
 
 #include <common/mavlink.h>
 
@@ -109,6 +122,30 @@
 #define MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_YAW_ANGLE    0b0000100111111111
 #define MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_YAW_RATE     0b0000010111111111
 
+// How often the write thread sends a TIMESYNC request [us]
+#define AUTOPILOT_INTERFACE_TIMESYNC_INTERVAL 500000
+
+// Batches of GENERIC_PORT_MAX_BATCH frames read_messages() handles per call,
+// so a saturated link still lets the read thread look up now and then
+#define AUTOPILOT_INTERFACE_MAX_BATCHES 8
+
+// Fastest rate the write thread will stream setpoints at [Hz]
+#define AUTOPILOT_INTERFACE_MAX_SETPOINT_RATE 250
+
+// How often the write thread sends the companion's HEARTBEAT [us]
+#define AUTOPILOT_INTERFACE_HEARTBEAT_INTERVAL 1000000
+
+// Longest the read thread sleeps before checking the link for silence [ms]
+#define AUTOPILOT_INTERFACE_LINK_CHECK 100
+
+// Longest a message the write thread queued waits for the rest of its
+// batch [us]; each wake up flushes long before this
+#define AUTOPILOT_INTERFACE_WRITE_DELAY 1000
+
+// Samples kept of each message with a history, a power of two; a few
+// seconds of IMU at full rate
+#define AUTOPILOT_INTERFACE_HISTORY 1024
+
 
 // ------------------------------------------------------------------------------
 //   Prototypes
@@ -116,7 +153,6 @@
 
 
 // helper functions
-uint64_t get_time_usec();
 void set_position(float x, float y, float z, mavlink_set_position_target_local_ned_t &sp);
 void set_velocity(float vx, float vy, float vz, mavlink_set_position_target_local_ned_t &sp);
 void set_acceleration(float ax, float ay, float az, mavlink_set_position_target_local_ned_t &sp);
@@ -148,7 +184,9 @@ struct Time_Stamps
 	uint64_t position_target_global_int;
 	uint64_t highres_imu;
 	uint64_t attitude;
+	uint64_t attitude_target;
     uint64_t vfr_hud;
+	uint64_t home_position;
 
 	void
 	reset_timestamps()
@@ -163,62 +201,142 @@ struct Time_Stamps
 		position_target_global_int = 0;
 		highres_imu = 0;
 		attitude = 0;
+		attitude_target = 0;
         vfr_hud = 0;
+		home_position = 0;
 	}
 
 };
 
 
 // Struct containing information on the MAV we are currently connected to
+//
+// The read thread stores each message type in its own seqlock, together with
+// the time it arrived.  Readers copy out just the type they need with load(),
+// which never returns a half written message, e.g.
+//
+//     mavlink_local_position_ned_t pos;
+//     uint64_t stamp = current_messages.local_position_ned.load(pos);
+//
+// Every other sender on the link gets one of these too, see
+// Autopilot_Interface::vehicles.
 
 struct Mavlink_Messages {
 
+	Mavlink_Messages()
+	{
+		sysid    = 0;
+		compid   = 0;
+		messages = 0;
+	}
+
 	int sysid;
 	int compid;
 
+	uint64_t messages; // received from this sender
+
+	// frames of this sender lost on the way, from their sequence numbers
+	Sequence_Counter sequence;
+
 	// Heartbeat
-	mavlink_heartbeat_t heartbeat;
+	Seqlock<mavlink_heartbeat_t> heartbeat;
 
 	// System Status
-	mavlink_sys_status_t sys_status;
+	Seqlock<mavlink_sys_status_t> sys_status;
 
 	// Battery Status
-	mavlink_battery_status_t battery_status;
+	Seqlock<mavlink_battery_status_t> battery_status;
 
 	// Radio Status
-	mavlink_radio_status_t radio_status;
+	Seqlock<mavlink_radio_status_t> radio_status;
 
 	// Local Position
-	mavlink_local_position_ned_t local_position_ned;
+	Seqlock<mavlink_local_position_ned_t> local_position_ned;
 
 	// Global Position
-	mavlink_global_position_int_t global_position_int;
+	Seqlock<mavlink_global_position_int_t> global_position_int;
 
 	// Local Position Target
-	mavlink_position_target_local_ned_t position_target_local_ned;
+	Seqlock<mavlink_position_target_local_ned_t> position_target_local_ned;
 
 	// Global Position Target
-	mavlink_position_target_global_int_t position_target_global_int;
+	Seqlock<mavlink_position_target_global_int_t> position_target_global_int;
 
 	// HiRes IMU
-	mavlink_highres_imu_t highres_imu;
+	Seqlock<mavlink_highres_imu_t> highres_imu;
 
 	// Attitude
-	mavlink_attitude_t attitude;
+	Seqlock<mavlink_attitude_t> attitude;
     // Attitude Target
-    mavlink_attitude_target_t attitude_target;
+    Seqlock<mavlink_attitude_target_t> attitude_target;
     // VFR_HUD
-    mavlink_vfr_hud_t vfr_hud;
+    Seqlock<mavlink_vfr_hud_t> vfr_hud;
+
+	// Home Position
+	Seqlock<mavlink_home_position_t> home_position;
 	// System Parameters?
 
 
-	// Time Stamps
-	Time_Stamps time_stamps;
+	// Time Stamps, collected from the message slots
+	Time_Stamps
+	time_stamps() const
+	{
+		Time_Stamps stamps;
+		stamps.heartbeat                  = heartbeat.time_stamp();
+		stamps.sys_status                 = sys_status.time_stamp();
+		stamps.battery_status             = battery_status.time_stamp();
+		stamps.radio_status               = radio_status.time_stamp();
+		stamps.local_position_ned         = local_position_ned.time_stamp();
+		stamps.global_position_int        = global_position_int.time_stamp();
+		stamps.position_target_local_ned  = position_target_local_ned.time_stamp();
+		stamps.position_target_global_int = position_target_global_int.time_stamp();
+		stamps.highres_imu                = highres_imu.time_stamp();
+		stamps.attitude                   = attitude.time_stamp();
+		stamps.attitude_target            = attitude_target.time_stamp();
+		stamps.vfr_hud                    = vfr_hud.time_stamp();
+		stamps.home_position              = home_position.time_stamp();
+		return stamps;
+	}
 
+	// Take over what other received so far, only from the thread that
+	// stores messages
+	void
+	merge(const Mavlink_Messages &other)
+	{
+		messages += other.messages;
+		sequence  = other.sequence;
+		heartbeat.copy_from(other.heartbeat);
+		sys_status.copy_from(other.sys_status);
+		battery_status.copy_from(other.battery_status);
+		radio_status.copy_from(other.radio_status);
+		local_position_ned.copy_from(other.local_position_ned);
+		global_position_int.copy_from(other.global_position_int);
+		position_target_local_ned.copy_from(other.position_target_local_ned);
+		position_target_global_int.copy_from(other.position_target_global_int);
+		highres_imu.copy_from(other.highres_imu);
+		attitude.copy_from(other.attitude);
+		attitude_target.copy_from(other.attitude_target);
+		vfr_hud.copy_from(other.vfr_hud);
+		home_position.copy_from(other.home_position);
+	}
+
+	// only from the thread that stores messages
 	void
 	reset_timestamps()
 	{
-		time_stamps.reset_timestamps();
+		heartbeat.reset_timestamp();
+		sys_status.reset_timestamp();
+		battery_status.reset_timestamp();
+		radio_status.reset_timestamp();
+		local_position_ned.reset_timestamp();
+		global_position_int.reset_timestamp();
+		position_target_local_ned.reset_timestamp();
+		position_target_global_int.reset_timestamp();
+		highres_imu.reset_timestamp();
+		attitude.reset_timestamp();
+		attitude_target.reset_timestamp();
+		vfr_hud.reset_timestamp();
+		home_position.reset_timestamp();
 	}
 
 };
@@ -232,9 +350,15 @@ struct Mavlink_Messages {
  *
  * This starts two threads for read and write over MAVlink. The read thread
  * listens for any MAVlink message and pushes it to the current_messages
- * attribute.  The write thread at the moment only streams a position target
+ * attribute, or to the sender's entry in vehicles if it is not from the
+ * autopilot being flown.  The write thread at the moment only streams a position target
  * in the local NED frame (mavlink_set_position_target_local_ned_t), which
- * is changed by using the method update_setpoint().  Sending these messages
+ * is changed by using the method update_setpoint().  It wakes up on absolute
+ * deadlines setpoint_rate times a second, so the stream does not drift, and
+ * can run at a SCHED_FIFO priority.  It also sends the TIMESYNC requests and
+ * answers, so the read thread never waits on the port.  With setpoint_rate
+ * at 0 nothing is sent at all, unless timesync_read_only asks for the write
+ * thread to run for clock sync alone.  Sending these messages
  * are only half the requirement to get response from the autopilot, a signal
  * to enter "offboard_control" mode is sent by using the enable_offboard_control()
  * method.  Signal the exit of this mode with disable_offboard_control().  It's
@@ -247,23 +371,80 @@ class Autopilot_Interface
 public:
 
 	Autopilot_Interface();
-	Autopilot_Interface(Serial_Port *serial_port_);
+	Autopilot_Interface(Generic_Port *port_);
 	~Autopilot_Interface();
 
 	char reading_status;
 	char writing_status;
 	char control_status;
-    uint64_t write_count;
+    uint64_t write_count; // messages written, from any thread
 
     int system_id;
 	int autopilot_id;
 	int companion_id;
 
+	// the autopilot flown: the one system_id/autopilot_id name if set
+	// before start(), otherwise the first that sends a HEARTBEAT
 	Mavlink_Messages current_messages;
 	mavlink_set_position_target_local_ned_t initial_position;
 
+	// state of every sender on the link, current_messages among them
+	Vehicle_Table<Mavlink_Messages> vehicles;
+
+	// the last AUTOPILOT_INTERFACE_HISTORY of the autopilot's messages that
+	// filters need every one of
+	History_Ring<mavlink_local_position_ned_t, AUTOPILOT_INTERFACE_HISTORY> local_position_history;
+	History_Ring<mavlink_highres_imu_t,        AUTOPILOT_INTERFACE_HISTORY> highres_imu_history;
+
+	// per leg tracking error of the autopilot's position setpoints
+	Tracking_Analyzer tracking;
+
+	// time from the port turning readable to each message being handled;
+	// batches read after the first count from their own read
+	Latency_Histogram dispatch_latency;
+
+	// setpoint streaming, set before start()
+	int setpoint_rate;     // [Hz], 0 leaves the write thread off
+	int setpoint_priority; // SCHED_FIFO priority of the write thread, 0 for none
+
+	// time between write thread wake ups, and how late each wake up was
+	Latency_Histogram setpoint_period;
+	Latency_Histogram setpoint_jitter;
+	uint64_t setpoint_overruns; // cycles skipped because a deadline was missed
+
+	// autopilot boot time to companion time, learned from received messages
+	Boot_Time_Map boot_time;
+
+	// from the autopilot stamping a message to it being handled here, above
+	// the fastest delivery seen
+	Latency_Histogram link_latency;
+
+	// clock offset and drift from TIMESYNC round trips
+	Time_Sync time_sync;
+	uint64_t  timesync_interval;  // [us], 0 stops sending requests
+	bool      timesync_read_only; // sync clocks even when setpoint_rate is 0
+
+	// the companion's HEARTBEAT, sent whenever the write thread runs
+	uint64_t heartbeat_interval; // [us], 0 sends none
+
+	// rates and gaps of the autopilot's messages, and the link lost handler
+	Link_Supervisor link;
+
+	uint64_t autopilot_time_usec(uint64_t local_usec) const;
+
+	// where received messages go, subscribe to more or drop unused ones
+	// here before start()
+	Message_Dispatch dispatch;
+
+	// rings the autopilot's messages are also pushed to, subscribe more
+	// here before start()
+	Message_Dispatch history;
+
+	// if set, every message of the autopilot flown is published to it
+	Telemetry_Bus *bus;
+
 	void update_setpoint(mavlink_set_position_target_local_ned_t setpoint);
-	void read_messages();
+	void read_messages(uint64_t arrival);
 	int  write_message(mavlink_message_t message);
 
 	void enable_offboard_control();
@@ -277,24 +458,71 @@ public:
 
 	void handle_quit( int sig );
 
+	void print_stats();
+
 
 private:
 
-	Serial_Port *serial_port;
+	Generic_Port *port;
 
 	bool time_to_exit;
+	int  wake_fd;
+
+	// TIMESYNC goes out from the write thread, the read thread only posts
+	// answers to the autopilot's requests here and wakes it
+	bool            timesync_active;   // decided by start()
+	uint64_t        next_timesync;     // when the next request goes out [us]
+	uint64_t        next_heartbeat;    // [us]
+	pthread_mutex_t tx_lock;
+	pthread_cond_t  tx_cond;           // on CLOCK_MONOTONIC
+	bool            reply_pending;
+	int64_t         reply_ts1;         // of the request to answer
 
 	pthread_t read_tid;
 	pthread_t write_tid;
 
-	mavlink_set_position_target_local_ned_t current_setpoint;
+	// update_setpoint() may be called from any thread, the write thread
+	// copies the latest one out without waiting
+	Seqlock<mavlink_set_position_target_local_ned_t> current_setpoint;
+	pthread_mutex_t setpoint_lock; // serializes update_setpoint() callers
+
+	// messages the write thread sends, flushed once per wake up
+	Write_Batch tx_batch;
+
+	// encode what is sent all the time straight into a send buffer, set up
+	// by start() once the ids are known
+	Wire_Encoder<mavlink_set_position_target_local_ned_t> setpoint_encoder;
+	Wire_Encoder<mavlink_heartbeat_t>                     heartbeat_encoder;
+	Wire_Encoder<mavlink_timesync_t>                      timesync_encoder;
+	Wire_Encoder<mavlink_command_long_t>                  command_encoder;
 
 	void read_thread();
 	void write_thread(void);
+	void wait_for_tx(uint64_t deadline);
+
+	void handle_message(const Frame_View &frame);
+	void sync_boot_time(uint64_t boot_usec, uint64_t now);
+	void handle_timesync(const Message_View<mavlink_timesync_t> &timesync, uint64_t now);
+	void write_timesync(int64_t tc1, int64_t ts1);
+	void write_heartbeat();
 
 	int toggle_offboard_control( bool flag );
 	void write_setpoint();
 
+	void flush_messages();
+
+	// Write thread only, encodes the message into the batch flush_messages()
+	// sends
+	template <typename T>
+	void
+	queue_message(const Wire_Encoder<T> &encoder, const T &value)
+	{
+		__atomic_add_fetch(&write_count, 1, __ATOMIC_RELAXED);
+
+		if ( tx_batch.add(encoder, value) < 0 )
+			fprintf(stderr,"WARNING: could not send messages \n");
+	}
+
 };
 
 
@@ -0,0 +1,234 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_bus.cpp
+ *
+ * @brief Latency and cost of the shared memory telemetry bus
+ *
+ * Publishes SYSTEM_TIME messages carrying the time they were published, and
+ * a reader in a forked process, as another program would be, maps the bus
+ * and polls it:
+ *   1 kHz     the rate of the fastest autopilot streams; prints how long a
+ *             message took to be seen by the reader and the cost of latest()
+ *   flat out  publish() back to back; prints its cost and how many messages
+ *             a reader following history() kept up with
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "telemetry_bus.h"
+#include "latency_histogram.h"
+#include "time_base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Messages published at 1 kHz
+#define BENCH_PACED 3000
+
+// Messages published back to back
+#define BENCH_FLAT_OUT 2000000
+
+// Samples copied out of the history per call
+#define BENCH_BATCH 64
+
+
+// ------------------------------------------------------------------------------
+//   Reader
+// ------------------------------------------------------------------------------
+// Polls the newest SYSTEM_TIME until the last one was seen
+static void
+follow_latest(const char *name)
+{
+	Telemetry_Bus_Reader reader;
+	while ( not reader.open(name) )
+		usleep(1000);
+
+	Latency_Histogram latency;
+	Telemetry_Sample  sample;
+	uint64_t          seen  = 0;
+	uint64_t          polls = 0;
+	uint64_t          start = get_time_nsec();
+
+	while ( seen < BENCH_PACED )
+	{
+		polls++;
+		if ( reader.latest(MAVLINK_MSG_ID_SYSTEM_TIME, sample) && sample.index >= seen )
+		{
+			mavlink_system_time_t system_time;
+			memcpy(&system_time, sample.payload, sizeof(system_time));
+			latency.add((get_time_nsec() - system_time.time_unix_usec) / 1000);
+			seen = sample.index + 1;
+		}
+		else
+			sched_yield();
+	}
+
+	uint64_t elapsed = get_time_nsec() - start;
+
+	latency.print("PUBLISH TO READ");
+	printf("%-20s %llu polls, %.0f ns each with yielding\n", "READER",
+			(unsigned long long)polls, (double)elapsed / polls);
+
+	// the cost of a read on its own, the slot cached
+	start = get_time_nsec();
+	for ( int i = 0; i < 1000000; i++ )
+		reader.latest(MAVLINK_MSG_ID_SYSTEM_TIME, sample);
+	printf("%-20s %.1f ns\n", "LATEST()", (get_time_nsec() - start) / 1e6);
+}
+
+// Copies out every message in order until the writer is done
+static void
+follow_history(const char *name)
+{
+	Telemetry_Bus_Reader reader;
+	while ( not reader.open(name) )
+		usleep(1000);
+
+	Telemetry_Sample samples[BENCH_BATCH];
+	uint64_t         cursor = reader.published();
+	uint64_t         read   = 0;
+	uint64_t         missed = 0;
+
+	while ( cursor < BENCH_FLAT_OUT )
+	{
+		int count = reader.history(cursor, samples, BENCH_BATCH, &missed);
+		if ( not count )
+			sched_yield();
+		read += count;
+	}
+
+	printf("%-20s %llu read, %llu overwritten before the reader got to them\n", "HISTORY",
+			(unsigned long long)read, (unsigned long long)missed);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Writer
+// ------------------------------------------------------------------------------
+static void
+publish(Telemetry_Bus &bus, int messages, int period)
+{
+	uint64_t start = get_time_nsec();
+
+	for ( int i = 0; i < messages; i++ )
+	{
+		uint64_t now = get_time_nsec();
+
+		mavlink_message_t message;
+		mavlink_msg_system_time_pack(1, 1, &message, now, (now - start) / 1000000);
+		bus.publish(message, now / 1000);
+
+		if ( period )
+			usleep(period);
+	}
+
+	if ( not period )
+		printf("%-20s %.1f ns\n", "PUBLISH()", (double)(get_time_nsec() - start) / messages);
+}
+
+static void
+run(Telemetry_Bus &bus, const char *name, void (*reader)(const char *), int messages, int period)
+{
+	fflush(stdout);
+
+	pid_t child = fork();
+	if ( child == 0 )
+	{
+		reader(name);
+		fflush(stdout);
+		_exit(0);
+	}
+
+	// let the reader map the bus before the first message
+	usleep(100000);
+	publish(bus, messages, period);
+
+	waitpid(child, NULL, 0);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	char name[64];
+	snprintf(name, sizeof(name), "/bench_bus_%d", (int)getpid());
+
+	try
+	{
+		Telemetry_Bus bus;
+
+		printf("1 kHz\n");
+		bus.open(name);
+		run(bus, name, follow_latest, BENCH_PACED, 1000);
+
+		// starts the history at 0 again
+		printf("\nflat out\n");
+		bus.open(name);
+		run(bus, name, follow_history, BENCH_FLAT_OUT, 0);
+
+		bus.close();
+	}
+	catch ( int error )
+	{
+		shm_unlink(name);
+		return error;
+	}
+
+	shm_unlink(name);
+	return 0;
+}
+
+
@@ -0,0 +1,357 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_columns.cpp
+ *
+ * @brief Post flight analysis of an hour of telemetry
+ *
+ * Writes a tlog of a synthetic flight, a circle flown half a metre off its
+ * target with IMU at 250 Hz and the rest at 50 and 10 Hz, then times
+ * loading it into Telemetry_Columns and the tracking, velocity and climb
+ * analyses flight_analysis does, and checks their results against the
+ * known answers.  Last, the vector kernels against plain loops.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "telemetry_columns.h"
+#include "log_replay.h"
+#include "time_base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <vector>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+#define BENCH_LOG "/tmp/bench_columns.tlog"
+
+// Length of the flight [s]
+#define BENCH_FLIGHT 3600
+
+// Common clock of the analyses [Hz]
+#define BENCH_RATE 50
+
+// Kernel runs, the best one is reported
+#define BENCH_ROUNDS 5
+
+// The circle flown and how far off its target [m]
+#define BENCH_RADIUS   10.0
+#define BENCH_PERIOD   60.0
+#define BENCH_OFFSET_X 0.3
+#define BENCH_OFFSET_Y -0.4
+
+
+// ------------------------------------------------------------------------------
+//   Flight
+// ------------------------------------------------------------------------------
+
+static void
+write_frame(FILE *file, uint64_t time_usec, const mavlink_message_t &message)
+{
+	uint8_t record[8 + MAVLINK_MAX_PACKET_LEN];
+
+	for ( int i = 0; i < 8; i++ )
+		record[i] = (uint8_t)(time_usec >> (56 - 8 * i));
+
+	unsigned len = mavlink_msg_to_send_buffer(record + 8, &message);
+	fwrite(record, 1, 8 + len, file);
+}
+
+// Target on the circle, climbing 1 mm/s; position off by the offset
+static void
+write_flight(const char *path)
+{
+	FILE *file = fopen(path, "wb");
+	if ( file == NULL )
+	{
+		fprintf(stderr, "ERROR: could not write %s\n", path);
+		exit(1);
+	}
+
+	const uint64_t start = 1700000000000000ULL; // a wall clock time, as tlogs have
+	const double   w     = 2 * M_PI / BENCH_PERIOD;
+
+	mavlink_message_t message;
+
+	// ticks of 4 ms, everything runs at a divisor of 250 Hz
+	for ( uint64_t tick = 0; tick <= (uint64_t)BENCH_FLIGHT * 250; tick++ )
+	{
+		double   t         = tick / 250.0;
+		uint64_t time_usec = start + tick * 4000;
+		uint32_t boot_ms   = (uint32_t)(tick * 4);
+
+		float x  = (float)(BENCH_RADIUS * cos(w * t));
+		float y  = (float)(BENCH_RADIUS * sin(w * t));
+		float z  = (float)(-5.0 - 0.001 * t);
+		float vx = (float)(-BENCH_RADIUS * w * sin(w * t));
+		float vy = (float)( BENCH_RADIUS * w * cos(w * t));
+		float vz = -0.001f;
+
+		if ( tick % 250 == 0 )
+		{
+			mavlink_msg_heartbeat_pack(1, 1, &message, MAV_TYPE_QUADROTOR, MAV_AUTOPILOT_PX4, 0, 0, 0);
+			write_frame(file, time_usec, message);
+		}
+
+		mavlink_msg_highres_imu_pack(1, 1, &message, tick * 4000, 0, 0, -9.8f, 0, 0, 0, 0, 0, 0,
+				1013, 0, 488.0f - z, 20, 0xffff);
+		write_frame(file, time_usec, message);
+
+		if ( tick % 5 == 0 )
+		{
+			mavlink_msg_local_position_ned_pack(1, 1, &message, boot_ms,
+					x + (float)BENCH_OFFSET_X, y + (float)BENCH_OFFSET_Y, z, vx, vy, vz);
+			write_frame(file, time_usec, message);
+
+			mavlink_msg_position_target_local_ned_pack(1, 1, &message, boot_ms, MAV_FRAME_LOCAL_NED,
+					0, x, y, z, vx, vy, vz, 0, 0, 0, 0, 0);
+			write_frame(file, time_usec, message);
+
+			mavlink_msg_attitude_pack(1, 1, &message, boot_ms, 0, 0, (float)fmod(w * t, 2 * M_PI), 0, 0, (float)w);
+			write_frame(file, time_usec, message);
+		}
+
+		if ( tick % 25 == 0 )
+		{
+			mavlink_msg_vfr_hud_pack(1, 1, &message, 0, (float)(BENCH_RADIUS * w), 0, 50,
+					488.0f - z, -vz);
+			write_frame(file, time_usec, message);
+		}
+	}
+
+	fclose(file);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Analyses
+// ------------------------------------------------------------------------------
+// Same as flight_analysis, with the answers
+struct Bench_Results
+{
+	double tracking; // 3D rms [m]
+	double velocity; // worst axis rms [m/s]
+	double climb;    // rms [m/s]
+};
+
+static void
+resample(const Telemetry_Stream &stream, const char *name, const Telemetry_Clock &clock,
+		std::vector<float> &out)
+{
+	out.resize(clock.count);
+	telemetry_resample(&(*stream.column(name))[0], clock, &out[0]);
+}
+
+static Bench_Results
+analyse(const Telemetry_Columns &columns)
+{
+	static const char *axes[]       = { "x", "y", "z" };
+	static const char *velocities[] = { "vx", "vy", "vz" };
+
+	double period = 1.0 / BENCH_RATE;
+	size_t count  = (size_t)(columns.local_position.time.back() / period);
+
+	Bench_Results results;
+	Telemetry_Clock position_clock, target_clock, imu_clock, hud_clock;
+	std::vector<float> position, target, velocity, derivative(count), altitude, climb;
+
+	telemetry_clock(columns.local_position,  0, period, count, position_clock);
+	telemetry_clock(columns.position_target, 0, period, count, target_clock);
+
+	double tracking = 0;
+	results.velocity = 0;
+
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		resample(columns.local_position,  axes[axis], position_clock, position);
+		resample(columns.position_target, axes[axis], target_clock,   target);
+		tracking += telemetry_squared_error(&position[0], &target[0], count);
+
+		resample(columns.local_position, velocities[axis], position_clock, velocity);
+		telemetry_differentiate(&position[0], count, period, &derivative[0]);
+
+		// the one sided ends are off on a circle, leave them out
+		double rms = sqrt(telemetry_squared_error(&derivative[1], &velocity[1], count - 2) / (count - 2));
+		if ( rms > results.velocity )
+			results.velocity = rms;
+	}
+
+	results.tracking = sqrt(tracking / count);
+
+	telemetry_clock(columns.highres_imu, 0, period, count, imu_clock);
+	telemetry_clock(columns.vfr_hud,     0, period, count, hud_clock);
+	resample(columns.highres_imu, "pressure_alt", imu_clock, altitude);
+	resample(columns.vfr_hud,     "climb",        hud_clock, climb);
+	telemetry_differentiate(&altitude[0], count, period, &derivative[0]);
+
+	results.climb = sqrt(telemetry_squared_error(&derivative[1], &climb[1], count - 2) / (count - 2));
+
+	return results;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Kernels
+// ------------------------------------------------------------------------------
+// What the kernels do, one float at a time
+static void
+differentiate_scalar(const float *values, size_t count, double period, float *out)
+{
+	float half = (float)(0.5 / period);
+
+	out[0]         = (values[1] - values[0]) * 2 * half;
+	out[count - 1] = (values[count - 1] - values[count - 2]) * 2 * half;
+
+	for ( size_t i = 1; i + 1 < count; i++ )
+		out[i] = (values[i + 1] - values[i - 1]) * half;
+}
+
+static double
+squared_error_scalar(const float *a, const float *b, size_t count)
+{
+	double total = 0;
+
+	for ( size_t i = 0; i < count; i++ )
+		total += (double)(a[i] - b[i]) * (a[i] - b[i]);
+
+	return total;
+}
+
+// ns per element, best of BENCH_ROUNDS
+static void
+run_kernels(const std::vector<float> &a, const std::vector<float> &b)
+{
+	size_t count = a.size();
+	std::vector<float> out(count);
+	double best[4] = { 0, 0, 0, 0 };
+	double sink    = 0;
+
+	for ( int round = 0; round < BENCH_ROUNDS; round++ )
+	{
+		double ns[4];
+		uint64_t start = get_time_nsec();
+		telemetry_differentiate(&a[0], count, 0.004, &out[0]);
+		ns[0] = (double)(get_time_nsec() - start) / count;
+		sink += out[count / 2];
+
+		start = get_time_nsec();
+		differentiate_scalar(&a[0], count, 0.004, &out[0]);
+		ns[1] = (double)(get_time_nsec() - start) / count;
+		sink += out[count / 2];
+
+		start = get_time_nsec();
+		sink += telemetry_squared_error(&a[0], &b[0], count);
+		ns[2] = (double)(get_time_nsec() - start) / count;
+
+		start = get_time_nsec();
+		sink += squared_error_scalar(&a[0], &b[0], count);
+		ns[3] = (double)(get_time_nsec() - start) / count;
+
+		for ( int i = 0; i < 4; i++ )
+			if ( round == 0 || ns[i] < best[i] )
+				best[i] = ns[i];
+	}
+
+	// keeps the loops from being optimised away
+	if ( sink == 1234 )
+		printf(" ");
+
+	printf("%-24s %8.2f ns %8.2f ns\n", "differentiate", best[0], best[1]);
+	printf("%-24s %8.2f ns %8.2f ns\n", "squared error", best[2], best[3]);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	write_flight(BENCH_LOG);
+
+	uint64_t start = get_time_usec();
+
+	Log_Replay log(BENCH_LOG, 0);
+	log.start();
+
+	uint64_t indexed = get_time_usec();
+
+	Telemetry_Columns columns;
+	columns.load(log);
+
+	uint64_t loaded = get_time_usec();
+
+	Bench_Results results = analyse(columns);
+
+	uint64_t analysed = get_time_usec();
+
+	columns.print();
+	printf("\n");
+	printf("%.0f s of flight, %lu frames\n", (double)BENCH_FLIGHT, (unsigned long)columns.frames);
+	printf("    index     %8.1f ms\n", (indexed  - start)   / 1e3);
+	printf("    columns   %8.1f ms\n", (loaded   - indexed) / 1e3);
+	printf("    analyses  %8.1f ms at %d Hz\n", (analysed - loaded) / 1e3, BENCH_RATE);
+	printf("    tracking rms %.4f m, velocity rms %.4f m/s, climb rms %.4f m/s\n",
+			results.tracking, results.velocity, results.climb);
+
+	log.stop();
+	unlink(BENCH_LOG);
+
+	double offset = sqrt(BENCH_OFFSET_X * BENCH_OFFSET_X + BENCH_OFFSET_Y * BENCH_OFFSET_Y);
+	if ( fabs(results.tracking - offset) > 0.01 || results.velocity > 0.01 || results.climb > 0.01 )
+	{
+		fprintf(stderr, "ERROR: the analyses are off, the tracking error is %.2f m\n", offset);
+		return 1;
+	}
+
+	printf("\n%-24s %11s %11s\n", "per element", "vector", "scalar");
+	run_kernels(columns.highres_imu.values[7], columns.highres_imu.values[6]);
+
+	return 0;
+}
+
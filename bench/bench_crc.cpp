@@ -0,0 +1,184 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_crc.cpp
+ *
+ * @brief Throughput of the X.25 CRC variants in checksum.h
+ *
+ * Times the original shift/xor update, the table lookup crc_accumulate()
+ * and the slice-by-4 crc_accumulate_buffer() on frame sized buffers, after
+ * checking that all three agree.  Build with MAVLINK_CRC_TABLE defined.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <checksum.h>
+
+#include "time_base.h"
+
+#ifndef MAVLINK_CRC_TABLE
+#error "bench_crc compares against the table driven CRC, build it with -DMAVLINK_CRC_TABLE"
+#endif
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Bytes checksummed per variant and length
+#define BENCH_BYTES (64 * 1024 * 1024)
+
+#define BENCH_BUFFER 4096
+
+
+// ------------------------------------------------------------------------------
+//   CRC Variants
+// ------------------------------------------------------------------------------
+
+// checksum.h's crc_accumulate() without MAVLINK_CRC_TABLE
+static inline void
+crc_accumulate_bitwise(uint8_t data, uint16_t *crcAccum)
+{
+	uint8_t tmp;
+
+	tmp = data ^ (uint8_t)(*crcAccum & 0xff);
+	tmp ^= (tmp << 4);
+	*crcAccum = (*crcAccum >> 8) ^ (tmp << 8) ^ (tmp << 3) ^ (tmp >> 4);
+}
+
+static uint16_t
+crc_bitwise(const uint8_t *buf, unsigned len)
+{
+	uint16_t crc = X25_INIT_CRC;
+	while ( len-- )
+		crc_accumulate_bitwise(*buf++, &crc);
+	return crc;
+}
+
+static uint16_t
+crc_table(const uint8_t *buf, unsigned len)
+{
+	uint16_t crc = X25_INIT_CRC;
+	while ( len-- )
+		crc_accumulate(*buf++, &crc);
+	return crc;
+}
+
+static uint16_t
+crc_slice4(const uint8_t *buf, unsigned len)
+{
+	uint16_t crc = X25_INIT_CRC;
+	crc_accumulate_buffer(&crc, (const char *)buf, (uint16_t)len);
+	return crc;
+}
+
+typedef uint16_t (*Crc_Function)(const uint8_t *buf, unsigned len);
+
+
+// ------------------------------------------------------------------------------
+//   Run
+// ------------------------------------------------------------------------------
+// MB/s over buffers of len bytes at different offsets of data
+static double
+run(Crc_Function crc, const uint8_t *data, unsigned len)
+{
+	unsigned rounds = BENCH_BYTES / len;
+	uint16_t sink   = 0;
+
+	uint64_t start = get_time_nsec();
+
+	for ( unsigned i = 0; i < rounds; i++ )
+		sink ^= crc(data + (i * 7) % (BENCH_BUFFER - len), len);
+
+	uint64_t elapsed = get_time_nsec() - start;
+
+	// keeps the loop from being optimised away
+	if ( sink == 0x1234 )
+		printf(" ");
+
+	return (double)rounds * len * 1000.0 / elapsed;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	uint8_t *data = (uint8_t *)malloc(BENCH_BUFFER);
+	srand(1);
+	for ( int i = 0; i < BENCH_BUFFER; i++ )
+		data[i] = (uint8_t)rand();
+
+	// all three must agree before their speed means anything
+	for ( unsigned len = 0; len < 300; len++ )
+	{
+		uint16_t expected = crc_bitwise(data + len, len);
+		if ( crc_table(data + len, len) != expected || crc_slice4(data + len, len) != expected )
+		{
+			fprintf(stderr, "ERROR: CRC variants disagree on %u bytes\n", len);
+			return 1;
+		}
+	}
+
+	// the header, SET_POSITION_TARGET_LOCAL_NED's payload, the largest frame
+	const unsigned lengths[] = { 5, 53, 263 };
+
+	printf("%-8s %14s %14s %14s\n", "bytes", "shift/xor", "table", "slice-by-4");
+
+	for ( int i = 0; i < 3; i++ )
+	{
+		printf("%-8u %9.0f MB/s %9.0f MB/s %9.0f MB/s\n", lengths[i],
+				run(&crc_bitwise, data, lengths[i]),
+				run(&crc_table,   data, lengths[i]),
+				run(&crc_slice4,  data, lengths[i]));
+	}
+
+	free(data);
+
+	return 0;
+}
+
@@ -0,0 +1,223 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_dispatch.cpp
+ *
+ * @brief Cost of handing a high rate HIGHRES_IMU stream to its subscriber
+ *
+ * Times the receive path from scanned frames to the vehicle's slot: the
+ * old way, copying each frame into a mavlink_message_t and decoding it
+ * into a struct that is then stored, against Message_Dispatch storing
+ * straight from the frame, and against a handler that reads only
+ * pressure_alt through a Message_View.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "message_dispatch.h"
+#include "time_base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Messages handled per run
+#define BENCH_MESSAGES (8 * 1000 * 1000)
+
+// Distinct frames cycled through
+#define BENCH_RING 4096
+
+// Runs per variant, the best one is reported
+#define BENCH_ROUNDS 3
+
+
+// ------------------------------------------------------------------------------
+//   Stream
+// ------------------------------------------------------------------------------
+// BENCH_RING HIGHRES_IMU frames back to back, scanned into views
+static void
+make_frames(uint8_t *stream, Frame_View *frames)
+{
+	mavlink_message_t message;
+	unsigned len = 0;
+
+	for ( int i = 0; i < BENCH_RING; i++ )
+	{
+		mavlink_msg_highres_imu_pack(1, 1, &message, i, 0.01f * i, 0, -9.8f, 0, 0, 0, 0, 0, 0,
+				1013, 0, 100.0f + i, 20, 0xffff);
+		len += mavlink_msg_to_send_buffer(stream + len, &message);
+	}
+
+	Frame_Scanner scanner;
+	unsigned consumed;
+	if ( scanner.scan(stream, len, frames, BENCH_RING, consumed) != BENCH_RING )
+	{
+		fprintf(stderr, "ERROR: the scanner did not find every frame\n");
+		exit(1);
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Handlers
+// ------------------------------------------------------------------------------
+
+struct Altitude
+{
+	float    pressure_alt;
+	uint64_t updates;
+
+	void
+	handle_imu(const Message_View<mavlink_highres_imu_t> &imu, uint64_t /* now */)
+	{
+		pressure_alt = imu.get(&mavlink_highres_imu_t::pressure_alt);
+		updates++;
+	}
+};
+
+
+// ------------------------------------------------------------------------------
+//   Run
+// ------------------------------------------------------------------------------
+
+enum Bench_Path
+{
+	PATH_DECODE,   // to_message() and the generated decode
+	PATH_DISPATCH, // Message_Dispatch into the slot
+	PATH_VIEW      // Message_Dispatch to a Message_View handler
+};
+
+// Nanoseconds per message, best of BENCH_ROUNDS
+static double
+run(const Frame_View *frames, Bench_Path path)
+{
+	Seqlock<mavlink_highres_imu_t> slot;
+	Altitude                       altitude;
+	Message_Dispatch               dispatch;
+
+	altitude.updates = 0;
+
+	if ( path == PATH_VIEW )
+		dispatch.subscribe<mavlink_highres_imu_t, Altitude, &Altitude::handle_imu>(&altitude);
+	else
+		dispatch.subscribe(slot);
+
+	double best = 0;
+
+	for ( int round = 0; round < BENCH_ROUNDS; round++ )
+	{
+		uint64_t start = get_time_nsec();
+
+		for ( int i = 0; i < BENCH_MESSAGES; i++ )
+		{
+			const Frame_View &frame = frames[i & (BENCH_RING - 1)];
+
+			if ( path == PATH_DECODE )
+			{
+				mavlink_message_t     message;
+				mavlink_highres_imu_t imu;
+				frame.to_message(message);
+				mavlink_msg_highres_imu_decode(&message, &imu);
+				slot.store(imu, i + 1);
+			}
+			else
+				dispatch.dispatch(frame, i + 1);
+		}
+
+		double ns = (double)(get_time_nsec() - start) / BENCH_MESSAGES;
+		if ( round == 0 || ns < best )
+			best = ns;
+	}
+
+	// the last frame must have arrived whole, or in part for the view
+	mavlink_message_t     message;
+	mavlink_highres_imu_t expected;
+	frames[(BENCH_MESSAGES - 1) & (BENCH_RING - 1)].to_message(message);
+	mavlink_msg_highres_imu_decode(&message, &expected);
+
+	bool ok;
+	if ( path == PATH_VIEW )
+		ok = altitude.updates == (uint64_t)BENCH_ROUNDS * BENCH_MESSAGES &&
+		     altitude.pressure_alt == expected.pressure_alt;
+	else
+	{
+		mavlink_highres_imu_t imu = slot.load();
+		ok = memcmp(&imu, &expected, MAVLINK_MSG_ID_HIGHRES_IMU_LEN) == 0 &&
+		     slot.load_field(&mavlink_highres_imu_t::pressure_alt) == expected.pressure_alt;
+	}
+
+	if ( not ok )
+	{
+		fprintf(stderr, "ERROR: the slot does not hold the last message\n");
+		exit(1);
+	}
+
+	return best;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	uint8_t    *stream = new uint8_t[BENCH_RING * MAVLINK_MAX_PACKET_LEN];
+	Frame_View *frames = new Frame_View[BENCH_RING];
+
+	make_frames(stream, frames);
+
+	printf("HIGHRES_IMU, %d byte payload\n", MAVLINK_MSG_ID_HIGHRES_IMU_LEN);
+	printf("  %-36s %7.1f ns/msg\n", "to_message + decode + store", run(frames, PATH_DECODE));
+	printf("  %-36s %7.1f ns/msg\n", "dispatch, stored from the frame", run(frames, PATH_DISPATCH));
+	printf("  %-36s %7.1f ns/msg\n", "dispatch, view reads pressure_alt", run(frames, PATH_VIEW));
+
+	delete[] frames;
+	delete[] stream;
+
+	return 0;
+}
+
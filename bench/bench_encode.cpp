@@ -0,0 +1,203 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_encode.cpp
+ *
+ * @brief Cost of encoding the companion's outbound messages
+ *
+ * Times the generic path, mavlink_msg_*_encode() into a mavlink_message_t
+ * and mavlink_msg_to_send_buffer(), against Wire_Encoder writing the frame
+ * directly, after checking that both give the same bytes for every
+ * sequence number.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "wire_encoder.h"
+#include "time_base.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Messages encoded per path and message type
+#define BENCH_MESSAGES (4 * 1000 * 1000)
+
+#define BENCH_SYSID  1
+#define BENCH_COMPID 2
+
+
+// ------------------------------------------------------------------------------
+//   Test Values
+// ------------------------------------------------------------------------------
+
+static void
+random_bytes(void *value, size_t len)
+{
+	for ( size_t i = 0; i < len; i++ )
+		((uint8_t *)value)[i] = (uint8_t)rand();
+}
+
+template <typename T>
+static T
+random_message()
+{
+	T value;
+	random_bytes(&value, sizeof(value));
+	return value;
+}
+
+// the generated heartbeat encoder always writes MAVLINK_VERSION
+template <>
+mavlink_heartbeat_t
+random_message<mavlink_heartbeat_t>()
+{
+	mavlink_heartbeat_t value;
+	random_bytes(&value, sizeof(value));
+	value.mavlink_version = MAVLINK_VERSION;
+	return value;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Encode Paths
+// ------------------------------------------------------------------------------
+
+template <typename T>
+static unsigned
+encode_generic(const T &value, uint8_t seq, uint8_t *out)
+{
+	mavlink_message_t message;
+	mavlink_get_channel_status(MAVLINK_COMM_0)->current_tx_seq = seq;
+	Wire_Message<T>::encode(BENCH_SYSID, BENCH_COMPID, &message, &value);
+	return mavlink_msg_to_send_buffer(out, &message);
+}
+
+template <typename T>
+static bool
+check(const Wire_Encoder<T> &encoder)
+{
+	uint8_t expected[MAVLINK_MAX_PACKET_LEN];
+	uint8_t frame[MAVLINK_MAX_PACKET_LEN];
+
+	for ( int seq = 0; seq < 256; seq++ )
+	{
+		T value = random_message<T>();
+
+		unsigned len = encode_generic(value, (uint8_t)seq, expected);
+		if ( encoder.encode(value, (uint8_t)seq, frame) != len || memcmp(frame, expected, len) )
+			return false;
+	}
+
+	return true;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Run
+// ------------------------------------------------------------------------------
+// ns per message for both paths
+template <typename T>
+static void
+run(const char *name)
+{
+	Wire_Encoder<T> encoder(BENCH_SYSID, BENCH_COMPID);
+
+	if ( not check(encoder) )
+	{
+		fprintf(stderr, "ERROR: %s frames differ from the generic encoder\n", name);
+		exit(1);
+	}
+
+	T value = random_message<T>();
+	uint8_t frame[MAVLINK_MAX_PACKET_LEN];
+	unsigned sink = 0;
+
+	uint64_t start = get_time_nsec();
+	for ( int i = 0; i < BENCH_MESSAGES; i++ )
+	{
+		encode_generic(value, (uint8_t)i, frame);
+		sink += frame[Wire_Encoder<T>::FRAME_LENGTH - 1];
+	}
+	uint64_t generic = get_time_nsec() - start;
+
+	start = get_time_nsec();
+	for ( int i = 0; i < BENCH_MESSAGES; i++ )
+	{
+		encoder.encode(value, (uint8_t)i, frame);
+		sink += frame[Wire_Encoder<T>::FRAME_LENGTH - 1];
+	}
+	uint64_t wire = get_time_nsec() - start;
+
+	// keeps the loops from being optimised away
+	if ( sink == 0x1234 )
+		printf(" ");
+
+	printf("%-32s %5d %9.1f ns %9.1f ns %7.1fx\n", name, (int)Wire_Encoder<T>::FRAME_LENGTH,
+			(double)generic / BENCH_MESSAGES, (double)wire / BENCH_MESSAGES,
+			(double)generic / wire);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	srand(1);
+
+	printf("%-32s %5s %12s %12s %8s\n", "message", "bytes", "generic", "wire", "speedup");
+
+	run<mavlink_set_position_target_local_ned_t>("SET_POSITION_TARGET_LOCAL_NED");
+	run<mavlink_command_long_t>("COMMAND_LONG");
+	run<mavlink_timesync_t>("TIMESYNC");
+	run<mavlink_heartbeat_t>("HEARTBEAT");
+
+	return 0;
+}
+
@@ -0,0 +1,341 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_history.cpp
+ *
+ * @brief History_Ring costs, and readers following a full rate writer
+ *
+ * Times push() of HIGHRES_IMU samples, then lets 1 to 4 readers follow a
+ * writer pushing flat out or at 1 kHz with read(), checking every sample
+ * for a torn update and counting what the readers missed.  Last, the cost
+ * of since() and interpolate() on a full ring, checked against values
+ * that are a known function of time.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "history_ring.h"
+#include "time_base.h"
+
+#include <common/mavlink.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+#define BENCH_HISTORY 1024
+
+// How long each configuration runs [us]
+#define BENCH_DURATION 1000000
+
+#define BENCH_MAX_READERS 4
+
+// Samples handed out per read()
+#define BENCH_READ 64
+
+// Pushes and queries timed
+#define BENCH_OPERATIONS 2000000
+
+typedef History_Ring<mavlink_highres_imu_t, BENCH_HISTORY> Bench_Ring;
+typedef History_Sample<mavlink_highres_imu_t>              Bench_Sample;
+
+
+// ------------------------------------------------------------------------------
+//   Samples
+// ------------------------------------------------------------------------------
+
+// Every field follows the counter, a torn read shows as a mismatch
+static void
+fill(mavlink_highres_imu_t &imu, uint32_t counter)
+{
+	float value = (float)(counter & 0xffff);
+
+	imu.time_usec      = counter;
+	imu.xacc           = value;
+	imu.yacc           = value;
+	imu.zacc           = value;
+	imu.xgyro          = value;
+	imu.ygyro          = value;
+	imu.zgyro          = value;
+	imu.xmag           = value;
+	imu.ymag           = value;
+	imu.zmag           = value;
+	imu.abs_pressure   = value;
+	imu.diff_pressure  = value;
+	imu.pressure_alt   = value;
+	imu.temperature    = value;
+	imu.fields_updated = (uint16_t)counter;
+}
+
+static bool
+consistent(const Bench_Sample &sample)
+{
+	mavlink_highres_imu_t expected;
+	fill(expected, (uint32_t)sample.value.time_usec);
+
+	return sample.index + 1 == sample.time_usec && sample.value.time_usec == sample.time_usec &&
+	       memcmp(&expected, &sample.value, MAVLINK_MSG_ID_HIGHRES_IMU_LEN) == 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Threads
+// ------------------------------------------------------------------------------
+
+struct Bench_Run
+{
+	int writer_period; // [us], 0 pushes flat out
+
+	Bench_Ring ring;
+
+	volatile bool stop;
+
+	uint64_t samples[BENCH_MAX_READERS];
+	uint64_t missed[BENCH_MAX_READERS];
+	uint64_t torn[BENCH_MAX_READERS];
+};
+
+struct Bench_Reader
+{
+	Bench_Run *run;
+	int        id;
+};
+
+// Stamps are the counter, so they ascend like arrival times do
+static void *
+writer(void *args)
+{
+	Bench_Run *run = (Bench_Run *)args;
+	mavlink_highres_imu_t imu;
+	uint32_t counter = 0;
+
+	while ( not run->stop )
+	{
+		fill(imu, ++counter);
+		run->ring.push(imu, counter);
+
+		if ( run->writer_period > 0 )
+			usleep(run->writer_period);
+	}
+
+	return NULL;
+}
+
+static void *
+reader(void *args)
+{
+	Bench_Reader *self = (Bench_Reader *)args;
+	Bench_Run    *run  = self->run;
+	Bench_Sample  samples[BENCH_READ];
+	uint64_t      cursor = 0;
+	uint64_t      count  = 0;
+	uint64_t      missed = 0;
+	uint64_t      torn   = 0;
+
+	while ( not run->stop )
+	{
+		int found = run->ring.read(cursor, samples, BENCH_READ, &missed);
+
+		for ( int i = 0; i < found; i++ )
+			if ( not consistent(samples[i]) )
+				torn++;
+		count += found;
+
+		if ( not found )
+			sched_yield();
+	}
+
+	run->samples[self->id] = count;
+	run->missed[self->id]  = missed;
+	run->torn[self->id]    = torn;
+
+	return NULL;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Run
+// ------------------------------------------------------------------------------
+
+static void
+run(int readers, int writer_period)
+{
+	Bench_Run *bench = new Bench_Run;
+	bench->writer_period = writer_period;
+	bench->stop          = false;
+
+	pthread_t    writer_tid;
+	pthread_t    reader_tid[BENCH_MAX_READERS];
+	Bench_Reader reader_args[BENCH_MAX_READERS];
+
+	pthread_create(&writer_tid, NULL, &writer, bench);
+	for ( int i = 0; i < readers; i++ )
+	{
+		reader_args[i].run = bench;
+		reader_args[i].id  = i;
+		pthread_create(&reader_tid[i], NULL, &reader, &reader_args[i]);
+	}
+
+	usleep(BENCH_DURATION);
+	bench->stop = true;
+
+	pthread_join(writer_tid, NULL);
+
+	uint64_t samples = 0, missed = 0, torn = 0;
+	for ( int i = 0; i < readers; i++ )
+	{
+		pthread_join(reader_tid[i], NULL);
+		samples += bench->samples[i];
+		missed  += bench->missed[i];
+		torn    += bench->torn[i];
+	}
+
+	printf("%-8i %-10s %12llu %12llu %12llu %8llu\n", readers,
+			writer_period ? "1 kHz" : "flat out",
+			(unsigned long long)bench->ring.pushed(), (unsigned long long)(samples / readers),
+			(unsigned long long)(missed / readers), (unsigned long long)torn);
+
+	delete bench;
+}
+
+// ns per push, and per since() and interpolate() on the full ring
+static void
+run_queries()
+{
+	Bench_Ring *ring = new Bench_Ring;
+	mavlink_highres_imu_t imu;
+	memset(&imu, 0, sizeof(imu));
+
+	// samples every 4 ms whose pressure_alt is a tenth of the time stamp
+	// within its 100 ms
+	uint64_t start = get_time_nsec();
+	for ( int i = 0; i < BENCH_OPERATIONS; i++ )
+	{
+		uint64_t stamp = 4000 * (uint64_t)(i + 1);
+		imu.time_usec    = stamp;
+		imu.pressure_alt = (float)(stamp % 100000) / 10;
+		ring->push(imu, stamp);
+	}
+	double push = (double)(get_time_nsec() - start) / BENCH_OPERATIONS;
+
+	uint64_t newest = 4000 * (uint64_t)BENCH_OPERATIONS;
+	uint64_t span   = 4000 * (uint64_t)(BENCH_HISTORY - 2);
+	Bench_Sample samples[16];
+	int errors = 0;
+
+	// the last 16 samples, from the time before them
+	start = get_time_nsec();
+	for ( int i = 0; i < BENCH_OPERATIONS; i++ )
+		if ( ring->since(newest - 16 * 4000, samples, 16) != 16 )
+			errors++;
+	double since = (double)(get_time_nsec() - start) / BENCH_OPERATIONS;
+
+	if ( samples[0].time_usec != newest - 15 * 4000 || samples[15].time_usec != newest )
+		errors++;
+
+	// anywhere in the ring, away from where pressure_alt starts over
+	srand(1);
+	double sink = 0;
+	start = get_time_nsec();
+	for ( int i = 0; i < BENCH_OPERATIONS; i++ )
+	{
+		uint64_t t = newest - (uint64_t)rand() % span;
+		double value;
+		if ( not ring->interpolate(t, &mavlink_highres_imu_t::pressure_alt, value) )
+			errors++;
+		else if ( t % 100000 < 96000 && fabs(value - (double)(t % 100000) / 10) > 0.01 )
+			errors++;
+		sink += value;
+	}
+	double interpolate = (double)(get_time_nsec() - start) / BENCH_OPERATIONS;
+
+	// nothing older than the ring, nothing newer than its newest
+	double value;
+	if ( ring->interpolate(newest - 4000 * BENCH_HISTORY - 1, &mavlink_highres_imu_t::pressure_alt, value) ||
+	     ring->interpolate(newest + 1, &mavlink_highres_imu_t::pressure_alt, value) )
+		errors++;
+
+	if ( errors )
+	{
+		fprintf(stderr, "ERROR: %i wrong query results\n", errors);
+		exit(1);
+	}
+
+	// keeps the loop from being optimised away
+	if ( sink == 1234 )
+		printf(" ");
+
+	printf("push %.1f ns   since() 16 samples %.1f ns   interpolate() %.1f ns\n", push, since, interpolate);
+
+	delete ring;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	printf("HIGHRES_IMU, %i samples, %u bytes per slot\n", BENCH_HISTORY,
+			(unsigned)(sizeof(Bench_Ring) / BENCH_HISTORY));
+
+	run_queries();
+
+	printf("\n%-8s %-10s %12s %12s %12s %8s\n", "readers", "writer", "pushed", "read each", "missed each", "torn");
+
+	for ( int readers = 1; readers <= BENCH_MAX_READERS; readers *= 2 )
+	{
+		run(readers, 0);
+		run(readers, 1000);
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,346 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_router.cpp
+ *
+ * @brief Cost of fanning a link out to local consumers
+ *
+ * A Mavlink_Router on top of an in-memory link forwards to 1 to 16 Unix
+ * socket endpoints, each drained by its own consumer thread:
+ *   link  frames are handed out at 921600 baud for two seconds, and the
+ *         CPU the read and router threads spent is printed as a share of
+ *         one core, with what the consumers got
+ *   max   frames are handed out as fast as the read thread takes them,
+ *         the rate into the router and the rate each consumer got are
+ *         printed, the rest was dropped at the full queues
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "mavlink_router.h"
+#include "time_base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Frames in the link's stream, it is replayed from the start when used up
+#define BENCH_MESSAGES 4096
+
+// Link speed the paced run hands frames out at [bytes/s]
+#define BENCH_LINK_RATE (921600 / 10)
+
+// Length of each run [ms]
+#define BENCH_RUN 2000
+
+// A consumer that gets nothing for this long is done [ms]
+#define BENCH_IDLE 200
+
+
+// ------------------------------------------------------------------------------
+//   In-memory Link
+// ------------------------------------------------------------------------------
+
+/*
+ * Hands out the frames of a prepared stream, as many as the byte budget
+ * allows; the budget is topped up by the caller
+ */
+class Memory_Link: public Generic_Port
+{
+
+public:
+
+	uint8_t  *stream;
+	unsigned  length;
+	unsigned  pos;
+	uint64_t  budget;  // bytes that may still be handed out
+	uint64_t  bytes;   // bytes handed out
+	uint64_t  frames;  // frames handed out
+
+	Frame_Scanner scanner;
+
+	int
+	read_frames(Frame_View *views, int max_views)
+	{
+		unsigned avail = length - pos;
+		if ( avail > budget )
+			avail = budget;
+
+		unsigned consumed;
+		int count = scanner.scan(stream + pos, avail, views, max_views, consumed);
+
+		pos    += consumed;
+		budget -= consumed;
+		bytes  += consumed;
+		frames += count;
+		if ( pos == length )
+			pos = 0;
+
+		return count;
+	}
+
+	int  wait_readable(int, int) { return 1; }
+	void add_message(uint8_t, uint8_t, uint8_t) {}
+	int  write_message(const mavlink_message_t &) { return 0; }
+
+	bool is_running() { return true; }
+	void start() {}
+	void stop() {}
+
+	void print_stats() {}
+
+};
+
+
+// ------------------------------------------------------------------------------
+//   Consumers
+// ------------------------------------------------------------------------------
+
+static uint64_t
+cpu_nsec(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct Bench_Consumer
+{
+	char     url[80];  // unix:// and the path
+	int      sock;
+	uint64_t frames;
+	uint64_t cpu;     // its own CPU time [ns]
+};
+
+static void *
+consumer(void *args)
+{
+	Bench_Consumer *c = (Bench_Consumer *)args;
+	Frame_Scanner   scanner;
+	Frame_View      views[64];
+	uint8_t         buf[2048];
+
+	while ( true )
+	{
+		struct pollfd pfd;
+		pfd.fd     = c->sock;
+		pfd.events = POLLIN;
+		if ( poll(&pfd, 1, BENCH_IDLE) <= 0 )
+			break;
+
+		int result = recv(c->sock, buf, sizeof(buf), 0);
+		if ( result <= 0 )
+			break;
+
+		unsigned offset = 0, consumed;
+		int count;
+		do {
+			count = scanner.scan(buf + offset, result - offset, views, 64, consumed, false);
+			offset    += consumed;
+			c->frames += count;
+		} while ( count == 64 );
+	}
+
+	c->cpu = cpu_nsec(CLOCK_THREAD_CPUTIME_ID);
+	return NULL;
+}
+
+static int
+open_consumer(Bench_Consumer &c, int index)
+{
+	snprintf(c.url, sizeof(c.url), "unix:///tmp/bench_router_%d_%d.sock", (int)getpid(), index);
+	const char *path = c.url + strlen("unix://");
+	unlink(path);
+
+	c.sock   = socket(AF_UNIX, SOCK_DGRAM, 0);
+	c.frames = 0;
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	int size = 1 << 20;
+	setsockopt(c.sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	if ( c.sock < 0 || bind(c.sock, (struct sockaddr *)&address, sizeof(address)) )
+	{
+		fprintf(stderr, "ERROR: could not bind %s, %s\n", path, strerror(errno));
+		exit(1);
+	}
+	return c.sock;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Runs
+// ------------------------------------------------------------------------------
+
+// Forwards for BENCH_RUN ms, paced at BENCH_LINK_RATE or not at all
+static void
+run(Memory_Link &link, int endpoints, bool paced)
+{
+	Bench_Consumer consumers[MAVLINK_ROUTER_MAX_ENDPOINTS];
+	pthread_t      tids[MAVLINK_ROUTER_MAX_ENDPOINTS];
+
+	Mavlink_Router router;
+	router.link = &link;
+
+	for ( int i = 0; i < endpoints; i++ )
+	{
+		open_consumer(consumers[i], i);
+		router.add_endpoint(consumers[i].url);
+	}
+
+	router.start();
+	for ( int i = 0; i < endpoints; i++ )
+		pthread_create(&tids[i], NULL, &consumer, &consumers[i]);
+
+	Frame_View views[GENERIC_PORT_MAX_BATCH];
+	link.frames = 0;
+	link.bytes  = 0;
+	link.budget = paced ? 0 : ~0ULL;
+
+	uint64_t start       = get_time_nsec();
+	uint64_t end         = start + BENCH_RUN * 1000000ULL;
+	uint64_t cpu_start   = cpu_nsec(CLOCK_THREAD_CPUTIME_ID);
+	uint64_t cpu_process = cpu_nsec(CLOCK_PROCESS_CPUTIME_ID);
+	uint64_t now         = start;
+
+	while ( now < end )
+	{
+		if ( paced )
+		{
+			// top up every millisecond like a UART read would
+			usleep(1000);
+			link.budget = (get_time_nsec() - start) * BENCH_LINK_RATE / 1000000000ULL - link.bytes;
+		}
+
+		// a batch at a time like the read thread, unpaced it never runs dry
+		for ( int batch = 0; batch < 64; batch++ )
+			if ( router.read_frames(views, GENERIC_PORT_MAX_BATCH) <= 0 )
+				break;
+
+		now = get_time_nsec();
+	}
+
+	uint64_t cpu_read = cpu_nsec(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+	uint64_t elapsed  = now - start;
+
+	for ( int i = 0; i < endpoints; i++ )
+		pthread_join(tids[i], NULL);
+
+	// what is left is the router thread's, it only idles after the run
+	uint64_t cpu_router = cpu_nsec(CLOCK_PROCESS_CPUTIME_ID) - cpu_process - cpu_read;
+
+	uint64_t got = 0;
+	for ( int i = 0; i < endpoints; i++ )
+	{
+		cpu_router -= consumers[i].cpu;
+		got += consumers[i].frames;
+		close(consumers[i].sock);
+		unlink(consumers[i].url + strlen("unix://"));
+	}
+
+	router.stop();
+
+	printf("%-4s %2d endpoints %9.0f msg/s in %9.0f msg/s out to each (%6.2f%%), read %5.1f%% router %5.1f%% of a core\n",
+			paced ? "link" : "max", endpoints, link.frames * 1e9 / elapsed, got * 1e9 / elapsed / endpoints,
+			100.0 * got / ((double)link.frames * endpoints), 100.0 * cpu_read / elapsed,
+			100.0 * cpu_router / elapsed);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	// telemetry sized messages
+	Memory_Link link;
+	link.stream = (uint8_t *)malloc(BENCH_MESSAGES * MAVLINK_MAX_PACKET_LEN);
+	link.length = 0;
+	link.pos    = 0;
+
+	for ( int i = 0; i < BENCH_MESSAGES; i++ )
+	{
+		mavlink_message_t message;
+		if ( i & 1 )
+			mavlink_msg_attitude_pack(1, 1, &message, i, 0.1f, 0.2f, 0.3f, 0, 0, 0);
+		else
+			mavlink_msg_local_position_ned_pack(1, 1, &message, i, 1, 2, 3, 0, 0, 0);
+		link.length += mavlink_msg_to_send_buffer(link.stream + link.length, &message);
+	}
+
+	static const int counts[] = { 1, 4, 8, 16 };
+
+	try
+	{
+		for ( int i = 0; i < 4; i++ )
+			run(link, counts[i], true);
+		for ( int i = 0; i < 4; i++ )
+			run(link, counts[i], false);
+	}
+	catch ( int error )
+	{
+		fprintf(stderr, "ERROR: could not start the router\n");
+		return error;
+	}
+
+	free(link.stream);
+
+	return 0;
+}
+
+
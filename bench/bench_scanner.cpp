@@ -0,0 +1,229 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_scanner.cpp
+ *
+ * @brief Receive parsing throughput, per byte against buffer at a time
+ *
+ * Parses the same stream of telemetry frames with mavlink_parse_char() one
+ * byte at a time, the way the read path used to, and with Frame_Scanner in
+ * chunks the size of a serial read, with and without copying each frame
+ * into a mavlink_message_t.  A little line noise is mixed in so the resync
+ * paths run too.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "frame_scanner.h"
+#include "time_base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Stream parsed per run
+#define BENCH_STREAM (16 * 1024 * 1024)
+
+// Bytes handed to the scanner at a time, what one serial read brings in
+#define BENCH_CHUNK 4096
+
+// Runs per variant, the best one is reported
+#define BENCH_ROUNDS 3
+
+
+// ------------------------------------------------------------------------------
+//   Stream
+// ------------------------------------------------------------------------------
+// Attitude, position, IMU and heartbeats with a noise byte every so often.
+// Returns the number of frames written.
+static int
+make_stream(uint8_t *stream, unsigned &len)
+{
+	mavlink_message_t message;
+	int frames = 0;
+
+	len = 0;
+	srand(1);
+
+	while ( len + MAVLINK_MAX_PACKET_LEN + 1 < BENCH_STREAM )
+	{
+		switch ( frames % 4 )
+		{
+			case 0:
+				mavlink_msg_attitude_pack(1, 1, &message, frames, 0.1f, 0.2f, 0.3f, 0, 0, 0);
+				break;
+			case 1:
+				mavlink_msg_local_position_ned_pack(1, 1, &message, frames, 1, 2, 3, 0, 0, 0);
+				break;
+			case 2:
+				mavlink_msg_highres_imu_pack(1, 1, &message, frames, 0, 0, -9.8f, 0, 0, 0, 0, 0, 0, 1013, 0, 0, 20, 0);
+				break;
+			default:
+				mavlink_msg_heartbeat_pack(1, 1, &message, MAV_TYPE_QUADROTOR, MAV_AUTOPILOT_PX4, 0, 0, 0);
+				break;
+		}
+		len += mavlink_msg_to_send_buffer(stream + len, &message);
+		frames++;
+
+		if ( rand() % 64 == 0 )
+			stream[len++] = (uint8_t)rand();
+	}
+
+	return frames;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Parsers
+// ------------------------------------------------------------------------------
+
+static int
+parse_per_byte(const uint8_t *stream, unsigned len)
+{
+	mavlink_message_t message;
+	mavlink_status_t  status;
+	int frames = 0;
+
+	for ( unsigned i = 0; i < len; i++ )
+		if ( mavlink_parse_char(MAVLINK_COMM_0, stream[i], &message, &status) )
+			frames++;
+
+	return frames;
+}
+
+// Like Serial_Port: chunks are appended behind what the last scan left
+static int
+parse_scanner(const uint8_t *stream, unsigned len, bool copy)
+{
+	static uint8_t    buffer[2 * BENCH_CHUNK];
+	Frame_Scanner     scanner;
+	Frame_View        views[32];
+	mavlink_message_t message;
+	unsigned          kept   = 0;
+	int               frames = 0;
+
+	for ( unsigned pos = 0; pos < len; pos += BENCH_CHUNK )
+	{
+		unsigned chunk = len - pos < BENCH_CHUNK ? len - pos : BENCH_CHUNK;
+		memcpy(buffer + kept, stream + pos, chunk);
+
+		unsigned avail = kept + chunk;
+		unsigned head  = 0;
+		int      count;
+		do {
+			unsigned consumed;
+			count = scanner.scan(buffer + head, avail - head, views, 32, consumed);
+			head += consumed;
+
+			if ( copy )
+				for ( int i = 0; i < count; i++ )
+					views[i].to_message(message);
+
+			frames += count;
+
+		} while ( count == 32 );
+
+		kept = avail - head;
+		memmove(buffer, buffer + head, kept);
+	}
+
+	return frames;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Run
+// ------------------------------------------------------------------------------
+
+static void
+report(const char *name, int variant, const uint8_t *stream, unsigned len, int expected)
+{
+	uint64_t best   = 0;
+	int      frames = 0;
+
+	for ( int round = 0; round < BENCH_ROUNDS; round++ )
+	{
+		uint64_t start = get_time_nsec();
+
+		if ( variant == 0 )
+			frames = parse_per_byte(stream, len);
+		else
+			frames = parse_scanner(stream, len, variant == 2);
+
+		uint64_t elapsed = get_time_nsec() - start;
+		if ( not best || elapsed < best )
+			best = elapsed;
+	}
+
+	printf("%-28s %8.0f MB/s %8.2f Mmsg/s %10i frames", name, len * 1000.0 / best,
+			frames * 1000.0 / best, frames);
+	if ( frames != expected )
+		printf(", %i lost to the noise", expected - frames);
+	printf("\n");
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	uint8_t *stream = (uint8_t *)malloc(BENCH_STREAM);
+	unsigned len;
+	int expected = make_stream(stream, len);
+
+	printf("%u bytes, %i frames\n", len, expected);
+
+	report("mavlink_parse_char",        0, stream, len, expected);
+	report("Frame_Scanner",             1, stream, len, expected);
+	report("Frame_Scanner + to_message", 2, stream, len, expected);
+
+	free(stream);
+
+	return 0;
+}
+
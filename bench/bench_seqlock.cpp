@@ -0,0 +1,264 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_seqlock.cpp
+ *
+ * @brief Reader cost of Seqlock under writer contention
+ *
+ * One writer stores a 256 byte value, idle, at 1 kHz or as fast as it can,
+ * while 1 to 4 readers load it.  Prints the time per load for the seqlock
+ * and for the same copy under a pthread mutex, and checks every value read
+ * for a torn update.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "seqlock.h"
+#include "time_base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// How long each configuration runs [us]
+#define BENCH_DURATION 1000000
+
+#define BENCH_MAX_READERS 4
+
+
+// ------------------------------------------------------------------------------
+//   Shared State
+// ------------------------------------------------------------------------------
+
+// Every word holds the same counter, a torn read shows as a mismatch
+struct Bench_Value
+{
+	uint32_t words[64];
+};
+
+struct Bench_Run
+{
+	bool use_mutex;
+	int  writer_period;  // [us], 0 stores flat out, -1 not at all
+
+	Seqlock<Bench_Value> seqlock;
+	pthread_mutex_t      mutex;
+	Bench_Value          locked;
+
+	volatile bool stop;
+
+	uint64_t loads[BENCH_MAX_READERS];
+	uint64_t torn[BENCH_MAX_READERS];
+};
+
+struct Bench_Reader
+{
+	Bench_Run *run;
+	int        id;
+};
+
+static void
+fill(Bench_Value &value, uint32_t counter)
+{
+	for ( int i = 0; i < 64; i++ )
+		value.words[i] = counter;
+}
+
+static bool
+consistent(const Bench_Value &value)
+{
+	for ( int i = 1; i < 64; i++ )
+		if ( value.words[i] != value.words[0] )
+			return false;
+	return true;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Threads
+// ------------------------------------------------------------------------------
+
+static void *
+writer(void *args)
+{
+	Bench_Run *run = (Bench_Run *)args;
+	Bench_Value value;
+	uint32_t counter = 0;
+
+	while ( not run->stop )
+	{
+		if ( run->writer_period < 0 )
+		{
+			usleep(1000);
+			continue;
+		}
+
+		fill(value, ++counter);
+
+		if ( run->use_mutex )
+		{
+			pthread_mutex_lock(&run->mutex);
+			run->locked = value;
+			pthread_mutex_unlock(&run->mutex);
+		}
+		else
+			run->seqlock.store(value, counter);
+
+		if ( run->writer_period > 0 )
+			usleep(run->writer_period);
+	}
+
+	return NULL;
+}
+
+static void *
+reader(void *args)
+{
+	Bench_Reader *self = (Bench_Reader *)args;
+	Bench_Run    *run  = self->run;
+	Bench_Value   value;
+	uint64_t      loads = 0;
+	uint64_t      torn  = 0;
+
+	while ( not run->stop )
+	{
+		if ( run->use_mutex )
+		{
+			pthread_mutex_lock(&run->mutex);
+			value = run->locked;
+			pthread_mutex_unlock(&run->mutex);
+		}
+		else
+			run->seqlock.load(value);
+
+		if ( not consistent(value) )
+			torn++;
+		loads++;
+	}
+
+	run->loads[self->id] = loads;
+	run->torn[self->id]  = torn;
+
+	return NULL;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Run
+// ------------------------------------------------------------------------------
+// Nanoseconds per load, averaged over the readers
+static double
+run(int readers, int writer_period, bool use_mutex, uint64_t &torn)
+{
+	Bench_Run *bench = new Bench_Run;
+	bench->use_mutex     = use_mutex;
+	bench->writer_period = writer_period;
+	bench->stop          = false;
+	pthread_mutex_init(&bench->mutex, NULL);
+	fill(bench->locked, 0);
+
+	pthread_t    writer_tid;
+	pthread_t    reader_tid[BENCH_MAX_READERS];
+	Bench_Reader reader_args[BENCH_MAX_READERS];
+
+	pthread_create(&writer_tid, NULL, &writer, bench);
+	for ( int i = 0; i < readers; i++ )
+	{
+		reader_args[i].run = bench;
+		reader_args[i].id  = i;
+		pthread_create(&reader_tid[i], NULL, &reader, &reader_args[i]);
+	}
+
+	usleep(BENCH_DURATION);
+	bench->stop = true;
+
+	pthread_join(writer_tid, NULL);
+
+	uint64_t loads = 0;
+	torn = 0;
+	for ( int i = 0; i < readers; i++ )
+	{
+		pthread_join(reader_tid[i], NULL);
+		loads += bench->loads[i];
+		torn  += bench->torn[i];
+	}
+
+	pthread_mutex_destroy(&bench->mutex);
+	delete bench;
+
+	// each reader ran for the whole duration
+	return loads ? (double)BENCH_DURATION * 1000.0 * readers / loads : 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	const int   periods[] = { -1, 1000, 0 };
+	const char *names[]   = { "idle", "1 kHz", "flat out" };
+
+	printf("%-8s %-10s %14s %14s %8s\n", "readers", "writer", "seqlock", "mutex", "torn");
+
+	for ( int readers = 1; readers <= BENCH_MAX_READERS; readers *= 2 )
+	{
+		for ( int i = 0; i < 3; i++ )
+		{
+			uint64_t torn, torn_mutex;
+			double seqlock = run(readers, periods[i], false, torn);
+			double mutex   = run(readers, periods[i], true, torn_mutex);
+
+			printf("%-8i %-10s %11.1f ns %11.1f ns %8llu\n", readers, names[i], seqlock, mutex,
+					(unsigned long long)(torn + torn_mutex));
+		}
+	}
+
+	return 0;
+}
+
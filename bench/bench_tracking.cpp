@@ -0,0 +1,282 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_tracking.cpp
+ *
+ * @brief Per leg setpoint tracking of a simulated square mission
+ *
+ * A vehicle answering each setpoint step like an underdamped second order
+ * system reports its position at 50 Hz and its target at 10 Hz, as frames
+ * fed to Tracking_Analyzer.  Its legs are checked against the same figures
+ * computed afterwards from every sample kept, and the time per message is
+ * reported.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "tracking_analyzer.h"
+#include "time_base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Legs flown, and how long each [s]
+#define BENCH_LEGS   2000
+#define BENCH_LEG    10
+
+// Response to a step: damping ratio and natural frequency [rad/s]
+#define BENCH_ZETA   0.5
+#define BENCH_OMEGA  2.0
+
+// Legs checked against the reference, the last closed ones
+#define BENCH_CHECKED 8
+#define BENCH_FIRST_CHECKED ( BENCH_LEGS - 1 - BENCH_CHECKED )
+
+
+// ------------------------------------------------------------------------------
+//   Flight
+// ------------------------------------------------------------------------------
+
+// The corners of a 1 m square, 1 m up
+static const float corners[4][3] = {
+	{ 0, 0, -1 },
+	{ 1, 0, -1 },
+	{ 1, 1, -1 },
+	{ 0, 1, -1 },
+};
+
+struct Bench_Sample
+{
+	uint64_t time_usec;
+	float    position[3];
+};
+
+// Fraction of a unit step done t seconds after it
+static double
+step_response(double t)
+{
+	double root = sqrt(1 - BENCH_ZETA * BENCH_ZETA);
+	return 1 - exp(-BENCH_ZETA * BENCH_OMEGA * t) / root * sin(BENCH_OMEGA * root * t + acos(BENCH_ZETA));
+}
+
+// The frames of the whole flight, and the positions of the checked legs
+static void
+make_flight(std::vector<mavlink_message_t> &messages, std::vector<Bench_Sample> *kept)
+{
+	mavlink_message_t message;
+	float from[3] = { 0, 0, 0 };
+
+	for ( int leg = 0; leg < BENCH_LEGS; leg++ )
+	{
+		const float *target = corners[leg % 4];
+
+		// 20 ms ticks, the target every fifth
+		for ( int tick = 0; tick < BENCH_LEG * 50; tick++ )
+		{
+			uint32_t boot_ms = ( leg * BENCH_LEG * 50 + tick ) * 20;
+			double   done    = step_response(tick * 0.02);
+
+			float p[3];
+			for ( int i = 0; i < 3; i++ )
+				p[i] = (float)( from[i] + ( target[i] - from[i] ) * done );
+
+			if ( tick % 5 == 0 )
+			{
+				mavlink_msg_position_target_local_ned_pack(1, 1, &message, boot_ms, MAV_FRAME_LOCAL_NED,
+						0, target[0], target[1], target[2], 0, 0, 0, 0, 0, 0, 0, 0);
+				messages.push_back(message);
+			}
+
+			mavlink_msg_local_position_ned_pack(1, 1, &message, boot_ms, p[0], p[1], p[2], 0, 0, 0);
+			messages.push_back(message);
+
+			if ( leg >= BENCH_FIRST_CHECKED and leg < BENCH_FIRST_CHECKED + BENCH_CHECKED )
+			{
+				Bench_Sample sample = { boot_ms * 1000ULL, { p[0], p[1], p[2] } };
+				kept[leg - BENCH_FIRST_CHECKED].push_back(sample);
+			}
+		}
+
+		// where the leg ended is where the next starts
+		for ( int i = 0; i < 3; i++ )
+			from[i] = (float)( from[i] + ( target[i] - from[i] ) * step_response(BENCH_LEG) );
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Reference
+// ------------------------------------------------------------------------------
+// The leg's figures from all of its samples at once
+static Tracking_Leg
+reference(const std::vector<Bench_Sample> &samples, const float from[3], const float target[3])
+{
+	Tracking_Leg leg;
+	memset(&leg, 0, sizeof(leg));
+
+	float d[3];
+	for ( int i = 0; i < 3; i++ )
+	{
+		leg.from[i]   = from[i];
+		leg.target[i] = target[i];
+		d[i]          = target[i] - from[i];
+	}
+	leg.step = sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+
+	double band = 0.05 * leg.step > 0.1 ? 0.05 * leg.step : 0.1;
+	double sum  = 0;
+
+	// the last sample outside the band ends the unsettled part
+	size_t settled = 0;
+
+	for ( size_t k = 0; k < samples.size(); k++ )
+	{
+		const float *p = samples[k].position;
+		float e[3] = { p[0] - target[0], p[1] - target[1], p[2] - target[2] };
+		double error = sqrt(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+
+		sum += error * error;
+		if ( error > leg.max_error )
+			leg.max_error = (float)error;
+		if ( error > band )
+			settled = k + 1;
+
+		double past = ( e[0]*d[0] + e[1]*d[1] + e[2]*d[2] ) / leg.step;
+		if ( past > leg.overshoot )
+			leg.overshoot = (float)past;
+	}
+
+	leg.samples = samples.size();
+	leg.rms     = (float)sqrt(sum / samples.size());
+	leg.settle  = settled < samples.size() ? ( samples[settled].time_usec - samples[0].time_usec ) * 1e-6f : -1.0f;
+
+	double steady = 0;
+	for ( size_t k = settled; k < samples.size(); k++ )
+	{
+		const float *p = samples[k].position;
+		float e[3] = { p[0] - target[0], p[1] - target[1], p[2] - target[2] };
+		steady += sqrt(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+	}
+	leg.steady = (float)( steady / ( samples.size() - settled ) );
+
+	return leg;
+}
+
+static bool
+close(float a, float b)
+{
+	return fabsf(a - b) <= 1e-4f + 1e-4f * fabsf(b);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	std::vector<mavlink_message_t> messages;
+	std::vector<Bench_Sample> kept[BENCH_CHECKED];
+	make_flight(messages, kept);
+
+	std::vector<Frame_View> frames(messages.size());
+	for ( size_t i = 0; i < messages.size(); i++ )
+		frames[i].from_message(messages[i]);
+
+	Tracking_Analyzer *analyzer = new Tracking_Analyzer;
+
+	uint64_t start = get_time_nsec();
+
+	for ( size_t i = 0; i < frames.size(); i++ )
+		analyzer->received(frames[i], 0);
+
+	uint64_t elapsed = get_time_nsec() - start;
+
+	uint64_t cursor = BENCH_FIRST_CHECKED;
+	Tracking_Analyzer::print_header();
+	History_Sample<Tracking_Leg> samples[BENCH_CHECKED];
+	int count = analyzer->legs.read(cursor, samples, BENCH_CHECKED);
+
+	for ( int i = 0; i < count; i++ )
+		Tracking_Analyzer::print_leg(samples[i].value);
+
+	printf("\n%lu messages, %lu legs, %.1f ns per message\n", (unsigned long)frames.size(),
+			(unsigned long)analyzer->legs.pushed(), (double)elapsed / frames.size());
+
+	double root = sqrt(1 - BENCH_ZETA * BENCH_ZETA);
+	printf("second order overshoot %.1f%%\n", 100 * exp(-M_PI * BENCH_ZETA / root));
+
+	// all but the last leg are closed by the next target
+	int failed = 0;
+	if ( analyzer->legs.pushed() != BENCH_LEGS - 1 or count != BENCH_CHECKED )
+	{
+		fprintf(stderr, "ERROR: %llu legs closed\n", (unsigned long long)analyzer->legs.pushed());
+		failed = 1;
+	}
+
+	for ( int i = 0; i < count; i++ )
+	{
+		const Tracking_Leg &leg = samples[i].value;
+		Tracking_Leg r = reference(kept[i], leg.from, leg.target);
+
+		if ( leg.samples != r.samples or not close(leg.step, r.step) or not close(leg.rms, r.rms)
+				or not close(leg.max_error, r.max_error) or not close(leg.overshoot, r.overshoot)
+				or not close(leg.settle, r.settle) or not close(leg.steady, r.steady) )
+		{
+			fprintf(stderr, "ERROR: leg %d differs from the reference\n", i);
+			Tracking_Analyzer::print_leg(r, stderr);
+			failed = 1;
+		}
+	}
+
+	delete analyzer;
+
+	return failed;
+}
+
@@ -0,0 +1,396 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_transport.cpp
+ *
+ * @brief Message throughput of each port over loopback
+ *
+ * For a Serial_Port on a pseudo terminal, a UDP_Port and a TCP_Port, each
+ * talking to a plain file descriptor on the other end of the link:
+ *   rx  the far end writes a burst of frames, the port reads them with
+ *       wait_readable() and read_frames() like the read thread does
+ *   tx  the port sends the burst with write_messages(), the far end drains
+ *       it
+ * and prints messages per second both ways.  Frames UDP lost when the
+ * reader fell behind are counted, not waited for.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "serial_port.h"
+#include "udp_port.h"
+#include "tcp_port.h"
+#include "time_base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Messages per burst
+#define BENCH_MESSAGES 200000
+
+// Loopback port the network transports use
+#define BENCH_PORT 14599
+
+// A link that stays quiet this long is done [ms]
+#define BENCH_IDLE 500
+
+
+// ------------------------------------------------------------------------------
+//   Link
+// ------------------------------------------------------------------------------
+
+/*
+ * The port under test and the descriptor at the other end of its link
+ */
+struct Bench_Link
+{
+	const char   *name;
+	Generic_Port *port;
+	int           far_fd;
+	bool          datagrams;  // one frame per write at the far end
+
+	mavlink_message_t *messages;
+	uint8_t           *stream;
+	unsigned          *offsets;  // of each frame in stream, and its end
+
+	uint64_t drained;  // bytes the far end read back
+};
+
+static void *
+far_writer(void *args)
+{
+	Bench_Link *link  = (Bench_Link *)args;
+	unsigned    total = link->offsets[BENCH_MESSAGES];
+	unsigned    pos   = 0;
+	int         frame = 0;
+
+	while ( pos < total )
+	{
+		// a datagram per frame, or as much of the stream as the link takes
+		unsigned len = link->datagrams ? link->offsets[frame + 1] - pos : total - pos;
+		if ( len > 16384 )
+			len = 16384;
+
+		int result = write(link->far_fd, link->stream + pos, len);
+		if ( result < 0 && (errno == EINTR || errno == EAGAIN || errno == ENOBUFS) )
+		{
+			usleep(100);
+			continue;
+		}
+		if ( result < 0 )
+		{
+			fprintf(stderr, "ERROR: %s far end write failed, %s\n", link->name, strerror(errno));
+			break;
+		}
+
+		pos += result;
+		frame++;
+	}
+
+	return NULL;
+}
+
+static void *
+far_reader(void *args)
+{
+	Bench_Link *link  = (Bench_Link *)args;
+	uint64_t    total = link->offsets[BENCH_MESSAGES];
+	uint8_t     buf[65536];
+
+	link->drained = 0;
+	while ( link->drained < total )
+	{
+		struct pollfd pfd;
+		pfd.fd     = link->far_fd;
+		pfd.events = POLLIN;
+		if ( poll(&pfd, 1, BENCH_IDLE) <= 0 )
+			break;
+
+		int result = read(link->far_fd, buf, sizeof(buf));
+		if ( result <= 0 )
+			break;
+		link->drained += result;
+	}
+
+	return NULL;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Runs
+// ------------------------------------------------------------------------------
+// Messages per second read through the port
+static double
+run_rx(Bench_Link &link, int &received)
+{
+	Frame_View views[GENERIC_PORT_MAX_BATCH];
+	pthread_t  writer_tid;
+
+	received = 0;
+	uint64_t start = get_time_nsec();
+	uint64_t last  = start;
+
+	pthread_create(&writer_tid, NULL, &far_writer, &link);
+
+	while ( received < BENCH_MESSAGES )
+	{
+		int count = link.port->read_frames(views, GENERIC_PORT_MAX_BATCH);
+		if ( count > 0 )
+		{
+			received += count;
+			last = get_time_nsec();
+			continue;
+		}
+		if ( link.port->wait_readable(-1, BENCH_IDLE) <= 0 )
+			break;
+	}
+
+	pthread_join(writer_tid, NULL);
+
+	return last > start ? received * 1e9 / (last - start) : 0;
+}
+
+// Messages per second sent through the port
+static double
+run_tx(Bench_Link &link)
+{
+	pthread_t reader_tid;
+	pthread_create(&reader_tid, NULL, &far_reader, &link);
+
+	uint64_t start = get_time_nsec();
+
+	for ( int i = 0; i < BENCH_MESSAGES; i += GENERIC_PORT_MAX_BATCH )
+	{
+		int batch = BENCH_MESSAGES - i < GENERIC_PORT_MAX_BATCH ? BENCH_MESSAGES - i : GENERIC_PORT_MAX_BATCH;
+		link.port->write_messages(link.messages + i, batch);
+	}
+
+	pthread_join(reader_tid, NULL);
+
+	uint64_t elapsed = get_time_nsec() - start;
+
+	// bytes that made it, in whole messages of the average length
+	double sent = (double)link.drained * BENCH_MESSAGES / link.offsets[BENCH_MESSAGES];
+
+	return sent * 1e9 / elapsed;
+}
+
+static void
+report(Bench_Link &link)
+{
+	int    received;
+	double rx = run_rx(link, received);
+	double tx = run_tx(link);
+
+	printf("%-8s %10.0f msg/s rx %10.0f msg/s tx", link.name, rx, tx);
+	if ( received < BENCH_MESSAGES )
+		printf(", %i of %i lost on rx", BENCH_MESSAGES - received, BENCH_MESSAGES);
+	printf("\n");
+}
+
+
+// ------------------------------------------------------------------------------
+//   Links
+// ------------------------------------------------------------------------------
+
+// Serial_Port on the slave side of a pseudo terminal
+static int
+open_pty(char *slave_name, size_t size)
+{
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ( master < 0 || grantpt(master) || unlockpt(master) || not ptsname(master) )
+	{
+		fprintf(stderr, "ERROR: could not open a pseudo terminal, %s\n", strerror(errno));
+		exit(1);
+	}
+	strncpy(slave_name, ptsname(master), size - 1);
+	slave_name[size - 1] = '\0';
+
+	struct termios config;
+	tcgetattr(master, &config);
+	cfmakeraw(&config);
+	tcsetattr(master, TCSANOW, &config);
+
+	return master;
+}
+
+// A UDP socket sending to the UDP_Port bound on loopback
+static int
+open_udp_peer()
+{
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family      = AF_INET;
+	address.sin_port        = htons(BENCH_PORT);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ( sock < 0 || connect(sock, (struct sockaddr *)&address, sizeof(address)) )
+	{
+		fprintf(stderr, "ERROR: could not open the UDP peer, %s\n", strerror(errno));
+		exit(1);
+	}
+	return sock;
+}
+
+// A listening socket the TCP_Port connects to
+static int
+open_tcp_listener()
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	int on   = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family      = AF_INET;
+	address.sin_port        = htons(BENCH_PORT);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ( sock < 0 || bind(sock, (struct sockaddr *)&address, sizeof(address)) || listen(sock, 1) )
+	{
+		fprintf(stderr, "ERROR: could not listen on TCP port %d, %s\n", BENCH_PORT, strerror(errno));
+		exit(1);
+	}
+	return sock;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	// telemetry sized messages, the setpoint stream is the same size class
+	mavlink_message_t *messages = new mavlink_message_t[BENCH_MESSAGES];
+	for ( int i = 0; i < BENCH_MESSAGES; i++ )
+	{
+		if ( i & 1 )
+			mavlink_msg_attitude_pack(1, 1, &messages[i], i, 0.1f, 0.2f, 0.3f, 0, 0, 0);
+		else
+			mavlink_msg_local_position_ned_pack(1, 1, &messages[i], i, 1, 2, 3, 0, 0, 0);
+	}
+
+	Bench_Link link;
+	link.messages = messages;
+	link.stream   = (uint8_t *)malloc(BENCH_MESSAGES * MAVLINK_MAX_PACKET_LEN);
+	link.offsets  = (unsigned *)malloc((BENCH_MESSAGES + 1) * sizeof(unsigned));
+
+	link.offsets[0] = 0;
+	for ( int i = 0; i < BENCH_MESSAGES; i++ )
+		link.offsets[i + 1] = link.offsets[i] + mavlink_msg_to_send_buffer(link.stream + link.offsets[i], &messages[i]);
+
+	try
+	{
+		// pty, as fast as the kernel moves it, the baud rate is not emulated
+		char slave_name[64];
+		int  master = open_pty(slave_name, sizeof(slave_name));
+		Serial_Port serial_port(slave_name, 921600);
+		serial_port.start();
+
+		link.name      = "pty";
+		link.port      = &serial_port;
+		link.far_fd    = master;
+		link.datagrams = false;
+		report(link);
+
+		serial_port.stop();
+		close(master);
+
+		// udp, the first datagram makes the peer known for tx
+		UDP_Port udp_port("127.0.0.1", BENCH_PORT, false);
+		udp_port.start();
+		int udp_peer = open_udp_peer();
+
+		link.name      = "udp";
+		link.port      = &udp_port;
+		link.far_fd    = udp_peer;
+		link.datagrams = true;
+		report(link);
+
+		udp_port.stop();
+		close(udp_peer);
+
+		// tcp, connect() completes against the backlog before accept()
+		int listener = open_tcp_listener();
+		TCP_Port tcp_port("127.0.0.1", BENCH_PORT);
+		tcp_port.start();
+		int tcp_peer = accept(listener, NULL, NULL);
+
+		link.name      = "tcp";
+		link.port      = &tcp_port;
+		link.far_fd    = tcp_peer;
+		link.datagrams = false;
+		report(link);
+
+		tcp_port.stop();
+		close(tcp_peer);
+		close(listener);
+	}
+	catch ( int error )
+	{
+		fprintf(stderr, "ERROR: could not open a port\n");
+		return error;
+	}
+
+	free(link.offsets);
+	free(link.stream);
+	delete[] messages;
+
+	return 0;
+}
+
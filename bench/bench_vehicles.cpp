@@ -0,0 +1,171 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file bench_vehicles.cpp
+ *
+ * @brief Receive path cost per message against the number of senders
+ *
+ * Feeds the same message mix from 1 to VEHICLE_TABLE_MAX senders through
+ * Vehicle_Table::insert() and the per vehicle Message_Dispatch slots, the
+ * work Autopilot_Interface::handle_message() does for every message, and
+ * prints the time per message.  With the table doing its job the column
+ * stays flat as the sender count grows.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "autopilot_interface.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Messages handled per run
+#define BENCH_MESSAGES 4000000
+
+// Distinct messages cycled through, a multiple of every sender count
+#define BENCH_RING 4096
+
+
+// ------------------------------------------------------------------------------
+//   Message Mix
+// ------------------------------------------------------------------------------
+// Senders take turns, like several vehicles and their cameras sharing a
+// radio, each sending mostly attitude and position with a heartbeat mixed in
+static void
+make_messages(mavlink_message_t *messages, int senders)
+{
+	for ( int i = 0; i < BENCH_RING; i++ )
+	{
+		int     sender = i % senders;
+		uint8_t sysid  = (uint8_t)(1 + sender / 2);
+		uint8_t compid = (sender & 1) ? MAV_COMP_ID_CAMERA : 1;
+		int     turn   = i / senders;
+
+		if ( turn % 10 == 0 )
+			mavlink_msg_heartbeat_pack(sysid, compid, &messages[i], MAV_TYPE_QUADROTOR, MAV_AUTOPILOT_PX4, 0, 0, 0);
+		else if ( turn & 1 )
+			mavlink_msg_attitude_pack(sysid, compid, &messages[i], i, 0.1f, 0.2f, 0.3f, 0, 0, 0);
+		else
+			mavlink_msg_local_position_ned_pack(sysid, compid, &messages[i], i, 1, 2, 3, 0, 0, 0);
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Run
+// ------------------------------------------------------------------------------
+// Nanoseconds per message for the given sender count
+static double
+run(const Frame_View *frames, int senders, bool use_table)
+{
+	Vehicle_Table<Mavlink_Messages> *vehicles = new Vehicle_Table<Mavlink_Messages>;
+	Mavlink_Messages                *single   = new Mavlink_Messages;
+	Message_Dispatch                 dispatch;
+
+	Mavlink_Messages &m = *single;
+	dispatch.subscribe(m, m.heartbeat);
+	dispatch.subscribe(m, m.attitude);
+	dispatch.subscribe(m, m.local_position_ned);
+
+	uint64_t start = get_time_nsec();
+
+	for ( int i = 0; i < BENCH_MESSAGES; i++ )
+	{
+		const Frame_View &frame = frames[i & (BENCH_RING - 1)];
+
+		Mavlink_Messages *vehicle = single;
+		if ( use_table )
+			vehicle = vehicles->insert(frame.sysid, frame.compid);
+
+		vehicle->messages++;
+		dispatch.dispatch(frame, i, vehicle);
+	}
+
+	uint64_t elapsed = get_time_nsec() - start;
+
+	if ( use_table && vehicles->size() != senders )
+	{
+		fprintf(stderr, "expected %i senders, the table has %i\n", senders, vehicles->size());
+		exit(1);
+	}
+
+	delete vehicles;
+	delete single;
+
+	return (double)elapsed / BENCH_MESSAGES;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	mavlink_message_t *messages = new mavlink_message_t[BENCH_RING];
+	Frame_View        *frames   = new Frame_View[BENCH_RING];
+
+	printf("%-10s %14s %14s %14s\n", "senders", "one struct", "vehicle table", "table memory");
+
+	for ( int senders = 1; senders <= VEHICLE_TABLE_MAX; senders *= 2 )
+	{
+		make_messages(messages, senders);
+		for ( int i = 0; i < BENCH_RING; i++ )
+			frames[i].from_message(messages[i]);
+
+		double flat  = run(frames, senders, false);
+		double table = run(frames, senders, true);
+
+		printf("%-10i %11.1f ns %11.1f ns %11u KB\n", senders, flat, table,
+				(unsigned)((sizeof(Vehicle_Table<Mavlink_Messages>) + senders * sizeof(Mavlink_Messages) + 1023) / 1024));
+	}
+
+	delete[] frames;
+	delete[] messages;
+
+	return 0;
+}
+
@@ -0,0 +1,394 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file flight_analysis.cpp
+ *
+ * @brief Post flight analysis of a recorded log
+ *
+ * Loads the position, attitude, IMU and HUD messages of a log written with
+ * mavlink_control -l (or a tlog or raw dump) into columns, resamples them
+ * to a common clock and prints how well the vehicle tracked its position
+ * targets, and whether its reported velocities and climb rate agree with
+ * its positions and altitude.  Optionally writes the resampled columns as
+ * CSV.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "telemetry_columns.h"
+#include "log_replay.h"
+#include "time_base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Common clock the streams are compared on [Hz]
+#define FLIGHT_ANALYSIS_RATE 50
+
+
+// ------------------------------------------------------------------------------
+//   Options
+// ------------------------------------------------------------------------------
+
+struct Flight_Analysis_Options
+{
+	const char *log_path;
+	const char *csv_path;
+	double      rate;
+};
+
+static void
+parse_commandline(int argc, char **argv, Flight_Analysis_Options &options)
+{
+	const char *commandline_usage = "usage: flight_analysis -f <flight log> [-r <common clock Hz>] [-o <csv of the resampled columns>]";
+
+	for (int i = 1; i < argc; i++) {
+
+		// Help
+		if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+			printf("%s\n",commandline_usage);
+			throw EXIT_FAILURE;
+		}
+
+		// Log to analyse
+		if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--file") == 0) {
+			if (argc > i + 1) {
+				options.log_path = argv[i + 1];
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Common clock
+		if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--rate") == 0) {
+			if (argc > i + 1 && atof(argv[i + 1]) > 0) {
+				options.rate = atof(argv[i + 1]);
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// CSV output
+		if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
+			if (argc > i + 1) {
+				options.csv_path = argv[i + 1];
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+	}
+
+	if ( options.log_path == NULL )
+	{
+		printf("%s\n",commandline_usage);
+		throw EXIT_FAILURE;
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Resampled Columns
+// ------------------------------------------------------------------------------
+// Named columns of stream on clock, which must have been set up for stream
+static void
+resample(const Telemetry_Stream &stream, const Telemetry_Clock &clock, int columns,
+		const char *const *names, std::vector<float> *out)
+{
+	for ( int c = 0; c < columns; c++ )
+	{
+		const std::vector<float> *column = stream.column(names[c]);
+		out[c].resize(clock.count);
+		telemetry_resample(&(*column)[0], clock, &out[c][0]);
+	}
+}
+
+// Ticks of period from the later start to the earlier end of a and b, 0
+// if they do not overlap
+static size_t
+common_clock(const Telemetry_Stream &a, const Telemetry_Stream &b, double period, double &start)
+{
+	if ( a.size() < 2 || b.size() < 2 )
+		return 0;
+
+	start = a.time.front() > b.time.front() ? a.time.front() : b.time.front();
+	double end = a.time.back() < b.time.back() ? a.time.back() : b.time.back();
+
+	return end > start ? (size_t)((end - start) / period) + 1 : 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Analyses
+// ------------------------------------------------------------------------------
+// Position against position target, per axis and in 3D
+static void
+analyse_tracking(const Telemetry_Columns &columns, double period)
+{
+	static const char *axes[] = { "x", "y", "z" };
+
+	double start;
+	size_t count = common_clock(columns.local_position, columns.position_target, period, start);
+	if ( not count )
+	{
+		printf("TRACKING ERROR       no position and target to compare\n");
+		return;
+	}
+
+	Telemetry_Clock    position_clock, target_clock;
+	std::vector<float> position[3], target[3];
+
+	telemetry_clock(columns.local_position,  start, period, count, position_clock);
+	telemetry_clock(columns.position_target, start, period, count, target_clock);
+	resample(columns.local_position,  position_clock, 3, axes, position);
+	resample(columns.position_target, target_clock,   3, axes, target);
+
+	double total = 0;
+	printf("TRACKING ERROR       over %.1f s\n", count * period);
+
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		double squared = telemetry_squared_error(&position[axis][0], &target[axis][0], count);
+		total += squared;
+
+		printf("    %-4s rms %8.3f m   max %8.3f m\n", axes[axis], sqrt(squared / count),
+				telemetry_max_error(&position[axis][0], &target[axis][0], count));
+	}
+
+	printf("    3D   rms %8.3f m\n", sqrt(total / count));
+}
+
+// Reported velocity against the derivative of position
+static void
+analyse_velocity(const Telemetry_Columns &columns, double period)
+{
+	static const char *names[] = { "x", "y", "z", "vx", "vy", "vz" };
+
+	const Telemetry_Stream &stream = columns.local_position;
+	if ( stream.size() < 2 )
+		return;
+
+	double start = stream.time.front();
+	size_t count = (size_t)((stream.time.back() - start) / period) + 1;
+
+	Telemetry_Clock    clock;
+	std::vector<float> resampled[6];
+	std::vector<float> derivative(count);
+
+	telemetry_clock(stream, start, period, count, clock);
+	resample(stream, clock, 6, names, resampled);
+
+	printf("VELOCITY             reported against d/dt position\n");
+
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		telemetry_differentiate(&resampled[axis][0], count, period, &derivative[0]);
+
+		printf("    %-4s rms %8.3f m/s max %8.3f m/s\n", names[axis + 3],
+				sqrt(telemetry_squared_error(&derivative[0], &resampled[axis + 3][0], count) / count),
+				telemetry_max_error(&derivative[0], &resampled[axis + 3][0], count));
+	}
+}
+
+// HUD climb rate against the derivative of the IMU's pressure altitude
+static void
+analyse_climb(const Telemetry_Columns &columns, double period)
+{
+	static const char *altitude[] = { "pressure_alt" };
+	static const char *climb[]    = { "climb" };
+
+	double start;
+	size_t count = common_clock(columns.highres_imu, columns.vfr_hud, period, start);
+	if ( not count )
+		return;
+
+	Telemetry_Clock    imu_clock, hud_clock;
+	std::vector<float> alt, rate;
+	std::vector<float> derivative(count);
+
+	telemetry_clock(columns.highres_imu, start, period, count, imu_clock);
+	telemetry_clock(columns.vfr_hud,     start, period, count, hud_clock);
+	resample(columns.highres_imu, imu_clock, 1, altitude, &alt);
+	resample(columns.vfr_hud,     hud_clock, 1, climb,    &rate);
+
+	telemetry_differentiate(&alt[0], count, period, &derivative[0]);
+
+	// NED altitude rises as the vehicle climbs, like VFR_HUD's climb
+	printf("CLIMB                HUD against d/dt pressure altitude\n");
+	printf("    rms %8.3f m/s max %8.3f m/s\n",
+			sqrt(telemetry_squared_error(&derivative[0], &rate[0], count) / count),
+			telemetry_max_error(&derivative[0], &rate[0], count));
+}
+
+
+// ------------------------------------------------------------------------------
+//   CSV
+// ------------------------------------------------------------------------------
+// Every column of every stream that has samples, on one clock over the log
+static void
+write_csv(const Telemetry_Columns &columns, double period, const char *path)
+{
+	const Telemetry_Stream *all[] = { &columns.local_position, &columns.position_target,
+	                                  &columns.attitude, &columns.highres_imu, &columns.vfr_hud };
+
+	double end = 0;
+	for ( int i = 0; i < 5; i++ )
+		if ( all[i]->size() && all[i]->time.back() > end )
+			end = all[i]->time.back();
+
+	size_t count = (size_t)(end / period) + 1;
+
+	std::vector< std::vector<float> > out;
+	std::vector<const char *>         stream_names, column_names;
+
+	for ( int i = 0; i < 5; i++ )
+	{
+		const Telemetry_Stream &s = *all[i];
+		if ( not s.size() )
+			continue;
+
+		Telemetry_Clock clock;
+		telemetry_clock(s, 0, period, count, clock);
+
+		for ( int c = 0; c < s.columns; c++ )
+		{
+			out.push_back(std::vector<float>(count));
+			telemetry_resample(&s.values[c][0], clock, &out.back()[0]);
+			stream_names.push_back(s.name);
+			column_names.push_back(s.names[c]);
+		}
+	}
+
+	FILE *file = fopen(path, "w");
+	if ( file == NULL )
+	{
+		fprintf(stderr, "ERROR: could not write %s\n", path);
+		throw 1;
+	}
+
+	fprintf(file, "time");
+	for ( size_t c = 0; c < out.size(); c++ )
+		fprintf(file, ",%s.%s", stream_names[c], column_names[c]);
+	fprintf(file, "\n");
+
+	for ( size_t k = 0; k < count; k++ )
+	{
+		fprintf(file, "%.4f", k * period);
+		for ( size_t c = 0; c < out.size(); c++ )
+			fprintf(file, ",%g", out[c][k]);
+		fprintf(file, "\n");
+	}
+
+	fclose(file);
+
+	printf("WROTE %s, %lu rows of %lu columns\n", path, (unsigned long)count, (unsigned long)out.size());
+}
+
+
+// ------------------------------------------------------------------------------
+//   Main
+// ------------------------------------------------------------------------------
+int
+main(int argc, char **argv)
+{
+	// This program uses throw, wrap one big try/catch here
+	try
+	{
+		Flight_Analysis_Options options;
+		options.log_path = NULL;
+		options.csv_path = NULL;
+		options.rate     = FLIGHT_ANALYSIS_RATE;
+
+		parse_commandline(argc, argv, options);
+
+		double period = 1.0 / options.rate;
+
+		Log_Replay log(options.log_path, 0);
+		log.start();
+
+		uint64_t start = get_time_usec();
+
+		Telemetry_Columns columns;
+		columns.load(log);
+
+		uint64_t loaded = get_time_usec();
+
+		printf("AUTOPILOT            %i/%i, %lu of %lu frames skipped, from other senders\n",
+				columns.sysid, columns.compid, (unsigned long)columns.skipped, (unsigned long)columns.frames);
+		columns.print();
+		printf("\n");
+
+		analyse_tracking(columns, period);
+		analyse_velocity(columns, period);
+		analyse_climb(columns, period);
+
+		uint64_t analysed = get_time_usec();
+
+		printf("\n");
+		printf("TIME                 load %.1f ms, analysis %.1f ms at %g Hz\n",
+				(loaded - start) / 1e3, (analysed - loaded) / 1e3, options.rate);
+
+		if ( options.csv_path )
+			write_csv(columns, period, options.csv_path);
+
+		log.stop();
+	}
+
+	catch ( int error )
+	{
+		fprintf(stderr,"flight_analysis threw exception %i \n" , error);
+		return error;
+	}
+
+	return 0;
+}
+
+
@@ -0,0 +1,564 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file flight_recorder.cpp
+ *
+ * @brief Binary flight recorder
+ *
+ * Functions for handing frames to the writer thread and appending them to
+ * the mapped log file
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "flight_recorder.h"
+#include "time_base.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/mavlink.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+
+// ----------------------------------------------------------------------------------
+//   Flight Recorder Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Flight_Recorder::
+Flight_Recorder()
+{
+	records      = 0;
+	bytes        = 0;
+	dropped      = 0;
+	index_blocks = 0;
+
+	for ( int i = 0; i < 2; i++ )
+	{
+		rings[i].buffer = NULL;
+		rings[i].head   = 0;
+		rings[i].tail   = 0;
+	}
+
+	fd          = -1;
+	running     = false;
+	producers   = 0;
+	failed      = false;
+	exit_writer = false;
+	writer_tid  = 0;
+
+	header          = NULL;
+	window          = NULL;
+	window_start    = 0;
+	length          = 0;
+	last_index      = 0;
+	last_index_time = 0;
+}
+
+Flight_Recorder::
+~Flight_Recorder()
+{
+	close();
+}
+
+
+// ------------------------------------------------------------------------------
+//   Open Log
+// ------------------------------------------------------------------------------
+// throws 1 if the file could not be created
+void
+Flight_Recorder::
+open(const char *path)
+{
+	failed = false;
+
+	fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if ( fd < 0 )
+	{
+		fprintf(stderr,"ERROR: could not create flight log %s\n", path);
+		throw 1;
+	}
+
+	// first chunk, and the header at its start mapped on its own so it stays
+	// reachable once the window moves on
+	map_chunk(0);
+	header = (Flight_Record_File_Header *)mmap(NULL, sizeof(Flight_Record_File_Header),
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if ( window == NULL || header == MAP_FAILED )
+	{
+		fprintf(stderr,"ERROR: could not map flight log %s\n", path);
+		header = NULL;
+		close();
+		throw 1;
+	}
+
+	for ( int i = 0; i < 2; i++ )
+	{
+		rings[i].buffer = (uint8_t *)malloc(FLIGHT_RECORDER_RING);
+		rings[i].head   = 0;
+		rings[i].tail   = 0;
+	}
+
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, FLIGHT_RECORDER_MAGIC, sizeof(header->magic));
+	header->version         = FLIGHT_RECORDER_VERSION;
+	header->header_size     = sizeof(Flight_Record_File_Header);
+	header->wall_time_usec  = get_wall_time_usec();
+	header->start_time_usec = get_time_usec();
+
+	length          = sizeof(Flight_Record_File_Header);
+	last_index      = 0;
+	last_index_time = 0;
+	header->length  = length;
+
+	printf("RECORDING TO %s\n", path);
+
+	// start the writer, then let producers in
+	exit_writer = false;
+	int result = pthread_create( &writer_tid, NULL, &start_flight_recorder_writer_thread, this );
+	if ( result ) throw result;
+
+	__atomic_store_n(&running, true, __ATOMIC_RELEASE);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Close Log
+// ------------------------------------------------------------------------------
+// Stop recording before this, i.e. close after the serial port has stopped
+void
+Flight_Recorder::
+close()
+{
+	// keep new frames out, and let copies already under way finish before
+	// the rings go away
+	__atomic_store_n(&running, false, __ATOMIC_SEQ_CST);
+	while ( __atomic_load_n(&producers, __ATOMIC_SEQ_CST) )
+		sched_yield();
+
+	// the writer empties the rings one last time on its way out
+	if ( writer_tid )
+	{
+		__atomic_store_n(&exit_writer, true, __ATOMIC_RELEASE);
+		pthread_join(writer_tid, NULL);
+		writer_tid = 0;
+	}
+
+	if ( window )
+	{
+		munmap(window, FLIGHT_RECORDER_CHUNK);
+		window = NULL;
+	}
+
+	if ( header )
+	{
+		msync(header, sizeof(*header), MS_SYNC);
+		munmap(header, sizeof(*header));
+		header = NULL;
+	}
+
+	// give back the preallocated space that was not used
+	if ( fd >= 0 )
+	{
+		if ( length && ftruncate(fd, length) < 0 )
+			fprintf(stderr,"WARNING: could not trim flight log\n");
+		::close(fd);
+		fd = -1;
+	}
+
+	for ( int i = 0; i < 2; i++ )
+	{
+		free(rings[i].buffer);
+		rings[i].buffer = NULL;
+	}
+}
+
+bool
+Flight_Recorder::
+is_open() const
+{
+	return __atomic_load_n(&running, __ATOMIC_ACQUIRE);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Record
+// ------------------------------------------------------------------------------
+// Called by the thread producing frames of this type.  Never blocks.
+void
+Flight_Recorder::
+record(uint8_t type, const uint8_t *frame, unsigned len, uint64_t time_usec)
+{
+	// not something a record can hold, still lost from the log
+	if ( type > FLIGHT_RECORD_TX || len > FLIGHT_RECORDER_MAX_RECORD )
+	{
+		__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	// announce the copy before looking at running, close() does the
+	// opposite, so one of the two always sees the other
+	__atomic_add_fetch(&producers, 1, __ATOMIC_SEQ_CST);
+
+	if ( not __atomic_load_n(&running, __ATOMIC_SEQ_CST) )
+	{
+		if ( __atomic_load_n(&failed, __ATOMIC_RELAXED) )
+			__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&producers, 1, __ATOMIC_RELEASE);
+		return;
+	}
+
+	Ring &ring = rings[type];
+
+	uint32_t tail = __atomic_load_n(&ring.tail, __ATOMIC_RELAXED);
+	uint32_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+	unsigned need = sizeof(Flight_Record_Header) + len;
+
+	// writer fell behind, losing a frame beats stalling the link
+	if ( FLIGHT_RECORDER_RING - (tail - head) < need )
+	{
+		__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&producers, 1, __ATOMIC_RELEASE);
+		return;
+	}
+
+	Flight_Record_Header record;
+	record.time_usec = time_usec;
+	record.length    = (uint16_t)len;
+	record.type      = type;
+	record.reserved  = 0;
+
+	ring_put(ring, tail, &record, sizeof(record));
+	ring_put(ring, tail + sizeof(record), frame, len);
+
+	__atomic_store_n(&ring.tail, tail + need, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&producers, 1, __ATOMIC_RELEASE);
+}
+
+// Frames laid back to back, as written in one go; a record each, so the
+// file keeps one frame per record.  A frame cut off at the end was not
+// sent whole and is left out.
+void
+Flight_Recorder::
+record_frames(uint8_t type, const uint8_t *frames, unsigned length, uint64_t time_usec)
+{
+	for ( unsigned pos = 0; pos + MAVLINK_NUM_HEADER_BYTES <= length; )
+	{
+		unsigned frame_length = frames[pos + 1] + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+		if ( pos + frame_length > length )
+			break;
+
+		record(type, frames + pos, frame_length, time_usec);
+		pos += frame_length;
+	}
+}
+
+void
+Flight_Recorder::
+ring_put(Ring &ring, uint32_t at, const void *data, unsigned len)
+{
+	unsigned pos   = at & (FLIGHT_RECORDER_RING - 1);
+	unsigned first = FLIGHT_RECORDER_RING - pos;
+	if ( first > len )
+		first = len;
+
+	memcpy(ring.buffer + pos, data, first);
+	memcpy(ring.buffer, (const uint8_t *)data + first, len - first);
+}
+
+void
+Flight_Recorder::
+ring_get(const Ring &ring, uint32_t at, void *out, unsigned len)
+{
+	unsigned pos   = at & (FLIGHT_RECORDER_RING - 1);
+	unsigned first = FLIGHT_RECORDER_RING - pos;
+	if ( first > len )
+		first = len;
+
+	memcpy(out, ring.buffer + pos, first);
+	memcpy((uint8_t *)out + first, ring.buffer, len - first);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Writer Thread
+// ------------------------------------------------------------------------------
+void
+Flight_Recorder::
+start_writer_thread()
+{
+	writer_thread();
+}
+
+void
+Flight_Recorder::
+writer_thread()
+{
+	while ( not __atomic_load_n(&exit_writer, __ATOMIC_ACQUIRE) )
+	{
+		drain();
+		usleep(FLIGHT_RECORDER_FLUSH_INTERVAL);
+	}
+
+	drain();
+}
+
+// Moves everything queued in the rings to the file, oldest record first
+void
+Flight_Recorder::
+drain()
+{
+	uint8_t buf[sizeof(Flight_Record_Header) + FLIGHT_RECORDER_MAX_RECORD];
+
+	while ( true )
+	{
+		// ----------------------------------------------------------------------
+		//   PICK THE OLDER OF THE TWO NEXT RECORDS
+		// ----------------------------------------------------------------------
+		Flight_Record_Header next[2];
+		bool have[2];
+
+		for ( int i = 0; i < 2; i++ )
+		{
+			uint32_t head = rings[i].head;
+			uint32_t tail = __atomic_load_n(&rings[i].tail, __ATOMIC_ACQUIRE);
+
+			have[i] = ( head != tail );
+			if ( have[i] )
+				ring_get(rings[i], head, &next[i], sizeof(next[i]));
+		}
+
+		if ( not have[0] && not have[1] )
+			break;
+
+		int i = ( have[0] && ( not have[1] || next[0].time_usec <= next[1].time_usec ) ) ? 0 : 1;
+
+		// ----------------------------------------------------------------------
+		//   APPEND IT
+		// ----------------------------------------------------------------------
+		unsigned size = sizeof(Flight_Record_Header) + next[i].length;
+
+		if ( not failed )
+		{
+			uint64_t before_length = length;
+			uint64_t before_index  = last_index;
+
+			if ( next[i].time_usec >= last_index_time + FLIGHT_RECORDER_INDEX_INTERVAL )
+				write_index(next[i].time_usec);
+
+			ring_get(rings[i], rings[i].head, buf, size);
+			append(buf, size);
+
+			// the file stopped growing part way, leave no half record behind
+			if ( failed )
+			{
+				length     = before_length;
+				last_index = before_index;
+			}
+		}
+
+		__atomic_store_n(&rings[i].head, rings[i].head + size, __ATOMIC_RELEASE);
+
+		if ( failed )
+		{
+			__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		records++;
+		bytes += size;
+	}
+
+	// readers of a file cut short trust the header
+	if ( header )
+	{
+		header->length     = length;
+		header->last_index = last_index;
+		header->records    = records;
+	}
+}
+
+// Index records chain back to the start of the file, a reader walks the
+// chain from header.last_index to find where each second starts
+void
+Flight_Recorder::
+write_index(uint64_t time_usec)
+{
+	Flight_Record_Header record;
+	record.time_usec = time_usec;
+	record.length    = sizeof(Flight_Record_Index);
+	record.type      = FLIGHT_RECORD_INDEX;
+	record.reserved  = 0;
+
+	Flight_Record_Index index;
+	index.previous = last_index;
+	index.records  = records;
+
+	last_index      = length;
+	last_index_time = time_usec;
+
+	append(&record, sizeof(record));
+	append(&index, sizeof(index));
+
+	index_blocks++;
+}
+
+
+// ------------------------------------------------------------------------------
+//   File Mapping
+// ------------------------------------------------------------------------------
+// Copies into the mapped file, moving the window on at the end of a chunk
+void
+Flight_Recorder::
+append(const void *data, unsigned len)
+{
+	const uint8_t *src = (const uint8_t *)data;
+
+	while ( len )
+	{
+		if ( length >= window_start + FLIGHT_RECORDER_CHUNK )
+			map_chunk(window_start + FLIGHT_RECORDER_CHUNK);
+
+		// could not grow the file, nothing more will fit
+		if ( window == NULL )
+			return;
+
+		unsigned room = (unsigned)(window_start + FLIGHT_RECORDER_CHUNK - length);
+		unsigned n    = len < room ? len : room;
+
+		memcpy(window + (length - window_start), src, n);
+
+		length += n;
+		src    += n;
+		len    -= n;
+	}
+}
+
+// Preallocates the chunk at offset and maps it in place of the current one
+void
+Flight_Recorder::
+map_chunk(uint64_t offset)
+{
+	if ( window )
+	{
+		// start write back of the finished chunk, don't wait for it
+		msync(window, FLIGHT_RECORDER_CHUNK, MS_ASYNC);
+		munmap(window, FLIGHT_RECORDER_CHUNK);
+		window = NULL;
+	}
+
+	// Reserve the blocks now, so the card is not allocating while we fly.
+	// Only file systems without fallocate get a sparse file instead; on any
+	// other error, e.g. a full card, writing into a sparse mapping would
+	// end in SIGBUS, so recording stops.
+	int error = posix_fallocate(fd, offset, FLIGHT_RECORDER_CHUNK);
+	if ( error == EOPNOTSUPP || error == EINVAL )
+		error = ftruncate(fd, offset + FLIGHT_RECORDER_CHUNK) < 0 ? errno : 0;
+
+	if ( error )
+	{
+		fprintf(stderr,"ERROR: could not grow flight log, %s, recording stopped\n", strerror(error));
+		stop_recording();
+		return;
+	}
+
+	void *mapped = mmap(NULL, FLIGHT_RECORDER_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+	if ( mapped == MAP_FAILED )
+	{
+		fprintf(stderr,"ERROR: could not map flight log, recording stopped\n");
+		stop_recording();
+		return;
+	}
+
+	window       = (uint8_t *)mapped;
+	window_start = offset;
+}
+
+
+// Refuses further frames, those still queued are counted as dropped.  The
+// rings stay until close(), producers may be copying into them.
+void
+Flight_Recorder::
+stop_recording()
+{
+	__atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+	__atomic_store_n(&running, false, __ATOMIC_SEQ_CST);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+Flight_Recorder::
+print_stats()
+{
+	printf("RECORDER  %llu records, %llu bytes, %llu index blocks, %llu dropped%s\n",
+			(unsigned long long)records, (unsigned long long)bytes,
+			(unsigned long long)index_blocks,
+			(unsigned long long)__atomic_load_n(&dropped, __ATOMIC_RELAXED),
+			__atomic_load_n(&failed, __ATOMIC_RELAXED) ? ", stopped, the file could not grow" : "");
+}
+
+
+// ------------------------------------------------------------------------------
+//  Pthread Starter Helper Functions
+// ------------------------------------------------------------------------------
+
+void*
+start_flight_recorder_writer_thread(void *args)
+{
+	// takes a flight recorder object argument
+	Flight_Recorder *flight_recorder = (Flight_Recorder *)args;
+
+	// run the object's writer thread
+	flight_recorder->start_writer_thread();
+
+	// done!
+	return NULL;
+}
+
+
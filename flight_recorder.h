@@ -0,0 +1,219 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file flight_recorder.h
+ *
+ * @brief Binary flight recorder
+ *
+ * Records every MAVLink frame sent and received, with its monotonic time
+ * stamp, to a memory mapped, append-only log file.
+ *
+ */
+
+#ifndef FLIGHT_RECORDER_H_
+#define FLIGHT_RECORDER_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+#define FLIGHT_RECORDER_MAGIC   "MAVFREC1"
+#define FLIGHT_RECORDER_VERSION 1
+
+// Record types
+#define FLIGHT_RECORD_RX    0 // frame received from the autopilot
+#define FLIGHT_RECORD_TX    1 // frame sent to the autopilot
+#define FLIGHT_RECORD_INDEX 2 // Flight_Record_Index, for seeking
+
+// The file grows by this much at a time, preallocated and mapped [bytes]
+#define FLIGHT_RECORDER_CHUNK (16*1024*1024)
+
+// Handoff buffer between each recording thread and the writer [bytes]
+// must be a power of two; 1 MB holds over ten seconds at 921600 baud
+#define FLIGHT_RECORDER_RING (1024*1024)
+
+// Longest record payload accepted, a MAVLink 1 frame is at most 263 bytes
+#define FLIGHT_RECORDER_MAX_RECORD 512
+
+// How often the writer thread empties the handoff buffers [us]
+#define FLIGHT_RECORDER_FLUSH_INTERVAL 10000
+
+// An index record is written at least this often [us]
+#define FLIGHT_RECORDER_INDEX_INTERVAL 1000000
+
+
+// ------------------------------------------------------------------------------
+//   File Format
+// ------------------------------------------------------------------------------
+/*
+ * The file starts with a Flight_Record_File_Header, followed by records,
+ * each a Flight_Record_Header and then length bytes: a complete MAVLink frame
+ * for RX and TX records, a Flight_Record_Index for INDEX records.  Index
+ * records form a chain back to the start of the file, last_index in the
+ * file header points at the newest one.  Everything is little endian.
+ *
+ * The header is updated after every flush, so a file cut short by a crash
+ * is valid up to header.length.
+ */
+struct Flight_Record_File_Header
+{
+	char     magic[8];        // FLIGHT_RECORDER_MAGIC
+	uint32_t version;         // FLIGHT_RECORDER_VERSION
+	uint32_t header_size;     // sizeof(Flight_Record_File_Header)
+	uint64_t wall_time_usec;  // wall clock when recording started
+	uint64_t start_time_usec; // monotonic clock at the same moment
+	uint64_t length;          // bytes of the file in use, header included
+	uint64_t last_index;      // offset of the newest index record, 0 if none
+	uint64_t records;         // frames recorded
+	uint64_t reserved;
+};
+
+struct Flight_Record_Header
+{
+	uint64_t time_usec;       // monotonic time the frame was read or sent
+	uint16_t length;          // bytes following this header
+	uint8_t  type;            // FLIGHT_RECORD_RX, _TX or _INDEX
+	uint8_t  reserved;
+} __attribute__((packed));
+
+struct Flight_Record_Index
+{
+	uint64_t previous;        // offset of the previous index record, 0 if none
+	uint64_t records;         // frames recorded before this point
+};
+
+
+// ------------------------------------------------------------------------------
+//   Prototypes
+// ------------------------------------------------------------------------------
+
+void* start_flight_recorder_writer_thread(void *args);
+
+
+// ----------------------------------------------------------------------------------
+//   Flight Recorder Class
+// ----------------------------------------------------------------------------------
+/*
+ * Flight Recorder Class
+ *
+ * record() copies the frame into a single producer ring for its direction
+ * and returns; it never takes a lock, never touches the file and drops the
+ * frame (counted) rather than wait if the ring is full.  record_frames()
+ * records each whole frame of a batch sent with one write.  A writer thread
+ * merges both rings in time order into the file, which is mapped in
+ * preallocated chunks so appending is a memcpy.
+ *
+ * Each direction must only be recorded from one thread at a time: the
+ * serial port records RX from the read thread and TX under its write lock.
+ * record() may still be called while or after close() runs, it then does
+ * nothing; close() waits for copies already under way before freeing the
+ * rings.
+ *
+ * If the file can not grow, e.g. the card is full, recording stops and the
+ * frames that did not make it are counted as dropped.
+ */
+class Flight_Recorder
+{
+
+public:
+
+	Flight_Recorder();
+	~Flight_Recorder();
+
+	uint64_t records;      // frames written to the file
+	uint64_t bytes;        // bytes written to the file
+	uint64_t dropped;      // frames lost: a ring was full, the file could not grow, or too long
+	uint64_t index_blocks; // index records written
+
+	void open(const char *path);
+	void close();
+	bool is_open() const;
+
+	void record(uint8_t type, const uint8_t *frame, unsigned length, uint64_t time_usec);
+	void record_frames(uint8_t type, const uint8_t *frames, unsigned length, uint64_t time_usec);
+
+	void print_stats();
+
+	void start_writer_thread();
+
+private:
+
+	struct Ring
+	{
+		uint8_t *buffer;
+		uint32_t head;  // next byte the writer reads
+		uint32_t tail;  // next byte the producer writes
+	};
+
+	Ring      rings[2]; // RX and TX
+	int       fd;
+	bool      running;     // record() may copy into the rings
+	int       producers;   // record() calls copying right now
+	bool      failed;      // the file could not grow, recording stopped
+	bool      exit_writer;
+	pthread_t writer_tid;
+
+	Flight_Record_File_Header *header;  // mapped first page
+	uint8_t  *window;                   // mapped current chunk
+	uint64_t  window_start;             // file offset of the chunk
+	uint64_t  length;                   // bytes in use
+	uint64_t  last_index;
+	uint64_t  last_index_time;
+
+	void writer_thread();
+	void drain();
+	void write_index(uint64_t time_usec);
+	void append(const void *data, unsigned len);
+	void map_chunk(uint64_t offset);
+	void stop_recording();
+
+	static void ring_put(Ring &ring, uint32_t at, const void *data, unsigned len);
+	static void ring_get(const Ring &ring, uint32_t at, void *out, unsigned len);
+
+};
+
+
+
+#endif // FLIGHT_RECORDER_H_
+
+
@@ -0,0 +1,307 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file frame_scanner.cpp
+ *
+ * @brief Buffer-at-a-time MAVLink frame scanner
+ *
+ * Functions for locating and checking MAVLink frames in a receive buffer
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "frame_scanner.h"
+
+
+// ------------------------------------------------------------------------------
+//   Message Tables
+// ------------------------------------------------------------------------------
+
+// From the dialect, every scanner starts with a copy
+static const uint8_t dialect_crcs[256]    = MAVLINK_MESSAGE_CRCS;
+static const uint8_t dialect_lengths[256] = MAVLINK_MESSAGE_LENGTHS;
+
+// Why check_frame() rejected a frame
+#define FRAME_BAD_CHECKSUM -1
+#define FRAME_BAD_LENGTH   -2
+
+
+// ------------------------------------------------------------------------------
+//   Frame View
+// ------------------------------------------------------------------------------
+// Copies the frame into a mavlink_message_t, only the bytes actually used
+void
+Frame_View::
+to_message(mavlink_message_t &message) const
+{
+	message.magic  = frame[0];
+	message.len    = len;
+	message.seq    = seq;
+	message.sysid  = sysid;
+	message.compid = compid;
+	message.msgid  = msgid;
+
+	// payload followed by the two checksum bytes, like mavlink_parse_char()
+	memcpy(_MAV_PAYLOAD_NON_CONST(&message), payload(), len + MAVLINK_NUM_CHECKSUM_BYTES);
+
+	message.checksum = (uint16_t)(mavlink_ck_a(&message) | (mavlink_ck_b(&message) << 8));
+}
+
+// Views message in place, it has to outlive the view
+void
+Frame_View::
+from_message(const mavlink_message_t &message)
+{
+	frame  = &message.magic;
+	length = (uint16_t)(message.len + MAVLINK_NUM_NON_PAYLOAD_BYTES);
+	len    = message.len;
+	seq    = message.seq;
+	sysid  = message.sysid;
+	compid = message.compid;
+	msgid  = message.msgid;
+}
+
+
+// ----------------------------------------------------------------------------------
+//   Frame Scanner Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Frame_Scanner::
+Frame_Scanner()
+{
+	frames          = 0;
+	crc_errors      = 0;
+	truncated       = 0;
+	length_errors   = 0;
+	bytes_discarded = 0;
+
+	memcpy(message_crcs, dialect_crcs, sizeof(message_crcs));
+	memcpy(message_lengths, dialect_lengths, sizeof(message_lengths));
+}
+
+
+// ------------------------------------------------------------------------------
+//   Add Message
+// ------------------------------------------------------------------------------
+// Teaches this scanner a message the dialect does not know, or knows with
+// a different definition.  Call it before the port starts reading.
+void
+Frame_Scanner::
+add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length)
+{
+	message_crcs[msgid]    = crc_extra;
+	message_lengths[msgid] = length;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Check Frame
+// ------------------------------------------------------------------------------
+// Looks at the frame starting with the STX at frame[0], of which avail bytes
+// are in the buffer.  Returns the frame length if it is complete and the
+// checksum matches, 0 if more bytes are needed, FRAME_BAD_CHECKSUM or
+// FRAME_BAD_LENGTH if it is not a frame.
+int
+Frame_Scanner::
+check_frame(const uint8_t *frame, unsigned avail) const
+{
+	// need the header to know how long the frame is
+	if ( avail < MAVLINK_NUM_HEADER_BYTES )
+		return 0;
+
+	uint8_t  payload = frame[1];
+	uint8_t  msgid   = frame[5];
+	unsigned length  = payload + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+
+	// Message_View reads a known message's whole payload in place, one
+	// shorter than its definition would be read past its end.  Messages
+	// nobody defined (length 0) pass unless MAVLINK_CHECK_MESSAGE_LENGTH.
+	uint8_t expected = message_lengths[msgid];
+#ifdef MAVLINK_CHECK_MESSAGE_LENGTH
+	if ( payload != expected )
+#else
+	if ( expected && payload != expected )
+#endif
+		return FRAME_BAD_LENGTH;
+
+	// rest of the frame is still on the wire
+	if ( avail < length )
+		return 0;
+
+	uint16_t checksum = crc_calculate(frame + 1, MAVLINK_CORE_HEADER_LEN);
+	crc_accumulate_buffer(&checksum, (const char *)frame + MAVLINK_NUM_HEADER_BYTES, payload);
+#if MAVLINK_CRC_EXTRA
+	crc_accumulate(message_crcs[msgid], &checksum);
+#endif
+
+	const uint8_t *ck = frame + MAVLINK_NUM_HEADER_BYTES + payload;
+
+	if ( ck[0] != (uint8_t)(checksum & 0xFF) || ck[1] != (uint8_t)(checksum >> 8) )
+		return FRAME_BAD_CHECKSUM;
+
+	return (int)length;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Scan Buffer
+// ------------------------------------------------------------------------------
+// Fills views[] with up to max_views frames found in buf and returns how many.
+// consumed is set to the number of leading bytes the caller can drop; the rest
+// is the start of a frame that is not complete yet, or was not looked at
+// because views[] is full.  more is false if nothing can follow buf, e.g. it
+// is a datagram or the end of a file, a frame cut off at its end is then
+// skipped like a bad one.
+int
+Frame_Scanner::
+scan(const uint8_t *buf, unsigned len, Frame_View *views, int max_views, unsigned &consumed,
+		bool more)
+{
+	unsigned pos       = 0;
+	int      count     = 0;
+	unsigned discarded = 0;
+	unsigned bad       = 0;
+	unsigned cut       = 0;
+	unsigned mislength = 0;
+
+	while ( pos < len && count < max_views )
+	{
+		// ----------------------------------------------------------------------
+		//   FIND START OF FRAME
+		// ----------------------------------------------------------------------
+		const uint8_t *stx = (const uint8_t *)memchr(buf + pos, MAVLINK_STX, len - pos);
+
+		if ( stx == NULL )
+		{
+			discarded += len - pos;
+			pos = len;
+			break;
+		}
+
+		unsigned skipped = (unsigned)(stx - (buf + pos));
+		discarded += skipped;
+		pos       += skipped;
+
+		// ----------------------------------------------------------------------
+		//   CHECK FRAME
+		// ----------------------------------------------------------------------
+		const uint8_t *frame  = buf + pos;
+		int            length = check_frame(frame, len - pos);
+
+		// Wait for the rest of it.  A stray STX may claim a length that holds
+		// back the frames behind it until that many bytes are in, the
+		// checksum then rejects it and they are scanned.  Guessing earlier
+		// from what follows would throw away genuine frames.
+		if ( length == 0 && more )
+			break;
+
+		if ( length <= 0 )
+		{
+			// cut off, nothing more of it will come
+			if ( length == 0 )
+				cut++;
+			else if ( length == FRAME_BAD_LENGTH )
+				mislength++;
+			else
+				bad++;
+
+			// look for the next STX
+			discarded++;
+			pos++;
+			continue;
+		}
+
+		// ----------------------------------------------------------------------
+		//   GOT FRAME
+		// ----------------------------------------------------------------------
+		Frame_View &view = views[count++];
+		view.frame  = frame;
+		view.length = (uint16_t)length;
+		view.len    = frame[1];
+		view.seq    = frame[2];
+		view.sysid  = frame[3];
+		view.compid = frame[4];
+		view.msgid  = frame[5];
+
+		pos += length;
+	}
+
+	// one store each per call, other threads may read them any time
+	__atomic_store_n(&frames, frames + count, __ATOMIC_RELAXED);
+	if ( bad )
+		__atomic_store_n(&crc_errors, crc_errors + bad, __ATOMIC_RELAXED);
+	if ( cut )
+		__atomic_store_n(&truncated, truncated + cut, __ATOMIC_RELAXED);
+	if ( mislength )
+		__atomic_store_n(&length_errors, length_errors + mislength, __ATOMIC_RELAXED);
+	if ( discarded )
+		__atomic_store_n(&bytes_discarded, bytes_discarded + discarded, __ATOMIC_RELAXED);
+
+	consumed = pos;
+
+	return count;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+// Frames rejected for any reason
+uint32_t
+Frame_Scanner::
+bad_frames() const
+{
+	return __atomic_load_n(&crc_errors, __ATOMIC_RELAXED) + __atomic_load_n(&truncated, __ATOMIC_RELAXED) +
+			__atomic_load_n(&length_errors, __ATOMIC_RELAXED);
+}
+
+void
+Frame_Scanner::
+print(const char *name, FILE *out) const
+{
+	fprintf(out, "%-20s %u frames, %u failed the checksum, %u truncated, %u of the wrong length, "
+			"%u bytes discarded looking for STX\n", name,
+			__atomic_load_n(&frames, __ATOMIC_RELAXED), __atomic_load_n(&crc_errors, __ATOMIC_RELAXED),
+			__atomic_load_n(&truncated, __ATOMIC_RELAXED), __atomic_load_n(&length_errors, __ATOMIC_RELAXED),
+			__atomic_load_n(&bytes_discarded, __ATOMIC_RELAXED));
+}
+
+
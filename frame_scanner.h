@@ -0,0 +1,149 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file frame_scanner.h
+ *
+ * @brief Buffer-at-a-time MAVLink frame scanner
+ *
+ * Finds and checks complete MAVLink frames in a receive buffer without
+ * copying them, as a replacement for feeding mavlink_parse_char() one byte
+ * at a time.
+ *
+ */
+
+#ifndef FRAME_SCANNER_H_
+#define FRAME_SCANNER_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <common/mavlink.h>
+
+
+// ------------------------------------------------------------------------------
+//   Data Structures
+// ------------------------------------------------------------------------------
+
+/*
+ * Frame View
+ *
+ * A complete, checksum-verified frame inside somebody else's buffer.  The
+ * view does not own the bytes, it is only valid for as long as the buffer it
+ * was scanned from is left untouched.
+ *
+ * from_message() views a finalized mavlink_message_t the same way, its
+ * header bytes lie right before the payload.
+ */
+struct Frame_View
+{
+	const uint8_t *frame;  // first byte of the frame (STX)
+	uint16_t length;       // whole frame, header and checksum included
+
+	uint8_t len;           // payload length
+	uint8_t seq;
+	uint8_t sysid;
+	uint8_t compid;
+	uint8_t msgid;
+
+	const uint8_t *
+	payload() const
+	{
+		return frame + MAVLINK_NUM_HEADER_BYTES;
+	}
+
+	void to_message(mavlink_message_t &message) const;
+	void from_message(const mavlink_message_t &message);
+};
+
+
+// ----------------------------------------------------------------------------------
+//   Frame Scanner Class
+// ----------------------------------------------------------------------------------
+/*
+ * Frame Scanner Class
+ *
+ * Scans a whole buffer per call: STX is located with memchr(), and once the
+ * length byte says the frame is complete the checksum (CRC_EXTRA included)
+ * is checked in one pass over the frame.  A frame cut off at the end of the
+ * buffer is left unconsumed, so the caller can keep those bytes and scan
+ * them again together with the next chunk.
+ *
+ * Each scanner has its own copy of the dialect's CRC_EXTRA and length
+ * tables.  add_message() changes them, only from the thread that scans or
+ * before it starts.  A frame of a known message whose length byte differs
+ * from the table is rejected, so its whole payload is always in the view.
+ *
+ * The counters are stored once per scan() with atomic stores, so another
+ * thread can read them with print() while the scanning thread runs.
+ */
+class Frame_Scanner
+{
+
+public:
+
+	Frame_Scanner();
+
+	uint32_t frames;          // good frames found
+	uint32_t crc_errors;      // candidate frames that failed the checksum
+	uint32_t truncated;       // frames cut off at the end of a datagram or file
+	uint32_t length_errors;   // known messages with the wrong payload length
+	uint32_t bytes_discarded; // bytes skipped while looking for STX
+
+	int scan(const uint8_t *buf, unsigned len, Frame_View *views, int max_views, unsigned &consumed,
+			bool more = true);
+
+	void add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length);
+
+	uint32_t bad_frames() const;
+	void print(const char *name, FILE *out = stdout) const;
+
+private:
+
+	uint8_t message_crcs[256];
+	uint8_t message_lengths[256];
+
+	int check_frame(const uint8_t *frame, unsigned avail) const;
+
+};
+
+
+
+#endif // FRAME_SCANNER_H_
+
+
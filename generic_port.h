@@ -0,0 +1,157 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file generic_port.h
+ *
+ * @brief Interface shared by all MAVLink transports
+ *
+ * Autopilot_Interface talks to the autopilot through this, so a serial
+ * port, a network link or a recorded log can stand behind it.
+ *
+ */
+
+#ifndef GENERIC_PORT_H_
+#define GENERIC_PORT_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <common/mavlink.h>
+
+#include "frame_scanner.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Frames a reader takes from a port per read_frames() call
+#define GENERIC_PORT_MAX_BATCH 32
+
+
+// ----------------------------------------------------------------------------------
+//   Generic Port Class
+// ----------------------------------------------------------------------------------
+/*
+ * Generic Port Class
+ *
+ * read_frames() hands out views of complete frames without blocking, the
+ * views stay valid until the next read on the port.  wait_readable() sleeps
+ * until read_frames() has something, wake_fd becomes readable or the timeout
+ * passes, and returns 1, 0 or -1 on error like Serial_Port's.
+ *
+ * write_messages() sends several messages at once, ports that can batch
+ * them into fewer system calls override it.  write_frames() does the same
+ * for frames already encoded back to back in one buffer, e.g. by a
+ * Wire_Encoder; ports that can send the buffer as it is override it.
+ *
+ * add_message() teaches the port's frame scanner a message from outside
+ * the dialect; call it before the port is read from.
+ */
+class Generic_Port
+{
+
+public:
+
+	Generic_Port() {}
+	virtual ~Generic_Port() {}
+
+	virtual int read_frames(Frame_View *views, int max_views) = 0;
+	virtual int wait_readable(int wake_fd, int timeout_ms) = 0;
+	virtual void add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length) = 0;
+	virtual int write_message(const mavlink_message_t &message) = 0;
+
+	virtual int
+	write_messages(const mavlink_message_t *messages, int count)
+	{
+		int bytes = 0;
+		for ( int i = 0; i < count; i++ )
+		{
+			int result = write_message(messages[i]);
+			if ( result > 0 )
+				bytes += result;
+		}
+		return bytes;
+	}
+
+	// count complete frames in len bytes, returns the bytes sent
+	virtual int
+	write_frames(const uint8_t *frames, unsigned len, int count)
+	{
+		mavlink_message_t messages[GENERIC_PORT_MAX_BATCH];
+		unsigned pos   = 0;
+		int      bytes = 0;
+
+		while ( count > 0 && pos < len )
+		{
+			int batch = 0;
+			for ( ; batch < count && batch < GENERIC_PORT_MAX_BATCH && pos < len; batch++ )
+			{
+				Frame_View view;
+				view.frame  = frames + pos;
+				view.length = frames[pos + 1] + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+				view.len    = frames[pos + 1];
+				view.seq    = frames[pos + 2];
+				view.sysid  = frames[pos + 3];
+				view.compid = frames[pos + 4];
+				view.msgid  = frames[pos + 5];
+				view.to_message(messages[batch]);
+
+				pos += view.length;
+			}
+
+			int result = write_messages(messages, batch);
+			if ( result > 0 )
+				bytes += result;
+
+			count -= batch;
+		}
+
+		return bytes;
+	}
+
+	virtual bool is_running() = 0;
+	virtual void start() = 0;
+	virtual void stop() = 0;
+
+	virtual void print_stats() = 0;
+
+};
+
+
+
+#endif // GENERIC_PORT_H_
+
+
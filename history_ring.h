@@ -0,0 +1,333 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file history_ring.h
+ *
+ * @brief The last N samples of a message, for readers that need every one
+ *
+ * One writer pushes, any number of readers copy out samples by position or
+ * by time without taking a lock or ever blocking the writer.
+ *
+ */
+
+#ifndef HISTORY_RING_H_
+#define HISTORY_RING_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// ------------------------------------------------------------------------------
+//   Data Structures
+// ------------------------------------------------------------------------------
+
+template <typename T>
+struct History_Sample
+{
+	uint64_t index;     // samples pushed before this one
+	uint64_t time_usec; // time stamp it was pushed with
+	T        value;
+};
+
+
+// ----------------------------------------------------------------------------------
+//   History Ring Class
+// ----------------------------------------------------------------------------------
+/*
+ * History Ring Class
+ *
+ * Keeps the last N values of type T (a plain struct, e.g.
+ * mavlink_highres_imu_t), N a power of two, in slots of their own cache
+ * lines.  Everything is inside the object, push() never allocates.
+ *
+ * Each slot is a seqlock whose counter also names the sample it holds:
+ * 2 * index + 1 while it is written, 2 * index + 2 once it is complete.  A
+ * reader asking for sample index retries nothing, it either copies that
+ * sample whole or learns it was overwritten and moves on, so a slow reader
+ * skips what it missed instead of slowing the writer down.
+ *
+ * read() hands out everything pushed since a cursor, so a filter that keeps
+ * its cursor sees every sample once.  since() does the same from a time,
+ * and bracket() and interpolate() look up the samples around a time.  Both
+ * search by time stamp, which push() must be given in ascending order.
+ *
+ * Only one thread may call push() at a time.
+ */
+template <typename T, int N>
+class History_Ring
+{
+
+public:
+
+	History_Ring()
+	{
+		head = 0;
+		for ( int i = 0; i < N; i++ )
+			slots[i].sequence = 0;
+	}
+
+	// ------------------------------------------------------------------------
+	//   Writer side
+	// ------------------------------------------------------------------------
+
+	void
+	push(const T &value, uint64_t time_usec)
+	{
+		Slot &slot = begin_push(time_usec);
+		slot.sample.value = value;
+		end_push(slot);
+	}
+
+	// Lets source write the value in place with source.decode(T &)
+	template <typename S>
+	void
+	push_from(const S &source, uint64_t time_usec)
+	{
+		Slot &slot = begin_push(time_usec);
+		source.decode(slot.sample.value);
+		end_push(slot);
+	}
+
+	// ------------------------------------------------------------------------
+	//   Reader side
+	// ------------------------------------------------------------------------
+
+	// Samples pushed so far, the next one gets this index
+	uint64_t
+	pushed() const
+	{
+		return __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	}
+
+	// Copies out sample index, false if it was not pushed yet or was
+	// overwritten by now
+	bool
+	sample(uint64_t index, History_Sample<T> &sample_) const
+	{
+		const Slot &slot    = slots[index & (N - 1)];
+		uint64_t   complete = 2 * index + 2;
+
+		if ( __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != complete )
+			return false;
+
+		sample_ = slot.sample;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		return __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) == complete;
+	}
+
+	// The newest sample, false if there is none
+	bool
+	latest(History_Sample<T> &sample_) const
+	{
+		uint64_t count = pushed();
+
+		// a slow reader can be lapped while it copies, try the new newest
+		while ( count && not sample(count - 1, sample_) )
+			count = pushed();
+
+		return count != 0;
+	}
+
+	// Copies up to max_samples pushed since cursor, oldest first, and moves
+	// cursor past them.  What the ring overwrote before the reader got to it
+	// is added to missed.
+	int
+	read(uint64_t &cursor, History_Sample<T> *samples, int max_samples, uint64_t *missed = NULL) const
+	{
+		uint64_t count = pushed();
+		int      found = 0;
+
+		if ( cursor > count )
+			cursor = count;
+
+		if ( count - cursor > (uint64_t)N )
+		{
+			if ( missed )
+				*missed += count - cursor - N;
+			cursor = count - N;
+		}
+
+		while ( found < max_samples && cursor < count )
+		{
+			if ( sample(cursor, samples[found]) )
+				found++;
+			else if ( missed )
+				*missed += 1;
+
+			cursor++;
+		}
+
+		return found;
+	}
+
+	// Up to max_samples stamped after time_usec, oldest first
+	int
+	since(uint64_t time_usec, History_Sample<T> *samples, int max_samples) const
+	{
+		uint64_t cursor = first_after(time_usec, pushed());
+		return read(cursor, samples, max_samples);
+	}
+
+	// The samples at or before and after time_usec.  False if the ring does
+	// not reach back that far, or time_usec is after the newest sample;
+	// before and after are the same sample if it was stamped time_usec.
+	bool
+	bracket(uint64_t time_usec, History_Sample<T> &before, History_Sample<T> &after) const
+	{
+		uint64_t count = pushed();
+		uint64_t index = first_after(time_usec, count);
+
+		if ( index == 0 || not sample(index - 1, before) )
+			return false;
+
+		if ( index == count )
+		{
+			after = before;
+			return before.time_usec == time_usec;
+		}
+
+		return sample(index, after);
+	}
+
+	// One field linearly interpolated at time_usec, e.g.
+	// interpolate(t, &mavlink_local_position_ned_t::x, x).  Same cases as
+	// bracket(), nothing is extrapolated.
+	template <typename F>
+	bool
+	interpolate(uint64_t time_usec, F T::*field, double &value) const
+	{
+		History_Sample<T> before, after;
+
+		if ( not bracket(time_usec, before, after) )
+			return false;
+
+		double from = (double)(before.value.*field);
+		double to   = (double)(after.value.*field);
+
+		if ( after.time_usec == before.time_usec )
+			value = from;
+		else
+			value = from + (to - from) * (double)(time_usec - before.time_usec) /
+			                             (double)(after.time_usec - before.time_usec);
+		return true;
+	}
+
+private:
+
+	struct Slot
+	{
+		uint64_t          sequence;
+		History_Sample<T> sample;
+	} __attribute__((aligned(64)));
+
+	typedef char capacity_is_a_power_of_two[(N > 0 && (N & (N - 1)) == 0) ? 1 : -1];
+
+	uint64_t head __attribute__((aligned(64)));
+	Slot     slots[N];
+
+	Slot &
+	begin_push(uint64_t time_usec)
+	{
+		uint64_t index = __atomic_load_n(&head, __ATOMIC_RELAXED);
+		Slot    &slot  = slots[index & (N - 1)];
+
+		__atomic_store_n(&slot.sequence, 2 * index + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		slot.sample.index     = index;
+		slot.sample.time_usec = time_usec;
+
+		return slot;
+	}
+
+	void
+	end_push(Slot &slot)
+	{
+		uint64_t index = slot.sample.index;
+
+		__atomic_store_n(&slot.sequence, 2 * index + 2, __ATOMIC_RELEASE);
+		__atomic_store_n(&head, index + 1, __ATOMIC_RELEASE);
+	}
+
+	// Time stamp of sample index, false if it was overwritten
+	bool
+	time_stamp(uint64_t index, uint64_t &time_usec) const
+	{
+		const Slot &slot    = slots[index & (N - 1)];
+		uint64_t   complete = 2 * index + 2;
+
+		if ( __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != complete )
+			return false;
+
+		time_usec = slot.sample.time_usec;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		return __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) == complete;
+	}
+
+	// Index of the oldest of the first count samples stamped after
+	// time_usec, count if there is none; a binary search over the ring
+	uint64_t
+	first_after(uint64_t time_usec, uint64_t count) const
+	{
+		uint64_t low  = count > (uint64_t)N ? count - N : 0;
+		uint64_t high = count;
+
+		while ( low < high )
+		{
+			uint64_t middle = low + (high - low) / 2;
+			uint64_t stamp;
+
+			// overwritten ones are older than anything still there
+			if ( not time_stamp(middle, stamp) || stamp <= time_usec )
+				low = middle + 1;
+			else
+				high = middle;
+		}
+
+		return low;
+	}
+
+};
+
+
+
+#endif // HISTORY_RING_H_
+
+
@@ -0,0 +1,213 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file home_position.h
+ *
+ * @brief HOME_POSITION (#242) message definition
+ *
+ * The vendored v1.0 common dialect predates HOME_POSITION, so it has no
+ * header for it and a zero CRC_EXTRA in its message table.  This is the
+ * receive side of the message as PX4 and ArduPilot send it, written like
+ * the generated headers so it can be dropped once they are regenerated.
+ *
+ */
+
+#ifndef HOME_POSITION_H_
+#define HOME_POSITION_H_
+
+#include <common/mavlink.h>
+
+#ifndef MAVLINK_MSG_ID_HOME_POSITION
+
+// MESSAGE HOME_POSITION
+
+#define MAVLINK_MSG_ID_HOME_POSITION 242
+
+typedef struct __mavlink_home_position_t
+{
+ int32_t latitude; ///< Latitude (WGS84), in degrees * 1E7
+ int32_t longitude; ///< Longitude (WGS84, in degrees * 1E7
+ int32_t altitude; ///< Altitude (AMSL), in meters * 1000 (positive for up)
+ float x; ///< Local X position of this position in the local coordinate frame
+ float y; ///< Local Y position of this position in the local coordinate frame
+ float z; ///< Local Z position of this position in the local coordinate frame
+ float q[4]; ///< World to surface normal and heading transformation of the takeoff position
+ float approach_x; ///< Local X position of the end of the approach vector
+ float approach_y; ///< Local Y position of the end of the approach vector
+ float approach_z; ///< Local Z position of the end of the approach vector
+} mavlink_home_position_t;
+
+#define MAVLINK_MSG_ID_HOME_POSITION_LEN 52
+#define MAVLINK_MSG_ID_242_LEN 52
+
+#define MAVLINK_MSG_ID_HOME_POSITION_CRC 104
+#define MAVLINK_MSG_ID_242_CRC 104
+
+#define MAVLINK_MSG_HOME_POSITION_FIELD_Q_LEN 4
+
+
+// MESSAGE HOME_POSITION UNPACKING
+
+
+/**
+ * @brief Get field latitude from home_position message
+ *
+ * @return Latitude (WGS84), in degrees * 1E7
+ */
+static inline int32_t mavlink_msg_home_position_get_latitude(const mavlink_message_t* msg)
+{
+	return _MAV_RETURN_int32_t(msg,  0);
+}
+
+/**
+ * @brief Get field longitude from home_position message
+ *
+ * @return Longitude (WGS84, in degrees * 1E7
+ */
+static inline int32_t mavlink_msg_home_position_get_longitude(const mavlink_message_t* msg)
+{
+	return _MAV_RETURN_int32_t(msg,  4);
+}
+
+/**
+ * @brief Get field altitude from home_position message
+ *
+ * @return Altitude (AMSL), in meters * 1000 (positive for up)
+ */
+static inline int32_t mavlink_msg_home_position_get_altitude(const mavlink_message_t* msg)
+{
+	return _MAV_RETURN_int32_t(msg,  8);
+}
+
+/**
+ * @brief Get field x from home_position message
+ *
+ * @return Local X position of this position in the local coordinate frame
+ */
+static inline float mavlink_msg_home_position_get_x(const mavlink_message_t* msg)
+{
+	return _MAV_RETURN_float(msg,  12);
+}
+
+/**
+ * @brief Get field y from home_position message
+ *
+ * @return Local Y position of this position in the local coordinate frame
+ */
+static inline float mavlink_msg_home_position_get_y(const mavlink_message_t* msg)
+{
+	return _MAV_RETURN_float(msg,  16);
+}
+
+/**
+ * @brief Get field z from home_position message
+ *
+ * @return Local Z position of this position in the local coordinate frame
+ */
+static inline float mavlink_msg_home_position_get_z(const mavlink_message_t* msg)
+{
+	return _MAV_RETURN_float(msg,  20);
+}
+
+/**
+ * @brief Get field q from home_position message
+ *
+ * @return World to surface normal and heading transformation of the takeoff position
+ */
+static inline uint16_t mavlink_msg_home_position_get_q(const mavlink_message_t* msg, float *q)
+{
+	return _MAV_RETURN_float_array(msg, q, 4,  24);
+}
+
+/**
+ * @brief Get field approach_x from home_position message
+ *
+ * @return Local X position of the end of the approach vector
+ */
+static inline float mavlink_msg_home_position_get_approach_x(const mavlink_message_t* msg)
+{
+	return _MAV_RETURN_float(msg,  40);
+}
+
+/**
+ * @brief Get field approach_y from home_position message
+ *
+ * @return Local Y position of the end of the approach vector
+ */
+static inline float mavlink_msg_home_position_get_approach_y(const mavlink_message_t* msg)
+{
+	return _MAV_RETURN_float(msg,  44);
+}
+
+/**
+ * @brief Get field approach_z from home_position message
+ *
+ * @return Local Z position of the end of the approach vector
+ */
+static inline float mavlink_msg_home_position_get_approach_z(const mavlink_message_t* msg)
+{
+	return _MAV_RETURN_float(msg,  48);
+}
+
+/**
+ * @brief Decode a home_position message into a struct
+ *
+ * @param msg The message to decode
+ * @param home_position C-struct to decode the message contents into
+ */
+static inline void mavlink_msg_home_position_decode(const mavlink_message_t* msg, mavlink_home_position_t* home_position)
+{
+#if MAVLINK_NEED_BYTE_SWAP
+	home_position->latitude = mavlink_msg_home_position_get_latitude(msg);
+	home_position->longitude = mavlink_msg_home_position_get_longitude(msg);
+	home_position->altitude = mavlink_msg_home_position_get_altitude(msg);
+	home_position->x = mavlink_msg_home_position_get_x(msg);
+	home_position->y = mavlink_msg_home_position_get_y(msg);
+	home_position->z = mavlink_msg_home_position_get_z(msg);
+	mavlink_msg_home_position_get_q(msg, home_position->q);
+	home_position->approach_x = mavlink_msg_home_position_get_approach_x(msg);
+	home_position->approach_y = mavlink_msg_home_position_get_approach_y(msg);
+	home_position->approach_z = mavlink_msg_home_position_get_approach_z(msg);
+#else
+	memcpy(home_position, _MAV_PAYLOAD(msg), MAVLINK_MSG_ID_HOME_POSITION_LEN);
+#endif
+}
+
+#endif // MAVLINK_MSG_ID_HOME_POSITION
+
+
+
+#endif // HOME_POSITION_H_
+
+
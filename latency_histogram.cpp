@@ -0,0 +1,194 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file latency_histogram.cpp
+ *
+ * @brief Fixed size latency histogram
+ *
+ * Functions for recording durations and reading back percentiles
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "latency_histogram.h"
+
+#include <string.h>
+
+
+// ----------------------------------------------------------------------------------
+//   Latency Histogram Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Latency_Histogram::
+Latency_Histogram()
+{
+	reset();
+}
+
+void
+Latency_Histogram::
+reset()
+{
+	memset(buckets, 0, sizeof(buckets));
+	total   = 0;
+	sum     = 0;
+	largest = 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Bucket Mapping
+// ------------------------------------------------------------------------------
+// Exact below LATENCY_HISTOGRAM_LINEAR, then 2^SUB_BITS buckets per octave
+unsigned
+Latency_Histogram::
+bucket_of(uint64_t usec)
+{
+	if ( usec < LATENCY_HISTOGRAM_LINEAR )
+		return (unsigned)usec;
+
+	unsigned octave = 63 - __builtin_clzll(usec); // >= 4
+	unsigned sub    = (unsigned)(usec >> (octave - LATENCY_HISTOGRAM_SUB_BITS)) & ((1 << LATENCY_HISTOGRAM_SUB_BITS) - 1);
+
+	return LATENCY_HISTOGRAM_LINEAR + ((octave - 4) << LATENCY_HISTOGRAM_SUB_BITS) + sub;
+}
+
+// Largest value that still falls into bucket
+uint64_t
+Latency_Histogram::
+bucket_limit(unsigned bucket)
+{
+	if ( bucket < LATENCY_HISTOGRAM_LINEAR )
+		return bucket;
+
+	unsigned octave = ((bucket - LATENCY_HISTOGRAM_LINEAR) >> LATENCY_HISTOGRAM_SUB_BITS) + 4;
+	uint64_t sub    = (bucket - LATENCY_HISTOGRAM_LINEAR) & ((1 << LATENCY_HISTOGRAM_SUB_BITS) - 1);
+	uint64_t step   = (uint64_t)1 << (octave - LATENCY_HISTOGRAM_SUB_BITS);
+
+	return ((uint64_t)1 << octave) + (sub + 1) * step - 1;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Record
+// ------------------------------------------------------------------------------
+void
+Latency_Histogram::
+add(uint64_t usec)
+{
+	__atomic_fetch_add(&buckets[bucket_of(usec)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&total, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&sum, usec, __ATOMIC_RELAXED);
+
+	// racing writers may lose a new maximum, that is good enough here
+	if ( usec > __atomic_load_n(&largest, __ATOMIC_RELAXED) )
+		__atomic_store_n(&largest, usec, __ATOMIC_RELAXED);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+uint64_t
+Latency_Histogram::
+count() const
+{
+	return __atomic_load_n(&total, __ATOMIC_RELAXED);
+}
+
+uint64_t
+Latency_Histogram::
+max() const
+{
+	return __atomic_load_n(&largest, __ATOMIC_RELAXED);
+}
+
+uint64_t
+Latency_Histogram::
+mean() const
+{
+	uint64_t n = count();
+	return n ? __atomic_load_n(&sum, __ATOMIC_RELAXED) / n : 0;
+}
+
+// p is in percent, e.g. 99.9
+uint64_t
+Latency_Histogram::
+percentile(double p) const
+{
+	uint64_t n = count();
+	if ( n == 0 )
+		return 0;
+
+	uint64_t rank = (uint64_t)(p / 100.0 * n);
+	if ( rank >= n )
+		rank = n - 1;
+
+	uint64_t seen = 0;
+	for ( unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++ )
+	{
+		seen += __atomic_load_n(&buckets[i], __ATOMIC_RELAXED);
+		if ( seen > rank )
+		{
+			uint64_t limit = bucket_limit(i);
+			return limit < max() ? limit : max();
+		}
+	}
+
+	return max();
+}
+
+void
+Latency_Histogram::
+print(const char *name, FILE *out) const
+{
+	fprintf(out, "%-20s n: %8llu  mean: %6llu  p50: %6llu  p90: %6llu  p99: %6llu  p99.9: %6llu  max: %6llu (us)\n",
+			name,
+			(unsigned long long)count(),
+			(unsigned long long)mean(),
+			(unsigned long long)percentile(50.0),
+			(unsigned long long)percentile(90.0),
+			(unsigned long long)percentile(99.0),
+			(unsigned long long)percentile(99.9),
+			(unsigned long long)max());
+}
+
+
@@ -0,0 +1,112 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file latency_histogram.h
+ *
+ * @brief Fixed size latency histogram
+ *
+ * Records durations in microseconds and reports percentiles, used for the
+ * timing statistics of the read and write paths.
+ *
+ */
+
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Values below this are counted exactly [us]
+#define LATENCY_HISTOGRAM_LINEAR   16
+
+// Buckets per power of two above that, about 12% resolution
+#define LATENCY_HISTOGRAM_SUB_BITS 3
+
+#define LATENCY_HISTOGRAM_BUCKETS  (LATENCY_HISTOGRAM_LINEAR + (64 - 4) * (1 << LATENCY_HISTOGRAM_SUB_BITS))
+
+
+// ----------------------------------------------------------------------------------
+//   Latency Histogram Class
+// ----------------------------------------------------------------------------------
+/*
+ * Latency Histogram Class
+ *
+ * Log-linear histogram of microsecond durations.  It never allocates, and
+ * add() only does relaxed atomic increments, so it can be fed from the read
+ * and write threads while another thread prints percentiles.  The
+ * percentiles are the upper edge of the bucket they fall in.
+ */
+class Latency_Histogram
+{
+
+public:
+
+	Latency_Histogram();
+
+	void add(uint64_t usec);
+	void reset();
+
+	uint64_t count() const;
+	uint64_t max() const;
+	uint64_t mean() const;
+	uint64_t percentile(double p) const;
+
+	void print(const char *name, FILE *out = stdout) const;
+
+private:
+
+	uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t largest;
+
+	static unsigned bucket_of(uint64_t usec);
+	static uint64_t bucket_limit(unsigned bucket);
+
+};
+
+
+
+#endif // LATENCY_HISTOGRAM_H_
+
+
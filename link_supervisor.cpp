@@ -0,0 +1,218 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file link_supervisor.cpp
+ *
+ * @brief Health of the link to the autopilot
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "link_supervisor.h"
+
+#include <string.h>
+
+
+// ----------------------------------------------------------------------------------
+//   Link Supervisor Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Link_Supervisor::
+Link_Supervisor()
+{
+	timeout = LINK_SUPERVISOR_TIMEOUT;
+
+	handler = NULL;
+	context = NULL;
+
+	link_state = LINK_WAITING;
+	last       = 0;
+	loss_count = 0;
+
+	memset(stats, 0, sizeof(stats));
+}
+
+// Before start(), the read thread calls it
+void
+Link_Supervisor::
+set_handler(Link_Handler handler_, void *context_)
+{
+	handler = handler_;
+	context = context_;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Read Thread
+// ------------------------------------------------------------------------------
+void
+Link_Supervisor::
+received(const Frame_View &frame, uint64_t now)
+{
+	// sequence numbers count every frame the autopilot sent, whatever its id
+	sequence.count(frame.seq);
+
+	Link_Message_Stats &s = stats[frame.msgid];
+
+	if ( s.count )
+	{
+		uint64_t gap     = now - s.last;
+		uint64_t average = s.count > 1 ? ( s.last - s.first ) / ( s.count - 1 ) : 0;
+
+		if ( gap > s.max_gap )
+			__atomic_store_n(&s.max_gap, gap, __ATOMIC_RELAXED);
+		if ( s.count > 1 && gap > LINK_SUPERVISOR_LATE_FACTOR * average )
+			__atomic_store_n(&s.late, s.late + 1, __ATOMIC_RELAXED);
+	}
+	else
+		__atomic_store_n(&s.first, now, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&s.last, now, __ATOMIC_RELAXED);
+	__atomic_store_n(&s.count, s.count + 1, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&last, now, __ATOMIC_RELAXED);
+
+	if ( link_state != LINK_UP )
+		change_state(LINK_UP);
+}
+
+// Declares the link lost once the autopilot was silent for timeout
+void
+Link_Supervisor::
+check(uint64_t now)
+{
+	if ( link_state == LINK_UP && now - last > timeout )
+	{
+		__atomic_store_n(&loss_count, loss_count + 1, __ATOMIC_RELAXED);
+		change_state(LINK_LOST);
+	}
+}
+
+void
+Link_Supervisor::
+change_state(int state_)
+{
+	__atomic_store_n(&link_state, state_, __ATOMIC_RELEASE);
+
+	if ( handler )
+		handler(context, state_);
+}
+
+
+// ------------------------------------------------------------------------------
+//   State, from any thread
+// ------------------------------------------------------------------------------
+int
+Link_Supervisor::
+state() const
+{
+	return __atomic_load_n(&link_state, __ATOMIC_ACQUIRE);
+}
+
+// Arrival of the latest message from the autopilot, 0 if none yet [us]
+uint64_t
+Link_Supervisor::
+last_received() const
+{
+	return __atomic_load_n(&last, __ATOMIC_RELAXED);
+}
+
+uint64_t
+Link_Supervisor::
+losses() const
+{
+	return __atomic_load_n(&loss_count, __ATOMIC_RELAXED);
+}
+
+// Frames the autopilot sent that never arrived, from gaps in their sequence
+// numbers
+uint32_t
+Link_Supervisor::
+lost_frames() const
+{
+	return sequence.lost_frames();
+}
+
+void
+Link_Supervisor::
+message_stats(uint8_t msgid, Link_Message_Stats &stats_) const
+{
+	const Link_Message_Stats &s = stats[msgid];
+
+	stats_.count   = __atomic_load_n(&s.count,   __ATOMIC_RELAXED);
+	stats_.first   = __atomic_load_n(&s.first,   __ATOMIC_RELAXED);
+	stats_.last    = __atomic_load_n(&s.last,    __ATOMIC_RELAXED);
+	stats_.max_gap = __atomic_load_n(&s.max_gap, __ATOMIC_RELAXED);
+	stats_.late    = __atomic_load_n(&s.late,    __ATOMIC_RELAXED);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+Link_Supervisor::
+print(uint64_t now) const
+{
+	static const char *names[] = { "waiting", "up", "lost" };
+
+	uint64_t latest = last_received();
+
+	printf("%-20s %s", "LINK", names[state()]);
+	if ( latest )
+		printf(", last message %.1f s ago", (now - latest) * 1e-6);
+	printf(", lost %llu times, %u frames missing\n", (unsigned long long)losses(), lost_frames());
+
+	for ( int msgid = 0; msgid < 256; msgid++ )
+	{
+		Link_Message_Stats s;
+		message_stats(msgid, s);
+		if ( not s.count )
+			continue;
+
+		double rate = s.last > s.first ? ( s.count - 1 ) * 1e6 / ( s.last - s.first ) : 0.0;
+
+		printf("  msgid %3i %10llu messages %8.1f Hz, longest gap %8.1f ms, %llu late\n", msgid,
+				(unsigned long long)s.count, rate, s.max_gap * 1e-3, (unsigned long long)s.late);
+	}
+}
+
+
@@ -0,0 +1,206 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file link_supervisor.h
+ *
+ * @brief Health of the link to the autopilot
+ *
+ * Message rates and gaps per message id, frames lost by sequence number,
+ * and a handler called when the autopilot goes silent or comes back.
+ *
+ */
+
+#ifndef LINK_SUPERVISOR_H_
+#define LINK_SUPERVISOR_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <common/mavlink.h>
+
+#include "frame_scanner.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Silence from the autopilot after which the link counts as lost [us]
+#define LINK_SUPERVISOR_TIMEOUT 1000000
+
+// A gap longer than this many average intervals of its message is late
+#define LINK_SUPERVISOR_LATE_FACTOR 2
+
+
+// ------------------------------------------------------------------------------
+//   Data Structures
+// ------------------------------------------------------------------------------
+
+enum Link_State
+{
+	LINK_WAITING = 0, // nothing heard from the autopilot yet
+	LINK_UP,
+	LINK_LOST
+};
+
+// Called with the new state from the read thread, keep it short
+typedef void (*Link_Handler)(void *context, int state);
+
+// Frames one sender numbered that never arrived.  MAVLink numbers every
+// frame of a sender, whatever its id, in an 8 bit counter, so a gap of half
+// the range or more is taken for a late or repeated frame, not a loss.
+// Counted by the read thread, the counters can be read from any thread.
+struct Sequence_Counter
+{
+	Sequence_Counter()
+	{
+		received = 0;
+		lost     = 0;
+		late     = 0;
+		next     = 0;
+	}
+
+	uint32_t received;
+	uint32_t lost;
+	uint32_t late;  // out of order or repeated
+	uint8_t  next;  // sequence number expected next
+
+	void
+	count(uint8_t seq)
+	{
+		uint8_t missing = seq - next;
+
+		if ( received && missing >= 128 )
+		{
+			__atomic_store_n(&late, late + 1, __ATOMIC_RELAXED);
+			return;
+		}
+
+		if ( received && missing )
+			__atomic_store_n(&lost, lost + missing, __ATOMIC_RELAXED);
+
+		next = seq + 1;
+		__atomic_store_n(&received, received + 1, __ATOMIC_RELAXED);
+	}
+
+	uint32_t lost_frames() const { return __atomic_load_n(&lost, __ATOMIC_RELAXED); }
+	uint32_t late_frames() const { return __atomic_load_n(&late, __ATOMIC_RELAXED); }
+
+	// of all the frames sent, lost ones included
+	double
+	loss() const
+	{
+		uint32_t lost_     = lost_frames();
+		uint32_t received_ = __atomic_load_n(&received, __ATOMIC_RELAXED);
+		return lost_ ? (double)lost_ / ( lost_ + received_ ) : 0.0;
+	}
+};
+
+struct Link_Message_Stats
+{
+	uint64_t count;
+	uint64_t first;    // arrival of the first [us]
+	uint64_t last;     // arrival of the latest [us]
+	uint64_t max_gap;  // longest time between two [us]
+	uint64_t late;     // gaps over LINK_SUPERVISOR_LATE_FACTOR average intervals
+};
+
+
+// ----------------------------------------------------------------------------------
+//   Link Supervisor Class
+// ----------------------------------------------------------------------------------
+/*
+ * Link Supervisor Class
+ *
+ * The read thread feeds it every message of the autopilot with received()
+ * and calls check() at least every few hundred milliseconds, even when
+ * nothing arrives.  Once the autopilot was silent for timeout, check()
+ * moves to LINK_LOST and calls the handler; the next message moves back
+ * to LINK_UP and calls it again.  So the handler runs at most timeout plus
+ * the check interval after the last message.
+ *
+ * Everything is written by the read thread alone.  state(), last_received()
+ * and message_stats() are plain atomic loads, cheap enough for a control
+ * loop; the fields of message_stats() are each consistent, not with each
+ * other.
+ */
+class Link_Supervisor
+{
+
+public:
+
+	Link_Supervisor();
+
+	uint64_t timeout; // [us], set before start()
+
+	void set_handler(Link_Handler handler_, void *context_);
+
+	void received(const Frame_View &frame, uint64_t now);
+	void check(uint64_t now);
+
+	int      state() const;
+	uint64_t last_received() const;
+	uint64_t losses() const;
+	uint32_t lost_frames() const;
+	void     message_stats(uint8_t msgid, Link_Message_Stats &stats) const;
+
+	void print(uint64_t now) const;
+
+private:
+
+	Link_Handler handler;
+	void        *context;
+
+	int      link_state;
+	uint64_t last;         // arrival of the latest message [us]
+	uint64_t loss_count;   // times the link was lost
+
+	// frames of the autopilot missing between sequence numbers
+	Sequence_Counter sequence;
+
+	Link_Message_Stats stats[256];
+
+	void change_state(int state_);
+
+};
+
+
+
+#endif // LINK_SUPERVISOR_H_
+
+
@@ -0,0 +1,556 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file log_replay.cpp
+ *
+ * @brief Replays recorded MAVLink traffic as if it came from a port
+ *
+ * Functions for indexing flight logs and handing out their frames on time
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "log_replay.h"
+#include "time_base.h"
+
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// ------------------------------------------------------------------------------
+//   Helpers
+// ------------------------------------------------------------------------------
+
+// tlog time stamps are big endian microseconds
+static uint64_t
+_read_be64(const uint8_t *p)
+{
+	uint64_t value = 0;
+	for ( int i = 0; i < 8; i++ )
+		value = (value << 8) | p[i];
+	return value;
+}
+
+static bool
+_entry_before(const Log_Replay_Entry &entry, uint64_t time_usec)
+{
+	return entry.time_usec < time_usec;
+}
+
+
+// ----------------------------------------------------------------------------------
+//   Log Replay Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Log_Replay::
+Log_Replay(const char *path_, double speed_)
+{
+	initialize_defaults();
+	path  = path_;
+	speed = speed_;
+}
+
+Log_Replay::
+Log_Replay()
+{
+	initialize_defaults();
+}
+
+Log_Replay::
+~Log_Replay()
+{
+	close_log();
+	pthread_mutex_destroy(&lock);
+}
+
+void
+Log_Replay::
+initialize_defaults()
+{
+	path     = NULL;
+	speed    = 1.0;
+	baudrate = 57600;
+	format   = LOG_REPLAY_RAW;
+
+	frames_replayed = 0;
+	tx_messages     = 0;
+
+	fd       = -1;
+	data     = NULL;
+	data_len = 0;
+	running  = false;
+
+	next      = 0;
+	base_wall = 0;
+	base_log  = 0;
+
+	pthread_mutex_init(&lock, NULL);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Open Log
+// ------------------------------------------------------------------------------
+// throws 1 if the log can not be read
+void
+Log_Replay::
+open_log()
+{
+	printf("OPEN LOG\n");
+
+	fd = open(path, O_RDONLY);
+
+	struct stat st;
+	if ( fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0 )
+	{
+		fprintf(stderr,"failure, could not open log %s\n", path);
+		close_log();
+		throw 1;
+	}
+
+	data_len = st.st_size;
+	void *mapped = mmap(NULL, data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if ( mapped == MAP_FAILED )
+	{
+		fprintf(stderr,"failure, could not map log %s\n", path);
+		close_log();
+		throw 1;
+	}
+
+	data = (const uint8_t *)mapped;
+	madvise(mapped, data_len, MADV_SEQUENTIAL);
+}
+
+void
+Log_Replay::
+close_log()
+{
+	if ( data )
+		munmap((void *)data, data_len);
+	data     = NULL;
+	data_len = 0;
+
+	if ( fd >= 0 )
+		close(fd);
+	fd = -1;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Build Index
+// ------------------------------------------------------------------------------
+void
+Log_Replay::
+detect_format()
+{
+	format = LOG_REPLAY_RAW;
+
+	if ( data_len >= sizeof(Flight_Record_File_Header) &&
+	     memcmp(data, FLIGHT_RECORDER_MAGIC, 8) == 0 )
+	{
+		format = LOG_REPLAY_RECORDER;
+	}
+
+	// a frame right after a time stamp between 2000 and 2100
+	else if ( data_len > 8 && data[8] == MAVLINK_STX )
+	{
+		uint64_t stamp = _read_be64(data);
+		if ( stamp > 946684800000000ULL && stamp < 4102444800000000ULL )
+			format = LOG_REPLAY_TLOG;
+	}
+}
+
+// Every frame the scanner finds, timed by when its first byte came in
+void
+Log_Replay::
+index_raw()
+{
+	Frame_View views[GENERIC_PORT_MAX_BATCH];
+	size_t pos = 0;
+
+	while ( pos < data_len )
+	{
+		unsigned chunk = data_len - pos < 65536 ? (unsigned)(data_len - pos) : 65536;
+		unsigned consumed;
+
+		int count = scanner.scan(data + pos, chunk, views, GENERIC_PORT_MAX_BATCH, consumed,
+				pos + chunk < data_len);
+
+		for ( int i = 0; i < count; i++ )
+		{
+			Log_Replay_Entry entry;
+			entry.offset    = views[i].frame - data;
+			entry.length    = views[i].length;
+			entry.time_usec = entry.offset * 10 * 1000000ULL / baudrate; // 8N1
+			index.push_back(entry);
+		}
+
+		// nothing but a frame cut off by the end of the file is left
+		if ( consumed == 0 )
+			break;
+
+		pos += consumed;
+	}
+}
+
+// 8 byte time stamp, frame, 8 byte time stamp, frame...
+void
+Log_Replay::
+index_tlog()
+{
+	size_t pos = 0;
+
+	while ( pos + 8 + MAVLINK_NUM_NON_PAYLOAD_BYTES <= data_len )
+	{
+		size_t   left  = data_len - pos - 8;
+		unsigned avail = left < MAVLINK_MAX_PACKET_LEN ? (unsigned)left : MAVLINK_MAX_PACKET_LEN;
+
+		Frame_View view;
+		unsigned consumed;
+
+		if ( scanner.scan(data + pos + 8, avail, &view, 1, consumed) == 0 )
+		{
+			// cut off at the end, or garbage, try the next byte
+			if ( avail < MAVLINK_MAX_PACKET_LEN )
+				break;
+			pos++;
+			continue;
+		}
+
+		// garbage before the frame, its time stamp is right in front of it
+		if ( view.frame != data + pos + 8 )
+		{
+			pos = (view.frame - data) - 8;
+			continue;
+		}
+
+		Log_Replay_Entry entry;
+		entry.time_usec = _read_be64(data + pos);
+		entry.offset    = pos + 8;
+		entry.length    = view.length;
+		index.push_back(entry);
+
+		pos += 8 + view.length;
+	}
+}
+
+// Received frames of a Flight_Recorder log, up to where it was last flushed
+void
+Log_Replay::
+index_recorder()
+{
+	Flight_Record_File_Header header;
+	memcpy(&header, data, sizeof(header));
+
+	size_t end = header.length && header.length <= data_len ? header.length : data_len;
+	size_t pos = header.header_size;
+
+	while ( pos + sizeof(Flight_Record_Header) <= end )
+	{
+		Flight_Record_Header record;
+		memcpy(&record, data + pos, sizeof(record));
+
+		size_t body = pos + sizeof(record);
+		if ( body + record.length > end )
+			break;
+
+		if ( record.type == FLIGHT_RECORD_RX )
+		{
+			Log_Replay_Entry entry;
+			entry.time_usec = record.time_usec;
+			entry.offset    = body;
+			entry.length    = record.length;
+			index.push_back(entry);
+		}
+
+		pos = body + record.length;
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Start / Stop
+// ------------------------------------------------------------------------------
+// Maps and indexes the log the first time, then (re)starts the replay clock
+// from the current position.  throws 1 if the log can not be read.
+void
+Log_Replay::
+start()
+{
+	if ( data == NULL )
+	{
+		open_log();
+		detect_format();
+
+		index.clear();
+		if ( format == LOG_REPLAY_RECORDER )
+			index_recorder();
+		else if ( format == LOG_REPLAY_TLOG )
+			index_tlog();
+		else
+			index_raw();
+
+		static const char *names[] = { "raw", "tlog", "flight recorder" };
+		printf("Replaying %s (%s) with %lu frames over %.1f s at %gx\n", path, names[format],
+				(unsigned long)index.size(), (end_time() - start_time()) / 1e6, speed);
+		printf("\n");
+	}
+
+	pthread_mutex_lock(&lock);
+	base_wall = get_time_usec();
+	base_log  = next < index.size() ? index[next].time_usec : 0;
+	running   = true;
+	pthread_mutex_unlock(&lock);
+}
+
+void
+Log_Replay::
+stop()
+{
+	running = false;
+}
+
+bool
+Log_Replay::
+is_running()
+{
+	return running;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Position
+// ------------------------------------------------------------------------------
+// Continue from the first frame received at or after time_usec, in log time
+void
+Log_Replay::
+seek(uint64_t time_usec)
+{
+	pthread_mutex_lock(&lock);
+
+	next = std::lower_bound(index.begin(), index.end(), time_usec, _entry_before) - index.begin();
+
+	base_wall = get_time_usec();
+	base_log  = time_usec;
+
+	pthread_mutex_unlock(&lock);
+}
+
+bool
+Log_Replay::
+finished()
+{
+	pthread_mutex_lock(&lock);
+	bool done = next >= index.size();
+	pthread_mutex_unlock(&lock);
+
+	return done;
+}
+
+size_t
+Log_Replay::
+frames() const
+{
+	return index.size();
+}
+
+uint64_t
+Log_Replay::
+start_time() const
+{
+	return index.empty() ? 0 : index.front().time_usec;
+}
+
+uint64_t
+Log_Replay::
+end_time() const
+{
+	return index.empty() ? 0 : index.back().time_usec;
+}
+
+// Frame i of the log, wherever the replay is, and the time it was received.
+// The index does not change after start(), tools that go through the whole
+// log at once call this instead of read_frames().
+uint64_t
+Log_Replay::
+frame(size_t i, Frame_View &view) const
+{
+	const Log_Replay_Entry &entry = index[i];
+
+	view.frame  = data + entry.offset;
+	view.length = entry.length;
+	view.len    = view.frame[1];
+	view.seq    = view.frame[2];
+	view.sysid  = view.frame[3];
+	view.compid = view.frame[4];
+	view.msgid  = view.frame[5];
+
+	return entry.time_usec;
+}
+
+// Local time at which frame i is handed out
+uint64_t
+Log_Replay::
+due(size_t i) const
+{
+	uint64_t t = index[i].time_usec;
+	if ( t <= base_log )
+		return base_wall;
+
+	return base_wall + (uint64_t)((t - base_log) / speed);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Read
+// ------------------------------------------------------------------------------
+// Views of the frames that are due, pointing into the mapped log
+int
+Log_Replay::
+read_frames(Frame_View *views, int max_views)
+{
+	pthread_mutex_lock(&lock);
+
+	uint64_t now   = speed > 0 ? get_time_usec() : 0;
+	int      count = 0;
+
+	while ( count < max_views && next < index.size() )
+	{
+		if ( speed > 0 && due(next) > now )
+			break;
+
+		frame(next, views[count]);
+
+		next++;
+		count++;
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	frames_replayed += count;
+
+	return count;
+}
+
+// Passed on to the frame scanner.  Frames are indexed by start(), call it
+// before that for the index to include the message.
+void
+Log_Replay::
+add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length)
+{
+	scanner.add_message(msgid, crc_extra, length);
+}
+
+// Sleeps until the next frame is due, like Serial_Port's waits for bytes
+int
+Log_Replay::
+wait_readable(int wake_fd, int timeout_ms)
+{
+	pthread_mutex_lock(&lock);
+	bool     more    = next < index.size();
+	uint64_t wake_at = more ? due(next) : 0;
+	pthread_mutex_unlock(&lock);
+
+	if ( more && speed <= 0 )
+		return 1;
+
+	int wait_ms = timeout_ms;
+	if ( more )
+	{
+		uint64_t now = get_time_usec();
+		if ( wake_at <= now )
+			return 1;
+
+		int until = (int)((wake_at - now + 999) / 1000);
+		if ( wait_ms < 0 || until < wait_ms )
+			wait_ms = until;
+	}
+
+	struct pollfd pfd;
+	pfd.fd      = wake_fd;
+	pfd.events  = POLLIN;
+	pfd.revents = 0;
+
+	int result = poll(&pfd, wake_fd < 0 ? 0 : 1, wait_ms);
+
+	if ( result < 0 )
+		return errno == EINTR ? 0 : -1;
+
+	// woken up by the caller
+	if ( result > 0 )
+		return 0;
+
+	return ( more && get_time_usec() >= wake_at ) ? 1 : 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Write
+// ------------------------------------------------------------------------------
+// Nothing is listening, count it and pretend it went out
+int
+Log_Replay::
+write_message(const mavlink_message_t &message)
+{
+	tx_messages++;
+	return message.len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+Log_Replay::
+print_stats()
+{
+	printf("REPLAY  %llu of %lu frames, %u bad, %llu messages dropped\n",
+			(unsigned long long)frames_replayed, (unsigned long)index.size(),
+			scanner.bad_frames(), (unsigned long long)tx_messages);
+}
+
+
@@ -0,0 +1,171 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file log_replay.h
+ *
+ * @brief Replays recorded MAVLink traffic as if it came from a port
+ *
+ * Functions for indexing flight logs and feeding their frames to an
+ * Autopilot_Interface in place of a serial port.
+ *
+ */
+
+#ifndef LOG_REPLAY_H_
+#define LOG_REPLAY_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+
+#include <common/mavlink.h>
+
+#include "generic_port.h"
+#include "frame_scanner.h"
+#include "flight_recorder.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Log formats
+#define LOG_REPLAY_RAW      0 // bytes as read from the UART
+#define LOG_REPLAY_TLOG     1 // each frame after an 8 byte big endian time [us]
+#define LOG_REPLAY_RECORDER 2 // Flight_Recorder file, received frames only
+
+
+// ------------------------------------------------------------------------------
+//   Data Structures
+// ------------------------------------------------------------------------------
+
+// Where one frame of the log is, and when it was received
+struct Log_Replay_Entry
+{
+	uint64_t time_usec;
+	uint64_t offset;
+	uint16_t length;
+};
+
+
+// ----------------------------------------------------------------------------------
+//   Log Replay Class
+// ----------------------------------------------------------------------------------
+/*
+ * Log Replay Class
+ *
+ * A port that reads from a log file instead of a device.  start() maps the
+ * file and indexes every frame in it with the time it was received; the
+ * frames are then handed out by read_frames() straight from the mapping when
+ * their time comes, speed times faster than they were recorded, or all at
+ * once with speed 0.  seek() jumps to a log time with a binary search over
+ * the index.  Messages written to the port are counted and dropped.
+ *
+ * Raw UART dumps carry no times, their frames are spread out at baudrate as
+ * the bytes would have arrived.
+ */
+class Log_Replay: public Generic_Port
+{
+
+public:
+
+	Log_Replay();
+	Log_Replay(const char *path_, double speed_);
+	void initialize_defaults();
+	~Log_Replay();
+
+	const char *path;
+	double speed;          // 1 is real time, 0 as fast as possible
+	int    baudrate;       // for raw dumps
+	int    format;         // LOG_REPLAY_*, known after start()
+
+	uint64_t frames_replayed;
+	uint64_t tx_messages;  // messages written to the port and dropped
+
+	int read_frames(Frame_View *views, int max_views);
+	int wait_readable(int wake_fd, int timeout_ms);
+	void add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length);
+	int write_message(const mavlink_message_t &message);
+
+	bool is_running();
+	void start();
+	void stop();
+
+	void seek(uint64_t time_usec);
+	bool finished();
+
+	size_t   frames() const;
+	uint64_t frame(size_t i, Frame_View &view) const;
+	uint64_t start_time() const;
+	uint64_t end_time() const;
+
+	void print_stats();
+
+private:
+
+	int            fd;
+	const uint8_t *data;
+	size_t         data_len;
+	bool           running;
+
+	std::vector<Log_Replay_Entry> index;
+	size_t   next;       // index of the next frame to hand out
+	uint64_t base_wall;  // local time when replay (re)started at...
+	uint64_t base_log;   // ...this log time
+
+	pthread_mutex_t lock; // position, between the reader and seek()
+
+	Frame_Scanner scanner;
+
+	void open_log();
+	void close_log();
+
+	void detect_format();
+	void index_raw();
+	void index_tlog();
+	void index_recorder();
+
+	uint64_t due(size_t i) const;
+
+};
+
+
+
+#endif // LOG_REPLAY_H_
+
+
@@ -74,9 +74,35 @@ top (int argc, char **argv)
 	char *uart_name = (char*)"/dev/ttyAMA0";
 #endif
 	int baudrate = 57600;
+	int setpoint_rate = 0;     // only read, don't stream setpoints
+	int setpoint_priority = 0;
+	char *log_name = NULL;     // no flight log
+	char *replay_name = NULL;  // talk to the autopilot, not a log
+	double replay_speed = 1.0;
+	char *port_url = NULL;     // the uart given by -d and -b
+	bool timesync = false;     // with -r 0 send nothing at all
+	char *shm_name = NULL;     // no telemetry bus
+
+	// frames forwarded to other programs on this computer, if -o is given
+	Mavlink_Router router;
 
 	// do the parse, will throw an int if it fails
-	parse_commandline(argc, argv, uart_name, baudrate);
+	parse_commandline(argc, argv, uart_name, baudrate, setpoint_rate, setpoint_priority, log_name,
+			replay_name, replay_speed, port_url, timesync, router, shm_name);
+
+	// a url picks the transport, serial:// just names the uart
+	Port_Url url;
+	memset(&url, 0, sizeof(url));
+	if ( port_url )
+	{
+		parse_port_url(port_url, url);
+		if ( url.type == PORT_URL_SERIAL )
+		{
+			uart_name = url.host;
+			if ( url.baudrate )
+				baudrate = url.baudrate;
+		}
+	}
 
 
 	// --------------------------------------------------------------------------
@@ -95,6 +121,62 @@ top (int argc, char **argv)
 	 */
 	Serial_Port serial_port(uart_name, baudrate);
 
+	// Write from a separate thread, so sending a setpoint never waits for
+	// the UART to drain
+	serial_port.async_tx = true;
+
+	/*
+	 * Record every frame sent and received to a binary flight log, written
+	 * by its own thread so the read thread never waits on the SD card
+	 */
+	Flight_Recorder flight_recorder;
+
+	/*
+	 * Or talk to the autopilot over the network
+	 *
+	 * udp://:14540 listens like PX4 SITL's offboard port expects,
+	 * udpout://host:port and tcp://host:port go to the autopilot.
+	 */
+	UDP_Port udp_port(url.host, url.port, url.type == PORT_URL_UDPOUT);
+	TCP_Port tcp_port(url.host, url.port);
+
+	if ( log_name )
+	{
+		flight_recorder.open(log_name);
+		serial_port.recorder = &flight_recorder;
+		udp_port.recorder    = &flight_recorder;
+		tcp_port.recorder    = &flight_recorder;
+	}
+
+	/*
+	 * Or replay a recorded flight instead
+	 *
+	 * The log's frames go through the same decode path as the serial port's,
+	 * on their original schedule, faster, or as fast as possible with speed 0.
+	 */
+	Log_Replay log_replay(replay_name, replay_speed);
+	log_replay.baudrate = baudrate;
+
+	Generic_Port *port = &serial_port;
+	if ( port_url && (url.type == PORT_URL_UDP || url.type == PORT_URL_UDPOUT) )
+		port = &udp_port;
+	if ( port_url && url.type == PORT_URL_TCP )
+		port = &tcp_port;
+	if ( replay_name )
+		port = &log_replay;
+
+	/*
+	 * Share the link with other programs
+	 *
+	 * The router owns the port and forwards every frame read from it to the
+	 * -o endpoints, and what they send to the autopilot.
+	 */
+	if ( router.endpoint_count() )
+	{
+		router.link = port;
+		port = &router;
+	}
+
 
 	/*
 	 * Instantiate an autopilot interface object
@@ -111,7 +193,32 @@ top (int argc, char **argv)
 	 * otherwise the vehicle will go into failsafe.
 	 *
 	 */
-	Autopilot_Interface autopilot_interface(&serial_port);
+	Autopilot_Interface autopilot_interface(port);
+
+	// Stream setpoints from a deadline scheduled write thread, PX4 wants
+	// at least 2 Hz and works best at 20-50 Hz
+	autopilot_interface.setpoint_rate     = setpoint_rate;
+	autopilot_interface.setpoint_priority = setpoint_priority;
+
+	// Without setpoints only talk to the autopilot if asked to
+	autopilot_interface.timesync_read_only = timesync;
+
+	// Say so when the autopilot goes silent, and when it is back
+	autopilot_interface.link.set_handler(link_changed, &autopilot_interface);
+
+	/*
+	 * Publish the autopilot's messages to shared memory
+	 *
+	 * Other processes on this computer map it with Telemetry_Bus_Reader and
+	 * read the latest of each message, or all of them in order, without
+	 * opening a link or socket of their own.
+	 */
+	Telemetry_Bus telemetry_bus;
+	if ( shm_name )
+	{
+		telemetry_bus.open(shm_name);
+		autopilot_interface.bus = &telemetry_bus;
+	}
 
 	/*
 	 * Setup interrupt signal handler
@@ -121,15 +228,16 @@ top (int argc, char **argv)
 	 * The handler in this example needs references to the above objects.
 	 *
 	 */
-	serial_port_quit         = &serial_port;
+	port_quit                = port;
 	autopilot_interface_quit = &autopilot_interface;
+	flight_recorder_quit     = &flight_recorder;
 	signal(SIGINT,quit_handler);
 
 	/*
 	 * Start the port and autopilot_interface
 	 * This is where the port is opened, and read and write threads are started.
 	 */
-	serial_port.start();
+	port->start();
 
                 
 	autopilot_interface.start();
@@ -165,7 +273,8 @@ top (int argc, char **argv)
 	 * Now that we are done we can stop the threads and close the port
 	 */
 	autopilot_interface.stop();
-	serial_port.stop();
+	port->stop();
+	flight_recorder.close();
 
 
 	// --------------------------------------------------------------------------
@@ -183,6 +292,18 @@ top (int argc, char **argv)
 // ------------------------------------------------------------------------------
 
 
+// Sends the setpoint and waits, then prints the legs the autopilot finished
+void
+fly_leg(Autopilot_Interface &api, const char *name, mavlink_set_position_target_local_ned_t &sp,
+		int seconds, uint64_t &legs)
+{
+	printf("---------------------- %s for %dsec ----------------------\n", name, seconds);
+	api.update_setpoint(sp);
+	sleep(seconds);
+	api.tracking.print(legs);
+}
+
+
 // si2_mission
 void si2_mission(float dx, float dy, float dz, float vx, float vy , float vz,mavlink_set_position_target_local_ned_t &sp){
 	//set_velocity(vx,vy,vz,sp);
@@ -215,24 +336,16 @@ commands(Autopilot_Interface &api,float dx,float dy,float dz, float vx, float vy
 
 	// initialize command data strtuctures
 	mavlink_set_position_target_local_ned_t sp;
-	mavlink_set_position_target_local_ned_t ip = api.initial_position;
 
-	// autopilot_interface.h provides some helper functions to build the command
-        
-        for(int i=0 ;i<15;++i){
-            printf("write_thread_initialization_Waiting for %d sec\n",(15-i));
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-            printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-	    
-            sleep(1);
-        }
-	/*    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            printf("Update Initial Position to  XYZ = [ % .4f , % .4f , % .4f ] \n", pos.x, pos.y, pos.z);
-	    api.initial_position.x = pos.x;
-            api.initial_position.y = pos.y;
-            api.initial_position.z = pos.z;*/
+	// give the write thread time to stream setpoints before moving
+	printf("write_thread_initialization_Waiting for 15 sec\n");
+	sleep(15);
+
+	// every position the autopilot reports is scored against its target, a
+	// line per leg is printed once the target moves on
+	uint64_t legs = api.tracking.legs.pushed();
+	Tracking_Analyzer::print_header();
+
 	// Example 1 - Set Velocity
 	/*set_velocity( vx       , // [m/s]
 				  vy       , // [m/s]
@@ -240,151 +353,52 @@ commands(Autopilot_Interface &api,float dx,float dy,float dz, float vx, float vy
 				   sp        );
         */
 	// Example 2 - Set Position
-	// mavlink_local_position_ned_t initial_pos = api.current_messages.local_position_ned;
-	 set_position(  dx + api.initial_position.x, 
-		        dy + api.initial_position.y,
-			dz + api.initial_position.z,
-			sp         );
-        
-    	
-           
-        //Example 1.2 - Append Yaw Command
-	//set_yaw( api.current_messages.attitude.yaw , // [rad]	
-        //        sp     );
-        
-	// SEND THE COMMAND
-	
-	sp.type_mask =	  MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_POSITION;
-        //Just let it run its write thread
-        api.update_setpoint(sp);
-	
-        
-        // NOW pixhawk will try to move
-        
-	// Wait for 10 seconds, check position
-        printf("\n\n\n----------------------Command Upward 1m by set_position for 10sec----------------------\n");
-	for (int i=0; i <10; i++){
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-		printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-		sleep(1);
-	}
-	
-        mavlink_local_position_ned_t current_pos = api.current_messages.local_position_ned;
-        printf("\n\n\n----------------------si2_mission Hold this altitude for 5sec------------------\n");
-	si2_mission(api.initial_position.x , api.initial_position.y ,  api.initial_position.z-1, 0, 0 , 0 ,sp);
-        
-        api.update_setpoint(sp);
-        for(int i=0; i<5;++i){
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-		printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-		sleep(1);
-        }
+	set_position(  dx + api.initial_position.x,
+		       dy + api.initial_position.y,
+		       dz + api.initial_position.z,
+		       sp         );
 
+	//Example 1.2 - Append Yaw Command
+	//set_yaw( api.current_messages.attitude.yaw , // [rad]
+	//        sp     );
 
+	sp.type_mask = MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_POSITION;
 
-        current_pos = api.current_messages.local_position_ned;
-	si2_mission( api.initial_position.x+1  , api.initial_position.y , api.initial_position.z -1, 0, 0 , 0 ,sp);
-	
-        printf("\n\n\n-----si2_mission move Forward 1m for 10 seconds------------\n");
-	api.update_setpoint(sp);
-	for (int i=0; i <10; i++){
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-		printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-		sleep(1);
-	}
+	// NOW pixhawk will try to move
+	fly_leg(api, "Command Upward 1m by set_position", sp, 10, legs);
+
+	// the same setpoint again is the same leg, the hold is part of it
+	si2_mission(api.initial_position.x , api.initial_position.y ,  api.initial_position.z-1, 0, 0 , 0 ,sp);
+	fly_leg(api, "si2_mission Hold this altitude", sp, 5, legs);
 
-        printf("\n\n\n----------------------si2_mission Hold this altitude for 5sec------------------\n");
 	si2_mission(api.initial_position.x+1 , api.initial_position.y ,  api.initial_position.z-1, 0, 0 , 0 ,sp);
-        
-        api.update_setpoint(sp);
-        for(int i=0; i<5;++i){
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-		printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-		sleep(1);
-        }
-	printf("\n");
-        printf("\n\n\n----------------------si2_mission Turn Right for 10sec------------------\n");
+	fly_leg(api, "si2_mission move Forward 1m", sp, 10, legs);
+
+	si2_mission(api.initial_position.x+1 , api.initial_position.y ,  api.initial_position.z-1, 0, 0 , 0 ,sp);
+	fly_leg(api, "si2_mission Hold this altitude", sp, 5, legs);
+
 	si2_mission(api.initial_position.x+1 , api.initial_position.y+1 ,  api.initial_position.z-1, 0, 0 , 0 ,sp);
-        
-        api.update_setpoint(sp);
-        for(int i=0; i<10;++i){
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-		printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-		sleep(1);
-        }
-	printf("\n");
+	fly_leg(api, "si2_mission Turn Right", sp, 10, legs);
 
-        printf("\n\n\n----------------------si2_mission Hold this altitude for 5sec------------------\n");
 	si2_mission(api.initial_position.x+1 , api.initial_position.y+1,  api.initial_position.z-1, 0, 0 , 0 ,sp);
-        
-        api.update_setpoint(sp);
-        for(int i=0; i<5;++i){
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-		printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-		sleep(1);
-        }
-	printf("\n");
-        printf("\n\n\n----------------------si2_mission Move Backward for 10sec------------------\n");
+	fly_leg(api, "si2_mission Hold this altitude", sp, 5, legs);
+
 	si2_mission(api.initial_position.x , api.initial_position.y+1 ,  api.initial_position.z-1, 0, 0 , 0 ,sp);
-        
-        api.update_setpoint(sp);
-        for(int i=0; i<10;++i){
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-		printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-		sleep(1);
-        }
-	printf("\n");
-        printf("\n\n\n----------------------si2_mission Hold this altitude for 5sec------------------\n");
+	fly_leg(api, "si2_mission Move Backward", sp, 10, legs);
+
 	si2_mission(api.initial_position.x , api.initial_position.y+1,  api.initial_position.z-1, 0, 0 , 0 ,sp);
-        
-        api.update_setpoint(sp);
-        for(int i=0; i<5;++i){
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-		printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-		sleep(1);
-        }
-	printf("\n");
-        printf("\n\n\n----------------------si2_mission Turn Left for 10sec------------------\n");
+	fly_leg(api, "si2_mission Hold this altitude", sp, 5, legs);
+
 	si2_mission(api.initial_position.x , api.initial_position.y ,  api.initial_position.z-1, 0, 0 , 0 ,sp);
-        
-        api.update_setpoint(sp);
-        for(int i=0; i<10;++i){
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-		printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-		sleep(1);
-        }
-	printf("\n");
+	fly_leg(api, "si2_mission Turn Left", sp, 10, legs);
 
-        printf("\n\n\n----------------------si2_mission Move Downward for 10sec------------------\n");
 	si2_mission(api.initial_position.x , api.initial_position.y ,  api.initial_position.z, 0, 0 , 0 ,sp);
-        
-        api.update_setpoint(sp);
-        for(int i=0; i<10;++i){
-	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned;
-            mavlink_position_target_local_ned_t  target_pos = api.current_messages.position_target_local_ned;
-            printf("%i TARGET  POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, target_pos.x,target_pos.y, target_pos.z);
-		printf("%i CURRENT POSITION XYZ = [ % .4f , % .4f , % .4f ] \n", i, pos.x, pos.y, pos.z);
-		sleep(1);
-        }
+	fly_leg(api, "si2_mission Move Downward", sp, 10, legs);
+
+	// the last leg is still open
+	api.tracking.print_current();
 	printf("\n");
+
 	// --------------------------------------------------------------------------
 	//   STOP OFFBOARD MODE
 	// --------------------------------------------------------------------------
@@ -399,16 +413,13 @@ commands(Autopilot_Interface &api,float dx,float dy,float dz, float vx, float vy
 	// --------------------------------------------------------------------------
 	printf("READ SOME MESSAGES \n");
 
-	// copy current messages
-	Mavlink_Messages messages = api.current_messages;
-
 	// local position in ned frame
-	mavlink_local_position_ned_t pos = messages.local_position_ned;
+	mavlink_local_position_ned_t pos = api.current_messages.local_position_ned.load();
 	printf("Got message LOCAL_POSITION_NED (spec: https://pixhawk.ethz.ch/mavlink/#LOCAL_POSITION_NED)\n");
 	printf("    pos  (NED):  %f %f %f (m)\n", pos.x, pos.y, pos.z );
 
 	// hires imu
-	mavlink_highres_imu_t imu = messages.highres_imu;
+	mavlink_highres_imu_t imu = api.current_messages.highres_imu.load();
 	printf("Got message HIGHRES_IMU (spec: https://pixhawk.ethz.ch/mavlink/#HIGHRES_IMU)\n");
 	printf("    ap time:     %llu \n", imu.time_usec);
 	printf("    acc  (NED):  % f % f % f (m/s^2)\n", imu.xacc , imu.yacc , imu.zacc );
@@ -435,30 +446,30 @@ void si2_message_broadcast(Autopilot_Interface &api){
 	    // --------------------------------------------------------------------------
 	    printf("READ SOME MESSAGES \n");
 
-	    // copy current messages
-	    Mavlink_Messages messages = api.current_messages;
-
 	    // local position in ned frame
-	    mavlink_local_position_ned_t pos = messages.local_position_ned;
+	    mavlink_local_position_ned_t pos = api.current_messages.local_position_ned.load();
 	    printf("Got message LOCAL_POSITION_NED \n");
 	    printf("    pos  (NED): x: %8f  y: %8f  z: %8f (m)\n", pos.x, pos.y, pos.z );
 	    printf("    pos  (NED):vx: %8f vy: %8f vz: %8f (m)\n", pos.vx, pos.vy, pos.vz );
 
 
-	    // highres_imu
-	    mavlink_highres_imu_t imu = messages.highres_imu;
+	    // highres_imu, only the one field is copied out
+	    float pressure_alt = api.current_messages.highres_imu.load_field(&mavlink_highres_imu_t::pressure_alt);
 	    printf("Got message HIGHRES_IMU \n");
-	    printf("    altitude:    %f (m) \n"     , imu.pressure_alt);
+	    printf("    altitude:    %f (m) \n"     , pressure_alt);
 	    printf("\n");
 
         // attribute
-        mavlink_attitude_t attitude = messages.attitude;
+        mavlink_attitude_t attitude = api.current_messages.attitude.load();
         printf("Got message ATTITUDE #30 \n");
         printf("In Degree:   row:  %f    pitch:  %f    yaw:  %f \n",attitude.roll*180, attitude.pitch*180, attitude.yaw*180);
         // VFR_HUD
-        mavlink_vfr_hud_t vfr_hud = messages.vfr_hud;
+        mavlink_vfr_hud_t vfr_hud = api.current_messages.vfr_hud.load();
         printf("Got message VFR_HUD  #74 \n");
         printf("Headig in 360 degree(0 = North) : %d  \n", vfr_hud.heading);
+
+        // link timing and throughput
+        api.print_stats();
         sleep(1);
     }
 
@@ -479,11 +490,14 @@ void si2_message_broadcast(Autopilot_Interface &api){
 // ------------------------------------------------------------------------------
 // throws EXIT_FAILURE if could not open the port
 void
-parse_commandline(int argc, char **argv, char *&uart_name, int &baudrate)
+parse_commandline(int argc, char **argv, char *&uart_name, int &baudrate,
+		int &setpoint_rate, int &setpoint_priority, char *&log_name,
+		char *&replay_name, double &replay_speed, char *&port_url, bool &timesync,
+		Mavlink_Router &router, char *&shm_name)
 {
 
 	// string for command line usage
-	const char *commandline_usage = "usage: mavlink_serial -d <devicename> -b <baudrate>";
+	const char *commandline_usage = "usage: mavlink_serial -d <devicename> -b <baudrate> [-r <setpoint rate Hz>] [-p <SCHED_FIFO priority>] [-l <flight log>] [-f <log to replay> [-s <speed, 0 for max>]] [-u <udp://[host]:port | udpout://host:port | tcp://host:port | serial://device[:baudrate]>] [-t (TIMESYNC even with -r 0)] [-o <udpout://host:port | unix:///path> [-F <sysid>[:<compid>]]]... [-m <shared memory name, e.g. /mavlink_telemetry>]";
 
 	// Read input arguments
 	for (int i = 1; i < argc; i++) { // argv[0] is "mavlink"
@@ -516,6 +530,107 @@ parse_commandline(int argc, char **argv, char *&uart_name, int &baudrate)
 			}
 		}
 
+		// Setpoint rate
+		if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--rate") == 0) {
+			if (argc > i + 1) {
+				setpoint_rate = atoi(argv[i + 1]);
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Write thread priority
+		if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--priority") == 0) {
+			if (argc > i + 1) {
+				setpoint_priority = atoi(argv[i + 1]);
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Flight log
+		if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--log") == 0) {
+			if (argc > i + 1) {
+				log_name = argv[i + 1];
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Replay a log
+		if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--replay") == 0) {
+			if (argc > i + 1) {
+				replay_name = argv[i + 1];
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Replay speed
+		if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--speed") == 0) {
+			if (argc > i + 1) {
+				replay_speed = atof(argv[i + 1]);
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Transport url
+		if (strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--url") == 0) {
+			Port_Url url;
+			if (argc > i + 1 && parse_port_url(argv[i + 1], url) && url.type != PORT_URL_UNIX) {
+				port_url = argv[i + 1];
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Clock sync while only reading
+		if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--timesync") == 0) {
+			timesync = true;
+		}
+
+		// Forward to another program
+		if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--forward") == 0) {
+			if (argc < i + 2 || not router.add_endpoint(argv[i + 1])) {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Only frames from this system and component to the last -o
+		if (strcmp(argv[i], "-F") == 0 || strcmp(argv[i], "--filter") == 0) {
+			int sysid = -1, compid = 0;
+			if (argc < i + 2 || sscanf(argv[i + 1], "%d:%d", &sysid, &compid) < 1 ||
+			    not router.set_filter(sysid, compid)) {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Telemetry bus
+		if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--shm") == 0) {
+			if (argc > i + 1 && argv[i + 1][0] == '/') {
+				shm_name = argv[i + 1];
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
 	}
 	// end: for each input argument
 
@@ -524,6 +639,25 @@ parse_commandline(int argc, char **argv, char *&uart_name, int &baudrate)
 }
 
 
+// ------------------------------------------------------------------------------
+//   Link Lost Handler
+// ------------------------------------------------------------------------------
+// Called from the read thread, at most the link timeout after the last
+// message.  The autopilot runs its own offboard loss failsafe, this is where
+// the companion would stop its mission or hold its setpoint.
+void
+link_changed(void *context, int state)
+{
+	Autopilot_Interface *autopilot_interface = (Autopilot_Interface *)context;
+
+	if ( state == LINK_LOST )
+		fprintf(stderr, "WARNING: no message from the autopilot for %.1f s, link lost\n",
+				(get_time_usec() - autopilot_interface->link.last_received()) * 1e-6);
+	else if ( state == LINK_UP && autopilot_interface->link.losses() )
+		fprintf(stderr, "LINK TO THE AUTOPILOT RESTORED\n");
+}
+
+
 // ------------------------------------------------------------------------------
 //   Quit Signal Handler
 // ------------------------------------------------------------------------------
@@ -541,12 +675,15 @@ quit_handler( int sig )
 	}
 	catch (int error){}
 
-	// serial port
+	// serial port, network port or log replay
 	try {
-		serial_port_quit->handle_quit(sig);
+		port_quit->stop();
 	}
 	catch (int error){}
 
+	// flight log, trimmed to what was recorded
+	flight_recorder_quit->close();
+
 	// end program here
 	exit(0);
 
@@ -71,6 +71,12 @@ using namespace std;
 
 #include "autopilot_interface.h"
 #include "serial_port.h"
+#include "udp_port.h"
+#include "tcp_port.h"
+#include "log_replay.h"
+#include "mavlink_router.h"
+#include "port_url.h"
+#include "telemetry_bus.h"
 
 
 // ------------------------------------------------------------------------------
@@ -81,12 +87,19 @@ int main(int argc, char **argv);
 int top(int argc, char **argv);
 
 void commands(Autopilot_Interface &autopilot_interface, float dx, float dy, float dz,float vx, float vy, float vz);
+void fly_leg(Autopilot_Interface &api, const char *name, mavlink_set_position_target_local_ned_t &sp,
+		int seconds, uint64_t &legs);
 void si2_mission(float dx, float dy, float dz, float vx, float vy , float vz,mavlink_set_position_target_local_ned_t &sp);
-void parse_commandline(int argc, char **argv, char *&uart_name, int &baudrate);
-void si2_message_broadcast(Autopilot_Interface &autopilot_interface );   
+void parse_commandline(int argc, char **argv, char *&uart_name, int &baudrate,
+		int &setpoint_rate, int &setpoint_priority, char *&log_name,
+		char *&replay_name, double &replay_speed, char *&port_url, bool &timesync,
+		Mavlink_Router &router, char *&shm_name);
+void si2_message_broadcast(Autopilot_Interface &autopilot_interface );
+void link_changed(void *context, int state);   
         
 // quit handler
 Autopilot_Interface *autopilot_interface_quit;
-Serial_Port *serial_port_quit;
+Generic_Port *port_quit;
+Flight_Recorder *flight_recorder_quit;
 void quit_handler( int sig );
 
@@ -0,0 +1,776 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file mavlink_router.cpp
+ *
+ * @brief Fans the autopilot link out to local consumers, functions
+ *
+ * Queues frames per endpoint in the read thread and sends them from the
+ * router thread.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "mavlink_router.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+
+#include "time_base.h"
+
+
+// ----------------------------------------------------------------------------------
+//   MAVLink Router Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Mavlink_Router::
+Mavlink_Router()
+{
+	link = NULL;
+
+	endpoints_count = 0;
+
+	forward_tid  = 0;
+	time_to_exit = false;
+	sleeping     = false;
+
+	added_count   = 0;
+	added_applied = 0;
+
+	if ( pthread_mutex_init(&added_lock, NULL) )
+	{
+		printf("\n mutex init failed\n");
+		throw 1;
+	}
+
+	// lets the read thread and stop() wake the router thread
+	wake_fd = eventfd(0, EFD_NONBLOCK);
+	if ( wake_fd < 0 )
+	{
+		fprintf(stderr,"ERROR: could not create wake up event\n");
+		throw 1;
+	}
+}
+
+Mavlink_Router::
+~Mavlink_Router()
+{
+	// the link is stopped by whoever stopped the router
+	if ( forward_tid )
+		stop();
+
+	for ( int i = 0; i < endpoints_count; i++ )
+		delete endpoints[i];
+
+	close(wake_fd);
+	pthread_mutex_destroy(&added_lock);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Endpoints
+// ------------------------------------------------------------------------------
+// Adds a consumer by url, false if the url is not one the router sends to or
+// there are MAVLINK_ROUTER_MAX_ENDPOINTS already
+bool
+Mavlink_Router::
+add_endpoint(const char *url)
+{
+	if ( endpoints_count == MAVLINK_ROUTER_MAX_ENDPOINTS )
+		return false;
+
+	Port_Url parsed;
+	if ( not parse_port_url(url, parsed) )
+		return false;
+	if ( parsed.type != PORT_URL_UDPOUT && parsed.type != PORT_URL_UNIX )
+		return false;
+	if ( parsed.type == PORT_URL_UNIX && strlen(parsed.host) >= sizeof(((struct sockaddr_un *)0)->sun_path) )
+		return false;
+
+	Router_Endpoint *endpoint = new Router_Endpoint;
+
+	endpoint->name   = url;
+	endpoint->url    = parsed;
+	endpoint->sysid  = 0;
+	endpoint->compid = 0;
+
+	endpoint->sock         = -1;
+	endpoint->connected    = false;
+	endpoint->blocked      = false;
+	endpoint->next_connect = 0;
+	endpoint->address_len  = 0;
+	memset(&endpoint->address, 0, sizeof(endpoint->address));
+
+	endpoint->head = 0;
+	endpoint->tail = 0;
+
+	endpoint->tx_frames    = 0;
+	endpoint->tx_bytes     = 0;
+	endpoint->tx_datagrams = 0;
+	endpoint->tx_writes    = 0;
+	endpoint->dropped      = 0;
+	endpoint->lost         = 0;
+	endpoint->filtered     = 0;
+	endpoint->peak         = 0;
+	endpoint->rx_frames    = 0;
+
+	endpoints[endpoints_count++] = endpoint;
+
+	return true;
+}
+
+// Only forward frames from sysid (and compid) to the endpoint added last,
+// 0 for any.  False if there is none or the ids are out of range.
+bool
+Mavlink_Router::
+set_filter(int sysid, int compid)
+{
+	if ( endpoints_count == 0 || sysid < 0 || sysid > 255 || compid < 0 || compid > 255 )
+		return false;
+
+	endpoints[endpoints_count - 1]->sysid  = sysid;
+	endpoints[endpoints_count - 1]->compid = compid;
+
+	return true;
+}
+
+int
+Mavlink_Router::
+endpoint_count()
+{
+	return endpoints_count;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Read from the Link
+// ------------------------------------------------------------------------------
+// The link's frames, each also queued for the endpoints that want it
+int
+Mavlink_Router::
+read_frames(Frame_View *views, int max_views)
+{
+	int count = link->read_frames(views, max_views);
+
+	if ( count > 0 )
+		forward(views, count);
+
+	return count;
+}
+
+// Copies the frames into the endpoint queues, only called from the read
+// thread.  The router thread is only woken if it went to sleep, so a busy
+// link costs one eventfd write per batch at most.
+void
+Mavlink_Router::
+forward(const Frame_View *views, int count)
+{
+	bool queued = false;
+
+	for ( int e = 0; e < endpoints_count; e++ )
+	{
+		Router_Endpoint &endpoint = *endpoints[e];
+
+		uint32_t head = __atomic_load_n(&endpoint.head, __ATOMIC_ACQUIRE);
+		uint32_t tail = endpoint.tail;
+
+		for ( int i = 0; i < count; i++ )
+		{
+			const Frame_View &view = views[i];
+
+			if ( (endpoint.sysid  && view.sysid  != endpoint.sysid) ||
+			     (endpoint.compid && view.compid != endpoint.compid) )
+			{
+				endpoint.filtered++;
+				continue;
+			}
+
+			if ( tail - head + view.length > MAVLINK_ROUTER_QUEUE_LEN )
+			{
+				endpoint.dropped++;
+				continue;
+			}
+
+			// frames are copied as received, wrapping around the end
+			unsigned at    = tail & (MAVLINK_ROUTER_QUEUE_LEN - 1);
+			unsigned first = MAVLINK_ROUTER_QUEUE_LEN - at;
+			if ( first > view.length )
+				first = view.length;
+
+			memcpy(endpoint.queue + at, view.frame, first);
+			memcpy(endpoint.queue, view.frame + first, view.length - first);
+
+			tail += view.length;
+		}
+
+		if ( tail != endpoint.tail )
+		{
+			if ( tail - head > endpoint.peak )
+				endpoint.peak = tail - head;
+
+			__atomic_store_n(&endpoint.tail, tail, __ATOMIC_SEQ_CST);
+			queued = true;
+		}
+	}
+
+	if ( queued && __atomic_exchange_n(&sleeping, false, __ATOMIC_SEQ_CST) )
+	{
+		uint64_t one = 1;
+		if ( write(wake_fd, &one, sizeof(one)) < 0 )
+			fprintf(stderr, "ERROR: could not wake the router thread\n");
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Passed on to the Link
+// ------------------------------------------------------------------------------
+int
+Mavlink_Router::
+wait_readable(int wake_fd_, int timeout_ms)
+{
+	return link->wait_readable(wake_fd_, timeout_ms);
+}
+
+// The endpoint scanners learn it in the router thread, see apply_added()
+void
+Mavlink_Router::
+add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length)
+{
+	link->add_message(msgid, crc_extra, length);
+
+	pthread_mutex_lock(&added_lock);
+	if ( added_count < 256 )
+	{
+		added[added_count][0] = msgid;
+		added[added_count][1] = crc_extra;
+		added[added_count][2] = length;
+		__atomic_store_n(&added_count, added_count + 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&added_lock);
+}
+
+int
+Mavlink_Router::
+write_message(const mavlink_message_t &message)
+{
+	return link->write_message(message);
+}
+
+int
+Mavlink_Router::
+write_messages(const mavlink_message_t *messages, int count)
+{
+	return link->write_messages(messages, count);
+}
+
+int
+Mavlink_Router::
+write_frames(const uint8_t *frames, unsigned len, int count)
+{
+	return link->write_frames(frames, len, count);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+Mavlink_Router::
+print_stats()
+{
+	link->print_stats();
+
+	for ( int i = 0; i < endpoints_count; i++ )
+	{
+		const Router_Endpoint &endpoint = *endpoints[i];
+
+		printf("ROUTE   %s", endpoint.name);
+		if ( endpoint.sysid || endpoint.compid )
+			printf(" (from %u:%u)", endpoint.sysid, endpoint.compid);
+
+		printf("  tx: %llu frames, %llu bytes in %llu datagrams, %llu writes, queue %u (peak %u), %llu dropped, %llu lost, %llu filtered  rx: %llu frames\n",
+				(unsigned long long)endpoint.tx_frames, (unsigned long long)endpoint.tx_bytes,
+				(unsigned long long)endpoint.tx_datagrams, (unsigned long long)endpoint.tx_writes,
+				endpoint.tail - endpoint.head, endpoint.peak,
+				(unsigned long long)endpoint.dropped, (unsigned long long)endpoint.lost,
+				(unsigned long long)endpoint.filtered, (unsigned long long)endpoint.rx_frames);
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Startup and Shutdown
+// ------------------------------------------------------------------------------
+/**
+ * throws EXIT_FAILURE if an endpoint could not be opened
+ */
+void
+Mavlink_Router::
+start()
+{
+	if ( not link )
+	{
+		fprintf(stderr, "ERROR: router has no link\n");
+		throw EXIT_FAILURE;
+	}
+
+	link->start();
+
+	for ( int i = 0; i < endpoints_count; i++ )
+		open_endpoint(*endpoints[i]);
+
+	time_to_exit = false;
+
+	printf("START ROUTER THREAD\n");
+
+	int result = pthread_create( &forward_tid, NULL, &start_mavlink_router_forward_thread, this );
+	if ( result ) throw result;
+
+	printf("ROUTING TO %i ENDPOINTS\n", endpoints_count);
+	printf("\n");
+}
+
+void
+Mavlink_Router::
+stop()
+{
+	if ( forward_tid )
+	{
+		printf("CLOSE ROUTER THREAD\n");
+
+		time_to_exit = true;
+
+		uint64_t one = 1;
+		if ( write(wake_fd, &one, sizeof(one)) < 0 )
+			fprintf(stderr, "ERROR: could not wake the router thread\n");
+
+		pthread_join(forward_tid, NULL);
+		forward_tid = 0;
+	}
+
+	for ( int i = 0; i < endpoints_count; i++ )
+	{
+		if ( endpoints[i]->sock >= 0 )
+			close(endpoints[i]->sock);
+		endpoints[i]->sock      = -1;
+		endpoints[i]->connected = false;
+	}
+
+	if ( link )
+		link->stop();
+}
+
+bool
+Mavlink_Router::
+is_running()
+{
+	return link && link->is_running();
+}
+
+// throws EXIT_FAILURE if the socket can not be made, a unix consumer that
+// is not there yet is only waited for
+void
+Mavlink_Router::
+open_endpoint(Router_Endpoint &endpoint)
+{
+	const Port_Url &url = endpoint.url;
+
+	if ( url.type == PORT_URL_UDPOUT )
+	{
+		if ( not resolve_host(url.host, url.port, endpoint.address.in) )
+		{
+			printf("failure, could not resolve %s.\n", url.host);
+			throw EXIT_FAILURE;
+		}
+		endpoint.address_len = sizeof(endpoint.address.in);
+
+		endpoint.sock = socket(AF_INET, SOCK_DGRAM, 0);
+	}
+	else
+	{
+		endpoint.address.un.sun_family = AF_UNIX;
+		strcpy(endpoint.address.un.sun_path, url.host);
+		endpoint.address_len = sizeof(endpoint.address.un);
+
+		endpoint.sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+		// an abstract address of our own, so the consumer can answer
+		struct sockaddr_un local;
+		memset(&local, 0, sizeof(local));
+		local.sun_family = AF_UNIX;
+		if ( endpoint.sock >= 0 && bind(endpoint.sock, (struct sockaddr *)&local, sizeof(sa_family_t)) )
+			fprintf(stderr, "WARNING: %s can not answer, %s\n", endpoint.name, strerror(errno));
+	}
+
+	if ( endpoint.sock < 0 )
+	{
+		printf("failure, could not open socket for %s, %s.\n", endpoint.name, strerror(errno));
+		throw EXIT_FAILURE;
+	}
+
+	fcntl(endpoint.sock, F_SETFL, fcntl(endpoint.sock, F_GETFL) | O_NONBLOCK);
+
+	connect_endpoint(endpoint, get_time_usec());
+}
+
+// Connected sockets report a full consumer as POLLOUT, and a unix consumer
+// that went away as ECONNREFUSED
+void
+Mavlink_Router::
+connect_endpoint(Router_Endpoint &endpoint, uint64_t now)
+{
+	if ( connect(endpoint.sock, (struct sockaddr *)&endpoint.address, endpoint.address_len) == 0 )
+	{
+		endpoint.connected = true;
+		printf("Forwarding to %s\n", endpoint.name);
+		return;
+	}
+
+	// say so once, then keep trying quietly
+	if ( endpoint.next_connect == 0 )
+		printf("Waiting for %s, %s\n", endpoint.name, strerror(errno));
+
+	endpoint.connected    = false;
+	endpoint.next_connect = now + MAVLINK_ROUTER_RETRY_INTERVAL*1000ULL;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Send Queued Frames
+// ------------------------------------------------------------------------------
+// Packs whole frames into datagrams of up to MAVLINK_ROUTER_DATAGRAM_LEN,
+// straight out of the queue, and sends as many as the socket takes.  Returns
+// true if the socket is full and frames are left.
+bool
+Mavlink_Router::
+send_queued(Router_Endpoint &endpoint)
+{
+	struct mmsghdr msgs[MAVLINK_ROUTER_MAX_BATCH];
+	struct iovec   iovs[MAVLINK_ROUTER_MAX_BATCH][2];
+	uint32_t       sizes[MAVLINK_ROUTER_MAX_BATCH];
+	unsigned       frames[MAVLINK_ROUTER_MAX_BATCH];
+
+	uint32_t head = endpoint.head;
+	uint32_t tail = __atomic_load_n(&endpoint.tail, __ATOMIC_ACQUIRE);
+
+	endpoint.blocked = false;
+
+	while ( head != tail )
+	{
+		int      count = 0;
+		uint32_t at    = head;
+
+		memset(msgs, 0, sizeof(msgs));
+		while ( count < MAVLINK_ROUTER_MAX_BATCH && at != tail )
+		{
+			// whole frames, at least one, the length byte follows STX
+			uint32_t start  = at;
+			unsigned inside = 0;
+			while ( at != tail )
+			{
+				unsigned length = endpoint.queue[(at + 1) & (MAVLINK_ROUTER_QUEUE_LEN - 1)] + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+				if ( inside && at - start + length > MAVLINK_ROUTER_DATAGRAM_LEN )
+					break;
+				at += length;
+				inside++;
+			}
+
+			uint32_t size   = at - start;
+			unsigned offset = start & (MAVLINK_ROUTER_QUEUE_LEN - 1);
+			unsigned first  = MAVLINK_ROUTER_QUEUE_LEN - offset;
+			if ( first > size )
+				first = size;
+
+			iovs[count][0].iov_base = endpoint.queue + offset;
+			iovs[count][0].iov_len  = first;
+			iovs[count][1].iov_base = endpoint.queue;
+			iovs[count][1].iov_len  = size - first;
+
+			msgs[count].msg_hdr.msg_iov    = iovs[count];
+			msgs[count].msg_hdr.msg_iovlen = size > first ? 2 : 1;
+
+			sizes[count]  = size;
+			frames[count] = inside;
+			count++;
+		}
+
+		// nobody to send to, make room for when there is
+		if ( not endpoint.connected )
+		{
+			for ( int i = 0; i < count; i++ )
+				endpoint.lost += frames[i];
+			head = at;
+			continue;
+		}
+
+		int result = sendmmsg(endpoint.sock, msgs, count, MSG_DONTWAIT);
+		endpoint.tx_writes++;
+
+		if ( result < 0 )
+		{
+			if ( errno == EAGAIN || errno == EWOULDBLOCK )
+			{
+				endpoint.blocked = true;
+				break;
+			}
+			if ( errno == EINTR )
+				continue;
+
+			// the consumer is gone, or an earlier datagram bounced; give up
+			// on the first datagram and carry on with the rest
+			endpoint.lost += frames[0];
+			head += sizes[0];
+
+			if ( endpoint.url.type == PORT_URL_UNIX && (errno == ECONNREFUSED || errno == ENOENT) )
+			{
+				printf("Lost %s, %s\n", endpoint.name, strerror(errno));
+				endpoint.connected    = false;
+				endpoint.next_connect = get_time_usec() + MAVLINK_ROUTER_RETRY_INTERVAL*1000ULL;
+			}
+			continue;
+		}
+
+		for ( int i = 0; i < result; i++ )
+		{
+			head += sizes[i];
+			endpoint.tx_bytes  += sizes[i];
+			endpoint.tx_frames += frames[i];
+		}
+		endpoint.tx_datagrams += result;
+
+		// the rest would block
+		if ( result < count )
+		{
+			endpoint.blocked = true;
+			break;
+		}
+	}
+
+	__atomic_store_n(&endpoint.head, head, __ATOMIC_RELEASE);
+
+	return endpoint.blocked;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Receive from an Endpoint
+// ------------------------------------------------------------------------------
+// Frames a consumer sent, checked and written to the link
+void
+Mavlink_Router::
+receive(Router_Endpoint &endpoint)
+{
+	Frame_View views[GENERIC_PORT_MAX_BATCH];
+
+	// a few datagrams per wakeup, the link is slower than any consumer
+	for ( int i = 0; i < MAVLINK_ROUTER_MAX_BATCH; i++ )
+	{
+		int result = recv(endpoint.sock, rx_buffer, sizeof(rx_buffer), MSG_DONTWAIT);
+		if ( result <= 0 )
+			return;
+
+		unsigned offset = 0;
+		int count;
+		do {
+			unsigned consumed;
+			count = endpoint.scanner.scan(rx_buffer + offset, result - offset, views, GENERIC_PORT_MAX_BATCH,
+					consumed, false);
+			offset += consumed;
+
+			// checked by the scanner, sent on as they are
+			for ( int j = 0; j < count; j++ )
+				link->write_frames(views[j].frame, views[j].length, 1);
+			endpoint.rx_frames += count;
+
+		} while ( count == GENERIC_PORT_MAX_BATCH );
+	}
+}
+
+// Messages from add_message() that the endpoint scanners do not know yet
+void
+Mavlink_Router::
+apply_added()
+{
+	if ( __atomic_load_n(&added_count, __ATOMIC_ACQUIRE) == added_applied )
+		return;
+
+	pthread_mutex_lock(&added_lock);
+	for ( ; added_applied < added_count; added_applied++ )
+	{
+		for ( int i = 0; i < endpoints_count; i++ )
+			endpoints[i]->scanner.add_message(added[added_applied][0], added[added_applied][1],
+					added[added_applied][2]);
+	}
+	pthread_mutex_unlock(&added_lock);
+}
+
+// Frames waiting on a socket that is not full
+bool
+Mavlink_Router::
+have_queued()
+{
+	for ( int i = 0; i < endpoints_count; i++ )
+	{
+		const Router_Endpoint &endpoint = *endpoints[i];
+		if ( not endpoint.blocked && __atomic_load_n(&endpoint.tail, __ATOMIC_SEQ_CST) != endpoint.head )
+			return true;
+	}
+	return false;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Router Thread
+// ------------------------------------------------------------------------------
+void
+Mavlink_Router::
+start_forward_thread()
+{
+	forward_thread();
+}
+
+// Sends what the read thread queued, sleeps in poll() until more is queued,
+// a full socket drains, a consumer sends something or it is time to look
+// for a unix consumer again
+void
+Mavlink_Router::
+forward_thread()
+{
+	struct pollfd pfds[1 + MAVLINK_ROUTER_MAX_ENDPOINTS];
+
+	while ( not time_to_exit )
+	{
+		apply_added();
+
+		uint64_t now     = get_time_usec();
+		int      wait_ms = -1;
+
+		pfds[0].fd      = wake_fd;
+		pfds[0].events  = POLLIN;
+		pfds[0].revents = 0;
+
+		for ( int i = 0; i < endpoints_count; i++ )
+		{
+			Router_Endpoint &endpoint = *endpoints[i];
+
+			if ( not endpoint.connected && now >= endpoint.next_connect )
+				connect_endpoint(endpoint, now);
+			if ( not endpoint.connected )
+				wait_ms = MAVLINK_ROUTER_RETRY_INTERVAL;
+
+			if ( not endpoint.blocked )
+				send_queued(endpoint);
+
+			pfds[1 + i].fd      = endpoint.sock;
+			pfds[1 + i].events  = POLLIN | (endpoint.blocked ? POLLOUT : 0);
+			pfds[1 + i].revents = 0;
+		}
+
+		// the read thread only wakes us once we said we sleep, so look again
+		// after saying it
+		__atomic_store_n(&sleeping, true, __ATOMIC_SEQ_CST);
+		if ( have_queued() )
+		{
+			__atomic_store_n(&sleeping, false, __ATOMIC_SEQ_CST);
+			continue;
+		}
+
+		int result = poll(pfds, 1 + endpoints_count, wait_ms);
+
+		__atomic_store_n(&sleeping, false, __ATOMIC_SEQ_CST);
+
+		if ( result <= 0 )
+			continue;
+
+		if ( pfds[0].revents & POLLIN )
+		{
+			uint64_t count;
+			if ( read(wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN )
+				fprintf(stderr, "ERROR: could not read the router wake up event\n");
+		}
+
+		for ( int i = 0; i < endpoints_count; i++ )
+		{
+			Router_Endpoint &endpoint = *endpoints[i];
+
+			if ( pfds[1 + i].revents & POLLIN )
+				receive(endpoint);
+			if ( pfds[1 + i].revents & (POLLOUT | POLLERR) )
+				endpoint.blocked = false;
+
+			// an ICMP port unreachable from a consumer that is not up yet,
+			// it would keep poll() returning
+			if ( pfds[1 + i].revents & POLLERR )
+			{
+				int error;
+				socklen_t length = sizeof(error);
+				getsockopt(endpoint.sock, SOL_SOCKET, SO_ERROR, &error, &length);
+			}
+		}
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//  Pthread Starter Helper Functions
+// ------------------------------------------------------------------------------
+
+void*
+start_mavlink_router_forward_thread(void *args)
+{
+	// takes a router object argument
+	Mavlink_Router *router = (Mavlink_Router *)args;
+
+	// run the object's router thread
+	router->start_forward_thread();
+
+	// done!
+	return NULL;
+}
+
+
@@ -0,0 +1,223 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file mavlink_router.h
+ *
+ * @brief Fans the autopilot link out to local consumers
+ *
+ * Forwards every frame read from the link, as received, to UDP and Unix
+ * socket endpoints, and what those send back to the autopilot.
+ *
+ */
+
+#ifndef MAVLINK_ROUTER_H_
+#define MAVLINK_ROUTER_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+
+#include <common/mavlink.h>
+
+#include "generic_port.h"
+#include "frame_scanner.h"
+#include "port_url.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Consumers one router forwards to
+#define MAVLINK_ROUTER_MAX_ENDPOINTS 16
+
+// Bytes queued per endpoint before its frames are dropped, a power of two
+#define MAVLINK_ROUTER_QUEUE_LEN 16384
+
+// Frames are packed into datagrams up to this size, under the Ethernet MTU
+#define MAVLINK_ROUTER_DATAGRAM_LEN 1400
+
+// Datagrams sent per sendmmsg() call
+#define MAVLINK_ROUTER_MAX_BATCH 16
+
+// How often an endpoint nobody listens on is tried again [ms]
+#define MAVLINK_ROUTER_RETRY_INTERVAL 1000
+
+
+// ------------------------------------------------------------------------------
+//   Data Structures
+// ------------------------------------------------------------------------------
+
+/*
+ * One consumer.  The read thread appends frames behind tail, the router
+ * thread sends them and moves head; both only ever grow and wrap around
+ * 2^32, their difference is what is queued.
+ */
+struct Router_Endpoint
+{
+	const char *name;  // the url as given
+	Port_Url    url;
+	uint8_t     sysid;  // only frames from this system, 0 for any
+	uint8_t     compid; // only frames from this component, 0 for any
+
+	int  sock;
+	bool connected;    // unix sockets wait for the consumer to bind
+	bool blocked;      // the socket was full, wait for POLLOUT
+	uint64_t next_connect;
+
+	union
+	{
+		struct sockaddr_in in;
+		struct sockaddr_un un;
+	} address;
+	socklen_t address_len;
+
+	uint8_t  queue[MAVLINK_ROUTER_QUEUE_LEN];
+	uint32_t head;     // bytes ever sent or given up on
+	uint32_t tail;     // bytes ever queued
+
+	uint64_t tx_frames;
+	uint64_t tx_bytes;
+	uint64_t tx_datagrams;
+	uint64_t tx_writes;    // sendmmsg() calls
+	uint64_t dropped;      // frames that did not fit in the queue
+	uint64_t lost;         // frames the socket refused, or nobody listened
+	uint64_t filtered;     // frames from other systems or components
+	uint32_t peak;         // most bytes ever queued
+
+	uint64_t rx_frames;    // frames the consumer sent to the autopilot
+	Frame_Scanner scanner;
+};
+
+
+// ------------------------------------------------------------------------------
+//   Prototypes
+// ------------------------------------------------------------------------------
+
+void* start_mavlink_router_forward_thread(void *args);
+
+
+// ----------------------------------------------------------------------------------
+//   MAVLink Router Class
+// ----------------------------------------------------------------------------------
+/*
+ * MAVLink Router Class
+ *
+ * Stands in for the link port, so Autopilot_Interface keeps reading and
+ * writing as before while the router owns the link.  Every frame the read
+ * thread takes from the link is also copied, bytes as received, into the
+ * queue of each endpoint whose sysid/compid filter it passes; a full queue
+ * drops the frame for that endpoint only.
+ *
+ * The router thread packs queued frames into datagrams and sends them with
+ * sendmmsg() on non-blocking connected sockets, so a slow consumer fills
+ * its own queue and nobody else's.  Frames the consumers send are checked
+ * and written to the link.
+ *
+ * udpout://host:port and unix:///path endpoints are supported.  A unix
+ * consumer binds the path itself; until it does the frames are counted as
+ * lost.  Add endpoints and set link before start().
+ */
+class Mavlink_Router: public Generic_Port
+{
+
+public:
+
+	Mavlink_Router();
+	~Mavlink_Router();
+
+	Generic_Port *link;  // the port that talks to the autopilot
+
+	bool add_endpoint(const char *url);
+	bool set_filter(int sysid, int compid);
+	int  endpoint_count();
+
+	int read_frames(Frame_View *views, int max_views);
+	int wait_readable(int wake_fd, int timeout_ms);
+	void add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length);
+	int write_message(const mavlink_message_t &message);
+	int write_messages(const mavlink_message_t *messages, int count);
+	int write_frames(const uint8_t *frames, unsigned len, int count);
+
+	bool is_running();
+	void start();
+	void stop();
+
+	void print_stats();
+
+	void start_forward_thread();
+
+private:
+
+	Router_Endpoint *endpoints[MAVLINK_ROUTER_MAX_ENDPOINTS];
+	int  endpoints_count;
+
+	pthread_t forward_tid;
+	int  wake_fd;
+	bool time_to_exit;
+	bool sleeping;   // the router thread is, or is about to be, in poll()
+
+	uint8_t rx_buffer[MAVLINK_ROUTER_DATAGRAM_LEN + MAVLINK_MAX_PACKET_LEN];
+
+	// add_message() calls, taught to the endpoint scanners by the router
+	// thread since it is the one scanning
+	pthread_mutex_t added_lock;
+	uint8_t added[256][3]; // msgid, crc_extra, length
+	int     added_count;
+	int     added_applied;
+
+	void forward(const Frame_View *views, int count);
+	void open_endpoint(Router_Endpoint &endpoint);
+	void connect_endpoint(Router_Endpoint &endpoint, uint64_t now);
+	bool send_queued(Router_Endpoint &endpoint);
+	void receive(Router_Endpoint &endpoint);
+	void apply_added();
+	bool have_queued();
+
+	void forward_thread();
+
+};
+
+
+
+#endif // MAVLINK_ROUTER_H_
+
+
@@ -0,0 +1,100 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file message_dispatch.cpp
+ *
+ * @brief Message dispatch table
+ *
+ * Functions for registering message handlers
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "message_dispatch.h"
+
+
+// ----------------------------------------------------------------------------------
+//   Message Dispatch Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Message_Dispatch::
+Message_Dispatch()
+{
+	dispatched = 0;
+	ignored    = 0;
+
+	for ( int i = 0; i < 256; i++ )
+		unsubscribe((uint8_t)i);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Subscriptions
+// ------------------------------------------------------------------------------
+// A message id has at most one handler, subscribing again replaces it
+void
+Message_Dispatch::
+subscribe(uint8_t msgid, Message_Handler handler, void *context)
+{
+	table[msgid].handler = handler;
+	table[msgid].context = context;
+	table[msgid].offset  = -1;
+	table[msgid].defined = false;
+}
+
+void
+Message_Dispatch::
+unsubscribe(uint8_t msgid)
+{
+	table[msgid].handler = NULL;
+	table[msgid].context = NULL;
+	table[msgid].offset  = -1;
+	table[msgid].defined = false;
+}
+
+bool
+Message_Dispatch::
+subscribed(uint8_t msgid) const
+{
+	return table[msgid].handler != NULL;
+}
+
+
@@ -0,0 +1,402 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file message_dispatch.h
+ *
+ * @brief Message dispatch table
+ *
+ * Routes received frames to handlers registered per message id, with
+ * typed helpers that read fields or decode straight from the payload.
+ *
+ */
+
+#ifndef MESSAGE_DISPATCH_H_
+#define MESSAGE_DISPATCH_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <common/mavlink.h>
+
+#include "home_position.h"
+#include "frame_scanner.h"
+#include "seqlock.h"
+#include "history_ring.h"
+
+
+// ------------------------------------------------------------------------------
+//   Message Types
+// ------------------------------------------------------------------------------
+
+/*
+ * Message Type
+ *
+ * Ties a payload struct to its message id, wire definition and decoder, so
+ * the typed subscribe() calls below cannot pair a struct with the wrong
+ * message.  MESSAGE_TYPE(name, NAME) declares one from the generated
+ * mavlink_msg_<name>.h; do the same for messages of other dialects.
+ */
+template <typename T>
+struct Message_Type;
+
+#define MESSAGE_TYPE(name, NAME)                                                 \
+	template <>                                                                  \
+	struct Message_Type<mavlink_##name##_t>                                      \
+	{                                                                            \
+		enum {                                                                   \
+			msgid     = MAVLINK_MSG_ID_##NAME,                                   \
+			crc_extra = MAVLINK_MSG_ID_##NAME##_CRC,                             \
+			length    = MAVLINK_MSG_ID_##NAME##_LEN                              \
+		};                                                                       \
+		static void                                                              \
+		decode(const mavlink_message_t *message, mavlink_##name##_t *value)      \
+		{                                                                        \
+			mavlink_msg_##name##_decode(message, value);                         \
+		}                                                                        \
+	};
+
+MESSAGE_TYPE(heartbeat,                  HEARTBEAT)
+MESSAGE_TYPE(sys_status,                 SYS_STATUS)
+MESSAGE_TYPE(battery_status,             BATTERY_STATUS)
+MESSAGE_TYPE(radio_status,               RADIO_STATUS)
+MESSAGE_TYPE(local_position_ned,         LOCAL_POSITION_NED)
+MESSAGE_TYPE(global_position_int,        GLOBAL_POSITION_INT)
+MESSAGE_TYPE(position_target_local_ned,  POSITION_TARGET_LOCAL_NED)
+MESSAGE_TYPE(position_target_global_int, POSITION_TARGET_GLOBAL_INT)
+MESSAGE_TYPE(highres_imu,                HIGHRES_IMU)
+MESSAGE_TYPE(attitude,                   ATTITUDE)
+MESSAGE_TYPE(attitude_target,            ATTITUDE_TARGET)
+MESSAGE_TYPE(vfr_hud,                    VFR_HUD)
+MESSAGE_TYPE(timesync,                   TIMESYNC)
+MESSAGE_TYPE(home_position,              HOME_POSITION)
+
+
+// ------------------------------------------------------------------------------
+//   Message Views
+// ------------------------------------------------------------------------------
+/*
+ * Message View
+ *
+ * A received payload of message T read where it lies, in the port's buffer
+ * or in a mavlink_message_t, without decoding the rest of it.
+ *
+ * get() reads one field, e.g. view.get(&mavlink_highres_imu_t::pressure_alt).
+ * The generated structs list their fields in wire order with nothing in
+ * between, so a field sits at its offset in the struct; the bytes are read
+ * the way the _MAV_RETURN_* accessors of protocol.h do, an unaligned load
+ * when the host is little endian and swapped when it is not.
+ *
+ * decode() fills a whole T, a copy of the payload unless the bytes need
+ * swapping.  Array fields are only read with decode().
+ *
+ * Both read Message_Type<T>::length bytes.  Frame_Scanner rejects frames of
+ * T with any other length, and a mavlink_message_t holds the largest
+ * payload, so the read never leaves the frame or the message.
+ */
+template <typename T>
+class Message_View
+{
+
+public:
+
+	explicit
+	Message_View(const Frame_View &frame)
+	{
+		payload = frame.payload();
+	}
+
+	explicit
+	Message_View(const mavlink_message_t &message)
+	{
+		payload = (const uint8_t *)_MAV_PAYLOAD(&message);
+	}
+
+	template <typename F>
+	F
+	get(F T::*field) const
+	{
+		F value;
+		const char *source = (const char *)payload + offset(field);
+
+#if MAVLINK_NEED_BYTE_SWAP
+		switch ( sizeof(F) )
+		{
+			case 2:  byte_swap_2((char *)&value, source); break;
+			case 4:  byte_swap_4((char *)&value, source); break;
+			case 8:  byte_swap_8((char *)&value, source); break;
+			default: memcpy(&value, source, sizeof(F));   break;
+		}
+#else
+		memcpy(&value, source, sizeof(F));
+#endif
+
+		return value;
+	}
+
+	void
+	decode(T &value) const
+	{
+#if MAVLINK_NEED_BYTE_SWAP
+		mavlink_message_t message;
+		memcpy(_MAV_PAYLOAD_NON_CONST(&message), payload, Message_Type<T>::length);
+		Message_Type<T>::decode(&message, &value);
+#else
+		memcpy(&value, payload, Message_Type<T>::length);
+#endif
+	}
+
+private:
+
+	// the payload is the start of the struct, only padding follows it
+	typedef char payload_is_the_struct[sizeof(T) >= (size_t)Message_Type<T>::length ? 1 : -1];
+
+	const uint8_t *payload;
+
+	// folds to a constant once inlined, probe is never read
+	template <typename F>
+	static size_t
+	offset(F T::*field)
+	{
+		T probe;
+		return (size_t)((const char *)&(probe.*field) - (const char *)&probe);
+	}
+
+};
+
+
+// ------------------------------------------------------------------------------
+//   Handlers
+// ------------------------------------------------------------------------------
+
+// Called with the frame, its arrival time [us] and the registered context.
+// The frame is only valid during the call.
+typedef void (*Message_Handler)(const Frame_View &frame, uint64_t now, void *context);
+
+// Decodes into the Seqlock<T> passed as context, in place
+template <typename T>
+void
+store_message(const Frame_View &frame, uint64_t now, void *slot)
+{
+	((Seqlock<T> *)slot)->store_from(Message_View<T>(frame), now);
+}
+
+// Decodes into the next slot of the History_Ring<T, N> passed as context
+template <typename T, int N>
+void
+push_message(const Frame_View &frame, uint64_t now, void *ring)
+{
+	((History_Ring<T, N> *)ring)->push_from(Message_View<T>(frame), now);
+}
+
+// Decodes and calls a member function of the object passed as context
+template <typename T, typename C, void (C::*method)(const T &, uint64_t)>
+void
+call_member(const Frame_View &frame, uint64_t now, void *object)
+{
+	T value;
+	Message_View<T>(frame).decode(value);
+	(((C *)object)->*method)(value, now);
+}
+
+// Calls a member function with a view, for handlers that read a few fields
+template <typename T, typename C, void (C::*method)(const Message_View<T> &, uint64_t)>
+void
+call_member_view(const Frame_View &frame, uint64_t now, void *object)
+{
+	(((C *)object)->*method)(Message_View<T>(frame), now);
+}
+
+
+// ----------------------------------------------------------------------------------
+//   Message Dispatch Class
+// ----------------------------------------------------------------------------------
+/*
+ * Message Dispatch Class
+ *
+ * A table of 256 handlers indexed by message id, one lookup per message.
+ * Frames are dispatched as they lie in the port's buffer; message ids nobody
+ * subscribed to are dropped before anything is copied or decoded, and a
+ * handler taking a Message_View only reads the fields it uses.
+ * The typed subscribe() calls also note the message's CRC_EXTRA and length;
+ * add_messages_to() hands them to the port's frame scanner, so messages
+ * from outside the common dialect get through too.
+ *
+ * A slot can also be subscribed per vehicle, as a member of a struct like
+ * Mavlink_Messages: dispatch() is then told which sender's struct the
+ * message belongs to and stores it in that struct's slot.
+ *
+ * Change subscriptions before the read thread starts, or from inside a
+ * handler; dispatch() itself does not lock.
+ */
+class Message_Dispatch
+{
+
+public:
+
+	Message_Dispatch();
+
+	uint64_t dispatched; // messages handed to a handler
+	uint64_t ignored;    // messages nobody subscribed to
+
+	void subscribe(uint8_t msgid, Message_Handler handler, void *context);
+	void unsubscribe(uint8_t msgid);
+	bool subscribed(uint8_t msgid) const;
+
+	// Keep the latest T in slot
+	template <typename T>
+	void
+	subscribe(Seqlock<T> &slot)
+	{
+		subscribe(Message_Type<T>::msgid, &store_message<T>, &slot);
+		define<T>();
+	}
+
+	// Keep the latest T in the same slot of the vehicle passed to dispatch(),
+	// example is any one of the vehicle structs and slot a member of it
+	template <typename T, typename V>
+	void
+	subscribe(V &example, Seqlock<T> &slot)
+	{
+		subscribe(Message_Type<T>::msgid, &store_message<T>, NULL);
+		define<T>();
+		table[Message_Type<T>::msgid].offset = (char *)&slot - (char *)&example;
+	}
+
+	// Keep the last N of T in ring
+	template <typename T, int N>
+	void
+	subscribe(History_Ring<T, N> &ring)
+	{
+		subscribe(Message_Type<T>::msgid, &push_message<T, N>, &ring);
+		define<T>();
+	}
+
+	// Call object->method(value, now) for every T
+	template <typename T, typename C, void (C::*method)(const T &, uint64_t)>
+	void
+	subscribe(C *object)
+	{
+		subscribe(Message_Type<T>::msgid, &call_member<T, C, method>, object);
+		define<T>();
+	}
+
+	// Call object->method(view, now) for every T, nothing is decoded
+	template <typename T, typename C, void (C::*method)(const Message_View<T> &, uint64_t)>
+	void
+	subscribe(C *object)
+	{
+		subscribe(Message_Type<T>::msgid, &call_member_view<T, C, method>, object);
+		define<T>();
+	}
+
+	template <typename T>
+	void
+	unsubscribe()
+	{
+		unsubscribe(Message_Type<T>::msgid);
+	}
+
+	// Teaches port, a Generic_Port or Frame_Scanner, the CRC_EXTRA and
+	// length of every message subscribed with a type.  Call it before the
+	// port is read from.
+	template <typename P>
+	void
+	add_messages_to(P &port) const
+	{
+		for ( int i = 0; i < 256; i++ )
+		{
+			if ( table[i].defined )
+				port.add_message((uint8_t)i, table[i].crc_extra, table[i].length);
+		}
+	}
+
+	// Returns true if somebody handled the message.  vehicle is the sender's
+	// struct for per vehicle slots, which are skipped if it is NULL.
+	bool
+	dispatch(const Frame_View &frame, uint64_t now, void *vehicle = NULL)
+	{
+		const Entry &entry = table[frame.msgid];
+
+		void *context = entry.context;
+		if ( entry.offset >= 0 )
+			context = vehicle ? (char *)vehicle + entry.offset : NULL;
+
+		if ( entry.handler == NULL || context == NULL )
+		{
+			ignored++;
+			return false;
+		}
+
+		entry.handler(frame, now, context);
+		dispatched++;
+		return true;
+	}
+
+private:
+
+	struct Entry
+	{
+		Message_Handler handler;
+		void           *context;
+		ptrdiff_t       offset;  // of the slot in the vehicle, -1 if not per vehicle
+
+		bool            defined; // crc_extra and length known from the type
+		uint8_t         crc_extra;
+		uint8_t         length;
+	};
+
+	Entry table[256];
+
+	template <typename T>
+	void
+	define()
+	{
+		Entry &entry = table[Message_Type<T>::msgid];
+		entry.defined   = true;
+		entry.crc_extra = Message_Type<T>::crc_extra;
+		entry.length    = Message_Type<T>::length;
+	}
+
+};
+
+
+
+#endif // MESSAGE_DISPATCH_H_
+
+
@@ -0,0 +1,154 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file port_url.cpp
+ *
+ * @brief Urls that pick a MAVLink transport, functions
+ *
+ * Parses the urls that pick a transport on the command line.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "port_url.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+
+// ------------------------------------------------------------------------------
+//   Parse Port Url
+// ------------------------------------------------------------------------------
+/*
+ * Splits a url like udp://:14540, udpout://10.0.0.2:14557, tcp://localhost:5760
+ * serial:///dev/ttyAMA0:921600 or unix:///run/vision.sock into its parts.  Returns false if the
+ * scheme is unknown or a network url has no valid port.
+ */
+bool
+parse_port_url(const char *url, Port_Url &parsed)
+{
+	static const struct { const char *scheme; int type; } schemes[] = {
+		{ "serial://", PORT_URL_SERIAL },
+		{ "udp://",    PORT_URL_UDP    },
+		{ "udpout://", PORT_URL_UDPOUT },
+		{ "tcp://",    PORT_URL_TCP    },
+		{ "unix://",   PORT_URL_UNIX   },
+	};
+
+	memset(&parsed, 0, sizeof(parsed));
+
+	const char *rest = NULL;
+	for ( unsigned i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++ )
+	{
+		size_t n = strlen(schemes[i].scheme);
+		if ( strncmp(url, schemes[i].scheme, n) == 0 )
+		{
+			parsed.type = schemes[i].type;
+			rest = url + n;
+			break;
+		}
+	}
+	if ( not rest || strlen(rest) >= sizeof(parsed.host) )
+		return false;
+
+	strcpy(parsed.host, rest);
+
+	// a path, colons and all
+	if ( parsed.type == PORT_URL_UNIX )
+		return parsed.host[0] != '\0';
+
+	// the number after the last colon, if it is one
+	char *colon = strrchr(parsed.host, ':');
+	long number = -1;
+	if ( colon && colon[1] )
+	{
+		char *end;
+		number = strtol(colon + 1, &end, 10);
+		if ( *end || number < 0 )
+			number = -1;
+	}
+
+	if ( parsed.type == PORT_URL_SERIAL )
+	{
+		if ( number > 0 )
+		{
+			parsed.baudrate = number;
+			*colon = '\0';
+		}
+		return parsed.host[0] != '\0';
+	}
+
+	if ( number < 1 || number > 65535 )
+		return false;
+
+	parsed.port = number;
+	*colon = '\0';
+
+	// listen on every interface, or talk to this machine
+	if ( not parsed.host[0] )
+		strcpy(parsed.host, parsed.type == PORT_URL_UDP ? "0.0.0.0" : "127.0.0.1");
+
+	return true;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Resolve Host
+// ------------------------------------------------------------------------------
+// IPv4 address of host, a name or dotted quad, false if it has none
+bool
+resolve_host(const char *host, int port, struct sockaddr_in &address)
+{
+	struct addrinfo hints, *found = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+
+	if ( getaddrinfo(host, NULL, &hints, &found) || not found )
+		return false;
+
+	memcpy(&address, found->ai_addr, sizeof(address));
+	address.sin_port = htons(port);
+
+	freeaddrinfo(found);
+	return true;
+}
+
+
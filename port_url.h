@@ -0,0 +1,86 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file port_url.h
+ *
+ * @brief Urls that pick a MAVLink transport
+ *
+ * Parses the urls given on the command line and resolves the hosts the
+ * network ports talk to.
+ *
+ */
+
+#ifndef PORT_URL_H_
+#define PORT_URL_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <netinet/in.h>
+
+
+// ------------------------------------------------------------------------------
+//   Data Structures
+// ------------------------------------------------------------------------------
+
+enum Port_Url_Type
+{
+	PORT_URL_SERIAL = 0, // serial:///dev/ttyAMA0[:baudrate]
+	PORT_URL_UDP,        // udp://[bind address]:port, replies go to the first sender
+	PORT_URL_UDPOUT,     // udpout://host:port, sends to host from any local port
+	PORT_URL_TCP,        // tcp://host:port, connects to host
+	PORT_URL_UNIX        // unix:///run/vision.sock, datagrams to a local socket
+};
+
+struct Port_Url
+{
+	int  type;
+	char host[256];  // device or socket path for serial and unix
+	int  port;
+	int  baudrate;   // 0 if the url does not say
+};
+
+
+// ------------------------------------------------------------------------------
+//   Prototypes
+// ------------------------------------------------------------------------------
+
+bool parse_port_url(const char *url, Port_Url &parsed);
+bool resolve_host(const char *host, int port, struct sockaddr_in &address);
+
+
+#endif // PORT_URL_H_
+
+
@@ -0,0 +1,218 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file seqlock.h
+ *
+ * @brief Sequence lock for sharing the latest value of a message
+ *
+ * One writer stores, any number of readers copy out a consistent value
+ * without taking a lock or ever blocking the writer.
+ *
+ */
+
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <string.h>
+
+
+// ----------------------------------------------------------------------------------
+//   Seqlock Class
+// ----------------------------------------------------------------------------------
+/*
+ * Seqlock Class
+ *
+ * Holds one value of type T (a plain struct, e.g. mavlink_attitude_t) and
+ * the time it was stored.  The sequence counter is odd while a store is in
+ * progress; a reader copies the value and retries if the counter was odd or
+ * changed underneath it.  Readers are lock-free (retry on concurrent write)
+ * and never see half of an update.
+ *
+ * Only one thread may call store() at a time.
+ */
+template <typename T>
+class Seqlock
+{
+
+public:
+
+	Seqlock()
+	{
+		sequence = 0;
+		stamp    = 0;
+		memset(&value, 0, sizeof(value));
+	}
+
+	// Writer side
+	void
+	store(const T &value_, uint64_t time_stamp)
+	{
+		uint32_t seq = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+
+		__atomic_store_n(&sequence, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		value = value_;
+		stamp = time_stamp;
+
+		__atomic_store_n(&sequence, seq + 2, __ATOMIC_RELEASE);
+	}
+
+	// Writer side, lets source write the value in place with
+	// source.decode(T &) instead of copying a finished one in
+	template <typename S>
+	void
+	store_from(const S &source, uint64_t time_stamp)
+	{
+		uint32_t seq = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+
+		__atomic_store_n(&sequence, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		source.decode(value);
+		stamp = time_stamp;
+
+		__atomic_store_n(&sequence, seq + 2, __ATOMIC_RELEASE);
+	}
+
+	// Reader side, copies the value out and returns its time stamp,
+	// which is 0 if nothing was stored yet
+	uint64_t
+	load(T &value_) const
+	{
+		uint32_t before, after;
+		uint64_t time_stamp;
+
+		do {
+			before = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+
+			value_     = value;
+			time_stamp = stamp;
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			after = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+
+		} while ( (before & 1) || before != after );
+
+		return time_stamp;
+	}
+
+	T
+	load() const
+	{
+		T value_;
+		load(value_);
+		return value_;
+	}
+
+	// Reader side for one field, e.g. load_field(&mavlink_highres_imu_t::pressure_alt),
+	// without copying the rest of the value
+	template <typename F>
+	F
+	load_field(F T::*field) const
+	{
+		uint32_t before, after;
+		F field_;
+
+		do {
+			before = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+
+			field_ = value.*field;
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			after = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+
+		} while ( (before & 1) || before != after );
+
+		return field_;
+	}
+
+	// Time stamp of the last store, 0 if none
+	uint64_t
+	time_stamp() const
+	{
+		uint32_t before, after;
+		uint64_t time_stamp;
+
+		do {
+			before = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+			time_stamp = stamp;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			after = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+
+		} while ( (before & 1) || before != after );
+
+		return time_stamp;
+	}
+
+	// Take over other's value and time stamp, if it holds one.  Only from
+	// the thread that stores into this one.
+	void
+	copy_from(const Seqlock &other)
+	{
+		T value_;
+		uint64_t time_stamp = other.load(value_);
+		if ( time_stamp )
+			store(value_, time_stamp);
+	}
+
+	// Forget the time stamp, the value is kept
+	void
+	reset_timestamp()
+	{
+		store(load(), 0);
+	}
+
+private:
+
+	uint32_t sequence;
+	uint64_t stamp;
+	T        value;
+
+	// copying would not be atomic
+	Seqlock(const Seqlock &);
+	Seqlock &operator=(const Seqlock &);
+
+};
+
+
+
+#endif // SEQLOCK_H_
+
+
@@ -79,8 +79,11 @@ Serial_Port()
 Serial_Port::
 ~Serial_Port()
 {
-	// destroy mutex
-	pthread_mutex_destroy(&lock);
+	// destroy mutexes
+	pthread_mutex_destroy(&read_lock);
+	pthread_mutex_destroy(&write_lock);
+	pthread_mutex_destroy(&tx_lock);
+	pthread_cond_destroy(&tx_cond);
 }
 
 void
@@ -92,11 +95,39 @@ initialize_defaults()
 	fd     = -1;
 	status = SERIAL_PORT_CLOSED;
 
+	rx_head     = 0;
+	rx_tail     = 0;
+	rx_more     = false;
+	rx_bytes    = 0;
+	rx_reads    = 0;
+	rx_messages = 0;
+
+	async_tx   = false;
+	tx_running = false;
+	tx_exit    = false;
+	tx_tid     = 0;
+	tx_head    = 0;
+	tx_count   = 0;
+	tx_stamp_head  = 0;
+	tx_stamp_count = 0;
+	tx_total   = 0;
+	tx_written = 0;
+	tx_writes   = 0;
+	tx_messages = 0;
+	tx_bytes    = 0;
+	tx_dropped  = 0;
+	tx_peak    = 0;
+
+	recorder = NULL;
+
 	uart_name = (char*)"/dev/ttyUSB0";
 	baudrate  = 57600;
 
-	// Start mutex
-	int result = pthread_mutex_init(&lock, NULL);
+	// Start mutexes
+	int result = pthread_mutex_init(&read_lock, NULL)  ||
+	             pthread_mutex_init(&write_lock, NULL) ||
+	             pthread_mutex_init(&tx_lock, NULL)    ||
+	             pthread_cond_init(&tx_cond, NULL);
 	if ( result != 0 )
 	{
 		printf("\n mutex init failed\n");
@@ -112,77 +143,186 @@ int
 Serial_Port::
 read_message(mavlink_message_t &message)
 {
-	uint8_t          cp;
-	mavlink_status_t status;
-	uint8_t          msgReceived = false;
+	// single message version of read_messages, shares its buffer
+	int result = read_messages(&message, 1);
 
-	// --------------------------------------------------------------------------
-	//   READ FROM PORT
-	// --------------------------------------------------------------------------
+	// unlike the batch calls, wait a little for data
+	if ( result == 0 && wait_readable(-1, SERIAL_PORT_READ_TIMEOUT) > 0 )
+		result = read_messages(&message, 1);
+
+	return result;
+}
+
+// Same as read_frames(), but hands back copies of the messages
+int
+Serial_Port::
+read_messages(mavlink_message_t *messages, int max_messages)
+{
+	Frame_View views[SERIAL_PORT_MAX_BATCH];
+
+	if ( max_messages > SERIAL_PORT_MAX_BATCH )
+		max_messages = SERIAL_PORT_MAX_BATCH;
+
+	int count = read_frames(views, max_messages);
 
-	// this function locks the port during read
-	int result = _read_port(cp);
+	for ( int i = 0; i < count; i++ )
+		views[i].to_message(messages[i]);
 
+	return count;
+}
 
+// Reads everything the port has available in one go and returns views of all
+// complete frames in it, at most max_views.  Returns 0 right away if there is
+// nothing.  The views point into rx_buffer and are only valid until the next
+// read on this port.
+int
+Serial_Port::
+read_frames(Frame_View *views, int max_views)
+{
+	unsigned consumed;
+	uint32_t crc_errors = scanner.crc_errors;
+
+	// --------------------------------------------------------------------------
+	//   SCAN WHAT IS BUFFERED
 	// --------------------------------------------------------------------------
-	//   PARSE MESSAGE
+	int count = scanner.scan(rx_buffer + rx_head, rx_tail - rx_head, views, max_views, consumed);
+	rx_head += consumed;
+
 	// --------------------------------------------------------------------------
-	if (result > 0)
+	//   READ FROM PORT
+	// --------------------------------------------------------------------------
+
+	// only go to the port once the buffered frames are used up
+	if ( count == 0 )
 	{
-		// the parsing
-		msgReceived = mavlink_parse_char(MAVLINK_COMM_1, cp, &message, &status);
+		rx_more = false;
 
-		// check for dropped packets
-		if ( (lastStatus.packet_rx_drop_count != status.packet_rx_drop_count) && debug )
+		// keep the start of a partial frame, and make room behind it
+		unsigned pending = rx_tail - rx_head;
+		if ( pending && rx_head )
+			memmove(rx_buffer, rx_buffer + rx_head, pending);
+		rx_head = 0;
+		rx_tail = pending;
+
+		// this function locks the port during read
+		int result = _read_port(rx_buffer + rx_tail, SERIAL_PORT_RX_BUFFER_LEN - rx_tail);
+
+		if ( result > 0 )
 		{
-			printf("ERROR: DROPPED %d PACKETS\n", status.packet_rx_drop_count);
-			unsigned char v=cp;
-			fprintf(stderr,"%02x ", v);
+			rx_tail  += result;
+			rx_bytes += result;
+			rx_reads++;
 		}
-		lastStatus = status;
-	}
 
-	// Couldn't read from port
-	else
-	{
-		fprintf(stderr, "ERROR: Could not read from fd %d\n", fd);
+		// Couldn't read from port
+		else if ( result < 0 )
+		{
+			fprintf(stderr, "ERROR: Could not read from fd %d\n", fd);
+			return 0;
+		}
+
+		// nothing there
+		else
+			return 0;
+
+		count = scanner.scan(rx_buffer + rx_head, rx_tail - rx_head, views, max_views, consumed);
+		rx_head += consumed;
 	}
 
+	// views[] was filled up, there may be more frames buffered
+	rx_more = ( count == max_views );
+
 	// --------------------------------------------------------------------------
 	//   DEBUGGING REPORTS
 	// --------------------------------------------------------------------------
-	if(msgReceived && debug)
+	if ( debug )
 	{
-		// Report info
-		printf("Received message from serial with ID #%d (sys:%d|comp:%d):\n", message.msgid, message.sysid, message.compid);
-
-		fprintf(stderr,"Received serial data: ");
-		unsigned int i;
-		uint8_t buffer[MAVLINK_MAX_PACKET_LEN];
-
-		// check message is write length
-		unsigned int messageLength = mavlink_msg_to_send_buffer(buffer, &message);
+		// frames lost to line noise, the ones never received show up in the
+		// senders' sequence numbers
+		if ( scanner.crc_errors != crc_errors )
+			printf("ERROR: %u FRAMES FAILED THE CHECKSUM\n", scanner.crc_errors - crc_errors);
 
-		// message length error
-		if (messageLength > MAVLINK_MAX_PACKET_LEN)
-		{
-			fprintf(stderr, "\nFATAL ERROR: MESSAGE LENGTH IS LARGER THAN BUFFER SIZE\n");
-		}
+		for ( int i = 0; i < count; i++ )
+			_debug_report(views[i]);
+	}
 
-		// print out the buffer
-		else
-		{
-			for (i=0; i<messageLength; i++)
-			{
-				unsigned char v=buffer[i];
-				fprintf(stderr,"%02x ", v);
-			}
-			fprintf(stderr,"\n");
-		}
+	// keep a copy of everything received
+	if ( recorder && count )
+	{
+		uint64_t now = get_time_usec();
+		for ( int i = 0; i < count; i++ )
+			recorder->record(FLIGHT_RECORD_RX, views[i].frame, views[i].length, now);
 	}
 
+	rx_messages += count;
+
 	// Done!
-	return msgReceived;
+	return count;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Add Message
+// ------------------------------------------------------------------------------
+// Passed on to the frame scanner, see Frame_Scanner::add_message()
+void
+Serial_Port::
+add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length)
+{
+	scanner.add_message(msgid, crc_extra, length);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Wait for Data
+// ------------------------------------------------------------------------------
+// Sleeps until the port has data, or until wake_fd (if not -1) becomes
+// readable, or timeout_ms passes (-1 waits forever).  Returns 1 if there is
+// something for read_frames(), 0 if not, and -1 on error.
+int
+Serial_Port::
+wait_readable(int wake_fd, int timeout_ms)
+{
+	// frames from the last read that did not fit the caller's batch
+	if ( rx_more )
+		return 1;
+
+	struct pollfd pfd[2];
+	pfd[0].fd      = fd;
+	pfd[0].events  = POLLIN;
+	pfd[0].revents = 0;
+	pfd[1].fd      = wake_fd;
+	pfd[1].events  = POLLIN;
+	pfd[1].revents = 0;
+
+	int result = poll(pfd, wake_fd < 0 ? 1 : 2, timeout_ms);
+
+	if ( result < 0 )
+		return errno == EINTR ? 0 : -1;
+
+	return ( pfd[0].revents & (POLLIN | POLLERR | POLLHUP) ) ? 1 : 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Debugging Report
+// ------------------------------------------------------------------------------
+void
+Serial_Port::
+_debug_report(const Frame_View &view)
+{
+	// Report info
+	printf("Received message from serial with ID #%d (sys:%d|comp:%d):\n", view.msgid, view.sysid, view.compid);
+
+	fprintf(stderr,"Received serial data: ");
+
+	// print out the frame
+	for (unsigned int i=0; i<view.length; i++)
+	{
+		unsigned char v=view.frame[i];
+		fprintf(stderr,"%02x ", v);
+	}
+	fprintf(stderr,"\n");
 }
 
 // ------------------------------------------------------------------------------
@@ -192,18 +332,274 @@ int
 Serial_Port::
 write_message(const mavlink_message_t &message)
 {
-	char buf[300];
+	return write_messages(&message, 1);
+}
+
+// Encodes the messages back to back and sends them with write_frames().
+// Returns the bytes written or queued.
+int
+Serial_Port::
+write_messages(const mavlink_message_t *messages, int count)
+{
+	uint8_t buf[GENERIC_PORT_MAX_BATCH * MAVLINK_MAX_PACKET_LEN];
+	int     bytes = 0;
+
+	while ( count > 0 )
+	{
+		int batch = count < GENERIC_PORT_MAX_BATCH ? count : GENERIC_PORT_MAX_BATCH;
 
-	// Translate message to buffer
-	unsigned len = mavlink_msg_to_send_buffer((uint8_t*)buf, &message);
+		// Translate messages to buffer
+		unsigned len = 0;
+		for ( int i = 0; i < batch; i++ )
+			len += mavlink_msg_to_send_buffer(buf + len, &messages[i]);
+
+		int result = write_frames(buf, len, batch);
+		if ( result > 0 )
+			bytes += result;
+
+		messages += batch;
+		count    -= batch;
+	}
+
+	return bytes;
+}
+
+// Sends the frames with one write() and one tcdrain(), or queues them for
+// the tx thread under one lock, which writes them out with whatever else has
+// queued up.  Returns the bytes written or queued.
+int
+Serial_Port::
+write_frames(const uint8_t *frames, unsigned len, int count)
+{
+	// Hand them to the tx thread
+	if ( async_tx )
+	{
+		int bytes = 0;
+
+		pthread_mutex_lock(&tx_lock);
+
+		uint64_t now = get_time_usec();
+		for ( unsigned pos = 0; pos < len; )
+		{
+			unsigned length = frames[pos + 1] + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+			bytes += _queue_frame((const char *)frames + pos, length, now);
+			pos   += length;
+		}
+
+		pthread_cond_signal(&tx_cond);
+		pthread_mutex_unlock(&tx_lock);
+
+		return bytes;
+	}
 
 	// Write buffer to serial port, locks port while writing
-	int bytesWritten = _write_port(buf,len);
+	uint64_t start = get_time_usec();
+	int bytesWritten = _write_port((char *)frames, len);
+	uint64_t elapsed = get_time_usec() - start;
+
+	for ( int i = 0; i < count; i++ )
+		write_latency.add(elapsed);
+	tx_writes++;
+
+	if ( bytesWritten > 0 )
+	{
+		tx_bytes    += bytesWritten;
+		tx_messages += count;
+	}
 
 	return bytesWritten;
 }
 
 
+// ------------------------------------------------------------------------------
+//   Transmit Queue
+// ------------------------------------------------------------------------------
+// Copies the frame into the tx queue, tx_lock held; the caller wakes the tx
+// thread.  Returns len, or 0 if the queue is full; frames are never split or
+// partially queued.
+int
+Serial_Port::
+_queue_frame(const char *buf, unsigned len, uint64_t now)
+{
+	if ( tx_count + len > SERIAL_PORT_TX_QUEUE_LEN || tx_stamp_count == SERIAL_PORT_TX_STAMPS )
+	{
+		tx_dropped++;
+		return 0;
+	}
+
+	// tx_lock keeps the recorder's TX producer single threaded
+	if ( recorder )
+		recorder->record(FLIGHT_RECORD_TX, (const uint8_t *)buf, len, now);
+
+	// copy behind the queued bytes, wrapping around the end
+	unsigned tail  = (tx_head + tx_count) % SERIAL_PORT_TX_QUEUE_LEN;
+	unsigned first = SERIAL_PORT_TX_QUEUE_LEN - tail;
+	if ( first > len )
+		first = len;
+
+	memcpy(tx_queue + tail, buf, first);
+	memcpy(tx_queue, buf + first, len - first);
+
+	tx_count += len;
+	if ( tx_count > tx_peak )
+		tx_peak = tx_count;
+
+	// the tx thread measures this frame once it wrote its last byte
+	tx_total += len;
+	Tx_Stamp &stamp = tx_stamps[(tx_stamp_head + tx_stamp_count) % SERIAL_PORT_TX_STAMPS];
+	stamp.end    = tx_total;
+	stamp.queued = now;
+	tx_stamp_count++;
+
+	return len;
+}
+
+unsigned
+Serial_Port::
+tx_queue_depth()
+{
+	pthread_mutex_lock(&tx_lock);
+	unsigned depth = tx_count;
+	pthread_mutex_unlock(&tx_lock);
+
+	return depth;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Transmit Thread
+// ------------------------------------------------------------------------------
+void
+Serial_Port::
+start_tx_thread()
+{
+	if ( tx_running )
+	{
+		fprintf(stderr,"tx thread already running\n");
+		return;
+	}
+	else
+	{
+		tx_thread();
+		return;
+	}
+}
+
+void
+Serial_Port::
+stop_tx_thread()
+{
+	if ( not tx_tid )
+		return;
+
+	// let it write out what is left, then exit
+	pthread_mutex_lock(&tx_lock);
+	tx_exit = true;
+	pthread_cond_signal(&tx_cond);
+	pthread_mutex_unlock(&tx_lock);
+
+	pthread_join(tx_tid, NULL);
+	tx_tid = 0;
+}
+
+// Writes out the queue as it fills, as many bytes per write() as have queued
+// up.  The bytes being written stay in the queue until write() returns, the
+// writers only ever append behind them.
+void
+Serial_Port::
+tx_thread()
+{
+	tx_running = true;
+
+	pthread_mutex_lock(&tx_lock);
+
+	while ( true )
+	{
+		while ( tx_count == 0 && not tx_exit )
+			pthread_cond_wait(&tx_cond, &tx_lock);
+
+		if ( tx_count == 0 )
+			break;
+
+		// contiguous part of the queue
+		unsigned len = tx_count;
+		if ( tx_head + len > SERIAL_PORT_TX_QUEUE_LEN )
+			len = SERIAL_PORT_TX_QUEUE_LEN - tx_head;
+
+		uint8_t *buf = tx_queue + tx_head;
+
+		pthread_mutex_unlock(&tx_lock);
+
+		// no tcdrain here, the kernel buffers the bytes for the UART
+		pthread_mutex_lock(&write_lock);
+		int result = write(fd, buf, len);
+		pthread_mutex_unlock(&write_lock);
+
+		uint64_t now = get_time_usec();
+
+		pthread_mutex_lock(&tx_lock);
+
+		if ( result < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+
+			// drop what we could not write rather than spin on it
+			fprintf(stderr, "ERROR: Could not write to fd %d\n", fd);
+			result = len;
+		}
+
+		tx_writes++;
+
+		tx_head     = (tx_head + result) % SERIAL_PORT_TX_QUEUE_LEN;
+		tx_count   -= result;
+		tx_written += result;
+		tx_bytes   += result;
+
+		// every frame that is out now, a partly written one stays
+		while ( tx_stamp_count && tx_stamps[tx_stamp_head].end <= tx_written )
+		{
+			write_latency.add(now - tx_stamps[tx_stamp_head].queued);
+			tx_messages++;
+			tx_stamp_head = (tx_stamp_head + 1) % SERIAL_PORT_TX_STAMPS;
+			tx_stamp_count--;
+		}
+	}
+
+	pthread_mutex_unlock(&tx_lock);
+
+	tx_running = false;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+Serial_Port::
+print_stats()
+{
+	printf("SERIAL  rx: %llu bytes in %llu reads, %llu messages  tx: %llu messages, %llu bytes in %llu writes (%.2f messages per write), queue %u (peak %u), %llu dropped\n",
+			(unsigned long long)rx_bytes, (unsigned long long)rx_reads, (unsigned long long)rx_messages,
+			(unsigned long long)tx_messages, (unsigned long long)tx_bytes, (unsigned long long)tx_writes,
+			tx_writes ? (double)tx_messages / tx_writes : 0.0,
+			tx_queue_depth(), tx_peak, (unsigned long long)tx_dropped);
+	write_latency.print("WRITE LATENCY");
+	scanner.print("SERIAL FRAMES");
+
+	// errors the UART driver counted, a pseudo terminal has none
+#ifdef TIOCGICOUNT
+	struct serial_icounter_struct icount;
+	if ( status == 1 && ioctl(fd, TIOCGICOUNT, &icount) == 0 )
+		printf("%-20s %i overruns, %i buffer overruns, %i framing, %i parity errors\n", "UART ERRORS",
+				icount.overrun, icount.buf_overrun, icount.frame, icount.parity);
+#endif
+
+	if ( recorder )
+		recorder->print_stats();
+}
+
+
 // ------------------------------------------------------------------------------
 //   Open Serial Port
 // ------------------------------------------------------------------------------
@@ -252,7 +648,6 @@ open_serial()
 	//   CONNECTED!
 	// --------------------------------------------------------------------------
 	printf("Connected to %s with %d baud, 8 data bits, no parity, 1 stop bit (8N1)\n", uart_name, baudrate);
-	lastStatus.packet_rx_drop_count = 0;
 
 	status = true;
 
@@ -294,16 +689,36 @@ Serial_Port::
 start()
 {
 	open_serial();
+
+	if ( async_tx )
+	{
+		tx_exit = false;
+
+		int result = pthread_create( &tx_tid, NULL, &start_serial_port_tx_thread, this );
+		if ( result ) throw result;
+	}
 }
 
 void
 Serial_Port::
 stop()
 {
+	stop_tx_thread();
 	close_serial();
 }
 
 
+// ------------------------------------------------------------------------------
+//   Status
+// ------------------------------------------------------------------------------
+bool
+Serial_Port::
+is_running()
+{
+	return status == 1; // SERIAL_PORT_OPEN
+}
+
+
 // ------------------------------------------------------------------------------
 //   Quit Handler
 // ------------------------------------------------------------------------------
@@ -408,10 +823,10 @@ _setup_port(int baud, int data_bits, int stop_bits, bool parity, bool hardware_c
 	config.c_cflag &= ~(CSIZE | PARENB);
 	config.c_cflag |= CS8;
 
-	// One input byte is enough to return from read()
-	// Inter-character timer off
-	config.c_cc[VMIN]  = 1;
-	config.c_cc[VTIME] = 10; // was 0
+	// read() returns whatever is buffered, and 0 if nothing is,
+	// waiting for data is done with poll() in wait_readable()
+	config.c_cc[VMIN]  = 0;
+	config.c_cc[VTIME] = 0;
 
 	// Get the current options for the port
 	////struct termios options;
@@ -500,18 +915,21 @@ _setup_port(int baud, int data_bits, int stop_bits, bool parity, bool hardware_c
 // ------------------------------------------------------------------------------
 //   Read Port with Lock
 // ------------------------------------------------------------------------------
+// Reads all bytes that are available (up to len) with a single read().  The
+// port is set up with VMIN = VTIME = 0, so this returns 0 instead of blocking
+// when there is nothing to read.
 int
 Serial_Port::
-_read_port(uint8_t &cp)
+_read_port(uint8_t *buf, unsigned len)
 {
 
 	// Lock
-	pthread_mutex_lock(&lock);
+	pthread_mutex_lock(&read_lock);
 
-	int result = read(fd, &cp, 1);
+	int result = read(fd, buf, len);
 
 	// Unlock
-	pthread_mutex_unlock(&lock);
+	pthread_mutex_unlock(&read_lock);
 
 	return result;
 }
@@ -520,25 +938,51 @@ _read_port(uint8_t &cp)
 // ------------------------------------------------------------------------------
 //   Write Port with Lock
 // ------------------------------------------------------------------------------
+// Synchronous write of whole frames, used when there is no tx thread.  Only
+// holds the write lock, so the read thread keeps going while we wait for the
+// UART.
 int
 Serial_Port::
 _write_port(char *buf, unsigned len)
 {
 
 	// Lock
-	pthread_mutex_lock(&lock);
+	pthread_mutex_lock(&write_lock);
 
 	// Write packet via serial link
 	const int bytesWritten = static_cast<int>(write(fd, buf, len));
 
+	// a record per frame written, the write lock keeps the recorder's TX
+	// producer single threaded
+	if ( recorder && bytesWritten > 0 )
+		recorder->record_frames(FLIGHT_RECORD_TX, (const uint8_t *)buf, bytesWritten, get_time_usec());
+
 	// Wait until all data has been written
 	tcdrain(fd);
 
 	// Unlock
-	pthread_mutex_unlock(&lock);
+	pthread_mutex_unlock(&write_lock);
 
 
 	return bytesWritten;
 }
 
 
+// ------------------------------------------------------------------------------
+//  Pthread Starter Helper Functions
+// ------------------------------------------------------------------------------
+
+void*
+start_serial_port_tx_thread(void *args)
+{
+	// takes a serial port object argument
+	Serial_Port *serial_port = (Serial_Port *)args;
+
+	// run the object's tx thread
+	serial_port->start_tx_thread();
+
+	// done!
+	return NULL;
+}
+
+
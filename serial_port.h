@@ -61,9 +61,21 @@
 #include <termios.h> // POSIX terminal control definitions
 #include <pthread.h> // This uses POSIX Threads
 #include <signal.h>
+#include <poll.h>    // Wait for incoming bytes
+#include <errno.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h> // UART error counters
+#endif
 
 #include <common/mavlink.h>
 
+#include "generic_port.h"
+#include "frame_scanner.h"
+#include "latency_histogram.h"
+#include "time_base.h"
+#include "flight_recorder.h"
+
 
 // ------------------------------------------------------------------------------
 //   Defines
@@ -80,6 +92,22 @@
 #endif
 
 
+// Receive buffer size, enough for several full frames at 921600 baud
+#define SERIAL_PORT_RX_BUFFER_LEN 4096
+
+// Maximum number of messages handed back by one read_messages() call
+#define SERIAL_PORT_MAX_BATCH GENERIC_PORT_MAX_BATCH
+
+// How long read_message() waits for new bytes before giving up [ms]
+#define SERIAL_PORT_READ_TIMEOUT 100
+
+// Transmit queue size when writing asynchronously
+#define SERIAL_PORT_TX_QUEUE_LEN 8192
+
+// Frames the tx queue can hold at most, each has at least a header and CRC
+#define SERIAL_PORT_TX_STAMPS (SERIAL_PORT_TX_QUEUE_LEN / MAVLINK_NUM_NON_PAYLOAD_BYTES)
+
+
 // Status flags
 #define SERIAL_PORT_OPEN   1;
 #define SERIAL_PORT_CLOSED 0;
@@ -92,6 +120,7 @@
 
 //class Serial_Port;
 
+void* start_serial_port_tx_thread(void *args);
 
 
 // ----------------------------------------------------------------------------------
@@ -104,9 +133,24 @@
  * serial port over which we'll communicate.  It also has methods to write
  * a byte stream buffer.  MAVlink is not used in this object yet, it's just
  * a serialization interface.  To help with read and write pthreading, it
- * gaurds any port operation with a pthread mutex.
+ * gaurds port operations with pthread mutexes, one for each direction, so a
+ * write never waits for a read or the other way around.
+ *
+ * Reads are buffered: every read() pulls in as many bytes as the kernel has
+ * queued, and all complete frames in that chunk are found in one pass by the
+ * frame scanner.  A frame cut off at the end of a chunk stays in rx_buffer and
+ * is completed by the next read.  read_frames() and read_messages() never
+ * block, use wait_readable() to sleep until data arrives.
+ *
+ * With async_tx set before start(), write_message() only copies the frame
+ * into a transmit queue and returns; a separate thread writes out whatever
+ * has queued up in one go and never waits for the UART to drain.
+ * write_messages() encodes a batch back to back, write_frames() writes such
+ * a batch with one write() and one tcdrain(), or queues it under one lock.
+ *
+ * Point recorder at an open Flight_Recorder to log every frame both ways.
  */
-class Serial_Port
+class Serial_Port: public Generic_Port
 {
 
 public:
@@ -121,27 +165,91 @@ public:
 	int  baudrate;
 	int  status;
 
+	uint64_t rx_bytes;    // bytes pulled from the port
+	uint64_t rx_reads;    // read() calls that returned data
+	uint64_t rx_messages; // messages parsed
+
+	Frame_Scanner scanner;
+
+	bool     async_tx;    // queue writes for the tx thread, set before start()
+	uint64_t tx_writes;   // write() calls
+	uint64_t tx_messages; // messages written
+	uint64_t tx_bytes;    // bytes on the wire
+	uint64_t tx_dropped;  // messages dropped because the tx queue was full
+	unsigned tx_peak;     // most bytes ever waiting in the tx queue
+
+	// time from write_message() until the last byte of that message was
+	// handed to the kernel, per message
+	Latency_Histogram write_latency;
+
+	// if set, gets a copy of every frame read and written
+	Flight_Recorder *recorder;
+
+	unsigned tx_queue_depth();
+	void print_stats();
+
 	int read_message(mavlink_message_t &message);
+	int read_messages(mavlink_message_t *messages, int max_messages);
+	int read_frames(Frame_View *views, int max_views);
+	int wait_readable(int wake_fd, int timeout_ms);
+	void add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length);
 	int write_message(const mavlink_message_t &message);
+	int write_messages(const mavlink_message_t *messages, int count);
+	int write_frames(const uint8_t *frames, unsigned len, int count);
 
 	void open_serial();
 	void close_serial();
 
+	bool is_running();
 	void start();
 	void stop();
 
 	void handle_quit( int sig );
 
+	void start_tx_thread();
+
 private:
 
 	int  fd;
-	mavlink_status_t lastStatus;
-	pthread_mutex_t  lock;
+	pthread_mutex_t  read_lock;
+	pthread_mutex_t  write_lock;
+
+	uint8_t  rx_buffer[SERIAL_PORT_RX_BUFFER_LEN];
+	unsigned rx_head; // next byte to scan
+	unsigned rx_tail; // end of received bytes
+	bool     rx_more; // complete frames left in rx_buffer
+
+	pthread_t       tx_tid;
+	pthread_mutex_t tx_lock;  // guards the tx queue
+	pthread_cond_t  tx_cond;  // signals queued bytes
+	bool     tx_running;
+	bool     tx_exit;
+	uint8_t  tx_queue[SERIAL_PORT_TX_QUEUE_LEN];
+	unsigned tx_head;         // next byte to write
+	unsigned tx_count;        // bytes queued
+
+	// when each queued frame was queued, and where it ends counted in bytes
+	// ever queued, popped once the tx thread wrote past the end
+	struct Tx_Stamp
+	{
+		uint64_t end;
+		uint64_t queued;
+	};
+	Tx_Stamp tx_stamps[SERIAL_PORT_TX_STAMPS];
+	unsigned tx_stamp_head;   // oldest frame not fully written
+	unsigned tx_stamp_count;  // frames queued
+	uint64_t tx_total;        // bytes ever queued
+	uint64_t tx_written;      // bytes ever written
 
 	int  _open_port(const char* port);
 	bool _setup_port(int baud, int data_bits, int stop_bits, bool parity, bool hardware_control);
-	int  _read_port(uint8_t &cp);
+	int  _read_port(uint8_t *buf, unsigned len);
 	int _write_port(char *buf, unsigned len);
+	int _queue_frame(const char *buf, unsigned len, uint64_t now);
+	void _debug_report(const Frame_View &view);
+
+	void tx_thread();
+	void stop_tx_thread();
 
 };
 
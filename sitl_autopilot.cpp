@@ -0,0 +1,1181 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sitl_autopilot.cpp
+ *
+ * @brief Stand-in autopilot on a pseudo terminal, functions
+ *
+ * Simulates a point-mass vehicle and speaks MAVLink over a pty, so
+ * mavlink_control can be run and benchmarked without a Pixhawk.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "sitl_autopilot.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+
+// ------------------------------------------------------------------------------
+//   Helper Functions
+// ------------------------------------------------------------------------------
+
+static const double GRAVITY = 9.80665; // [m/s^2]
+
+// scale a vector down to at most limit long
+static void
+clamp_vector(double &x, double &y, double &z, double limit)
+{
+	double norm = sqrt(x*x + y*y + z*z);
+	if ( norm > limit )
+	{
+		x *= limit / norm;
+		y *= limit / norm;
+		z *= limit / norm;
+	}
+}
+
+static double
+clamp(double value, double limit)
+{
+	return value > limit ? limit : ( value < -limit ? -limit : value );
+}
+
+// angle into [-pi, pi)
+static double
+wrap_pi(double angle)
+{
+	return angle - 2.0 * M_PI * floor( (angle + M_PI) / (2.0 * M_PI) );
+}
+
+
+// ----------------------------------------------------------------------------------
+//   Sitl Autopilot Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Sitl_Autopilot::
+Sitl_Autopilot()
+{
+	link_name    = NULL;
+	url          = NULL;
+	system_id    = 1;
+	component_id = 1;
+	sim_priority = 0;
+
+	static const Sitl_Stream defaults[SITL_STREAMS] = {
+		{ "heartbeat",                  1, 0, 0 },
+		{ "sys_status",                 1, 0, 0 },
+		{ "local_position_ned",        50, 0, 0 },
+		{ "attitude",                  50, 0, 0 },
+		{ "highres_imu",               50, 0, 0 },
+		{ "global_position_int",       10, 0, 0 },
+		{ "vfr_hud",                   10, 0, 0 },
+		{ "position_target_local_ned", 10, 0, 0 },
+	};
+	memcpy(streams, defaults, sizeof(streams));
+
+	tx_messages  = 0;
+	tx_bytes     = 0;
+	tx_dropped   = 0;
+	rx_messages  = 0;
+	rx_setpoints = 0;
+	rx_commands  = 0;
+	sim_overruns = 0;
+
+	link_fd   = -1;
+	listen_fd = -1;
+	datagrams = false;
+	slave_fd  = -1;
+	slave_name[0] = '\0';
+
+	boot_nsec    = 0;
+	time_to_exit = false;
+	guided_flag  = false;
+
+	sim_tid  = 0;
+	read_tid = 0;
+
+	memset(&vehicle, 0, sizeof(vehicle));
+
+	tx_count  = 0;
+	tx_queued = 0;
+	rx_count  = 0;
+
+	pthread_mutex_init(&state_lock, NULL);
+	pthread_mutex_init(&tx_lock, NULL);
+}
+
+Sitl_Autopilot::
+~Sitl_Autopilot()
+{
+	stop();
+
+	pthread_mutex_destroy(&state_lock);
+	pthread_mutex_destroy(&tx_lock);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Stream Rates
+// ------------------------------------------------------------------------------
+bool
+Sitl_Autopilot::
+set_rate(const char *name, int rate)
+{
+	if ( rate < 0 || rate > SITL_AUTOPILOT_MAX_RATE )
+		return false;
+
+	for ( int i = 0; i < SITL_STREAMS; i++ )
+	{
+		if ( strcmp(streams[i].name, name) == 0 )
+		{
+			streams[i].rate = rate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+// ------------------------------------------------------------------------------
+//   State
+// ------------------------------------------------------------------------------
+const char *
+Sitl_Autopilot::
+pty_name()
+{
+	return slave_name;
+}
+
+// a client is there to talk to, always for a pty or udp
+bool
+Sitl_Autopilot::
+connected()
+{
+	return __atomic_load_n(&link_fd, __ATOMIC_ACQUIRE) >= 0;
+}
+
+bool
+Sitl_Autopilot::
+guided()
+{
+	return __atomic_load_n(&guided_flag, __ATOMIC_ACQUIRE);
+}
+
+Sitl_State
+Sitl_Autopilot::
+state()
+{
+	pthread_mutex_lock(&state_lock);
+	Sitl_State s = vehicle;
+	pthread_mutex_unlock(&state_lock);
+
+	return s;
+}
+
+uint32_t
+Sitl_Autopilot::
+time_boot_ms(uint64_t now)
+{
+	return (uint32_t)( (now - boot_nsec) / 1000000ULL );
+}
+
+
+// ------------------------------------------------------------------------------
+//   Vehicle Model
+// ------------------------------------------------------------------------------
+/*
+ * Point mass with a velocity loop around a position loop.  Position and
+ * velocity setpoints are honoured as the type mask says, acceleration is
+ * feed forward.  Attitude follows from the commanded horizontal
+ * acceleration, as on a multicopter that tilts to accelerate.
+ */
+void
+Sitl_Autopilot::
+step(double dt)
+{
+	if ( dt <= 0 )
+		return;
+
+	Sitl_State &s = vehicle;
+
+	mavlink_set_position_target_local_ned_t sp;
+	bool flying = guided() && setpoint.load(sp) != 0;
+
+	// desired velocity, and feed forward acceleration
+	double vx = 0, vy = 0, vz = 0;
+	double ax = 0, ay = 0, az = 0;
+	double yawspeed = 0;
+
+	if ( flying )
+	{
+		uint16_t mask = sp.type_mask;
+
+		if ( not (mask & 0x0007) )
+		{
+			vx = SITL_AUTOPILOT_POS_GAIN * (sp.x - s.x);
+			vy = SITL_AUTOPILOT_POS_GAIN * (sp.y - s.y);
+			vz = SITL_AUTOPILOT_POS_GAIN * (sp.z - s.z);
+		}
+		if ( not (mask & 0x0038) )
+		{
+			vx += sp.vx;
+			vy += sp.vy;
+			vz += sp.vz;
+		}
+		if ( not (mask & 0x01C0) )
+		{
+			ax = sp.afx;
+			ay = sp.afy;
+			az = sp.afz;
+		}
+
+		if ( not (mask & 0x0400) )
+			yawspeed = SITL_AUTOPILOT_POS_GAIN * wrap_pi(sp.yaw - s.yaw);
+		else if ( not (mask & 0x0800) )
+			yawspeed = sp.yaw_rate;
+	}
+
+	clamp_vector(vx, vy, vz, SITL_AUTOPILOT_MAX_SPEED);
+
+	ax += SITL_AUTOPILOT_VEL_GAIN * (vx - s.vx);
+	ay += SITL_AUTOPILOT_VEL_GAIN * (vy - s.vy);
+	az += SITL_AUTOPILOT_VEL_GAIN * (vz - s.vz);
+	clamp_vector(ax, ay, az, SITL_AUTOPILOT_MAX_ACCEL);
+
+	s.ax = ax;
+	s.ay = ay;
+	s.az = az;
+
+	s.vx += ax * dt;
+	s.vy += ay * dt;
+	s.vz += az * dt;
+
+	s.x += s.vx * dt;
+	s.y += s.vy * dt;
+	s.z += s.vz * dt;
+
+	// the ground is at z = 0, down is positive
+	if ( s.z > 0 )
+	{
+		s.z = 0;
+		if ( s.vz > 0 )
+			s.vz = 0;
+	}
+
+	// tilt into the horizontal acceleration
+	double cy = cos(s.yaw), sy = sin(s.yaw);
+	double forward = cy * ax + sy * ay;
+	double right   = cy * ay - sy * ax;
+
+	double roll  =  atan2(right,   GRAVITY);
+	double pitch = -atan2(forward, GRAVITY);
+
+	s.yawspeed   = clamp(yawspeed, SITL_AUTOPILOT_MAX_YAW_RATE);
+	s.rollspeed  = (roll  - s.roll)  / dt;
+	s.pitchspeed = (pitch - s.pitch) / dt;
+
+	s.roll  = roll;
+	s.pitch = pitch;
+	s.yaw   = wrap_pi(s.yaw + s.yawspeed * dt);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Send Stream
+// ------------------------------------------------------------------------------
+// call with tx_lock held
+void
+Sitl_Autopilot::
+send_stream(int id, uint64_t now)
+{
+	Sitl_State s = state();
+	uint32_t ms = time_boot_ms(now);
+	mavlink_message_t message;
+
+	switch ( id )
+	{
+		case SITL_HEARTBEAT:
+		{
+			// PX4 custom main modes, 3 is position control, 6 offboard
+			bool g = guided();
+			uint8_t base_mode = MAV_MODE_FLAG_CUSTOM_MODE_ENABLED | MAV_MODE_FLAG_SAFETY_ARMED |
+				( g ? MAV_MODE_FLAG_GUIDED_ENABLED : 0 );
+			uint32_t custom_mode = ( g ? 6 : 3 ) << 16;
+
+			mavlink_msg_heartbeat_pack(system_id, component_id, &message,
+				MAV_TYPE_QUADROTOR, MAV_AUTOPILOT_PX4, base_mode, custom_mode, MAV_STATE_ACTIVE);
+			break;
+		}
+
+		case SITL_SYS_STATUS:
+		{
+			mavlink_sys_status_t status;
+			memset(&status, 0, sizeof(status));
+			status.load              = 250;   // [0.1 %]
+			status.voltage_battery   = 12400; // [mV]
+			status.current_battery   = 1000;  // [10 mA]
+			status.battery_remaining = 80;    // [%]
+
+			mavlink_msg_sys_status_encode(system_id, component_id, &message, &status);
+			break;
+		}
+
+		case SITL_LOCAL_POSITION_NED:
+		{
+			mavlink_msg_local_position_ned_pack(system_id, component_id, &message,
+				ms, s.x, s.y, s.z, s.vx, s.vy, s.vz);
+			break;
+		}
+
+		case SITL_ATTITUDE:
+		{
+			mavlink_msg_attitude_pack(system_id, component_id, &message,
+				ms, s.roll, s.pitch, s.yaw, s.rollspeed, s.pitchspeed, s.yawspeed);
+			break;
+		}
+
+		case SITL_HIGHRES_IMU:
+		{
+			// specific force in the body frame, flat enough to ignore the tilt
+			double cy = cos(s.yaw), sy = sin(s.yaw);
+			float pressure_alt = SITL_AUTOPILOT_HOME_ALT - s.z;
+
+			mavlink_msg_highres_imu_pack(system_id, component_id, &message,
+				(now - boot_nsec) / 1000,
+				cy * s.ax + sy * s.ay, cy * s.ay - sy * s.ax, s.az - GRAVITY,
+				s.rollspeed, s.pitchspeed, s.yawspeed,
+				0.21 * cy, -0.21 * sy, 0.42,
+				1013.25 * pow(1.0 - 2.25577e-5 * pressure_alt, 5.25588), 0, pressure_alt, 25.0,
+				0x1FFF);
+			break;
+		}
+
+		case SITL_GLOBAL_POSITION_INT:
+		{
+			const double earth_radius = 6371000.0; // [m]
+			double lat = SITL_AUTOPILOT_HOME_LAT + s.x / earth_radius * 180.0 / M_PI;
+			double lon = SITL_AUTOPILOT_HOME_LON + s.y / earth_radius * 180.0 / M_PI
+				/ cos(SITL_AUTOPILOT_HOME_LAT * M_PI / 180.0);
+			double heading = s.yaw < 0 ? s.yaw + 2.0 * M_PI : s.yaw;
+
+			mavlink_msg_global_position_int_pack(system_id, component_id, &message,
+				ms, lat * 1e7, lon * 1e7, (SITL_AUTOPILOT_HOME_ALT - s.z) * 1000, -s.z * 1000,
+				s.vx * 100, s.vy * 100, s.vz * 100, heading * 18000.0 / M_PI);
+			break;
+		}
+
+		case SITL_VFR_HUD:
+		{
+			double heading = s.yaw < 0 ? s.yaw + 2.0 * M_PI : s.yaw;
+			float groundspeed = sqrt(s.vx*s.vx + s.vy*s.vy);
+
+			mavlink_msg_vfr_hud_pack(system_id, component_id, &message,
+				groundspeed, groundspeed, heading * 180.0 / M_PI, 50,
+				SITL_AUTOPILOT_HOME_ALT - s.z, -s.vz);
+			break;
+		}
+
+		case SITL_POSITION_TARGET_LOCAL_NED:
+		{
+			// nothing is flown until a setpoint arrives
+			mavlink_set_position_target_local_ned_t sp;
+			if ( not setpoint.load(sp) )
+				return;
+
+			mavlink_msg_position_target_local_ned_pack(system_id, component_id, &message,
+				ms, sp.coordinate_frame, sp.type_mask, sp.x, sp.y, sp.z,
+				sp.vx, sp.vy, sp.vz, sp.afx, sp.afy, sp.afz, sp.yaw, sp.yaw_rate);
+			break;
+		}
+
+		default:
+			return;
+	}
+
+	queue_message(message);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Transmit
+// ------------------------------------------------------------------------------
+// call with tx_lock held, the frame is dropped if it does not fit, and
+// nothing is queued while no tcp client is connected
+void
+Sitl_Autopilot::
+queue_message(mavlink_message_t &message)
+{
+	if ( link_fd < 0 )
+		return;
+
+	if ( tx_count + MAVLINK_MAX_PACKET_LEN > SITL_AUTOPILOT_TX_BUFFER_LEN )
+	{
+		tx_dropped++;
+		return;
+	}
+
+	tx_count += mavlink_msg_to_send_buffer(tx_buffer + tx_count, &message);
+	tx_queued++;
+	tx_messages++;
+}
+
+// call with tx_lock held, writes what the link takes without blocking
+void
+Sitl_Autopilot::
+flush()
+{
+	if ( not tx_count || link_fd < 0 )
+		return;
+
+	int result = write(link_fd, tx_buffer, tx_count);
+
+	// one datagram, sent or lost as a whole
+	if ( datagrams )
+	{
+		if ( result > 0 )
+			tx_bytes += result;
+		else
+			tx_dropped += tx_queued;
+
+		tx_count  = 0;
+		tx_queued = 0;
+		return;
+	}
+
+	if ( result > 0 )
+	{
+		tx_bytes += result;
+		tx_count -= result;
+		if ( tx_count )
+			memmove(tx_buffer, tx_buffer + result, tx_count);
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Handle Frame
+// ------------------------------------------------------------------------------
+void
+Sitl_Autopilot::
+handle_frame(const Frame_View &view, uint64_t now)
+{
+	mavlink_message_t message;
+	view.to_message(message);
+
+	rx_messages++;
+
+	switch ( view.msgid )
+	{
+		case MAVLINK_MSG_ID_SET_POSITION_TARGET_LOCAL_NED:
+		{
+			mavlink_set_position_target_local_ned_t sp;
+			mavlink_msg_set_position_target_local_ned_decode(&message, &sp);
+
+			if ( sp.target_system && sp.target_system != system_id )
+				break;
+
+			// offsets are taken from where the vehicle is now
+			if ( sp.coordinate_frame == MAV_FRAME_LOCAL_OFFSET_NED ||
+			     sp.coordinate_frame == MAV_FRAME_BODY_OFFSET_NED )
+			{
+				Sitl_State s = state();
+				double x = sp.x, y = sp.y;
+
+				if ( sp.coordinate_frame == MAV_FRAME_BODY_OFFSET_NED )
+				{
+					double cy = cos(s.yaw), sy = sin(s.yaw);
+					x = cy * sp.x - sy * sp.y;
+					y = sy * sp.x + cy * sp.y;
+				}
+
+				sp.x = s.x + x;
+				sp.y = s.y + y;
+				sp.z = s.z + sp.z;
+				sp.coordinate_frame = MAV_FRAME_LOCAL_NED;
+			}
+
+			setpoint.store(sp, now);
+			rx_setpoints++;
+
+			// only as good as the sender's idea of our boot time
+			uint32_t ms = time_boot_ms(now);
+			if ( sp.time_boot_ms && sp.time_boot_ms <= ms )
+				setpoint_latency.add( (uint64_t)(ms - sp.time_boot_ms) * 1000 );
+			break;
+		}
+
+		case MAVLINK_MSG_ID_COMMAND_LONG:
+		{
+			mavlink_command_long_t command;
+			mavlink_msg_command_long_decode(&message, &command);
+
+			if ( command.target_system && command.target_system != system_id )
+				break;
+
+			rx_commands++;
+
+			uint8_t result = MAV_RESULT_UNSUPPORTED;
+			if ( command.command == MAV_CMD_NAV_GUIDED_ENABLE )
+			{
+				bool on = command.param1 > 0.5f;
+				__atomic_store_n(&guided_flag, on, __ATOMIC_RELEASE);
+				printf("SITL GUIDED MODE %s\n", on ? "ON" : "OFF");
+				result = MAV_RESULT_ACCEPTED;
+			}
+
+			pthread_mutex_lock(&tx_lock);
+			mavlink_msg_command_ack_pack(system_id, component_id, &message, command.command, result);
+			queue_message(message);
+			flush();
+			pthread_mutex_unlock(&tx_lock);
+			break;
+		}
+
+		case MAVLINK_MSG_ID_TIMESYNC:
+		{
+			mavlink_timesync_t timesync;
+			mavlink_msg_timesync_decode(&message, &timesync);
+
+			// answer requests with our time since boot
+			if ( timesync.tc1 != 0 )
+				break;
+
+			pthread_mutex_lock(&tx_lock);
+			mavlink_msg_timesync_pack(system_id, component_id, &message,
+				get_time_nsec() - boot_nsec, timesync.ts1);
+			queue_message(message);
+			flush();
+			pthread_mutex_unlock(&tx_lock);
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+Sitl_Autopilot::
+print_stats()
+{
+	Sitl_State s = state();
+
+	printf("SITL    %s  pos % 8.3f % 8.3f % 8.3f  vel % 6.2f % 6.2f % 6.2f  yaw % 5.2f\n",
+		guided() ? "GUIDED" : "HOLD  ", s.x, s.y, s.z, s.vx, s.vy, s.vz, s.yaw);
+	printf("SITL TX %llu messages, %llu bytes, %llu dropped, %llu sim overruns\n",
+		(unsigned long long)tx_messages, (unsigned long long)tx_bytes,
+		(unsigned long long)tx_dropped, (unsigned long long)sim_overruns);
+	printf("SITL RX %llu messages, %llu setpoints, %llu commands, %u bad frames\n",
+		(unsigned long long)rx_messages, (unsigned long long)rx_setpoints,
+		(unsigned long long)rx_commands, scanner.bad_frames());
+
+	sim_jitter.print("SIM JITTER");
+	setpoint_latency.print("SETPOINT LATENCY");
+}
+
+
+// ------------------------------------------------------------------------------
+//   STARTUP
+// ------------------------------------------------------------------------------
+void
+Sitl_Autopilot::
+start()
+{
+	int result;
+
+	// --------------------------------------------------------------------------
+	//   OPEN LINK
+	// --------------------------------------------------------------------------
+
+	if ( url )
+		open_url();
+	else
+		open_pty();
+
+	boot_nsec    = get_time_nsec();
+	time_to_exit = false;
+
+	// --------------------------------------------------------------------------
+	//   READ THREAD
+	// --------------------------------------------------------------------------
+
+	result = pthread_create( &read_tid, NULL, &start_sitl_autopilot_read_thread, this );
+	if ( result ) throw result;
+
+	// --------------------------------------------------------------------------
+	//   SIM THREAD
+	// --------------------------------------------------------------------------
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	if ( sim_priority > 0 )
+	{
+		struct sched_param param;
+		param.sched_priority = sim_priority;
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+
+	result = pthread_create( &sim_tid, &attr, &start_sitl_autopilot_sim_thread, this );
+	pthread_attr_destroy(&attr);
+
+	// real time priority needs root or CAP_SYS_NICE, carry on without it
+	if ( result == EPERM || result == EINVAL )
+	{
+		fprintf(stderr,"WARNING: could not set SCHED_FIFO priority %i, simulating at normal priority\n", sim_priority);
+		result = pthread_create( &sim_tid, NULL, &start_sitl_autopilot_sim_thread, this );
+	}
+	if ( result ) throw result;
+
+	if ( url )
+		printf("SITL AUTOPILOT ON %s\n", url);
+	else
+		printf("SITL AUTOPILOT ON %s%s%s\n", slave_name, link_name ? " -> " : "", link_name ? link_name : "");
+
+	return;
+}
+
+// throws 1 if the pty can not be opened
+void
+Sitl_Autopilot::
+open_pty()
+{
+	link_fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if ( link_fd < 0 || grantpt(link_fd) || unlockpt(link_fd) || not ptsname(link_fd) )
+	{
+		fprintf(stderr, "ERROR: could not open a pseudo terminal, %s\n", strerror(errno));
+		throw 1;
+	}
+	strncpy(slave_name, ptsname(link_fd), sizeof(slave_name) - 1);
+	slave_name[sizeof(slave_name) - 1] = '\0';
+
+	// raw until Serial_Port sets it up, so nothing is echoed back to us
+	slave_fd = open(slave_name, O_RDWR | O_NOCTTY);
+	if ( slave_fd < 0 )
+	{
+		fprintf(stderr, "ERROR: could not open %s, %s\n", slave_name, strerror(errno));
+		throw 1;
+	}
+
+	struct termios config;
+	tcgetattr(slave_fd, &config);
+	cfmakeraw(&config);
+	tcsetattr(slave_fd, TCSANOW, &config);
+
+	// the sim thread never waits for a slow reader
+	fcntl(link_fd, F_SETFL, fcntl(link_fd, F_GETFL) | O_NONBLOCK);
+
+	if ( link_name )
+	{
+		unlink(link_name);
+		if ( symlink(slave_name, link_name) )
+		{
+			fprintf(stderr, "ERROR: could not link %s to %s, %s\n", link_name, slave_name, strerror(errno));
+			throw 1;
+		}
+	}
+}
+
+// throws 1 if the url is not udpout:// or tcp://, or can not be opened
+void
+Sitl_Autopilot::
+open_url()
+{
+	Port_Url parsed;
+	struct sockaddr_in address;
+
+	if ( not parse_port_url(url, parsed) ||
+	     (parsed.type != PORT_URL_UDPOUT && parsed.type != PORT_URL_TCP) )
+	{
+		fprintf(stderr, "ERROR: %s is not a udpout:// or tcp:// url\n", url);
+		throw 1;
+	}
+	if ( not resolve_host(parsed.host, parsed.port, address) )
+	{
+		fprintf(stderr, "ERROR: could not resolve %s\n", parsed.host);
+		throw 1;
+	}
+
+	// connected, so read() and write() work on it like on the pty
+	if ( parsed.type == PORT_URL_UDPOUT )
+	{
+		datagrams = true;
+		link_fd   = socket(AF_INET, SOCK_DGRAM, 0);
+		if ( link_fd < 0 || connect(link_fd, (struct sockaddr *)&address, sizeof(address)) )
+		{
+			fprintf(stderr, "ERROR: could not open %s, %s\n", url, strerror(errno));
+			throw 1;
+		}
+		fcntl(link_fd, F_SETFL, fcntl(link_fd, F_GETFL) | O_NONBLOCK);
+		return;
+	}
+
+	// the read thread accepts clients
+	int on = 1;
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if ( listen_fd < 0 ||
+	     setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) ||
+	     bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) ||
+	     listen(listen_fd, 1) )
+	{
+		fprintf(stderr, "ERROR: could not listen on %s, %s\n", url, strerror(errno));
+		throw 1;
+	}
+}
+
+// takes the next tcp client, the last one is gone
+void
+Sitl_Autopilot::
+accept_client()
+{
+	int fd = accept(listen_fd, NULL, NULL);
+	if ( fd < 0 )
+		return;
+
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	pthread_mutex_lock(&tx_lock);
+	rx_count = 0;
+	__atomic_store_n(&link_fd, fd, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&tx_lock);
+
+	printf("SITL CLIENT CONNECTED\n");
+}
+
+void
+Sitl_Autopilot::
+drop_client()
+{
+	pthread_mutex_lock(&tx_lock);
+	close(link_fd);
+	__atomic_store_n(&link_fd, -1, __ATOMIC_RELEASE);
+	tx_count  = 0;
+	tx_queued = 0;
+	pthread_mutex_unlock(&tx_lock);
+
+	printf("SITL CLIENT DISCONNECTED\n");
+}
+
+
+// ------------------------------------------------------------------------------
+//   SHUTDOWN
+// ------------------------------------------------------------------------------
+void
+Sitl_Autopilot::
+stop()
+{
+	time_to_exit = true;
+
+	if ( sim_tid )
+		pthread_join(sim_tid, NULL);
+	if ( read_tid )
+		pthread_join(read_tid, NULL);
+	sim_tid  = 0;
+	read_tid = 0;
+
+	if ( link_name && slave_name[0] )
+		unlink(link_name);
+
+	if ( slave_fd >= 0 )
+		close(slave_fd);
+	if ( link_fd >= 0 )
+		close(link_fd);
+	if ( listen_fd >= 0 )
+		close(listen_fd);
+	slave_fd  = -1;
+	link_fd   = -1;
+	listen_fd = -1;
+	slave_name[0] = '\0';
+}
+
+
+// ------------------------------------------------------------------------------
+//   Quit Handler
+// ------------------------------------------------------------------------------
+void
+Sitl_Autopilot::
+handle_quit( int sig )
+{
+	(void)sig;
+
+	try {
+		stop();
+	}
+	catch (int error) {
+		fprintf(stderr,"Warning, could not stop sitl autopilot\n");
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Sim Thread
+// ------------------------------------------------------------------------------
+void
+Sitl_Autopilot::
+start_sim_thread()
+{
+	sim_thread();
+}
+
+void
+Sitl_Autopilot::
+sim_thread()
+{
+	// step the model at least at SITL_AUTOPILOT_MODEL_RATE, and as often as
+	// the fastest stream is sent
+	int tick_rate = SITL_AUTOPILOT_MODEL_RATE;
+	for ( int i = 0; i < SITL_STREAMS; i++ )
+		if ( streams[i].rate > tick_rate )
+			tick_rate = streams[i].rate;
+
+	uint64_t period   = 1000000000ULL / tick_rate; // [ns]
+	uint64_t deadline = get_time_nsec();
+	uint64_t last     = deadline;
+
+	for ( int i = 0; i < SITL_STREAMS; i++ )
+		streams[i].next = deadline;
+
+	while ( !time_to_exit )
+	{
+		deadline += period;
+
+		struct timespec wake_at;
+		wake_at.tv_sec  = deadline / 1000000000ULL;
+		wake_at.tv_nsec = deadline % 1000000000ULL;
+		while ( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_at, NULL) == EINTR );
+
+		uint64_t now = get_time_nsec();
+		sim_jitter.add( now > deadline ? (now - deadline) / 1000 : 0 );
+
+		pthread_mutex_lock(&state_lock);
+		step( (now - last) * 1e-9 );
+		pthread_mutex_unlock(&state_lock);
+		last = now;
+
+		// everything due goes out in one write
+		pthread_mutex_lock(&tx_lock);
+		for ( int i = 0; i < SITL_STREAMS; i++ )
+		{
+			Sitl_Stream &stream = streams[i];
+			if ( not stream.rate || now < stream.next )
+				continue;
+
+			send_stream(i, now);
+			stream.sent++;
+
+			// keep the average rate, but never send a burst to catch up
+			stream.next += 1000000000ULL / stream.rate;
+			if ( stream.next <= now )
+				stream.next = now + 1000000000ULL / stream.rate;
+		}
+		flush();
+		pthread_mutex_unlock(&tx_lock);
+
+		// fell a whole period or more behind, the next step covers the gap
+		now = get_time_nsec();
+		if ( now >= deadline + period )
+		{
+			uint64_t missed = (now - deadline) / period;
+			deadline     += missed * period;
+			sim_overruns += missed;
+		}
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Read Thread
+// ------------------------------------------------------------------------------
+void
+Sitl_Autopilot::
+start_read_thread()
+{
+	read_thread();
+}
+
+void
+Sitl_Autopilot::
+read_thread()
+{
+	Frame_View views[32];
+
+	while ( !time_to_exit )
+	{
+		// tcp waits for a client first
+		bool accepting = ( link_fd < 0 );
+
+		struct pollfd pfd;
+		pfd.fd     = accepting ? listen_fd : link_fd;
+		pfd.events = POLLIN;
+
+		if ( poll(&pfd, 1, 100) <= 0 )
+			continue;
+
+		// a broken link stays that way, poll() would return at once forever
+		if ( pfd.revents & (POLLERR | POLLNVAL) )
+		{
+			if ( not accepting && listen_fd >= 0 )
+			{
+				drop_client();
+				continue;
+			}
+
+			fprintf(stderr, "ERROR: sitl link fd %d failed, stopping\n", pfd.fd);
+			break;
+		}
+
+		if ( not (pfd.revents & (POLLIN | POLLHUP)) )
+			continue;
+
+		if ( accepting )
+		{
+			accept_client();
+			continue;
+		}
+
+		int result = read(link_fd, rx_buffer + rx_count, SITL_AUTOPILOT_RX_BUFFER_LEN - rx_count);
+
+		if ( listen_fd >= 0 && (result == 0 || (result < 0 && errno != EAGAIN && errno != EINTR)) )
+		{
+			drop_client();
+			continue;
+		}
+		if ( result <= 0 )
+			continue;
+		rx_count += result;
+
+		uint64_t now = get_time_nsec();
+
+		// handle every complete frame, keep the start of a partial one
+		unsigned head = 0;
+		int count;
+		do {
+			unsigned consumed;
+			count = scanner.scan(rx_buffer + head, rx_count - head, views, 32, consumed, not datagrams);
+			head += consumed;
+
+			for ( int i = 0; i < count; i++ )
+				handle_frame(views[i], now);
+
+		} while ( count == 32 );
+
+		// frames never span datagrams
+		rx_count = datagrams ? 0 : rx_count - head;
+		if ( rx_count && head )
+			memmove(rx_buffer, rx_buffer + head, rx_count);
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Pthread Starter Helper Functions
+// ------------------------------------------------------------------------------
+
+void*
+start_sitl_autopilot_sim_thread(void *args)
+{
+	Sitl_Autopilot *sitl = (Sitl_Autopilot *)args;
+	sitl->start_sim_thread();
+	return NULL;
+}
+
+void*
+start_sitl_autopilot_read_thread(void *args)
+{
+	Sitl_Autopilot *sitl = (Sitl_Autopilot *)args;
+	sitl->start_read_thread();
+	return NULL;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Command Line Tool
+// ------------------------------------------------------------------------------
+
+static Sitl_Autopilot *sitl_quit;
+
+static void
+quit_handler( int sig )
+{
+	printf("\n");
+	printf("TERMINATING AT USER REQUEST\n");
+	printf("\n");
+
+	sitl_quit->handle_quit(sig);
+	sitl_quit->print_stats();
+
+	exit(0);
+}
+
+// throws EXIT_FAILURE on bad arguments
+static void
+parse_commandline(int argc, char **argv, Sitl_Autopilot &sitl)
+{
+	const char *commandline_usage = "usage: sitl_autopilot [-d <link to pty> | -u <udpout://host:port | tcp://[host]:port>] [-r <telemetry rate Hz>] [-m <message>=<rate Hz>]... [-p <SCHED_FIFO priority>]";
+
+	for (int i = 1; i < argc; i++) {
+
+		// Help
+		if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+			printf("%s\n",commandline_usage);
+			throw EXIT_FAILURE;
+		}
+
+		// Where to link the slave pty
+		if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--device") == 0) {
+			if (argc > i + 1) {
+				sitl.link_name = argv[i + 1];
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Network link instead of a pty
+		if (strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--url") == 0) {
+			if (argc > i + 1) {
+				sitl.url = argv[i + 1];
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Rate of the fast telemetry streams
+		if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--rate") == 0) {
+			if (argc > i + 1) {
+				int rate = atoi(argv[i + 1]);
+				sitl.set_rate("local_position_ned", rate);
+				sitl.set_rate("attitude",           rate);
+				sitl.set_rate("highres_imu",        rate);
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Rate of one stream, by message name
+		if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--message") == 0) {
+			char name[64];
+			int  rate;
+			if (argc <= i + 1 || sscanf(argv[i + 1], "%63[a-z_]=%d", name, &rate) != 2 ||
+			    not sitl.set_rate(name, rate)) {
+				printf("%s\n",commandline_usage);
+				printf("streams:");
+				for (int j = 0; j < SITL_STREAMS; j++)
+					printf(" %s", sitl.streams[j].name);
+				printf("\n");
+				throw EXIT_FAILURE;
+			}
+		}
+
+		// Sim thread priority
+		if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--priority") == 0) {
+			if (argc > i + 1) {
+				sitl.sim_priority = atoi(argv[i + 1]);
+
+			} else {
+				printf("%s\n",commandline_usage);
+				throw EXIT_FAILURE;
+			}
+		}
+
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	// This program uses throw, wrap one big try/catch here
+	try
+	{
+		Sitl_Autopilot sitl;
+		parse_commandline(argc, argv, sitl);
+
+		sitl_quit = &sitl;
+		signal(SIGINT, quit_handler);
+
+		sitl.start();
+
+		// report once a second until stopped
+		while ( true )
+		{
+			sleep(1);
+			sitl.print_stats();
+			printf("\n");
+		}
+	}
+
+	catch ( int error )
+	{
+		fprintf(stderr,"sitl_autopilot threw exception %i \n" , error);
+		return error;
+	}
+
+}
+
+
@@ -0,0 +1,254 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sitl_autopilot.h
+ *
+ * @brief Stand-in autopilot on a pseudo terminal, definition
+ *
+ * Simulates a point-mass vehicle and speaks MAVLink over a pty, so
+ * mavlink_control can be run and benchmarked without a Pixhawk.
+ *
+ */
+
+#ifndef SITL_AUTOPILOT_H_
+#define SITL_AUTOPILOT_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <common/mavlink.h>
+
+#include "generic_port.h"
+#include "port_url.h"
+#include "frame_scanner.h"
+#include "latency_histogram.h"
+#include "seqlock.h"
+#include "time_base.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Slowest the model is stepped, streams faster than this step it faster [Hz]
+#define SITL_AUTOPILOT_MODEL_RATE 250
+
+// Fastest any stream may be configured [Hz]
+#define SITL_AUTOPILOT_MAX_RATE 20000
+
+// Bytes waiting for the pty, frames that do not fit are dropped
+#define SITL_AUTOPILOT_TX_BUFFER_LEN 65536
+
+#define SITL_AUTOPILOT_RX_BUFFER_LEN 4096
+
+// Point-mass controller limits and gains
+#define SITL_AUTOPILOT_MAX_SPEED    5.0  // [m/s]
+#define SITL_AUTOPILOT_MAX_ACCEL    4.0  // [m/s^2]
+#define SITL_AUTOPILOT_MAX_YAW_RATE 1.0  // [rad/s]
+#define SITL_AUTOPILOT_POS_GAIN     1.0  // [1/s] position error to velocity
+#define SITL_AUTOPILOT_VEL_GAIN     3.0  // [1/s] velocity error to acceleration
+
+// Where local position 0,0,0 is on the globe
+#define SITL_AUTOPILOT_HOME_LAT 47.397742  // [deg]
+#define SITL_AUTOPILOT_HOME_LON  8.545594  // [deg]
+#define SITL_AUTOPILOT_HOME_ALT 488.0      // [m]
+
+
+// ------------------------------------------------------------------------------
+//   Data Structures
+// ------------------------------------------------------------------------------
+
+// Messages the stand-in sends, each at its own rate
+enum Sitl_Stream_Id
+{
+	SITL_HEARTBEAT = 0,
+	SITL_SYS_STATUS,
+	SITL_LOCAL_POSITION_NED,
+	SITL_ATTITUDE,
+	SITL_HIGHRES_IMU,
+	SITL_GLOBAL_POSITION_INT,
+	SITL_VFR_HUD,
+	SITL_POSITION_TARGET_LOCAL_NED,
+	SITL_STREAMS
+};
+
+struct Sitl_Stream
+{
+	const char *name;     // lower case message name, as given on the command line
+	int         rate;     // [Hz], 0 is off
+	uint64_t    next;     // when it is due next [ns]
+	uint64_t    sent;
+};
+
+// Point-mass vehicle in the local NED frame
+struct Sitl_State
+{
+	double x,  y,  z;   // [m]
+	double vx, vy, vz;  // [m/s]
+	double ax, ay, az;  // [m/s^2]
+	double roll, pitch, yaw;   // [rad]
+	double rollspeed, pitchspeed, yawspeed; // [rad/s]
+};
+
+
+// ------------------------------------------------------------------------------
+//   Prototypes
+// ------------------------------------------------------------------------------
+
+void* start_sitl_autopilot_sim_thread(void *args);
+void* start_sitl_autopilot_read_thread(void *args);
+
+
+// ----------------------------------------------------------------------------------
+//   Sitl Autopilot Class
+// ----------------------------------------------------------------------------------
+/*
+ * Sitl Autopilot Class
+ *
+ * Opens a pseudo terminal pair and plays the autopilot on the master side.
+ * Serial_Port opens the slave side like any other tty, link_name points a
+ * fixed path at it.  With url set it talks over the network instead, to
+ * udpout://host:port like PX4 SITL sends to its offboard port, or to one
+ * client at a time on tcp://[host]:port.
+ *
+ * The sim thread sleeps until absolute deadlines, steps the vehicle model
+ * and packs every stream that is due into one write().  The read thread
+ * takes SET_POSITION_TARGET_LOCAL_NED, COMMAND_LONG NAV_GUIDED_ENABLE and
+ * TIMESYNC requests.  Setpoints are only flown while guided, otherwise the
+ * vehicle brakes and holds where it is.
+ */
+class Sitl_Autopilot
+{
+
+public:
+
+	Sitl_Autopilot();
+	~Sitl_Autopilot();
+
+	const char *link_name;  // symlink to the slave pty, NULL for none
+	const char *url;        // udpout:// or tcp:// instead of a pty, NULL for none
+	int  system_id;
+	int  component_id;
+	int  sim_priority;      // SCHED_FIFO priority of the sim thread, 0 for none
+
+	Sitl_Stream streams[SITL_STREAMS];
+
+	// set the rate of the stream called name, false if there is none
+	bool set_rate(const char *name, int rate);
+
+	uint64_t tx_messages;
+	uint64_t tx_bytes;
+	uint64_t tx_dropped;    // messages that did not fit the tx buffer
+	uint64_t rx_messages;
+	uint64_t rx_setpoints;
+	uint64_t rx_commands;
+	uint64_t sim_overruns;  // model steps skipped because the thread fell behind
+
+	Latency_Histogram sim_jitter;       // lateness of each model step
+	Latency_Histogram setpoint_latency; // setpoint time_boot_ms to arrival, 1 ms resolution
+
+	Frame_Scanner scanner;
+
+	const char *pty_name();
+	bool connected();
+	bool guided();
+	Sitl_State state();
+
+	void print_stats();
+
+	void start();
+	void stop();
+
+	void handle_quit( int sig );
+
+	void start_sim_thread();
+	void start_read_thread();
+
+private:
+
+	int  link_fd;           // pty master, udp socket or tcp client, -1 if none
+	int  listen_fd;         // tcp only
+	bool datagrams;         // each write is sent whole or not at all
+	int  slave_fd;          // held open so the master never sees a hangup
+	char slave_name[64];
+
+	uint64_t boot_nsec;
+	bool     time_to_exit;
+	bool     guided_flag;
+
+	pthread_t sim_tid;
+	pthread_t read_tid;
+
+	pthread_mutex_t state_lock;
+	Sitl_State      vehicle;
+
+	Seqlock<mavlink_set_position_target_local_ned_t> setpoint;
+
+	pthread_mutex_t tx_lock;
+	uint8_t  tx_buffer[SITL_AUTOPILOT_TX_BUFFER_LEN];
+	unsigned tx_count;
+	unsigned tx_queued;     // messages in tx_buffer
+
+	uint8_t  rx_buffer[SITL_AUTOPILOT_RX_BUFFER_LEN];
+	unsigned rx_count;
+
+	uint32_t time_boot_ms(uint64_t now);
+
+	void step(double dt);
+	void send_stream(int id, uint64_t now);
+	void queue_message(mavlink_message_t &message);
+	void flush();
+
+	void handle_frame(const Frame_View &view, uint64_t now);
+
+	void open_pty();
+	void open_url();
+	void accept_client();
+	void drop_client();
+
+	void sim_thread();
+	void read_thread();
+
+};
+
+
+
+#endif // SITL_AUTOPILOT_H_
+
+
@@ -0,0 +1,427 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file tcp_port.cpp
+ *
+ * @brief TCP interface functions
+ *
+ * Functions for sending and receiving MAVLink over a TCP connection.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "tcp_port.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "port_url.h"
+#include "time_base.h"
+
+
+// ----------------------------------------------------------------------------------
+//   TCP Port Manager Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+TCP_Port::
+TCP_Port(const char *host_, int port_)
+{
+	host = host_;
+	port = port_;
+
+	rx_bytes    = 0;
+	rx_reads    = 0;
+	rx_messages = 0;
+
+	tx_bytes    = 0;
+	tx_writes   = 0;
+	tx_messages = 0;
+	tx_dropped = 0;
+
+	recorder = NULL;
+
+	sock   = -1;
+	status = 0;
+
+	rx_head = 0;
+	rx_tail = 0;
+	rx_more = false;
+
+	int result = pthread_mutex_init(&read_lock, NULL) ||
+	             pthread_mutex_init(&write_lock, NULL);
+	if ( result != 0 )
+	{
+		printf("\n mutex init failed\n");
+		throw 1;
+	}
+}
+
+TCP_Port::
+~TCP_Port()
+{
+	stop();
+
+	pthread_mutex_destroy(&read_lock);
+	pthread_mutex_destroy(&write_lock);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Read from TCP
+// ------------------------------------------------------------------------------
+// Same as Serial_Port::read_frames(), the views point into rx_buffer and are
+// only valid until the next read
+int
+TCP_Port::
+read_frames(Frame_View *views, int max_views)
+{
+	unsigned consumed;
+
+	pthread_mutex_lock(&read_lock);
+
+	int count = scanner.scan(rx_buffer + rx_head, rx_tail - rx_head, views, max_views, consumed);
+	rx_head += consumed;
+
+	// only go to the socket once the buffered frames are used up
+	if ( count == 0 && status == 1 )
+	{
+		rx_more = false;
+
+		// keep the start of a partial frame, and make room behind it
+		unsigned pending = rx_tail - rx_head;
+		if ( pending && rx_head )
+			memmove(rx_buffer, rx_buffer + rx_head, pending);
+		rx_head = 0;
+		rx_tail = pending;
+
+		int result = recv(sock, rx_buffer + rx_tail, TCP_PORT_RX_BUFFER_LEN - rx_tail, MSG_DONTWAIT);
+
+		if ( result > 0 )
+		{
+			rx_tail  += result;
+			rx_bytes += result;
+			rx_reads++;
+
+			count = scanner.scan(rx_buffer + rx_head, rx_tail - rx_head, views, max_views, consumed);
+			rx_head += consumed;
+		}
+
+		// the other end hung up
+		else if ( result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) )
+		{
+			fprintf(stderr, "ERROR: TCP connection to %s:%d closed\n", host, port);
+			status = 0;
+		}
+	}
+
+	// views[] was filled up, there may be more frames buffered
+	rx_more = ( count == max_views );
+
+	// keep a copy of everything received
+	if ( recorder && count )
+	{
+		uint64_t now = get_time_usec();
+		for ( int i = 0; i < count; i++ )
+			recorder->record(FLIGHT_RECORD_RX, views[i].frame, views[i].length, now);
+	}
+
+	rx_messages += count;
+
+	pthread_mutex_unlock(&read_lock);
+
+	return count;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Add Message
+// ------------------------------------------------------------------------------
+// Passed on to the frame scanner, see Frame_Scanner::add_message()
+void
+TCP_Port::
+add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length)
+{
+	scanner.add_message(msgid, crc_extra, length);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Wait for Data
+// ------------------------------------------------------------------------------
+// Same as Serial_Port::wait_readable(), once the connection is gone only
+// wake_fd and the timeout are waited for
+int
+TCP_Port::
+wait_readable(int wake_fd, int timeout_ms)
+{
+	if ( rx_more )
+		return 1;
+
+	bool connected = ( status == 1 );
+
+	struct pollfd pfd[2];
+	pfd[0].fd      = connected ? sock : -1;
+	pfd[0].events  = POLLIN;
+	pfd[0].revents = 0;
+	pfd[1].fd      = wake_fd;
+	pfd[1].events  = POLLIN;
+	pfd[1].revents = 0;
+
+	int result = poll(pfd, 2, timeout_ms);
+
+	if ( result < 0 )
+		return errno == EINTR ? 0 : -1;
+
+	return ( pfd[0].revents & (POLLIN | POLLERR | POLLHUP) ) ? 1 : 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Write to TCP
+// ------------------------------------------------------------------------------
+int
+TCP_Port::
+write_message(const mavlink_message_t &message)
+{
+	uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+	unsigned len = mavlink_msg_to_send_buffer(buf, &message);
+
+	int result = _send(buf, len);
+	if ( result > 0 )
+		tx_messages++;
+	else
+		tx_dropped++;
+
+	return result;
+}
+
+// All messages go out with one send(), returns the bytes sent
+int
+TCP_Port::
+write_messages(const mavlink_message_t *messages, int count)
+{
+	uint8_t buf[GENERIC_PORT_MAX_BATCH * MAVLINK_MAX_PACKET_LEN];
+	int bytes = 0;
+
+	while ( count > 0 )
+	{
+		int batch = count < GENERIC_PORT_MAX_BATCH ? count : GENERIC_PORT_MAX_BATCH;
+
+		unsigned len = 0;
+		for ( int i = 0; i < batch; i++ )
+			len += mavlink_msg_to_send_buffer(buf + len, &messages[i]);
+
+		int result = write_frames(buf, len, batch);
+		if ( result > 0 )
+			bytes += result;
+
+		messages += batch;
+		count    -= batch;
+	}
+
+	return bytes;
+}
+
+int
+TCP_Port::
+write_frames(const uint8_t *frames, unsigned len, int count)
+{
+	int result = _send(frames, len);
+	if ( result > 0 )
+		tx_messages += count;
+	else
+		tx_dropped += count;
+
+	return result;
+}
+
+// Sends all of buf, the socket blocks until the kernel has taken it
+int
+TCP_Port::
+_send(const uint8_t *buf, unsigned len)
+{
+	pthread_mutex_lock(&write_lock);
+
+	if ( status != 1 )
+	{
+		pthread_mutex_unlock(&write_lock);
+		return 0;
+	}
+
+	// a signal or a full socket buffer can cut a send short, the rest must
+	// follow or the stream loses its framing
+	uint64_t start = get_time_usec();
+	unsigned sent  = 0;
+	while ( sent < len )
+	{
+		int result = send(sock, buf + sent, len - sent, MSG_NOSIGNAL);
+		if ( result > 0 )
+		{
+			sent += result;
+			continue;
+		}
+		if ( result < 0 && errno == EINTR )
+			continue;
+
+		// the other end hung up
+		if ( result < 0 && (errno == EPIPE || errno == ECONNRESET) )
+		{
+			fprintf(stderr, "ERROR: TCP connection to %s:%d closed\n", host, port);
+			status = 0;
+		}
+		break;
+	}
+	write_latency.add(get_time_usec() - start);
+	tx_writes++;
+
+	// a record per frame sent whole, after the loop so a short send does not
+	// split one
+	if ( sent )
+	{
+		tx_bytes += sent;
+		if ( recorder )
+			recorder->record_frames(FLIGHT_RECORD_TX, buf, sent, get_time_usec());
+	}
+
+	pthread_mutex_unlock(&write_lock);
+
+	// a frame cut off counts as not sent
+	return sent == len ? (int)sent : -1;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+TCP_Port::
+print_stats()
+{
+	printf("TCP     rx: %llu bytes in %llu reads, %llu messages  tx: %llu messages, %llu bytes in %llu writes (%.2f messages per write), %llu dropped%s\n",
+			(unsigned long long)rx_bytes, (unsigned long long)rx_reads, (unsigned long long)rx_messages,
+			(unsigned long long)tx_messages, (unsigned long long)tx_bytes, (unsigned long long)tx_writes,
+			tx_writes ? (double)tx_messages / tx_writes : 0.0, (unsigned long long)tx_dropped,
+			status == 1 ? "" : ", disconnected");
+	write_latency.print("WRITE LATENCY");
+	scanner.print("TCP FRAMES");
+
+	if ( recorder )
+		recorder->print_stats();
+}
+
+
+// ------------------------------------------------------------------------------
+//   Open and Close
+// ------------------------------------------------------------------------------
+/**
+ * throws EXIT_FAILURE if could not connect
+ */
+void
+TCP_Port::
+start()
+{
+	printf("OPEN PORT\n");
+
+	struct sockaddr_in address;
+	if ( not resolve_host(host, port, address) )
+	{
+		printf("failure, could not resolve %s.\n", host);
+		throw EXIT_FAILURE;
+	}
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	if ( sock < 0 )
+	{
+		printf("failure, could not open socket, %s.\n", strerror(errno));
+		throw EXIT_FAILURE;
+	}
+
+	if ( connect(sock, (struct sockaddr *)&address, sizeof(address)) )
+	{
+		printf("failure, could not connect to TCP %s:%d, %s.\n", host, port, strerror(errno));
+		close(sock);
+		sock = -1;
+		throw EXIT_FAILURE;
+	}
+
+	// every setpoint goes out as soon as it is written
+	int on = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	status = 1;
+
+	printf("Connected to TCP %s:%d\n", inet_ntoa(address.sin_addr), port);
+	printf("\n");
+}
+
+void
+TCP_Port::
+stop()
+{
+	if ( sock < 0 )
+		return;
+
+	printf("CLOSE PORT\n");
+
+	pthread_mutex_lock(&write_lock);
+	close(sock);
+	sock   = -1;
+	status = 0;
+	pthread_mutex_unlock(&write_lock);
+
+	printf("\n");
+}
+
+bool
+TCP_Port::
+is_running()
+{
+	return status == 1;
+}
+
+
@@ -0,0 +1,147 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file tcp_port.h
+ *
+ * @brief TCP interface definition
+ *
+ * Functions for sending and receiving MAVLink over a TCP connection.
+ *
+ */
+
+#ifndef TCP_PORT_H_
+#define TCP_PORT_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <common/mavlink.h>
+
+#include "generic_port.h"
+#include "frame_scanner.h"
+#include "latency_histogram.h"
+#include "flight_recorder.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Receive buffer size, a full socket read is scanned at once
+#define TCP_PORT_RX_BUFFER_LEN 16384
+
+
+// ----------------------------------------------------------------------------------
+//   TCP Port Class
+// ----------------------------------------------------------------------------------
+/*
+ * TCP Port Class
+ *
+ * Connects to host:port, e.g. the MAVLink port of a SITL or of a telemetry
+ * bridge, with Nagle turned off.  Reads are buffered like Serial_Port's:
+ * each recv() takes everything queued and a frame cut off at the end stays
+ * in rx_buffer until the rest arrives.  write_messages() sends a batch of
+ * messages with one send().
+ *
+ * When the other end closes the connection the port stops; it does not
+ * reconnect.
+ */
+class TCP_Port: public Generic_Port
+{
+
+public:
+
+	TCP_Port(const char *host_, int port_);
+	~TCP_Port();
+
+	const char *host;
+	int  port;
+
+	uint64_t rx_bytes;
+	uint64_t rx_reads;     // recv() calls that returned data
+	uint64_t rx_messages;
+
+	uint64_t tx_bytes;
+	uint64_t tx_writes;    // send() calls
+	uint64_t tx_messages;  // messages sent
+	uint64_t tx_dropped;   // messages not sent because the connection is gone
+
+	Frame_Scanner scanner;
+
+	// time spent in send()
+	Latency_Histogram write_latency;
+
+	// if set, gets a copy of every frame read and written
+	Flight_Recorder *recorder;
+
+	int read_frames(Frame_View *views, int max_views);
+	int wait_readable(int wake_fd, int timeout_ms);
+	void add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length);
+	int write_message(const mavlink_message_t &message);
+	int write_messages(const mavlink_message_t *messages, int count);
+	int write_frames(const uint8_t *frames, unsigned len, int count);
+
+	bool is_running();
+	void start();
+	void stop();
+
+	void print_stats();
+
+private:
+
+	int  sock;
+	int  status;
+
+	pthread_mutex_t read_lock;
+	pthread_mutex_t write_lock;
+
+	uint8_t  rx_buffer[TCP_PORT_RX_BUFFER_LEN];
+	unsigned rx_head; // next byte to scan
+	unsigned rx_tail; // end of received bytes
+	bool     rx_more; // complete frames left in rx_buffer
+
+	int  _send(const uint8_t *buf, unsigned len);
+
+};
+
+
+
+#endif // TCP_PORT_H_
+
+
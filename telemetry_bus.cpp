@@ -0,0 +1,366 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file telemetry_bus.cpp
+ *
+ * @brief Autopilot state in shared memory, for other processes, functions
+ *
+ * Creates and fills the segment, and maps it for readers.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "telemetry_bus.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// ----------------------------------------------------------------------------------
+//   Telemetry Bus Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Telemetry_Bus::
+Telemetry_Bus()
+{
+	name    = NULL;
+	fd      = -1;
+	segment = NULL;
+}
+
+Telemetry_Bus::
+~Telemetry_Bus()
+{
+	close();
+}
+
+
+// ------------------------------------------------------------------------------
+//   Open and Close
+// ------------------------------------------------------------------------------
+// throws 1 if the segment could not be created or mapped
+void
+Telemetry_Bus::
+open(const char *name_)
+{
+	close();
+	name = name_;
+
+	fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if ( fd < 0 )
+	{
+		fprintf(stderr, "ERROR: could not open shared memory %s, %s\n", name, strerror(errno));
+		throw 1;
+	}
+
+	if ( ftruncate(fd, sizeof(Telemetry_Bus_Segment)) )
+	{
+		fprintf(stderr, "ERROR: could not size shared memory %s, %s\n", name, strerror(errno));
+		::close(fd);
+		fd = -1;
+		throw 1;
+	}
+
+	void *mapped = mmap(NULL, sizeof(Telemetry_Bus_Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if ( mapped == MAP_FAILED )
+	{
+		fprintf(stderr, "ERROR: could not map shared memory %s, %s\n", name, strerror(errno));
+		::close(fd);
+		fd = -1;
+		throw 1;
+	}
+	segment = (Telemetry_Bus_Segment *)mapped;
+
+	Telemetry_Bus_Header &header = segment->header;
+
+	// readers of an earlier run see it go invalid until it is set up again
+	bool     ours       = header.magic == TELEMETRY_BUS_MAGIC && header.version == TELEMETRY_BUS_VERSION;
+	uint64_t generation = ours ? header.generation : 0;
+	__atomic_store_n(&header.magic, 0, __ATOMIC_RELEASE);
+
+	for ( int i = 0; i < 256; i++ )
+		new (&segment->latest[i]) Telemetry_Bus_Slot;
+	for ( int i = 0; i < TELEMETRY_BUS_HISTORY; i++ )
+		new (&segment->history[i]) Telemetry_Bus_Slot;
+
+	header.version        = TELEMETRY_BUS_VERSION;
+	header.size           = sizeof(Telemetry_Bus_Segment);
+	header.header_size    = sizeof(Telemetry_Bus_Header);
+	header.slot_size      = sizeof(Telemetry_Bus_Slot);
+	header.history_length = TELEMETRY_BUS_HISTORY;
+	header.writer_pid     = getpid();
+	header.reserved       = 0;
+	header.generation     = generation + 1;
+	__atomic_store_n(&header.published, 0, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&header.magic, TELEMETRY_BUS_MAGIC, __ATOMIC_RELEASE);
+
+	printf("PUBLISHING TELEMETRY TO SHARED MEMORY %s (%u bytes)\n", name, header.size);
+}
+
+// The segment stays, readers keep the last state and a new run takes over
+void
+Telemetry_Bus::
+close()
+{
+	if ( not segment )
+		return;
+
+	munmap(segment, sizeof(Telemetry_Bus_Segment));
+	::close(fd);
+
+	segment = NULL;
+	fd      = -1;
+}
+
+bool
+Telemetry_Bus::
+is_open()
+{
+	return segment != NULL;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Publish
+// ------------------------------------------------------------------------------
+// Only from one thread
+void
+Telemetry_Bus::
+publish(const mavlink_message_t &message, uint64_t time_usec)
+{
+	publish(message.sysid, message.compid, message.msgid, message.len,
+			(const uint8_t *)_MAV_PAYLOAD(&message), time_usec);
+}
+
+void
+Telemetry_Bus::
+publish(const Frame_View &frame, uint64_t time_usec)
+{
+	publish(frame.sysid, frame.compid, frame.msgid, frame.len, frame.payload(), time_usec);
+}
+
+void
+Telemetry_Bus::
+publish(uint8_t sysid, uint8_t compid, uint8_t msgid, uint8_t len,
+		const uint8_t *payload, uint64_t time_usec)
+{
+	Telemetry_Bus_Header &header = segment->header;
+
+	uint64_t index = __atomic_load_n(&header.published, __ATOMIC_RELAXED);
+
+	Telemetry_Sample sample;
+	sample.index     = index;
+	sample.time_usec = time_usec;
+	sample.sysid     = sysid;
+	sample.compid    = compid;
+	sample.msgid     = msgid;
+	sample.len       = len;
+	memcpy(sample.payload, payload, len);
+	memset(sample.payload + len, 0, sizeof(sample.payload) - len);
+
+	segment->latest[msgid].sample.store(sample, time_usec);
+	segment->history[index & (TELEMETRY_BUS_HISTORY - 1)].sample.store(sample, time_usec);
+
+	// the history entry is complete before readers are told about it
+	__atomic_store_n(&header.published, index + 1, __ATOMIC_RELEASE);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+Telemetry_Bus::
+print_stats()
+{
+	if ( not segment )
+		return;
+
+	printf("%-20s %s, %llu messages published, generation %llu\n", "TELEMETRY BUS", name,
+			(unsigned long long)__atomic_load_n(&segment->header.published, __ATOMIC_RELAXED),
+			(unsigned long long)segment->header.generation);
+}
+
+
+// ----------------------------------------------------------------------------------
+//   Telemetry Bus Reader Class
+// ----------------------------------------------------------------------------------
+
+Telemetry_Bus_Reader::
+Telemetry_Bus_Reader()
+{
+	segment = NULL;
+}
+
+Telemetry_Bus_Reader::
+~Telemetry_Bus_Reader()
+{
+	close();
+}
+
+// False if there is no such segment, or it was made for another layout
+bool
+Telemetry_Bus_Reader::
+open(const char *name)
+{
+	close();
+
+	int fd = shm_open(name, O_RDONLY, 0);
+	if ( fd < 0 )
+		return false;
+
+	struct stat info;
+	if ( fstat(fd, &info) || (size_t)info.st_size < sizeof(Telemetry_Bus_Segment) )
+	{
+		::close(fd);
+		return false;
+	}
+
+	void *mapped = mmap(NULL, sizeof(Telemetry_Bus_Segment), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if ( mapped == MAP_FAILED )
+		return false;
+
+	const Telemetry_Bus_Segment *found  = (const Telemetry_Bus_Segment *)mapped;
+	const Telemetry_Bus_Header  &header = found->header;
+
+	if ( __atomic_load_n(&header.magic, __ATOMIC_ACQUIRE) != TELEMETRY_BUS_MAGIC ||
+	     header.version        != TELEMETRY_BUS_VERSION ||
+	     header.size           != sizeof(Telemetry_Bus_Segment) ||
+	     header.header_size    != sizeof(Telemetry_Bus_Header) ||
+	     header.slot_size      != sizeof(Telemetry_Bus_Slot) ||
+	     header.history_length != TELEMETRY_BUS_HISTORY )
+	{
+		munmap(mapped, sizeof(Telemetry_Bus_Segment));
+		return false;
+	}
+
+	segment = found;
+	return true;
+}
+
+void
+Telemetry_Bus_Reader::
+close()
+{
+	if ( segment )
+		munmap((void *)segment, sizeof(Telemetry_Bus_Segment));
+	segment = NULL;
+}
+
+bool
+Telemetry_Bus_Reader::
+is_open() const
+{
+	return segment != NULL;
+}
+
+// Changes when a new writer took over the segment
+uint64_t
+Telemetry_Bus_Reader::
+generation() const
+{
+	return __atomic_load_n(&segment->header.generation, __ATOMIC_ACQUIRE);
+}
+
+uint64_t
+Telemetry_Bus_Reader::
+published() const
+{
+	return __atomic_load_n(&segment->header.published, __ATOMIC_ACQUIRE);
+}
+
+// Newest of msgid and the time it was handled, 0 if there was none
+uint64_t
+Telemetry_Bus_Reader::
+latest(uint8_t msgid, Telemetry_Sample &sample) const
+{
+	return segment->latest[msgid].sample.load(sample);
+}
+
+// Copies out up to max_samples messages published since cursor, oldest first,
+// and moves cursor past them.  Messages the ring overwrote before they were
+// read are skipped and added to missed.
+int
+Telemetry_Bus_Reader::
+history(uint64_t &cursor, Telemetry_Sample *samples, int max_samples, uint64_t *missed) const
+{
+	uint64_t head  = published();
+	int      count = 0;
+
+	// a writer that started over
+	if ( cursor > head )
+		cursor = head;
+
+	if ( head - cursor > TELEMETRY_BUS_HISTORY )
+	{
+		if ( missed )
+			*missed += head - cursor - TELEMETRY_BUS_HISTORY;
+		cursor = head - TELEMETRY_BUS_HISTORY;
+	}
+
+	while ( count < max_samples && cursor < head )
+	{
+		segment->history[cursor & (TELEMETRY_BUS_HISTORY - 1)].sample.load(samples[count]);
+
+		// overwritten while we got here, skip to what the slot holds now
+		if ( samples[count].index != cursor )
+		{
+			if ( missed )
+				*missed += 1;
+			cursor++;
+			continue;
+		}
+
+		cursor++;
+		count++;
+	}
+
+	return count;
+}
+
+
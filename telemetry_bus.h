@@ -0,0 +1,233 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file telemetry_bus.h
+ *
+ * @brief Autopilot state in shared memory, for other processes
+ *
+ * The read thread publishes every message of the autopilot flown into a
+ * POSIX shared memory segment; readers in other processes copy out the
+ * latest of each message, or walk the recent history, without a system
+ * call.
+ *
+ */
+
+#ifndef TELEMETRY_BUS_H_
+#define TELEMETRY_BUS_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <common/mavlink.h>
+
+#include "seqlock.h"
+#include "frame_scanner.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+#define TELEMETRY_BUS_MAGIC   0x4254564dU // "MVTB"
+#define TELEMETRY_BUS_VERSION 1
+
+// Segment name used when none is given
+#define TELEMETRY_BUS_DEFAULT_NAME "/mavlink_telemetry"
+
+// Messages kept in the history ring, a power of two; a few seconds of
+// telemetry at full rate
+#define TELEMETRY_BUS_HISTORY 4096
+
+
+// ------------------------------------------------------------------------------
+//   Segment Layout
+// ------------------------------------------------------------------------------
+/*
+ * The segment is a Telemetry_Bus_Header, then one slot per message id with
+ * the latest of that message, then the history ring.  Every slot is a
+ * Seqlock on its own cache lines.  A reader checks magic, version and the
+ * sizes in the header before it trusts anything else.
+ *
+ * Times are get_time_usec(), CLOCK_MONOTONIC, which every process on the
+ * computer shares.  Payloads are as sent: little endian, in the field order
+ * of the mavlink_<message>_t struct, so they can be copied straight into it.
+ */
+struct Telemetry_Sample
+{
+	uint64_t index;      // messages published before this one
+	uint64_t time_usec;  // when the read thread handled it
+	uint8_t  sysid;
+	uint8_t  compid;
+	uint8_t  msgid;
+	uint8_t  len;        // payload bytes
+	uint8_t  payload[MAVLINK_MAX_PAYLOAD_LEN];
+};
+
+struct Telemetry_Bus_Slot
+{
+	Seqlock<Telemetry_Sample> sample;
+} __attribute__((aligned(64)));
+
+struct Telemetry_Bus_Header
+{
+	uint32_t magic;          // TELEMETRY_BUS_MAGIC once the segment is ready
+	uint32_t version;        // TELEMETRY_BUS_VERSION
+	uint32_t size;           // of the whole segment
+	uint32_t header_size;    // sizeof(Telemetry_Bus_Header)
+	uint32_t slot_size;      // sizeof(Telemetry_Bus_Slot)
+	uint32_t history_length; // TELEMETRY_BUS_HISTORY
+	uint32_t writer_pid;
+	uint32_t reserved;
+	uint64_t generation;     // counts writers that opened the segment
+	uint64_t published;      // messages published, the history ring's head
+} __attribute__((aligned(64)));
+
+struct Telemetry_Bus_Segment
+{
+	Telemetry_Bus_Header header;
+	Telemetry_Bus_Slot   latest[256];
+	Telemetry_Bus_Slot   history[TELEMETRY_BUS_HISTORY];
+};
+
+
+// ----------------------------------------------------------------------------------
+//   Telemetry Bus Class
+// ----------------------------------------------------------------------------------
+/*
+ * Telemetry Bus Class
+ *
+ * The writer side.  open() creates the segment or takes over the one a
+ * previous run left behind, so readers that keep it mapped carry on with
+ * the new writer.  publish() is called by one thread only, the read thread;
+ * it copies the payload twice, into the message's slot and into the
+ * history ring, and never blocks.
+ */
+class Telemetry_Bus
+{
+
+public:
+
+	Telemetry_Bus();
+	~Telemetry_Bus();
+
+	void open(const char *name_);
+	void close();
+	bool is_open();
+
+	void publish(const mavlink_message_t &message, uint64_t time_usec);
+	void publish(const Frame_View &frame, uint64_t time_usec);
+
+	void print_stats();
+
+private:
+
+	void publish(uint8_t sysid, uint8_t compid, uint8_t msgid, uint8_t len,
+			const uint8_t *payload, uint64_t time_usec);
+
+	const char *name;
+	int  fd;
+	Telemetry_Bus_Segment *segment;
+
+};
+
+
+// ----------------------------------------------------------------------------------
+//   Telemetry Bus Reader Class
+// ----------------------------------------------------------------------------------
+/*
+ * Telemetry Bus Reader Class
+ *
+ * Maps a bus read only.  latest() copies out the newest of a message and
+ * returns the time it was handled, 0 if there was none yet; history() hands
+ * out what was published since a cursor, oldest first, and counts what the
+ * ring overwrote before it got there.  Neither makes a system call or
+ * waits for the writer, any number of readers can run at once.
+ *
+ *     Telemetry_Bus_Reader bus;
+ *     if ( bus.open(TELEMETRY_BUS_DEFAULT_NAME) )
+ *     {
+ *         mavlink_local_position_ned_t position;
+ *         if ( bus.latest(MAVLINK_MSG_ID_LOCAL_POSITION_NED, position) )
+ *             ...
+ *     }
+ */
+class Telemetry_Bus_Reader
+{
+
+public:
+
+	Telemetry_Bus_Reader();
+	~Telemetry_Bus_Reader();
+
+	bool open(const char *name);
+	void close();
+	bool is_open() const;
+
+	uint64_t generation() const;
+	uint64_t published() const;
+
+	uint64_t latest(uint8_t msgid, Telemetry_Sample &sample) const;
+	int history(uint64_t &cursor, Telemetry_Sample *samples, int max_samples, uint64_t *missed = NULL) const;
+
+	// The payload as its mavlink_<message>_t, fields the sender left out
+	// are zero
+	template <typename T>
+	uint64_t
+	latest(uint8_t msgid, T &value) const
+	{
+		Telemetry_Sample sample;
+		uint64_t time_usec = latest(msgid, sample);
+
+		memset(&value, 0, sizeof(value));
+		memcpy(&value, sample.payload, sample.len < sizeof(value) ? sample.len : sizeof(value));
+
+		return time_usec;
+	}
+
+private:
+
+	const Telemetry_Bus_Segment *segment;
+
+};
+
+
+
+#endif // TELEMETRY_BUS_H_
+
+
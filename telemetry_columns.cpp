@@ -0,0 +1,487 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file telemetry_columns.cpp
+ *
+ * @brief Recorded telemetry as columns, and the kernels that work on them
+ *
+ * Functions for turning a flight log into columns and for resampling,
+ * differentiating and comparing them.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "telemetry_columns.h"
+#include "message_dispatch.h"
+
+#include <string.h>
+#include <math.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Squared errors summed in float before they go into the double total
+#define TELEMETRY_COLUMNS_BLOCK 4096
+
+
+// ------------------------------------------------------------------------------
+//   Vectors
+// ------------------------------------------------------------------------------
+
+typedef float Telemetry_Vector __attribute__((vector_size(16)));
+
+static inline Telemetry_Vector
+load_vector(const float *p)
+{
+	Telemetry_Vector v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void
+store_vector(float *p, Telemetry_Vector v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline float
+sum_vector(Telemetry_Vector v)
+{
+	float lanes[4];
+	store_vector(lanes, v);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+
+// ------------------------------------------------------------------------------
+//   Fields
+// ------------------------------------------------------------------------------
+
+static const char *local_position_names[]  = { "x", "y", "z", "vx", "vy", "vz" };
+static const char *position_target_names[] = { "x", "y", "z", "vx", "vy", "vz", "yaw" };
+static const char *attitude_names[]        = { "roll", "pitch", "yaw", "rollspeed", "pitchspeed", "yawspeed" };
+static const char *highres_imu_names[]     = { "xacc", "yacc", "zacc", "xgyro", "ygyro", "zgyro",
+                                               "abs_pressure", "pressure_alt", "temperature" };
+static const char *vfr_hud_names[]         = { "airspeed", "groundspeed", "heading", "throttle", "alt", "climb" };
+
+static void
+extract_local_position(const Frame_View &frame, float *values)
+{
+	typedef mavlink_local_position_ned_t T;
+	Message_View<T> m(frame);
+
+	values[0] = m.get(&T::x);
+	values[1] = m.get(&T::y);
+	values[2] = m.get(&T::z);
+	values[3] = m.get(&T::vx);
+	values[4] = m.get(&T::vy);
+	values[5] = m.get(&T::vz);
+}
+
+static void
+extract_position_target(const Frame_View &frame, float *values)
+{
+	typedef mavlink_position_target_local_ned_t T;
+	Message_View<T> m(frame);
+
+	values[0] = m.get(&T::x);
+	values[1] = m.get(&T::y);
+	values[2] = m.get(&T::z);
+	values[3] = m.get(&T::vx);
+	values[4] = m.get(&T::vy);
+	values[5] = m.get(&T::vz);
+	values[6] = m.get(&T::yaw);
+}
+
+static void
+extract_attitude(const Frame_View &frame, float *values)
+{
+	typedef mavlink_attitude_t T;
+	Message_View<T> m(frame);
+
+	values[0] = m.get(&T::roll);
+	values[1] = m.get(&T::pitch);
+	values[2] = m.get(&T::yaw);
+	values[3] = m.get(&T::rollspeed);
+	values[4] = m.get(&T::pitchspeed);
+	values[5] = m.get(&T::yawspeed);
+}
+
+static void
+extract_highres_imu(const Frame_View &frame, float *values)
+{
+	typedef mavlink_highres_imu_t T;
+	Message_View<T> m(frame);
+
+	values[0] = m.get(&T::xacc);
+	values[1] = m.get(&T::yacc);
+	values[2] = m.get(&T::zacc);
+	values[3] = m.get(&T::xgyro);
+	values[4] = m.get(&T::ygyro);
+	values[5] = m.get(&T::zgyro);
+	values[6] = m.get(&T::abs_pressure);
+	values[7] = m.get(&T::pressure_alt);
+	values[8] = m.get(&T::temperature);
+}
+
+static void
+extract_vfr_hud(const Frame_View &frame, float *values)
+{
+	typedef mavlink_vfr_hud_t T;
+	Message_View<T> m(frame);
+
+	values[0] = m.get(&T::airspeed);
+	values[1] = m.get(&T::groundspeed);
+	values[2] = m.get(&T::heading);
+	values[3] = m.get(&T::throttle);
+	values[4] = m.get(&T::alt);
+	values[5] = m.get(&T::climb);
+}
+
+
+// ----------------------------------------------------------------------------------
+//   Telemetry Stream
+// ----------------------------------------------------------------------------------
+const std::vector<float> *
+Telemetry_Stream::
+column(const char *name_) const
+{
+	for ( int i = 0; i < columns; i++ )
+		if ( strcmp(names[i], name_) == 0 )
+			return &values[i];
+	return NULL;
+}
+
+
+// ----------------------------------------------------------------------------------
+//   Telemetry Columns Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Telemetry_Columns::
+Telemetry_Columns()
+{
+	sysid      = 0;
+	compid     = 0;
+	start_usec = 0;
+	frames     = 0;
+	skipped    = 0;
+
+	for ( int i = 0; i < 256; i++ )
+		streams[i] = NULL;
+
+	define(local_position,  "LOCAL_POSITION_NED",        MAVLINK_MSG_ID_LOCAL_POSITION_NED,
+			&extract_local_position,  local_position_names,  6);
+	define(position_target, "POSITION_TARGET_LOCAL_NED", MAVLINK_MSG_ID_POSITION_TARGET_LOCAL_NED,
+			&extract_position_target, position_target_names, 7);
+	define(attitude,        "ATTITUDE",                  MAVLINK_MSG_ID_ATTITUDE,
+			&extract_attitude,        attitude_names,        6);
+	define(highres_imu,     "HIGHRES_IMU",               MAVLINK_MSG_ID_HIGHRES_IMU,
+			&extract_highres_imu,     highres_imu_names,     9);
+	define(vfr_hud,         "VFR_HUD",                   MAVLINK_MSG_ID_VFR_HUD,
+			&extract_vfr_hud,         vfr_hud_names,         6);
+}
+
+void
+Telemetry_Columns::
+define(Telemetry_Stream &stream_, const char *name, uint8_t msgid,
+		Telemetry_Extract extract, const char *const *names, int columns)
+{
+	stream_.name    = name;
+	stream_.msgid   = msgid;
+	stream_.columns = columns;
+	stream_.extract = extract;
+
+	for ( int i = 0; i < columns; i++ )
+		stream_.names[i] = names[i];
+
+	streams[msgid] = &stream_;
+}
+
+Telemetry_Stream *
+Telemetry_Columns::
+stream(uint8_t msgid)
+{
+	return streams[msgid];
+}
+
+
+// ------------------------------------------------------------------------------
+//   Load
+// ------------------------------------------------------------------------------
+// Every frame of the log, after room for all of them was made in one go
+// and the autopilot was found
+void
+Telemetry_Columns::
+load(const Log_Replay &log)
+{
+	size_t     counts[256];
+	Frame_View view;
+
+	memset(counts, 0, sizeof(counts));
+
+	// the autopilot is known before its first frames go by
+	for ( size_t i = 0; i < log.frames(); i++ )
+	{
+		log.frame(i, view);
+		counts[view.msgid]++;
+
+		if ( not sysid && view.msgid == MAVLINK_MSG_ID_HEARTBEAT &&
+		     Message_View<mavlink_heartbeat_t>(view).get(&mavlink_heartbeat_t::autopilot) != MAV_AUTOPILOT_INVALID )
+		{
+			sysid  = view.sysid;
+			compid = view.compid;
+		}
+	}
+
+	for ( int i = 0; i < 256; i++ )
+	{
+		Telemetry_Stream *s = streams[i];
+		if ( s == NULL )
+			continue;
+
+		s->time.reserve(s->size() + counts[i]);
+		for ( int c = 0; c < s->columns; c++ )
+			s->values[c].reserve(s->size() + counts[i]);
+	}
+
+	if ( not frames )
+		start_usec = log.start_time();
+
+	for ( size_t i = 0; i < log.frames(); i++ )
+	{
+		uint64_t time_usec = log.frame(i, view);
+		add(view, time_usec);
+	}
+}
+
+void
+Telemetry_Columns::
+add(const Frame_View &frame, uint64_t time_usec)
+{
+	if ( not frames && not start_usec )
+		start_usec = time_usec;
+	frames++;
+
+	// the first autopilot that sends a heartbeat, unless told which
+	if ( not sysid && frame.msgid == MAVLINK_MSG_ID_HEARTBEAT &&
+	     Message_View<mavlink_heartbeat_t>(frame).get(&mavlink_heartbeat_t::autopilot) != MAV_AUTOPILOT_INVALID )
+	{
+		sysid  = frame.sysid;
+		compid = frame.compid;
+	}
+
+	Telemetry_Stream *s = streams[frame.msgid];
+	if ( s == NULL )
+		return;
+
+	if ( frame.sysid != sysid || frame.compid != compid )
+	{
+		skipped++;
+		return;
+	}
+
+	float values[TELEMETRY_COLUMNS_MAX];
+	s->extract(frame, values);
+
+	s->time.push_back((double)(int64_t)(time_usec - start_usec) * 1e-6);
+	for ( int c = 0; c < s->columns; c++ )
+		s->values[c].push_back(values[c]);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Print
+// ------------------------------------------------------------------------------
+void
+Telemetry_Columns::
+print(FILE *out) const
+{
+	const Telemetry_Stream *all[] = { &local_position, &position_target, &attitude, &highres_imu, &vfr_hud };
+
+	fprintf(out, "%-26s %10s %10s %10s\n", "STREAM", "samples", "seconds", "rate");
+
+	for ( int i = 0; i < 5; i++ )
+	{
+		const Telemetry_Stream &s = *all[i];
+		double seconds = s.size() > 1 ? s.time.back() - s.time.front() : 0;
+
+		fprintf(out, "%-26s %10lu %10.1f %7.1f Hz\n", s.name, (unsigned long)s.size(), seconds,
+				seconds > 0 ? (s.size() - 1) / seconds : 0.0);
+	}
+}
+
+
+// ----------------------------------------------------------------------------------
+//   Kernels
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Resampling
+// ------------------------------------------------------------------------------
+// One walk over the stream's time column for all of its columns
+void
+telemetry_clock(const Telemetry_Stream &stream, double start, double period,
+		size_t count, Telemetry_Clock &clock)
+{
+	clock.start  = start;
+	clock.period = period;
+	clock.count  = count;
+	clock.index.assign(count, 0);
+	clock.weight.assign(count, 0.0f);
+
+	size_t n = stream.size();
+	if ( n == 0 )
+		return;
+
+	const double *time = &stream.time[0];
+	size_t i = 0;
+
+	for ( size_t k = 0; k < count; k++ )
+	{
+		double t = start + k * period;
+
+		while ( i + 1 < n && time[i + 1] <= t )
+			i++;
+
+		clock.index[k] = (uint32_t)i;
+
+		// before the first sample or after the last there is nothing to
+		// interpolate towards
+		if ( t > time[i] && i + 1 < n )
+			clock.weight[k] = (float)((t - time[i]) / (time[i + 1] - time[i]));
+	}
+}
+
+void
+telemetry_resample(const float *values, const Telemetry_Clock &clock, float *out)
+{
+	const uint32_t *index  = &clock.index[0];
+	const float    *weight = &clock.weight[0];
+
+	for ( size_t k = 0; k < clock.count; k++ )
+	{
+		float w = weight[k];
+		float a = values[index[k]];
+		float b = values[index[k] + ( w > 0 )];
+
+		out[k] = a + w * (b - a);
+	}
+}
+
+
+// ------------------------------------------------------------------------------
+//   Differentiation
+// ------------------------------------------------------------------------------
+void
+telemetry_differentiate(const float *values, size_t count, double period, float *out)
+{
+	if ( count < 2 )
+	{
+		if ( count )
+			out[0] = 0;
+		return;
+	}
+
+	float rate = (float)(1.0 / period);
+	float half = rate / 2;
+
+	out[0]         = (values[1] - values[0]) * rate;
+	out[count - 1] = (values[count - 1] - values[count - 2]) * rate;
+
+	Telemetry_Vector halves = { half, half, half, half };
+	size_t i = 1;
+
+	for ( ; i + 4 < count; i += 4 )
+		store_vector(out + i, (load_vector(values + i + 1) - load_vector(values + i - 1)) * halves);
+
+	for ( ; i + 1 < count; i++ )
+		out[i] = (values[i + 1] - values[i - 1]) * half;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Errors
+// ------------------------------------------------------------------------------
+double
+telemetry_squared_error(const float *a, const float *b, size_t count)
+{
+	double total = 0;
+	size_t i = 0;
+
+	while ( i < count )
+	{
+		size_t end = count - i < TELEMETRY_COLUMNS_BLOCK ? count : i + TELEMETRY_COLUMNS_BLOCK;
+
+		Telemetry_Vector sum = { 0, 0, 0, 0 };
+		for ( ; i + 4 <= end; i += 4 )
+		{
+			Telemetry_Vector d = load_vector(a + i) - load_vector(b + i);
+			sum += d * d;
+		}
+
+		float block = sum_vector(sum);
+		for ( ; i < end; i++ )
+			block += (a[i] - b[i]) * (a[i] - b[i]);
+
+		total += block;
+	}
+
+	return total;
+}
+
+float
+telemetry_max_error(const float *a, const float *b, size_t count)
+{
+	float largest = 0;
+
+	for ( size_t i = 0; i < count; i++ )
+	{
+		float d = fabsf(a[i] - b[i]);
+		if ( d > largest )
+			largest = d;
+	}
+
+	return largest;
+}
+
+
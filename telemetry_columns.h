@@ -0,0 +1,202 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file telemetry_columns.h
+ *
+ * @brief Recorded telemetry as columns, and the kernels that work on them
+ *
+ * Turns the position, attitude, IMU and HUD messages of a flight log into
+ * one array per field, and resamples, differentiates and compares those
+ * arrays four values at a time.
+ *
+ */
+
+#ifndef TELEMETRY_COLUMNS_H_
+#define TELEMETRY_COLUMNS_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include <common/mavlink.h>
+
+#include "frame_scanner.h"
+#include "log_replay.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Most fields taken from one message
+#define TELEMETRY_COLUMNS_MAX 10
+
+
+// ------------------------------------------------------------------------------
+//   Data Structures
+// ------------------------------------------------------------------------------
+
+// Writes a frame's fields, in the order of the stream's names, to values
+typedef void (*Telemetry_Extract)(const Frame_View &frame, float *values);
+
+/*
+ * Telemetry Stream
+ *
+ * Every message of one id from one sender: the time each was received [s
+ * since the start of the log] and one column per field, all as long as
+ * time.
+ */
+struct Telemetry_Stream
+{
+	const char        *name;
+	uint8_t            msgid;
+	int                columns;
+	const char        *names[TELEMETRY_COLUMNS_MAX];
+	Telemetry_Extract  extract;
+
+	std::vector<double> time;
+	std::vector<float>  values[TELEMETRY_COLUMNS_MAX];
+
+	size_t size() const { return time.size(); }
+
+	// Column named name, NULL if there is none
+	const std::vector<float> *column(const char *name_) const;
+};
+
+/*
+ * Telemetry Clock
+ *
+ * A common clock streams are resampled to, count ticks period apart from
+ * start, with where each tick falls in one stream: between sample index[k]
+ * and the next, weight[k] of the way.
+ */
+struct Telemetry_Clock
+{
+	double start;  // [s]
+	double period; // [s]
+	size_t count;
+
+	std::vector<uint32_t> index;
+	std::vector<float>    weight;
+};
+
+
+// ----------------------------------------------------------------------------------
+//   Telemetry Columns Class
+// ----------------------------------------------------------------------------------
+/*
+ * Telemetry Columns Class
+ *
+ * The columns of LOCAL_POSITION_NED, POSITION_TARGET_LOCAL_NED, ATTITUDE,
+ * HIGHRES_IMU and VFR_HUD from one sender, the first autopilot in the log
+ * unless sysid and compid are set.  load() goes through a whole log,
+ * reading each field straight from the mapped frame; add() takes frames
+ * one at a time.
+ */
+class Telemetry_Columns
+{
+
+public:
+
+	Telemetry_Columns();
+
+	int sysid;  // 0 takes the first autopilot's
+	int compid;
+
+	uint64_t start_usec; // log time of time 0
+	uint64_t frames;     // frames looked at
+	uint64_t skipped;    // from other senders, or add()ed before the autopilot was known
+
+	Telemetry_Stream local_position;
+	Telemetry_Stream position_target;
+	Telemetry_Stream attitude;
+	Telemetry_Stream highres_imu;
+	Telemetry_Stream vfr_hud;
+
+	void load(const Log_Replay &log);
+	void add(const Frame_View &frame, uint64_t time_usec);
+
+	Telemetry_Stream *stream(uint8_t msgid);
+
+	void print(FILE *out = stdout) const;
+
+private:
+
+	Telemetry_Stream *streams[256];
+
+	void define(Telemetry_Stream &stream_, const char *name, uint8_t msgid,
+			Telemetry_Extract extract, const char *const *names, int columns);
+
+};
+
+
+// ------------------------------------------------------------------------------
+//   Kernels
+// ------------------------------------------------------------------------------
+/*
+ * The kernels work on plain float arrays, any part of a column can be
+ * passed.  telemetry_differentiate() and telemetry_squared_error() use GCC
+ * vector types, four floats per operation on SSE or NEON with a scalar
+ * loop for the tail.  Resampling looks up where every tick falls once per
+ * stream in telemetry_clock(), so each column is then a single pass.
+ */
+
+// Sets clock up for stream, count ticks of period from start; ticks outside
+// the stream get its first or last sample
+void telemetry_clock(const Telemetry_Stream &stream, double start, double period,
+		size_t count, Telemetry_Clock &clock);
+
+// values of a stream at the ticks of clock, linearly interpolated
+void telemetry_resample(const float *values, const Telemetry_Clock &clock, float *out);
+
+// Derivative of values sampled period apart, central differences inside
+// and one sided at both ends
+void telemetry_differentiate(const float *values, size_t count, double period, float *out);
+
+// Sum of (a - b)^2, summed in blocks so hours of samples keep their precision
+double telemetry_squared_error(const float *a, const float *b, size_t count);
+
+// Largest |a - b|
+float telemetry_max_error(const float *a, const float *b, size_t count);
+
+
+
+#endif // TELEMETRY_COLUMNS_H_
+
+
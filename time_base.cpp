@@ -0,0 +1,201 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file time_base.cpp
+ *
+ * @brief Monotonic time stamps and autopilot clock mapping
+ *
+ * Functions for reading the companion clock and mapping autopilot boot time
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "time_base.h"
+
+#include <pthread.h>
+
+
+// ----------------------------------------------------------------------------------
+//   Time
+// ----------------------------------------------------------------------------------
+
+// CLOCK_MONOTONIC is read in the vDSO without a system call, and is only
+// ever slewed, never stepped.  Nothing here keeps state, so it is safe to
+// call from every thread.
+uint64_t
+get_time_nsec()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec*1000000000ULL + now.tv_nsec;
+}
+
+uint64_t
+get_time_usec()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
+
+static pthread_once_t _wall_once = PTHREAD_ONCE_INIT;
+static int64_t        _wall_offset;
+
+// Read the wall clock between two monotonic reads a few times and keep the
+// tightest pair
+static void
+_calibrate_wall_time()
+{
+	uint64_t best_gap = (uint64_t)-1;
+
+	for ( int i = 0; i < 8; i++ )
+	{
+		struct timespec wall;
+		uint64_t before = get_time_usec();
+		clock_gettime(CLOCK_REALTIME, &wall);
+		uint64_t after  = get_time_usec();
+
+		if ( after - before < best_gap )
+		{
+			best_gap     = after - before;
+			_wall_offset = (int64_t)((uint64_t)wall.tv_sec*1000000 + wall.tv_nsec/1000)
+			             - (int64_t)(before + (after - before)/2);
+		}
+	}
+}
+
+uint64_t
+get_wall_time_usec()
+{
+	pthread_once(&_wall_once, _calibrate_wall_time);
+	return get_time_usec() + _wall_offset;
+}
+
+
+// ----------------------------------------------------------------------------------
+//   Boot Time Map Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Boot_Time_Map::
+Boot_Time_Map()
+{
+	reboots = 0;
+	reset();
+}
+
+void
+Boot_Time_Map::
+reset()
+{
+	__atomic_store_n(&have_estimate, false, __ATOMIC_RELEASE);
+	estimate      = 0;
+	current_min   = 0;
+	previous_min  = 0;
+	have_previous = false;
+	window_start  = 0;
+	last_remote   = 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Update
+// ------------------------------------------------------------------------------
+void
+Boot_Time_Map::
+update(uint64_t remote_usec, uint64_t local_usec)
+{
+	// autopilot rebooted, its old offset means nothing now
+	if ( remote_usec + BOOT_TIME_MAP_REBOOT < last_remote )
+	{
+		reset();
+		reboots++;
+	}
+	last_remote = remote_usec;
+
+	int64_t sample = (int64_t)local_usec - (int64_t)remote_usec;
+
+	// start a new window, remembering the minimum of the last one
+	if ( window_start == 0 || local_usec - window_start > BOOT_TIME_MAP_WINDOW )
+	{
+		have_previous = window_start != 0;
+		previous_min  = current_min;
+		current_min   = sample;
+		window_start  = local_usec;
+	}
+	else if ( sample < current_min )
+		current_min = sample;
+
+	int64_t best = current_min;
+	if ( have_previous && previous_min < best )
+		best = previous_min;
+
+	__atomic_store_n(&estimate, best, __ATOMIC_RELAXED);
+	__atomic_store_n(&have_estimate, true, __ATOMIC_RELEASE);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Mapping
+// ------------------------------------------------------------------------------
+bool
+Boot_Time_Map::
+valid() const
+{
+	return __atomic_load_n(&have_estimate, __ATOMIC_ACQUIRE);
+}
+
+int64_t
+Boot_Time_Map::
+offset() const
+{
+	return __atomic_load_n(&estimate, __ATOMIC_RELAXED);
+}
+
+// companion time at which the autopilot's clock read remote_usec
+uint64_t
+Boot_Time_Map::
+to_local(uint64_t remote_usec) const
+{
+	return remote_usec + offset();
+}
+
+
@@ -0,0 +1,128 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file time_base.h
+ *
+ * @brief Monotonic time stamps and autopilot clock mapping
+ *
+ * Functions for reading the companion clock, and a filter that maps the
+ * autopilot's time since boot onto it.
+ *
+ */
+
+#ifndef TIME_BASE_H_
+#define TIME_BASE_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <time.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Length of each minimum offset window of the boot time map [us]
+#define BOOT_TIME_MAP_WINDOW 10000000
+
+// Autopilot time going back by more than this means it rebooted [us]
+#define BOOT_TIME_MAP_REBOOT 1000000
+
+
+// ------------------------------------------------------------------------------
+//   Prototypes
+// ------------------------------------------------------------------------------
+
+// monotonic companion time, never jumps with NTP or date changes
+uint64_t get_time_usec();
+uint64_t get_time_nsec();
+
+// wall clock time, the monotonic clock plus an offset measured once
+uint64_t get_wall_time_usec();
+
+
+// ----------------------------------------------------------------------------------
+//   Boot Time Map Class
+// ----------------------------------------------------------------------------------
+/*
+ * Boot Time Map Class
+ *
+ * Maps autopilot time since boot (time_boot_ms, time_usec) to companion
+ * monotonic time.  Every received message carrying a boot time is one sample
+ * of local arrival time minus remote time, which is the clock offset plus
+ * the link delay.  The delay is never negative, so the smallest sample seen
+ * is the best offset estimate.  Minimums are kept over two consecutive
+ * windows, which lets the estimate follow slow clock drift.  A remote clock
+ * that jumps backwards is taken as an autopilot reboot and starts over.
+ *
+ * update() is called from the read thread only, to_local() and offset() may
+ * be called from any thread.
+ */
+class Boot_Time_Map
+{
+
+public:
+
+	Boot_Time_Map();
+
+	void update(uint64_t remote_usec, uint64_t local_usec);
+	void reset();
+
+	bool     valid() const;
+	int64_t  offset() const;
+	uint64_t to_local(uint64_t remote_usec) const;
+
+	uint32_t reboots; // times the autopilot clock went backwards
+
+private:
+
+	int64_t  estimate;     // published offset, local minus remote
+	bool     have_estimate;
+
+	int64_t  current_min;  // smallest offset in this window
+	int64_t  previous_min; // smallest offset in the last window
+	bool     have_previous;
+	uint64_t window_start;
+	uint64_t last_remote;
+
+};
+
+
+
+#endif // TIME_BASE_H_
+
+
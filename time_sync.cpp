@@ -0,0 +1,255 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file time_sync.cpp
+ *
+ * @brief Clock offset and drift estimation from TIMESYNC exchanges
+ *
+ * Functions for filtering round trips and fitting the clock mapping
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "time_sync.h"
+
+
+// ----------------------------------------------------------------------------------
+//   Time Sync Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Time_Sync::
+Time_Sync()
+{
+	samples  = 0;
+	outliers = 0;
+	resets   = 0;
+	reset();
+}
+
+void
+Time_Sync::
+reset()
+{
+	Estimate none = { 0, 0.0 };
+	estimate.store(none, 0);
+
+	pending      = 0;
+	typical_rtt  = 0;
+	slow_in_row  = 0;
+	sample_head  = 0;
+	sample_count = 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Exchange
+// ------------------------------------------------------------------------------
+
+// ts1 for the next request, tc1 goes out as 0
+int64_t
+Time_Sync::
+request(uint64_t now)
+{
+	__atomic_store_n(&pending, (int64_t)now, __ATOMIC_RELEASE);
+	return (int64_t)now;
+}
+
+// Returns true if the round trip was used for the estimate
+bool
+Time_Sync::
+handle_response(int64_t tc1, int64_t ts1, uint64_t now)
+{
+	// not an answer to our last request, or a late one
+	int64_t expected = ts1;
+	if ( ts1 == 0 || not __atomic_compare_exchange_n(&pending, &expected, 0, false,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) )
+		return false;
+
+	uint64_t round_trip = now - (uint64_t)ts1;
+	rtt.add(round_trip / 1000);
+
+	// drop round trips held up somewhere on the link
+	if ( typical_rtt && round_trip > TIME_SYNC_RTT_FACTOR*typical_rtt + TIME_SYNC_RTT_SLACK
+	     && ++slow_in_row < TIME_SYNC_MAX_OUTLIERS )
+	{
+		outliers++;
+		return false;
+	}
+	slow_in_row = 0;
+
+	// follow the typical round trip slowly, 1/8 per sample
+	if ( typical_rtt == 0 )
+		typical_rtt = round_trip;
+	else
+		typical_rtt = (7*typical_rtt + round_trip) / 8;
+
+	uint64_t local_mid = (uint64_t)ts1 + round_trip/2;
+	int64_t  sample    = tc1 - (int64_t)local_mid;
+
+	// autopilot rebooted, start over with this sample
+	if ( valid() )
+	{
+		int64_t jump = sample - ((int64_t)to_remote(local_mid) - (int64_t)local_mid);
+		if ( jump > TIME_SYNC_RESET_JUMP || jump < -TIME_SYNC_RESET_JUMP )
+		{
+			Estimate none = { 0, 0.0 };
+			estimate.store(none, 0);
+
+			sample_head  = 0;
+			sample_count = 0;
+			resets++;
+		}
+	}
+
+	sample_local[sample_head]  = local_mid;
+	sample_offset[sample_head] = sample;
+	sample_head = (sample_head + 1) % TIME_SYNC_SAMPLES;
+	if ( sample_count < TIME_SYNC_SAMPLES )
+		sample_count++;
+
+	samples++;
+	fit();
+
+	return true;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Fit
+// ------------------------------------------------------------------------------
+// Least squares line through the stored samples, evaluated at the newest one
+void
+Time_Sync::
+fit()
+{
+	// one round trip can be off by half of it, wait for a few
+	if ( sample_count < TIME_SYNC_MIN_FIT )
+		return;
+
+	unsigned newest = (sample_head + TIME_SYNC_SAMPLES - 1) % TIME_SYNC_SAMPLES;
+	Estimate next   = { sample_offset[newest], 0.0 };
+
+	// relative to the newest sample, so doubles keep full precision
+	uint64_t x0 = sample_local[newest];
+	int64_t  y0 = sample_offset[newest];
+
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	for ( unsigned i = 0; i < sample_count; i++ )
+	{
+		double x = (double)(int64_t)(sample_local[i] - x0);
+		double y = (double)(sample_offset[i] - y0);
+		sx  += x;
+		sy  += y;
+		sxx += x*x;
+		sxy += x*y;
+	}
+
+	double n     = sample_count;
+	double denom = n*sxx - sx*sx;
+	if ( denom > 0 )
+	{
+		next.skew   = (n*sxy - sx*sy) / denom;
+		next.offset = y0 + (int64_t)((sy - next.skew*sx) / n);
+	}
+
+	estimate.store(next, sample_local[newest]);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Mapping
+// ------------------------------------------------------------------------------
+bool
+Time_Sync::
+valid() const
+{
+	return estimate.time_stamp() != 0;
+}
+
+// autopilot time at local time, 0 if not synced yet
+uint64_t
+Time_Sync::
+to_remote(uint64_t local) const
+{
+	Estimate e;
+	uint64_t reference = estimate.load(e);
+	if ( reference == 0 )
+		return 0;
+
+	double since = (double)(int64_t)(local - reference);
+	return local + e.offset + (int64_t)(e.skew*since);
+}
+
+// autopilot minus companion time at the last sample [ns]
+int64_t
+Time_Sync::
+offset() const
+{
+	Estimate e;
+	estimate.load(e);
+	return e.offset;
+}
+
+// how much faster the autopilot clock runs [parts per million]
+double
+Time_Sync::
+drift() const
+{
+	Estimate e;
+	estimate.load(e);
+	return e.skew * 1e6;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+Time_Sync::
+print(FILE *out) const
+{
+	rtt.print("TIMESYNC RTT", out);
+	if ( valid() )
+		fprintf(out, "%-20s offset: %.3f ms  drift: %.1f ppm  samples: %u  outliers: %u  resets: %u\n",
+		        "TIMESYNC", offset() / 1e6, drift(), samples, outliers, resets);
+}
+
+
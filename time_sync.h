@@ -0,0 +1,154 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file time_sync.h
+ *
+ * @brief Clock offset and drift estimation from TIMESYNC exchanges
+ *
+ * Functions for turning TIMESYNC round trips into a companion to autopilot
+ * clock mapping.
+ *
+ */
+
+#ifndef TIME_SYNC_H_
+#define TIME_SYNC_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "latency_histogram.h"
+#include "seqlock.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Round trips the offset and drift are fitted over
+#define TIME_SYNC_SAMPLES 16
+
+// Round trips needed before there is an estimate at all, a single one can be
+// off by half its round trip
+#define TIME_SYNC_MIN_FIT 4
+
+// A round trip slower than this many times the typical one is an outlier
+#define TIME_SYNC_RTT_FACTOR 2
+
+// ...unless it is within this much of it anyway [ns]
+#define TIME_SYNC_RTT_SLACK 1000000
+
+// This many outliers in a row means the link itself got slower, accept it
+#define TIME_SYNC_MAX_OUTLIERS 8
+
+// An offset jump this large means the autopilot rebooted [ns]
+#define TIME_SYNC_RESET_JUMP 1000000000LL
+
+
+// ----------------------------------------------------------------------------------
+//   Time Sync Class
+// ----------------------------------------------------------------------------------
+/*
+ * Time Sync Class
+ *
+ * Implements the estimator side of the MAVLink TIMESYNC handshake.  We send
+ * tc1 = 0, ts1 = our time and the autopilot answers with tc1 = its time,
+ * ts1 echoed.  Assuming a symmetric link, the autopilot read its clock half
+ * a round trip after we sent, which gives one offset sample.
+ *
+ * Round trips much slower than the typical one are dropped, since queueing
+ * on the radio makes the link asymmetric and the sample unreliable.  The
+ * rest go into a least squares line over the last TIME_SYNC_SAMPLES, whose
+ * intercept is the offset and whose slope is the drift of the autopilot
+ * clock against ours.
+ *
+ * request() and handle_response() may be called from different threads,
+ * each from only one, to_remote() and the other readers from any thread.
+ * valid() holds once TIME_SYNC_MIN_FIT round trips were accepted, and again
+ * that many after the autopilot rebooted.  All times are in nanoseconds.
+ */
+class Time_Sync
+{
+
+public:
+
+	Time_Sync();
+
+	int64_t request(uint64_t now);
+	bool    handle_response(int64_t tc1, int64_t ts1, uint64_t now);
+	void    reset();
+
+	bool     valid() const;
+	uint64_t to_remote(uint64_t local) const;
+	int64_t  offset() const;
+	double   drift() const;
+
+	void print(FILE *out = stdout) const;
+
+	Latency_Histogram rtt; // round trip of every answered request [us]
+	uint32_t samples;      // round trips used
+	uint32_t outliers;     // round trips dropped for being slow
+	uint32_t resets;       // times the autopilot clock jumped
+
+private:
+
+	// published mapping, remote = local + offset + skew * (local - reference)
+	struct Estimate
+	{
+		int64_t offset;
+		double  skew;
+	};
+	Seqlock<Estimate> estimate; // time stamp is the reference local time
+
+	int64_t  pending;      // ts1 of the request in flight, 0 if none
+	uint64_t typical_rtt;  // smoothed round trip of accepted samples
+	uint32_t slow_in_row;
+
+	uint64_t sample_local[TIME_SYNC_SAMPLES];  // midpoints of the round trips
+	int64_t  sample_offset[TIME_SYNC_SAMPLES]; // remote minus local there
+	unsigned sample_head;
+	unsigned sample_count;
+
+	void fit();
+
+};
+
+
+
+#endif // TIME_SYNC_H_
+
+
@@ -0,0 +1,313 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file tracking_analyzer.cpp
+ *
+ * @brief How well the autopilot follows its position setpoints, per leg
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "tracking_analyzer.h"
+
+#include <string.h>
+#include <math.h>
+
+
+// ----------------------------------------------------------------------------------
+//   Tracking Analyzer Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Tracking_Analyzer::
+Tracking_Analyzer()
+{
+	step          = TRACKING_ANALYZER_STEP;
+	band          = TRACKING_ANALYZER_BAND;
+	band_fraction = TRACKING_ANALYZER_BAND_FRACTION;
+
+	memset(&leg, 0, sizeof(leg));
+	memset(last, 0, sizeof(last));
+	memset(last_target, 0, sizeof(last_target));
+	memset(direction, 0, sizeof(direction));
+
+	started        = false;
+	have_position  = false;
+	need_from      = false;
+	leg_band       = 0;
+	sum_squares    = 0;
+	steady_sum     = 0;
+	steady_samples = 0;
+	inside_since   = 0;
+}
+
+
+
+// ------------------------------------------------------------------------------
+//   Read Thread
+// ------------------------------------------------------------------------------
+void
+Tracking_Analyzer::
+received(const Frame_View &frame, uint64_t now)
+{
+	switch ( frame.msgid )
+	{
+		case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
+			position(Message_View<mavlink_local_position_ned_t>(frame), now);
+			break;
+
+		case MAVLINK_MSG_ID_POSITION_TARGET_LOCAL_NED:
+			target(Message_View<mavlink_position_target_local_ned_t>(frame), now);
+			break;
+	}
+}
+
+void
+Tracking_Analyzer::
+target(const Message_View<mavlink_position_target_local_ned_t> &view, uint64_t now)
+{
+	(void)now;
+
+	float target_[3] = {
+		view.get(&mavlink_position_target_local_ned_t::x),
+		view.get(&mavlink_position_target_local_ned_t::y),
+		view.get(&mavlink_position_target_local_ned_t::z) };
+
+	// a step between two reports starts a leg, a target moving smoothly
+	// stays in its leg and is followed
+	float dx = target_[0] - last_target[0];
+	float dy = target_[1] - last_target[1];
+	float dz = target_[2] - last_target[2];
+
+	memcpy(last_target, target_, sizeof(last_target));
+
+	if ( started and dx*dx + dy*dy + dz*dz <= step*step )
+	{
+		memcpy(leg.target, target_, sizeof(leg.target));
+		return;
+	}
+
+	if ( started )
+		end_leg();
+
+	begin_leg(target_, view.get(&mavlink_position_target_local_ned_t::time_boot_ms) * 1000ULL);
+}
+
+void
+Tracking_Analyzer::
+position(const Message_View<mavlink_local_position_ned_t> &view, uint64_t now)
+{
+	(void)now;
+
+	last[0] = view.get(&mavlink_local_position_ned_t::x);
+	last[1] = view.get(&mavlink_local_position_ned_t::y);
+	last[2] = view.get(&mavlink_local_position_ned_t::z);
+	have_position = true;
+
+	if ( not started )
+		return;
+
+	if ( need_from )
+		set_from(last);
+
+	uint64_t time_usec = view.get(&mavlink_local_position_ned_t::time_boot_ms) * 1000ULL;
+
+	// both come from the autopilot's clock, a position can still be stamped
+	// just before the target that started the leg
+	if ( time_usec < leg.start_usec )
+		time_usec = leg.start_usec;
+
+	float dx = last[0] - leg.target[0];
+	float dy = last[1] - leg.target[1];
+	float dz = last[2] - leg.target[2];
+
+	float squared = dx*dx + dy*dy + dz*dz;
+	float error   = sqrtf(squared);
+
+	sum_squares += squared;
+	leg.samples++;
+
+	if ( error > leg.max_error )
+		leg.max_error = error;
+
+	// past the target along the step
+	float past = dx*direction[0] + dy*direction[1] + dz*direction[2];
+	if ( past > leg.overshoot )
+		leg.overshoot = past;
+
+	if ( error > leg_band )
+	{
+		inside_since   = 0;
+		steady_sum     = 0;
+		steady_samples = 0;
+	}
+	else
+	{
+		if ( not inside_since )
+			inside_since = time_usec + 1; // 0 means outside
+		steady_sum += error;
+		steady_samples++;
+	}
+
+	leg.end_usec = time_usec;
+	leg.error    = error;
+	leg.rms      = (float)sqrt(sum_squares / leg.samples);
+	leg.settle   = inside_since ? ( inside_since - 1 - leg.start_usec ) * 1e-6f : -1.0f;
+	leg.steady   = steady_samples ? (float)( steady_sum / steady_samples ) : error;
+
+	current.store(leg, time_usec);
+}
+
+void
+Tracking_Analyzer::
+begin_leg(const float target_[3], uint64_t time_usec)
+{
+	uint32_t number = started ? leg.number + 1 : 0;
+
+	memset(&leg, 0, sizeof(leg));
+	leg.number     = number;
+	leg.start_usec = time_usec;
+	leg.end_usec   = time_usec;
+	leg.settle     = -1.0f;
+	memcpy(leg.target, target_, sizeof(leg.target));
+
+	sum_squares    = 0;
+	steady_sum     = 0;
+	steady_samples = 0;
+	inside_since   = 0;
+	started        = true;
+
+	need_from = not have_position;
+	if ( have_position )
+		set_from(last);
+
+	current.store(leg, time_usec);
+}
+
+// The step, its direction and the band follow from where the leg started
+void
+Tracking_Analyzer::
+set_from(const float from[3])
+{
+	float d[3];
+	for ( int i = 0; i < 3; i++ )
+	{
+		leg.from[i] = from[i];
+		d[i]        = leg.target[i] - from[i];
+	}
+
+	leg.step = sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+
+	// a leg that starts on its target has no direction to overshoot in
+	for ( int i = 0; i < 3; i++ )
+		direction[i] = leg.step > step ? d[i] / leg.step : 0.0f;
+
+	leg_band  = band_fraction * leg.step > band ? band_fraction * leg.step : band;
+	need_from = false;
+}
+
+void
+Tracking_Analyzer::
+end_leg()
+{
+	legs.push(leg, leg.end_usec);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Print
+// ------------------------------------------------------------------------------
+void
+Tracking_Analyzer::
+print_header(FILE *file)
+{
+	fprintf(file, "%-4s %8s %26s %7s %7s %7s %9s %8s %7s %7s\n", "LEG", "start s", "target m", "step m",
+			"rms m", "max m", "overshoot", "settle s", "steady", "samples");
+}
+
+void
+Tracking_Analyzer::
+print_leg(const Tracking_Leg &leg, FILE *file)
+{
+	char settle[16];
+	if ( leg.settle < 0 )
+		snprintf(settle, sizeof(settle), "%s", "-");
+	else
+		snprintf(settle, sizeof(settle), "%.2f", leg.settle);
+
+	fprintf(file, "%-4u %8.2f [ % 6.2f, % 6.2f, % 6.2f ] %7.2f %7.3f %7.3f %5.3f %3.0f%% %8s %7.3f %7u\n",
+			leg.number, leg.start_usec * 1e-6, leg.target[0], leg.target[1], leg.target[2], leg.step,
+			leg.rms, leg.max_error, leg.overshoot, leg.step > 0 ? 100 * leg.overshoot / leg.step : 0.0,
+			settle, leg.steady, leg.samples);
+}
+
+// From the main thread, any number of times; legs older than the ring are
+// reported as missed
+int
+Tracking_Analyzer::
+print(uint64_t &cursor, FILE *file) const
+{
+	History_Sample<Tracking_Leg> samples[8];
+	uint64_t missed = 0;
+	int printed     = 0;
+	int count;
+
+	while ( ( count = legs.read(cursor, samples, 8, &missed) ) > 0 )
+	{
+		for ( int i = 0; i < count; i++ )
+			print_leg(samples[i].value, file);
+		printed += count;
+	}
+
+	if ( missed )
+		fprintf(file, "%llu legs missed\n", (unsigned long long)missed);
+
+	return printed;
+}
+
+void
+Tracking_Analyzer::
+print_current(FILE *file) const
+{
+	Tracking_Leg leg_;
+
+	if ( current.load(leg_) )
+		print_leg(leg_, file);
+}
+
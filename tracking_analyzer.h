@@ -0,0 +1,175 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file tracking_analyzer.h
+ *
+ * @brief How well the autopilot follows its position setpoints, per leg
+ *
+ * Tracking error, settle time, overshoot and steady state error of each
+ * step of the position target, computed as the messages arrive.
+ *
+ */
+
+#ifndef TRACKING_ANALYZER_H_
+#define TRACKING_ANALYZER_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <common/mavlink.h>
+
+#include "seqlock.h"
+#include "history_ring.h"
+#include "message_dispatch.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// A target this much further than the one reported before starts a leg [m]
+#define TRACKING_ANALYZER_STEP 0.25
+
+// Settled once within the larger of these of the target, and staying there
+#define TRACKING_ANALYZER_BAND          0.1  // [m]
+#define TRACKING_ANALYZER_BAND_FRACTION 0.05 // of the step
+
+// Finished legs kept for readers, a power of two
+#define TRACKING_ANALYZER_LEGS 64
+
+
+// ------------------------------------------------------------------------------
+//   Data Structures
+// ------------------------------------------------------------------------------
+
+// One leg: from the target changing to it changing again.  Times are the
+// autopilot's boot time, errors are 3D distances to the target.
+struct Tracking_Leg
+{
+	uint32_t number;     // legs before this one
+	uint32_t samples;    // positions received during it
+	uint64_t start_usec; // target first seen
+	uint64_t end_usec;   // latest position
+
+	float from[3];       // position when it started [m]
+	float target[3];     // the latest [m]
+	float step;          // from to the leg's first target [m]
+
+	float rms;           // of the error over the leg [m]
+	float max_error;     // [m]
+	float error;         // at end_usec [m]
+	float overshoot;     // furthest past the target along the step [m]
+	float settle;        // from start into the band for good [s], -1 if not
+	float steady;        // mean error once settled [m], the last if not
+};
+
+
+// ----------------------------------------------------------------------------------
+//   Tracking Analyzer Class
+// ----------------------------------------------------------------------------------
+/*
+ * Tracking Analyzer Class
+ *
+ * The read thread feeds it every message of the autopilot with received(),
+ * which keeps POSITION_TARGET_LOCAL_NED and LOCAL_POSITION_NED and reads
+ * only the fields it needs from the frame.  Each position is compared with
+ * the latest target; a target more than step away from the one reported
+ * before closes the leg and starts the next.  Repeating the same setpoint,
+ * or a target moving smoothly along a trajectory, stays in its leg.  Legs
+ * start when the autopilot reports the new target, so at its
+ * POSITION_TARGET_LOCAL_NED rate after the setpoint.
+ *
+ * Every sample costs the same few operations, the running sums are reset
+ * per leg and nothing is allocated.  Finished legs are pushed to legs, the
+ * one in progress is republished in current with each position; both can
+ * be read from any thread.
+ */
+class Tracking_Analyzer
+{
+
+public:
+
+	Tracking_Analyzer();
+
+	// set before start()
+	float step;          // [m]
+	float band;          // [m]
+	float band_fraction; // of the leg's step
+
+	History_Ring<Tracking_Leg, TRACKING_ANALYZER_LEGS> legs;
+	Seqlock<Tracking_Leg> current;
+
+	void received(const Frame_View &frame, uint64_t now);
+
+	void position(const Message_View<mavlink_local_position_ned_t> &view, uint64_t now);
+	void target(const Message_View<mavlink_position_target_local_ned_t> &view, uint64_t now);
+
+	// legs finished since cursor, which is moved past them
+	int  print(uint64_t &cursor, FILE *file = stdout) const;
+	void print_current(FILE *file = stdout) const;
+
+	static void print_header(FILE *file = stdout);
+	static void print_leg(const Tracking_Leg &leg, FILE *file = stdout);
+
+private:
+
+	Tracking_Leg leg;
+	bool         started;      // a target was seen
+	bool         have_position;
+	bool         need_from;    // leg started before any position
+	float        last[3];      // latest position
+	float        last_target[3];
+
+	// running over the leg
+	float    direction[3];     // unit vector of the step, 0 if none
+	float    leg_band;
+	double   sum_squares;
+	double   steady_sum;
+	uint32_t steady_samples;
+	uint64_t inside_since;     // in the band since [us], 0 if outside
+
+	void begin_leg(const float target_[3], uint64_t time_usec);
+	void end_leg();
+	void set_from(const float from[3]);
+
+};
+
+
+
+#endif // TRACKING_ANALYZER_H_
+
+
@@ -0,0 +1,478 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file udp_port.cpp
+ *
+ * @brief UDP interface functions
+ *
+ * Functions for sending and receiving MAVLink over UDP, several datagrams
+ * per system call.
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "udp_port.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "port_url.h"
+#include "time_base.h"
+
+
+// ----------------------------------------------------------------------------------
+//   UDP Port Manager Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+UDP_Port::
+UDP_Port(const char *host_, int port_, bool remote_)
+{
+	host   = host_;
+	port   = port_;
+	remote = remote_;
+
+	rx_bytes     = 0;
+	rx_datagrams = 0;
+	rx_reads     = 0;
+	rx_messages  = 0;
+	rx_truncated = 0;
+	rx_other_senders = 0;
+
+	tx_bytes     = 0;
+	tx_datagrams = 0;
+	tx_writes    = 0;
+	tx_dropped   = 0;
+
+	recorder = NULL;
+
+	sock   = -1;
+	status = 0;
+
+	memset(&peer, 0, sizeof(peer));
+	have_peer = false;
+
+	rx_count  = 0;
+	rx_index  = 0;
+	rx_offset = 0;
+
+	int result = pthread_mutex_init(&read_lock, NULL) ||
+	             pthread_mutex_init(&write_lock, NULL);
+	if ( result != 0 )
+	{
+		printf("\n mutex init failed\n");
+		throw 1;
+	}
+}
+
+UDP_Port::
+~UDP_Port()
+{
+	stop();
+
+	pthread_mutex_destroy(&read_lock);
+	pthread_mutex_destroy(&write_lock);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Read from UDP
+// ------------------------------------------------------------------------------
+// Hands out views of the frames in the datagrams taken in by the last
+// recvmmsg(), and only calls it again once those are used up.  Returns 0 right
+// away if there is nothing.  The views are valid until the next read.
+int
+UDP_Port::
+read_frames(Frame_View *views, int max_views)
+{
+	pthread_mutex_lock(&read_lock);
+
+	int count = _scan(views, max_views);
+
+	if ( count == 0 && _receive() > 0 )
+		count = _scan(views, max_views);
+
+	// keep a copy of everything received
+	if ( recorder && count )
+	{
+		uint64_t now = get_time_usec();
+		for ( int i = 0; i < count; i++ )
+			recorder->record(FLIGHT_RECORD_RX, views[i].frame, views[i].length, now);
+	}
+
+	rx_messages += count;
+
+	pthread_mutex_unlock(&read_lock);
+
+	return count;
+}
+
+// Frames left in the received datagrams, a partial frame at the end of a
+// datagram is skipped since the next datagram will not complete it
+int
+UDP_Port::
+_scan(Frame_View *views, int max_views)
+{
+	int count = 0;
+
+	while ( count < max_views && rx_index < rx_count )
+	{
+		int want = max_views - count;
+		unsigned consumed;
+
+		int found = scanner.scan(rx_buffers[rx_index] + rx_offset, rx_lengths[rx_index] - rx_offset,
+				views + count, want, consumed, false);
+		rx_offset += consumed;
+		count     += found;
+
+		// fewer than asked for, nothing more in this datagram
+		if ( found < want )
+		{
+			rx_index++;
+			rx_offset = 0;
+		}
+	}
+
+	return count;
+}
+
+// Takes in whatever datagrams are queued, without blocking.  Returns how many,
+// 0 if none and -1 on error.
+int
+UDP_Port::
+_receive()
+{
+	struct mmsghdr     msgs[UDP_PORT_MAX_BATCH];
+	struct iovec       iovs[UDP_PORT_MAX_BATCH];
+	struct sockaddr_in from[UDP_PORT_MAX_BATCH];
+
+	memset(msgs, 0, sizeof(msgs));
+	for ( int i = 0; i < UDP_PORT_MAX_BATCH; i++ )
+	{
+		iovs[i].iov_base = rx_buffers[i];
+		iovs[i].iov_len  = UDP_PORT_DATAGRAM_LEN;
+		msgs[i].msg_hdr.msg_iov     = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen  = 1;
+		msgs[i].msg_hdr.msg_name    = &from[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+	}
+
+	int result = recvmmsg(sock, msgs, UDP_PORT_MAX_BATCH, MSG_DONTWAIT, NULL);
+
+	if ( result <= 0 )
+	{
+		rx_count = 0;
+		if ( result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+		{
+			fprintf(stderr, "ERROR: Could not read from UDP port %d, %s\n", port, strerror(errno));
+			return -1;
+		}
+		return 0;
+	}
+
+	for ( int i = 0; i < result; i++ )
+	{
+		rx_lengths[i] = msgs[i].msg_len;
+		rx_bytes     += msgs[i].msg_len;
+		if ( msgs[i].msg_hdr.msg_flags & MSG_TRUNC )
+			rx_truncated++;
+	}
+
+	rx_count  = result;
+	rx_index  = 0;
+	rx_offset = 0;
+	rx_datagrams += result;
+	rx_reads++;
+
+	// Answer the first sender.  Following whoever talked last would send
+	// setpoints to a ground station or a second vehicle that shares the
+	// port as soon as it says something.
+	if ( not remote )
+	{
+		pthread_mutex_lock(&write_lock);
+		for ( int i = 0; i < result; i++ )
+		{
+			const struct sockaddr_in &sender = from[i];
+
+			if ( not have_peer )
+			{
+				peer      = sender;
+				have_peer = true;
+				printf("UDP PEER %s:%d\n", inet_ntoa(peer.sin_addr), ntohs(peer.sin_port));
+			}
+			else if ( peer.sin_addr.s_addr != sender.sin_addr.s_addr || peer.sin_port != sender.sin_port )
+			{
+				if ( not rx_other_senders )
+					printf("UDP: also receiving from %s:%d, replies stay with the first sender\n",
+							inet_ntoa(sender.sin_addr), ntohs(sender.sin_port));
+				rx_other_senders++;
+			}
+		}
+		pthread_mutex_unlock(&write_lock);
+	}
+
+	return result;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Add Message
+// ------------------------------------------------------------------------------
+// Passed on to the frame scanner, see Frame_Scanner::add_message()
+void
+UDP_Port::
+add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length)
+{
+	scanner.add_message(msgid, crc_extra, length);
+}
+
+
+// ------------------------------------------------------------------------------
+//   Wait for Data
+// ------------------------------------------------------------------------------
+// Same as Serial_Port::wait_readable()
+int
+UDP_Port::
+wait_readable(int wake_fd, int timeout_ms)
+{
+	// datagrams from the last read that are not scanned yet
+	if ( rx_index < rx_count )
+		return 1;
+
+	struct pollfd pfd[2];
+	pfd[0].fd      = sock;
+	pfd[0].events  = POLLIN;
+	pfd[0].revents = 0;
+	pfd[1].fd      = wake_fd;
+	pfd[1].events  = POLLIN;
+	pfd[1].revents = 0;
+
+	int result = poll(pfd, wake_fd < 0 ? 1 : 2, timeout_ms);
+
+	if ( result < 0 )
+		return errno == EINTR ? 0 : -1;
+
+	return ( pfd[0].revents & (POLLIN | POLLERR) ) ? 1 : 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Write to UDP
+// ------------------------------------------------------------------------------
+int
+UDP_Port::
+write_message(const mavlink_message_t &message)
+{
+	return write_messages(&message, 1);
+}
+
+// One datagram per message, up to UDP_PORT_MAX_BATCH of them per sendmmsg().
+// Returns the bytes sent.
+int
+UDP_Port::
+write_messages(const mavlink_message_t *messages, int count)
+{
+	uint8_t        bufs[UDP_PORT_MAX_BATCH][MAVLINK_MAX_PACKET_LEN];
+	struct mmsghdr msgs[UDP_PORT_MAX_BATCH];
+	struct iovec   iovs[UDP_PORT_MAX_BATCH];
+
+	int bytes = 0;
+
+	pthread_mutex_lock(&write_lock);
+
+	if ( not have_peer )
+	{
+		tx_dropped += count;
+		pthread_mutex_unlock(&write_lock);
+		return 0;
+	}
+
+	while ( count > 0 )
+	{
+		int batch = count < UDP_PORT_MAX_BATCH ? count : UDP_PORT_MAX_BATCH;
+
+		memset(msgs, 0, batch * sizeof(msgs[0]));
+		for ( int i = 0; i < batch; i++ )
+		{
+			iovs[i].iov_base = bufs[i];
+			iovs[i].iov_len  = mavlink_msg_to_send_buffer(bufs[i], &messages[i]);
+			msgs[i].msg_hdr.msg_iov     = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen  = 1;
+			msgs[i].msg_hdr.msg_name    = &peer;
+			msgs[i].msg_hdr.msg_namelen = sizeof(peer);
+		}
+
+		uint64_t start = get_time_usec();
+		int result = sendmmsg(sock, msgs, batch, 0);
+		write_latency.add(get_time_usec() - start);
+		tx_writes++;
+
+		if ( result < 0 )
+			result = 0;
+
+		uint64_t now = get_time_usec();
+		for ( int i = 0; i < result; i++ )
+		{
+			bytes += msgs[i].msg_len;
+			if ( recorder )
+				recorder->record(FLIGHT_RECORD_TX, bufs[i], iovs[i].iov_len, now);
+		}
+
+		tx_datagrams += result;
+		tx_dropped   += batch - result;
+
+		messages += batch;
+		count    -= batch;
+	}
+
+	tx_bytes += bytes;
+
+	pthread_mutex_unlock(&write_lock);
+
+	return bytes;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Statistics
+// ------------------------------------------------------------------------------
+void
+UDP_Port::
+print_stats()
+{
+	printf("UDP     rx: %llu bytes in %llu datagrams, %llu reads, %llu messages, %llu truncated, %llu from other senders  tx: %llu bytes in %llu datagrams, %llu writes (%.2f messages per write), %llu dropped\n",
+			(unsigned long long)rx_bytes, (unsigned long long)rx_datagrams, (unsigned long long)rx_reads,
+			(unsigned long long)rx_messages, (unsigned long long)rx_truncated, (unsigned long long)rx_other_senders,
+			(unsigned long long)tx_bytes, (unsigned long long)tx_datagrams, (unsigned long long)tx_writes,
+			tx_writes ? (double)tx_datagrams / tx_writes : 0.0, (unsigned long long)tx_dropped);
+	write_latency.print("WRITE LATENCY");
+	scanner.print("UDP FRAMES");
+
+	if ( recorder )
+		recorder->print_stats();
+}
+
+
+// ------------------------------------------------------------------------------
+//   Open and Close
+// ------------------------------------------------------------------------------
+/**
+ * throws EXIT_FAILURE if could not open the port
+ */
+void
+UDP_Port::
+start()
+{
+	printf("OPEN PORT\n");
+
+	struct sockaddr_in address;
+	if ( not resolve_host(host, port, address) )
+	{
+		printf("failure, could not resolve %s.\n", host);
+		throw EXIT_FAILURE;
+	}
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if ( sock < 0 )
+	{
+		printf("failure, could not open socket, %s.\n", strerror(errno));
+		throw EXIT_FAILURE;
+	}
+
+	// room for bursts of kHz telemetry while the read thread is busy
+	int size = 1 << 20;
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	if ( remote )
+	{
+		pthread_mutex_lock(&write_lock);
+		peer      = address;
+		have_peer = true;
+		pthread_mutex_unlock(&write_lock);
+
+		printf("Sending to UDP %s:%d\n", inet_ntoa(address.sin_addr), port);
+	}
+	else
+	{
+		if ( bind(sock, (struct sockaddr *)&address, sizeof(address)) )
+		{
+			printf("failure, could not bind UDP %s:%d, %s.\n", host, port, strerror(errno));
+			close(sock);
+			sock = -1;
+			throw EXIT_FAILURE;
+		}
+
+		printf("Listening on UDP %s:%d\n", inet_ntoa(address.sin_addr), port);
+	}
+
+	status = 1;
+
+	printf("\n");
+}
+
+void
+UDP_Port::
+stop()
+{
+	if ( sock < 0 )
+		return;
+
+	printf("CLOSE PORT\n");
+
+	close(sock);
+	sock   = -1;
+	status = 0;
+
+	printf("\n");
+}
+
+bool
+UDP_Port::
+is_running()
+{
+	return status == 1;
+}
+
+
@@ -0,0 +1,161 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file udp_port.h
+ *
+ * @brief UDP interface definition
+ *
+ * Functions for sending and receiving MAVLink over UDP, several datagrams
+ * per system call.
+ *
+ */
+
+#ifndef UDP_PORT_H_
+#define UDP_PORT_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include <common/mavlink.h>
+
+#include "generic_port.h"
+#include "frame_scanner.h"
+#include "latency_histogram.h"
+#include "flight_recorder.h"
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Datagrams taken in or sent out per recvmmsg() / sendmmsg() call
+#define UDP_PORT_MAX_BATCH GENERIC_PORT_MAX_BATCH
+
+// Largest datagram kept, autopilots pack frames up to the Ethernet MTU
+#define UDP_PORT_DATAGRAM_LEN 2048
+
+
+// ----------------------------------------------------------------------------------
+//   UDP Port Class
+// ----------------------------------------------------------------------------------
+/*
+ * UDP Port Class
+ *
+ * Either binds host:port and answers whoever sent the first datagram (what
+ * PX4 SITL and most telemetry bridges expect), or with remote set sends to
+ * host:port from any local port and takes whatever comes back.  Frames from
+ * other senders are still read, only replies stay with the first.
+ *
+ * read_frames() takes in up to UDP_PORT_MAX_BATCH datagrams with one
+ * recvmmsg() and hands out views of the frames in them; frames never span
+ * datagrams.  write_messages() sends one datagram per message with one
+ * sendmmsg().  Nothing is sent before the peer is known.
+ */
+class UDP_Port: public Generic_Port
+{
+
+public:
+
+	UDP_Port(const char *host_, int port_, bool remote_);
+	~UDP_Port();
+
+	const char *host;
+	int  port;
+	bool remote;       // host:port is the peer, not the address to bind
+
+	uint64_t rx_bytes;
+	uint64_t rx_datagrams;
+	uint64_t rx_reads;     // recvmmsg() calls that returned data
+	uint64_t rx_messages;
+	uint64_t rx_truncated; // datagrams longer than UDP_PORT_DATAGRAM_LEN
+	uint64_t rx_other_senders; // datagrams not from the peer replies go to
+
+	uint64_t tx_bytes;
+	uint64_t tx_datagrams;
+	uint64_t tx_writes;    // sendmmsg() calls
+	uint64_t tx_dropped;   // messages not sent, no peer yet or the socket refused
+
+	Frame_Scanner scanner;
+
+	// time spent in sendmmsg()
+	Latency_Histogram write_latency;
+
+	// if set, gets a copy of every frame read and written
+	Flight_Recorder *recorder;
+
+	int read_frames(Frame_View *views, int max_views);
+	int wait_readable(int wake_fd, int timeout_ms);
+	void add_message(uint8_t msgid, uint8_t crc_extra, uint8_t length);
+	int write_message(const mavlink_message_t &message);
+	int write_messages(const mavlink_message_t *messages, int count);
+
+	bool is_running();
+	void start();
+	void stop();
+
+	void print_stats();
+
+private:
+
+	int  sock;
+	int  status;
+
+	pthread_mutex_t read_lock;
+	pthread_mutex_t write_lock;   // also guards peer
+
+	struct sockaddr_in peer;
+	bool have_peer;
+
+	uint8_t  rx_buffers[UDP_PORT_MAX_BATCH][UDP_PORT_DATAGRAM_LEN];
+	unsigned rx_lengths[UDP_PORT_MAX_BATCH];
+	int      rx_count;   // datagrams in rx_buffers
+	int      rx_index;   // datagram being scanned
+	unsigned rx_offset;  // next byte to scan in it
+
+	int  _scan(Frame_View *views, int max_views);
+	int  _receive();
+
+};
+
+
+
+#endif // UDP_PORT_H_
+
+
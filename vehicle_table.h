@@ -0,0 +1,242 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file vehicle_table.h
+ *
+ * @brief Per sender state for links shared by several MAVLink systems
+ *
+ * Finds the state kept for a (sysid, compid) pair with one table lookup.
+ *
+ */
+
+#ifndef VEHICLE_TABLE_H_
+#define VEHICLE_TABLE_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <string.h>
+
+
+// ------------------------------------------------------------------------------
+//   Defines
+// ------------------------------------------------------------------------------
+
+// Most senders kept apart on one link, the slot numbers must fit in a byte
+#define VEHICLE_TABLE_MAX 64
+
+// Index size, a power of two four times VEHICLE_TABLE_MAX so probe chains
+// stay a step or two long even with the table full
+#define VEHICLE_TABLE_HASH_BITS 8
+#define VEHICLE_TABLE_HASH      (1 << VEHICLE_TABLE_HASH_BITS)
+
+
+// ----------------------------------------------------------------------------------
+//   Vehicle Table Class
+// ----------------------------------------------------------------------------------
+/*
+ * Vehicle Table Class
+ *
+ * Maps (sysid, compid) to an entry of type V, e.g. Mavlink_Messages.  A small
+ * open addressed hash of slot numbers finds a sender in a step or two, so a
+ * lookup costs the same with one sender or VEHICLE_TABLE_MAX of them.  An
+ * entry is allocated when its sender is first seen, so the table itself is
+ * about 1 KB however many senders it may hold.
+ *
+ * bind() points a sender at an entry the caller already has.  What the
+ * sender's old entry received is merged into it first, V must provide
+ * merge(const V &).
+ *
+ * Entries are never removed.  Only one thread, the read thread, may insert()
+ * and bind(); find() and the iteration calls may be used from any thread.
+ * Entries replaced by bind() stay allocated until the table goes away, as
+ * another thread may still be looking at them.
+ */
+template <typename V>
+class Vehicle_Table
+{
+
+public:
+
+	Vehicle_Table()
+	{
+		memset(index, 0, sizeof(index));
+		memset(entries, 0, sizeof(entries));
+		memset(owned, 0, sizeof(owned));
+		memset(keys, 0, sizeof(keys));
+		count    = 0;
+		overflow = 0;
+	}
+
+	~Vehicle_Table()
+	{
+		for ( int i = 0; i < count; i++ )
+			delete owned[i];
+	}
+
+	uint64_t overflow; // insert() calls turned away because the table was full
+
+	// Entry for sysid/compid, NULL if it was never seen
+	V *
+	find(uint8_t sysid, uint8_t compid) const
+	{
+		int i = slot(key(sysid, compid));
+		return i < 0 ? NULL : __atomic_load_n(&entries[i], __ATOMIC_ACQUIRE);
+	}
+
+	// Entry for sysid/compid, allocated if it is new.  NULL if the table
+	// is full.
+	V *
+	insert(uint8_t sysid, uint8_t compid)
+	{
+		V *entry = find(sysid, compid);
+		if ( entry )
+			return entry;
+
+		if ( count == VEHICLE_TABLE_MAX )
+		{
+			overflow++;
+			return NULL;
+		}
+
+		owned[count] = new V;
+		return add(sysid, compid, owned[count]);
+	}
+
+	// Keep sysid/compid's state in entry from now on, taking over what its
+	// old entry received.  NULL if the sender is new and the table is full.
+	V *
+	bind(uint8_t sysid, uint8_t compid, V *entry)
+	{
+		int i = slot(key(sysid, compid));
+		if ( i < 0 )
+		{
+			if ( count == VEHICLE_TABLE_MAX )
+			{
+				overflow++;
+				return NULL;
+			}
+			return add(sysid, compid, entry);
+		}
+
+		if ( entries[i] != entry )
+		{
+			entry->merge(*entries[i]);
+			__atomic_store_n(&entries[i], entry, __ATOMIC_RELEASE);
+		}
+		return entry;
+	}
+
+	// Senders seen so far, in the order they were first seen
+	int
+	size() const
+	{
+		return __atomic_load_n(&count, __ATOMIC_ACQUIRE);
+	}
+
+	V *
+	at(int i) const
+	{
+		return __atomic_load_n(&entries[i], __ATOMIC_ACQUIRE);
+	}
+
+	uint8_t sysid_at(int i)  const { return keys[i] >> 8; }
+	uint8_t compid_at(int i) const { return keys[i] & 0xFF; }
+
+private:
+
+	uint8_t  index[VEHICLE_TABLE_HASH]; // slot + 1, 0 ends a probe chain
+	V       *entries[VEHICLE_TABLE_MAX];
+	V       *owned[VEHICLE_TABLE_MAX];  // allocated by insert(), or NULL
+	uint16_t keys[VEHICLE_TABLE_MAX];
+	int      count;
+
+	static uint16_t
+	key(uint8_t sysid, uint8_t compid)
+	{
+		return (uint16_t)(sysid << 8 | compid);
+	}
+
+	// Fibonacci hashing, spreads neighbouring sysids over the index
+	static unsigned
+	hash(uint16_t key_)
+	{
+		return ((uint32_t)key_ * 2654435769u) >> (32 - VEHICLE_TABLE_HASH_BITS);
+	}
+
+	// Slot holding key_, -1 if there is none.  The index always has free
+	// places, so every probe chain ends.
+	int
+	slot(uint16_t key_) const
+	{
+		for ( unsigned h = hash(key_); ; h = (h + 1) & (VEHICLE_TABLE_HASH - 1) )
+		{
+			uint8_t i = __atomic_load_n(&index[h], __ATOMIC_ACQUIRE);
+			if ( not i )
+				return -1;
+			if ( keys[i - 1] == key_ )
+				return i - 1;
+		}
+	}
+
+	V *
+	add(uint8_t sysid, uint8_t compid, V *entry)
+	{
+		uint16_t key_ = key(sysid, compid);
+		unsigned h    = hash(key_);
+		while ( index[h] )
+			h = (h + 1) & (VEHICLE_TABLE_HASH - 1);
+
+		// the entry is complete before the index makes it visible
+		entries[count] = entry;
+		keys[count]    = key_;
+		__atomic_store_n(&index[h], (uint8_t)(count + 1), __ATOMIC_RELEASE);
+		__atomic_store_n(&count, count + 1, __ATOMIC_RELEASE);
+
+		return entry;
+	}
+
+	// copying would not be atomic
+	Vehicle_Table(const Vehicle_Table &);
+	Vehicle_Table &operator=(const Vehicle_Table &);
+
+};
+
+
+
+#endif // VEHICLE_TABLE_H_
+
+
@@ -0,0 +1,224 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file wire_encoder.h
+ *
+ * @brief Messages encoded straight into a send buffer
+ *
+ * For the messages the companion sends all the time, a complete frame is
+ * written in one go without a mavlink_message_t in between.
+ *
+ */
+
+#ifndef WIRE_ENCODER_H_
+#define WIRE_ENCODER_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <string.h>
+
+#include <common/mavlink.h>
+
+
+// ------------------------------------------------------------------------------
+//   Message Layouts
+// ------------------------------------------------------------------------------
+/*
+ * What an encoder needs to know of a message at compile time.
+ * WIRE_MESSAGE(name, NAME) declares it from the generated
+ * mavlink_msg_<name>.h.
+ */
+template <typename T>
+struct Wire_Message;
+
+#define WIRE_MESSAGE(name, NAME)                                                 \
+	template <>                                                                  \
+	struct Wire_Message<mavlink_##name##_t>                                      \
+	{                                                                            \
+		enum                                                                     \
+		{                                                                        \
+			MSGID     = MAVLINK_MSG_ID_##NAME,                                   \
+			LENGTH    = MAVLINK_MSG_ID_##NAME##_LEN,                             \
+			CRC_EXTRA = MAVLINK_MSG_ID_##NAME##_CRC                              \
+		};                                                                       \
+		static void                                                              \
+		encode(uint8_t sysid, uint8_t compid, mavlink_message_t *message,        \
+				const mavlink_##name##_t *value)                                 \
+		{                                                                        \
+			mavlink_msg_##name##_encode(sysid, compid, message, value);          \
+		}                                                                        \
+	};
+
+WIRE_MESSAGE(heartbeat,                     HEARTBEAT)
+WIRE_MESSAGE(command_long,                  COMMAND_LONG)
+WIRE_MESSAGE(set_position_target_local_ned, SET_POSITION_TARGET_LOCAL_NED)
+WIRE_MESSAGE(timesync,                      TIMESYNC)
+
+
+// ----------------------------------------------------------------------------------
+//   Wire Encoder Class
+// ----------------------------------------------------------------------------------
+/*
+ * Wire Encoder Class
+ *
+ * Writes a whole frame of message T for one (sysid, compid) to a buffer.
+ * Everything in the header but the sequence number is fixed, so the
+ * checksum over the header is worked out once for each of the 256 sequence
+ * numbers; encode() then copies the payload, which on a little endian host
+ * is the struct as it is in memory, and only checksums those bytes and
+ * CRC_EXTRA.
+ *
+ * set_ids() redoes the table when the ids change, e.g. once the autopilot
+ * was found.  encode() only reads the encoder, any thread may call it.
+ */
+template <typename T>
+class Wire_Encoder
+{
+
+public:
+
+	enum
+	{
+		MSGID        = Wire_Message<T>::MSGID,
+		LENGTH       = Wire_Message<T>::LENGTH,
+		CRC_EXTRA    = Wire_Message<T>::CRC_EXTRA,
+		FRAME_LENGTH = LENGTH + MAVLINK_NUM_NON_PAYLOAD_BYTES
+	};
+
+	Wire_Encoder()
+	{
+		sysid  = 0;
+		compid = 0;
+		fill_header_crcs();
+	}
+
+	Wire_Encoder(uint8_t sysid_, uint8_t compid_)
+	{
+		sysid  = sysid_;
+		compid = compid_;
+		fill_header_crcs();
+	}
+
+	void
+	set_ids(uint8_t sysid_, uint8_t compid_)
+	{
+		if ( sysid_ == sysid && compid_ == compid )
+			return;
+
+		sysid  = sysid_;
+		compid = compid_;
+		fill_header_crcs();
+	}
+
+	// Writes FRAME_LENGTH bytes to out and returns that many
+	unsigned
+	encode(const T &value, uint8_t seq, uint8_t *out) const
+	{
+		out[0] = MAVLINK_STX;
+		out[1] = LENGTH;
+		out[2] = seq;
+		out[3] = sysid;
+		out[4] = compid;
+		out[5] = MSGID;
+
+		uint8_t *payload = out + MAVLINK_NUM_HEADER_BYTES;
+
+#if MAVLINK_NEED_BYTE_SWAP
+		// the fields need swapping, let the generated code lay them out
+		mavlink_message_t message;
+		Wire_Message<T>::encode(sysid, compid, &message, &value);
+		memcpy(payload, _MAV_PAYLOAD(&message), LENGTH);
+#else
+		memcpy(payload, &value, LENGTH);
+#endif
+
+		uint16_t crc = header_crcs[seq];
+		crc_accumulate_buffer(&crc, (const char *)payload, LENGTH);
+		crc_accumulate(CRC_EXTRA, &crc);
+
+		payload[LENGTH]     = (uint8_t)(crc & 0xff);
+		payload[LENGTH + 1] = (uint8_t)(crc >> 8);
+
+		return FRAME_LENGTH;
+	}
+
+private:
+
+	// the generated structs list their fields largest first, so the payload
+	// is the start of the struct and only padding follows it; the generated
+	// _pack() functions memcpy it the same way.  Fails to compile otherwise
+	typedef char payload_is_the_struct[sizeof(T) >= (size_t)LENGTH ? 1 : -1];
+
+	uint8_t  sysid;
+	uint8_t  compid;
+	uint16_t header_crcs[256]; // over length, seq, sysid, compid and msgid
+
+	void
+	fill_header_crcs()
+	{
+		for ( int seq = 0; seq < 256; seq++ )
+		{
+			uint16_t crc;
+			crc_init(&crc);
+			crc_accumulate(LENGTH, &crc);
+			crc_accumulate((uint8_t)seq, &crc);
+			crc_accumulate(sysid, &crc);
+			crc_accumulate(compid, &crc);
+			crc_accumulate(MSGID, &crc);
+			header_crcs[seq] = crc;
+		}
+	}
+
+};
+
+
+// ------------------------------------------------------------------------------
+//   Sequence Numbers
+// ------------------------------------------------------------------------------
+// The next sequence number of a channel, shared with the generated
+// mavlink_msg_*_encode() functions so both kinds of frames count up together
+static inline uint8_t
+wire_next_seq(mavlink_channel_t chan = MAVLINK_COMM_0)
+{
+	return __atomic_fetch_add(&mavlink_get_channel_status(chan)->current_tx_seq, 1, __ATOMIC_RELAXED);
+}
+
+
+
+#endif // WIRE_ENCODER_H_
+
+
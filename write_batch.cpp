@@ -0,0 +1,178 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file write_batch.cpp
+ *
+ * @brief Messages collected for one write to a port
+ *
+ */
+
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include "write_batch.h"
+#include "time_base.h"
+
+
+// ----------------------------------------------------------------------------------
+//   Write Batch Class
+// ----------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------
+//   Con/De structors
+// ------------------------------------------------------------------------------
+Write_Batch::
+Write_Batch()
+{
+	port      = NULL;
+	max_delay = 0;
+	flushes   = 0;
+	messages  = 0;
+	failed    = 0;
+	length    = 0;
+	count     = 0;
+	oldest    = 0;
+}
+
+Write_Batch::
+Write_Batch(Generic_Port *port_, uint64_t max_delay_)
+{
+	port      = port_;
+	max_delay = max_delay_;
+	flushes   = 0;
+	messages  = 0;
+	failed    = 0;
+	length    = 0;
+	count     = 0;
+	oldest    = 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   Add and Flush
+// ------------------------------------------------------------------------------
+// Returns what the flush it caused returned, 0 if it only queued the message
+int
+Write_Batch::
+add(const mavlink_message_t &message)
+{
+	reserve(MAVLINK_NUM_NON_PAYLOAD_BYTES + message.len);
+	length += mavlink_msg_to_send_buffer(buffer + length, &message);
+	return added();
+}
+
+// Makes room for a frame of len bytes
+void
+Write_Batch::
+reserve(unsigned len)
+{
+	if ( length + len > sizeof(buffer) )
+		flush();
+
+	if ( not count )
+		oldest = get_time_usec();
+}
+
+// Counts the frame just written, and flushes if it filled the batch or the
+// oldest has waited long enough
+int
+Write_Batch::
+added()
+{
+	count++;
+
+	if ( count == GENERIC_PORT_MAX_BATCH || get_time_usec() - oldest >= max_delay )
+		return flush();
+
+	return 0;
+}
+
+// Sends everything collected, returns the bytes the port took, or -1 if it
+// took none of them
+int
+Write_Batch::
+flush()
+{
+	if ( not count )
+		return 0;
+
+	int result = port->write_frames(buffer, length, count);
+
+	flushes++;
+	messages += count;
+	if ( result <= 0 )
+	{
+		failed++;
+		result = -1;
+	}
+
+	length = 0;
+	count  = 0;
+
+	return result;
+}
+
+// Flushes if the oldest message waited max_delay, now from get_time_usec()
+int
+Write_Batch::
+flush_due(uint64_t now)
+{
+	if ( count && now - oldest >= max_delay )
+		return flush();
+
+	return 0;
+}
+
+
+// ------------------------------------------------------------------------------
+//   State
+// ------------------------------------------------------------------------------
+int
+Write_Batch::
+size() const
+{
+	return count;
+}
+
+// When flush_due() will flush, 0 if there is nothing to send [us]
+uint64_t
+Write_Batch::
+deadline() const
+{
+	return count ? oldest + max_delay : 0;
+}
+
+
@@ -0,0 +1,122 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2014 MAVlink Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file write_batch.h
+ *
+ * @brief Messages collected for one write to a port
+ *
+ */
+
+#ifndef WRITE_BATCH_H_
+#define WRITE_BATCH_H_
+
+// ------------------------------------------------------------------------------
+//   Includes
+// ------------------------------------------------------------------------------
+
+#include <stdint.h>
+
+#include <common/mavlink.h>
+
+#include "generic_port.h"
+#include "wire_encoder.h"
+
+
+// ----------------------------------------------------------------------------------
+//   Write Batch Class
+// ----------------------------------------------------------------------------------
+/*
+ * Write Batch Class
+ *
+ * add() encodes messages back to back into one buffer, flush() hands it
+ * to the port's write_frames(), which sends it with as few system calls as
+ * the port can manage: one write() and one tcdrain() on a serial port, one
+ * send() on TCP.  add() with a Wire_Encoder writes the frame straight into
+ * the buffer, without a mavlink_message_t in between.
+ *
+ * Nothing waits longer than max_delay: add() flushes once the oldest
+ * message is that old, and so does flush_due(), for loops that call it
+ * every time they wake up anyway.  A full batch is flushed right away.
+ *
+ * Not thread safe, one thread owns a batch.
+ */
+class Write_Batch
+{
+
+public:
+
+	Write_Batch();
+	Write_Batch(Generic_Port *port_, uint64_t max_delay_);
+
+	Generic_Port *port;
+	uint64_t      max_delay; // [us], 0 flushes on every add()
+
+	uint64_t flushes;  // write_frames() calls
+	uint64_t messages; // messages flushed
+	uint64_t failed;   // flushes the port did not take
+
+	int  add(const mavlink_message_t &message);
+	int  flush();
+
+	template <typename T>
+	int
+	add(const Wire_Encoder<T> &encoder, const T &value)
+	{
+		reserve(Wire_Encoder<T>::FRAME_LENGTH);
+		length += encoder.encode(value, wire_next_seq(), buffer + length);
+		return added();
+	}
+
+	int  flush_due(uint64_t now);
+
+	int      size() const;
+	uint64_t deadline() const;
+
+private:
+
+	uint8_t  buffer[GENERIC_PORT_MAX_BATCH * MAVLINK_MAX_PACKET_LEN];
+	unsigned length;  // bytes in buffer
+	int      count;   // frames in buffer
+	uint64_t oldest;  // when the first was added
+
+	void reserve(unsigned len);
+	int  added();
+
+};
+
+
+
+#endif // WRITE_BATCH_H_
+
+